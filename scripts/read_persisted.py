@@ -71,7 +71,19 @@ def main():
             for _ in range(table_n_inited_cols):
                 column_name = read_object_name(catalog)
                 (column_index_type,) = unpack("i", catalog.read(calcsize("i")))
-                rich.print(f"  [ {column_name} ] {ColumnIndexType(column_index_type)}")
+                (column_tree_order,) = unpack("i", catalog.read(calcsize("i")))
+                (column_n_zones,) = unpack("N", catalog.read(calcsize("N")))
+                catalog.read(2 * column_n_zones * calcsize("i"))  # Zone map
+                column_index_type = ColumnIndexType(column_index_type)
+                if column_index_type in (
+                    ColumnIndexType.UNCLUSTERED_BTREE,
+                    ColumnIndexType.CLUSTERED_BTREE,
+                ):
+                    column_index_type = f"{column_index_type} order={column_tree_order}"
+                rich.print(
+                    f"  [ {column_name} ] {column_index_type}"
+                    f" ({column_n_zones} zones)"
+                )
 
                 column_data = np.empty(table_n_rows, dtype=np.int32)
                 column_path = persisted_dir / f"{table_name}.{column_name}"
@@ -0,0 +1,133 @@
+/**
+ * @file bench_bptree.c
+ *
+ * Benchmark of B+ tree point and range lookups across tree orders.
+ *
+ * Usage: `./bench_bptree [n_keys] [n_lookups]`
+ *
+ * For each order, this builds a B+ tree over sorted keys (as for a clustered
+ * index) and one over random keys via a sorter (as for an unclustered index).
+ * Point lookups search the clustered tree for random keys, which measures the
+ * descent from the root to a leaf. Range lookups search the unclustered tree
+ * for random ranges that select about `RANGE_N_KEYS` keys, which further walks
+ * the leaf level. The default order `BPLUS_TREE_ORDER` is the fixed order of
+ * page-sized nodes that all B+ tree indexes used to have. Every order is
+ * measured with and without AVX2 for the search within nodes.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "bptree.h"
+#include "sort.h"
+#include "sysinfo.h"
+
+/**
+ * The expected number of keys selected by a range lookup.
+ */
+#define RANGE_N_KEYS 128
+
+/**
+ * Helper function to generate a pseudo-random number (xorshift64).
+ */
+static inline uint64_t _next_random(uint64_t *state) {
+  *state ^= *state << 13;
+  *state ^= *state >> 7;
+  *state ^= *state << 17;
+  return *state;
+}
+
+/**
+ * Helper function to get the current time in nanoseconds.
+ */
+static inline double _now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int main(int argc, char **argv) {
+  size_t n_keys = argc > 1 ? strtoul(argv[1], NULL, 10) : 1 << 23;
+  size_t n_lookups = argc > 2 ? strtoul(argv[2], NULL, 10) : 1 << 20;
+  init_sysinfo();
+
+  // Keys are drawn from a domain of 4 keys per row, so ranges of this width
+  // select `RANGE_N_KEYS` keys on average
+  uint64_t state = 42;
+  long domain = (long)n_keys * 4;
+  int *sorted = malloc(sizeof(int) * n_keys);
+  int *data = malloc(sizeof(int) * n_keys);
+  size_t *sorter = malloc(sizeof(size_t) * n_keys);
+  long *lookups = malloc(sizeof(long) * n_lookups);
+  size_t *values = malloc(sizeof(size_t) * n_keys);
+  if (sorted == NULL || data == NULL || sorter == NULL || lookups == NULL ||
+      values == NULL) {
+    fprintf(stderr, "Failed to allocate the benchmark data.\n");
+    return 1;
+  }
+  for (size_t i = 0; i < n_keys; i++) {
+    data[i] = _next_random(&state) % domain;
+    sorted[i] = data[i];
+    sorter[i] = i;
+  }
+  quicksort(sorted, n_keys);
+  aquicksort(data, sorter, n_keys);
+  for (size_t i = 0; i < n_lookups; i++) {
+    lookups[i] = _next_random(&state) % domain;
+  }
+
+  printf("%zu keys, %zu lookups, %d processors, AVX2 %s\n\n", n_keys,
+         n_lookups, __n_processors__, __has_avx2__ ? "supported" : "disabled");
+  printf("%6s %7s %6s %10s %12s %12s\n", "order", "levels", "avx2", "build (s)",
+         "point (ns)", "range (ns)");
+
+  int orders[] = {BPLUS_TREE_ORDER, 8, 16, 32, 64, 128};
+  bool has_avx2 = __has_avx2__;
+  size_t checksum = 0;
+  for (size_t o = 0; o < sizeof(orders) / sizeof(int); o++) {
+    double start = _now_ns();
+    BPlusTree *clustered = bplus_tree_create(sorted, NULL, n_keys, orders[o]);
+    BPlusTree *unclustered = bplus_tree_create(data, sorter, n_keys, orders[o]);
+    double build = (_now_ns() - start) / 2;
+    if (clustered == NULL || unclustered == NULL) {
+      fprintf(stderr, "Failed to build the B+ trees of order %d.\n", orders[o]);
+      return 1;
+    }
+
+    for (int use_avx2 = has_avx2; use_avx2 >= 0; use_avx2--) {
+      __has_avx2__ = use_avx2;
+
+      start = _now_ns();
+      for (size_t i = 0; i < n_lookups; i++) {
+        checksum += bplus_tree_search_cont(clustered, lookups[i], true);
+      }
+      double point = (_now_ns() - start) / n_lookups;
+
+      start = _now_ns();
+      for (size_t i = 0; i < n_lookups; i++) {
+        checksum += bplus_tree_search_range(unclustered, lookups[i],
+                                            lookups[i] + RANGE_N_KEYS * 4,
+                                            values);
+      }
+      double range = (_now_ns() - start) / n_lookups;
+
+      printf("%6d %7d %6s %10.3f %12.1f %12.1f\n", orders[o],
+             clustered->n_levels, use_avx2 ? "yes" : "no", build / 1e9, point,
+             range);
+    }
+    __has_avx2__ = has_avx2;
+
+    bplus_tree_free(clustered);
+    bplus_tree_free(unclustered);
+  }
+  printf("\n(checksum %zu)\n", checksum);
+
+  free(sorted);
+  free(data);
+  free(sorter);
+  free(lookups);
+  free(values);
+  return 0;
+}
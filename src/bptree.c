@@ -4,13 +4,15 @@
  */
 
 #include <assert.h>
+#include <immintrin.h>
+#include <limits.h>
 #include <math.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
 
-#include "binsearch.h"
 #include "bptree.h"
+#include "sysinfo.h"
 
 #include <stdio.h>
 
@@ -29,27 +31,141 @@ typedef struct _BPlusNodeAccessStack {
 } _BPlusNodeAccessStack;
 
 /**
- * Helper function to create an empty internal node.
+ * The maximum number of internal levels of a B+ tree.
+ *
+ * Every internal node except the root has at least two children, so this bounds
+ * the depth of any B+ tree whose size fits in a `size_t`.
  */
-static inline BPlusNode *_create_internal_node() {
-  BPlusNode *node = malloc(sizeof(BPlusNode)); // XXX: not checking for NULL
-  if (node == NULL) {
+#define _BPLUS_TREE_MAX_LEVELS 64
+
+/**
+ * The access path from the root of a B+ tree to a leaf node.
+ *
+ * Unlike the access stack used when inserting, this records the index of the
+ * child taken at each internal node, so that the siblings of the nodes on the
+ * path can be found when rebalancing after a deletion, and the path can advance
+ * to the next leaf node. `nodes[0]` is the root, `nodes[n_levels]` is the leaf
+ * node, and `nodes[l + 1]` is child `inds[l]` of `nodes[l]`.
+ */
+typedef struct _BPlusTreePath {
+  BPlusNode *nodes[_BPLUS_TREE_MAX_LEVELS + 1];
+  int inds[_BPLUS_TREE_MAX_LEVELS];
+  int n_levels;
+} _BPlusTreePath;
+
+/**
+ * Helper function to allocate an empty node of a given order.
+ *
+ * The node, its keys, and its children or values are allocated as one block
+ * aligned to a cache line; the children or values start at the first 8-byte
+ * boundary after the keys. This function returns NULL on failure.
+ */
+static inline BPlusNode *_create_node(BPlusNodeType type, int order) {
+  size_t keys_size = sizeof(int) * (order - 1);
+  size_t payload_offset =
+      (sizeof(BPlusNode) + keys_size + sizeof(size_t) - 1) / sizeof(size_t) *
+      sizeof(size_t);
+  size_t payload_size = type == BPLUS_NODE_TYPE_INTERNAL
+                            ? sizeof(BPlusNode *) * order
+                            : sizeof(size_t) * (order - 1);
+  size_t size = (payload_offset + payload_size + 63) / 64 * 64;
+
+  void *block;
+  if (posix_memalign(&block, 64, size) != 0) {
     return NULL;
   }
-  node->type = BPLUS_NODE_TYPE_INTERNAL;
+  BPlusNode *node = block;
+  node->type = type;
   node->n_keys = 0;
+  node->keys = (int *)(node + 1);
+  if (type == BPLUS_NODE_TYPE_INTERNAL) {
+    node->spec.internal.children =
+        (BPlusNode **)((char *)block + payload_offset);
+  } else {
+    node->spec.leaf.values = (size_t *)((char *)block + payload_offset);
+    node->spec.leaf.next = NULL;
+  }
   return node;
 }
 
+/**
+ * Helper function to create an empty internal node.
+ */
+static inline BPlusNode *_create_internal_node(int order) {
+  return _create_node(BPLUS_NODE_TYPE_INTERNAL, order);
+}
+
 /**
  * Helper function to create an empty leaf node.
  */
-static inline BPlusNode *_create_leaf_node() {
-  BPlusNode *node = malloc(sizeof(BPlusNode)); // XXX: not checking for NULL
-  node->type = BPLUS_NODE_TYPE_LEAF;
-  node->n_keys = 0;
-  node->spec.leaf.next = NULL;
-  return node;
+static inline BPlusNode *_create_leaf_node(int order) {
+  return _create_node(BPLUS_NODE_TYPE_LEAF, order);
+}
+
+/**
+ * Helper function to count the keys less than a pivot, 8 at a time with AVX2.
+ *
+ * The keys in `[start, end)` are counted in whole blocks of 8, and the position
+ * after the last block is written to `stop`, where the counting can be resumed.
+ */
+TARGET_AVX2 static inline int _count_less_avx2(const int *keys, int start,
+                                               int end, int pivot, int *stop) {
+  __m256i pivots = _mm256_set1_epi32(pivot);
+  int count = 0;
+  int i = start;
+  for (; i + 8 <= end; i += 8) {
+    __m256i less = _mm256_cmpgt_epi32(
+        pivots, _mm256_loadu_si256((const __m256i *)(keys + i)));
+    count += __builtin_popcount(_mm256_movemask_ps(_mm256_castsi256_ps(less)));
+  }
+  *stop = i;
+  return count;
+}
+
+/**
+ * Helper function to search the keys of a node.
+ *
+ * This function has the same semantic as `binsearch` on the keys of the node.
+ * The candidate keys are binary searched only until at most
+ * `BPLUS_TREE_LINEAR_SEARCH_KEYS` of them are left, which span a few cache
+ * lines that are read anyways. The remaining keys before the target are then
+ * counted, 8 at a time with AVX2, which avoids the unpredictable branches of
+ * the last binary search steps; since the keys are sorted, the count is the
+ * position of the target.
+ */
+static inline int _search_node(const BPlusNode *node, long key,
+                               bool align_left) {
+  // Reduce the search to counting the keys less than a pivot; targets out of
+  // the integer range are after all or before all keys
+  if (align_left ? key > INT_MAX : key >= INT_MAX) {
+    return node->n_keys;
+  }
+  long pivot = align_left ? key : key + 1;
+  if (pivot <= INT_MIN) {
+    return 0;
+  }
+
+  const int *keys = node->keys;
+  int lo = 0;
+  int hi = node->n_keys;
+  while (hi - lo > BPLUS_TREE_LINEAR_SEARCH_KEYS) {
+    int mid = lo + (hi - lo) / 2;
+    if (keys[mid] < pivot) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+
+  int count = 0;
+  int i = lo;
+  if (__has_avx2__) {
+    count = _count_less_avx2(keys, lo, hi, (int)pivot, &i);
+  }
+  for (; i < hi; i++) {
+    count += keys[i] < pivot;
+  }
+  return lo + count;
 }
 
 /**
@@ -65,34 +181,30 @@ static inline BPlusNode *_create_leaf_node() {
  * the recursion is finished, the given key will be the last key in the top
  * node of the stack.
  */
-void _push_key_append_only(_BPlusNodeAccessStack *stack, int key) {
+void _push_key_append_only(_BPlusNodeAccessStack *stack, int key, int order) {
   // Assume a non-empty stack, peek the top node
   BPlusNode *node = *(stack->sptr - 1);
-  if (node->n_keys < BPLUS_TREE_ORDER - 1) {
+  if (node->n_keys < order - 1) {
     // Node has free space, so we directly insert the key and return
     node->keys[node->n_keys++] = key;
     return;
   }
 
   // Node is full, find the split point (the key that will be promoted)
-  int split_ind = BPLUS_TREE_ORDER / 2;
+  int split_ind = order / 2;
   int split_key = node->keys[split_ind];
 
   // Create a new internal node and move the keys and children to the right of
   // the split point to the new node, then insert the given new key
-  BPlusNode *new_node = _create_internal_node();
+  BPlusNode *new_node = _create_internal_node(order);
   // The number of keys to copy is the number of keys to the right of the split
-  // point; total number of keys is (BPLUS_TREE_ORDER - 1), number of keys up to
-  // the split point (inclusive) is (split_ind + 1)
-  int n_copy = BPLUS_TREE_ORDER - split_ind - 2;
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Warray-bounds"
-#pragma GCC diagnostic ignored "-Wstringop-overflow"
+  // point; total number of keys is (order - 1), number of keys up to the split
+  // point (inclusive) is (split_ind + 1)
+  int n_copy = order - split_ind - 2;
   memcpy(new_node->keys, node->keys + split_ind + 1, sizeof(int) * n_copy);
   memcpy(new_node->spec.internal.children,
          node->spec.internal.children + split_ind + 1,
          sizeof(BPlusNode *) * (n_copy + 1));
-#pragma GCC diagnostic pop
   new_node->n_keys = n_copy;
   new_node->keys[new_node->n_keys++] = key;
   node->n_keys = split_ind;
@@ -106,7 +218,7 @@ void _push_key_append_only(_BPlusNodeAccessStack *stack, int key) {
     // There are no more nodes in the access stack, so we need to create a new
     // root node and link to the current node and the new node; the new root
     // will be pushed to the empty stack
-    BPlusNode *root = _create_internal_node();
+    BPlusNode *root = _create_internal_node(order);
     root->keys[root->n_keys++] = split_key;
     root->spec.internal.children[0] = node;
     root->spec.internal.children[1] = new_node;
@@ -114,7 +226,7 @@ void _push_key_append_only(_BPlusNodeAccessStack *stack, int key) {
   } else {
     // There are more nodes in the access stack; we can recursively insert the
     // split key into the parent node
-    _push_key_append_only(stack, split_key);
+    _push_key_append_only(stack, split_key, order);
     BPlusNode *parent = *(stack->sptr - 1);
     parent->spec.internal.children[parent->n_keys] = new_node;
   }
@@ -126,27 +238,28 @@ void _push_key_append_only(_BPlusNodeAccessStack *stack, int key) {
 /**
  * @implements bplus_tree_create
  */
-BPlusTree *bplus_tree_create(int *data, size_t *sorter, size_t size) {
+BPlusTree *bplus_tree_create(int *data, size_t *sorter, size_t size,
+                             int order) {
   // Create the empty root node with leftmost child being the first leaf node;
   // note the cases of sorter being NULL and non-NULL only differ in using index
   // `i` or `sorter[i]`
   size_t i = 0;
   BPlusNode *leaf, *internal;
-  leaf = _create_leaf_node();
+  leaf = _create_leaf_node(order);
   if (sorter == NULL) {
-    for (; i < BPLUS_TREE_ORDER - 1 && i < size; i++) {
+    for (; i < (size_t)order - 1 && i < size; i++) {
       leaf->keys[i] = data[i];
       leaf->spec.leaf.values[i] = i;
       leaf->n_keys++;
     }
   } else {
-    for (; i < BPLUS_TREE_ORDER - 1 && i < size; i++) {
+    for (; i < (size_t)order - 1 && i < size; i++) {
       leaf->keys[i] = data[sorter[i]];
       leaf->spec.leaf.values[i] = sorter[i];
       leaf->n_keys++;
     }
   }
-  internal = _create_internal_node();
+  internal = _create_internal_node(order);
   internal->spec.internal.children[0] = leaf;
 
   if (i == 0) {
@@ -158,12 +271,13 @@ BPlusTree *bplus_tree_create(int *data, size_t *sorter, size_t size) {
     tree->root = internal;
     tree->size = 0;
     tree->n_levels = 1;
+    tree->order = order;
     return tree;
   }
 
   // Create the access stack for the internal nodes and push the root node
   // initially since that is the only node in our access path for now
-  int stack_size = (int)ceil(log(size) / log(BPLUS_TREE_ORDER)) * 2;
+  int stack_size = (int)ceil(log(size) / log(order)) * 2;
   stack_size = stack_size < 2 ? 2 : stack_size;
   BPlusNode **stack_array = malloc(sizeof(BPlusNode *) * stack_size);
   if (stack_array == NULL) {
@@ -177,29 +291,29 @@ BPlusTree *bplus_tree_create(int *data, size_t *sorter, size_t size) {
   BPlusNode *new_leaf;
   if (sorter == NULL) {
     while (i < size) {
-      new_leaf = _create_leaf_node();
+      new_leaf = _create_leaf_node(order);
       leaf->spec.leaf.next = new_leaf;
       leaf = new_leaf;
-      for (int j = 0; j < BPLUS_TREE_ORDER - 1 && i < size; i++, j++) {
+      for (int j = 0; j < order - 1 && i < size; i++, j++) {
         leaf->keys[j] = data[i];
         leaf->spec.leaf.values[j] = i;
         leaf->n_keys++;
       }
-      _push_key_append_only(&stack, leaf->keys[0]);
+      _push_key_append_only(&stack, leaf->keys[0], order);
       internal = *(stack.sptr - 1);
       internal->spec.internal.children[internal->n_keys] = leaf;
     }
   } else {
     while (i < size) {
-      new_leaf = _create_leaf_node();
+      new_leaf = _create_leaf_node(order);
       leaf->spec.leaf.next = new_leaf;
       leaf = new_leaf;
-      for (int j = 0; j < BPLUS_TREE_ORDER - 1 && i < size; i++, j++) {
+      for (int j = 0; j < order - 1 && i < size; i++, j++) {
         leaf->keys[j] = data[sorter[i]];
         leaf->spec.leaf.values[j] = sorter[i];
         leaf->n_keys++;
       }
-      _push_key_append_only(&stack, leaf->keys[0]);
+      _push_key_append_only(&stack, leaf->keys[0], order);
       internal = *(stack.sptr - 1);
       internal->spec.internal.children[internal->n_keys] = leaf;
     }
@@ -213,10 +327,28 @@ BPlusTree *bplus_tree_create(int *data, size_t *sorter, size_t size) {
   tree->root = *stack.s;
   tree->size = size;
   tree->n_levels = stack.sptr - stack.s;
+  tree->order = order;
   free(stack.s);
   return tree;
 }
 
+/**
+ * Helper function to find the index of a child in an internal node.
+ *
+ * The key must be the first key of the right half of the child after splitting
+ * it. Separators equal to the key may be on either side of the child, so the
+ * search for the key only gives the first candidate, from which the child is
+ * looked for.
+ */
+static inline int _find_child(const BPlusNode *node, int key,
+                              const BPlusNode *child) {
+  int ind = _search_node(node, key, true);
+  while (node->spec.internal.children[ind] != child) {
+    ind++;
+  }
+  return ind;
+}
+
 /**
  * Helper function to push a key up the B+ tree, allowing insertions.
  *
@@ -224,60 +356,62 @@ BPlusTree *bplus_tree_create(int *data, size_t *sorter, size_t size) {
  * being the root of the B+ tree. It will first check if the top node has free
  * space, in which case the key will be inserted in a sorted manner directly.
  * Otherwise, it will split the node at the median key and recursively push the
- * median key up the tree. The splitted node will be popped from the access
- * stack before recursing and the newly created node during splitting will be
- * pushed onto the stack after recursing so that the stack is up-to-date. The
- * invariant is that, after the recursion is finished, the given key will be at
- * the returned slot index in the top node of the stack; special case is -1
- * where the key is promoted to some higher level.
- */
-int _push_key(_BPlusNodeAccessStack *stack, int key) {
+ * median key up the tree. The key and the new child are inserted right after
+ * the split child, i.e., the left half of the node that was split. The splitted
+ * node will be popped from the access stack before recursing and the node
+ * holding the split child or the new child (depending on `follow_new`) will be
+ * pushed onto the stack after recursing, so that the stack stays the access
+ * path to that child; the two may end up in different nodes after splitting.
+ */
+void _push_key(_BPlusNodeAccessStack *stack, int key, int order,
+               BPlusNode *split_child, BPlusNode *new_child, bool follow_new) {
   // Assume a non-empty stack, peek the top node
   BPlusNode *node = *(stack->sptr - 1);
-  if (node->n_keys < BPLUS_TREE_ORDER - 1) {
-    // Node has free space, so we directly insert the key and return the index
-    // of the inserted key
-    int ind = binsearch(node->keys, key, node->n_keys, false);
-    memcpy(node->keys + ind + 1, node->keys + ind,
-           sizeof(int) * (node->n_keys - ind));
-    memcpy(node->spec.internal.children + ind + 2,
-           node->spec.internal.children + ind + 1,
-           sizeof(BPlusNode *) * (node->n_keys - ind));
+  if (node->n_keys < order - 1) {
+    // Node has free space, so we directly insert the key and the new child
+    int ind = _find_child(node, key, split_child);
+    memmove(node->keys + ind + 1, node->keys + ind,
+            sizeof(int) * (node->n_keys - ind));
+    memmove(node->spec.internal.children + ind + 2,
+            node->spec.internal.children + ind + 1,
+            sizeof(BPlusNode *) * (node->n_keys - ind));
     node->keys[ind] = key;
+    node->spec.internal.children[ind + 1] = new_child;
     node->n_keys++;
-    return ind;
+    return;
   }
 
   // Node is full, find the split point (the key that will be promoted)
-  int split_ind = BPLUS_TREE_ORDER / 2;
-  int ind = binsearch(node->keys, key, node->n_keys, false);
+  int split_ind = order / 2;
+  int ind = _find_child(node, key, split_child);
 
   // Create a new internal node to hold the moved keys and children
   int split_key;
   int slot;
   BPlusNode *slot_node;
-  BPlusNode *new_node = _create_internal_node();
+  BPlusNode *new_node = _create_internal_node(order);
   if (ind < split_ind) {
     // Copy the keys and children to the right of the split point to the new
     // node, because the insertion point is to the left of the split point
     memcpy(new_node->keys, node->keys + split_ind,
-           sizeof(int) * (BPLUS_TREE_ORDER - split_ind - 1));
+           sizeof(int) * (order - split_ind - 1));
     memcpy(new_node->spec.internal.children,
            node->spec.internal.children + split_ind,
-           sizeof(BPlusNode *) * (BPLUS_TREE_ORDER - split_ind));
+           sizeof(BPlusNode *) * (order - split_ind));
+    // The split key is the key to the left of the split point because we are
+    // inserting to the left and things are pushed one position to the right;
+    // it must be taken before it is overwritten by the shift below
+    split_key = node->keys[split_ind - 1];
     // Copy the keys and children to the right of the insertion point but to the
     // left of the split point one position to the right; note this excludes the
     // split point itself because it will be promoted anyways
-    memcpy(node->keys + ind + 1, node->keys + ind,
-           sizeof(int) * (split_ind - ind - 1));
-    memcpy(node->spec.internal.children + ind + 2,
-           node->spec.internal.children + ind + 1,
-           sizeof(BPlusNode *) * (split_ind - ind - 1));
-    // Insert the key at the insertion point; the split key is the key to the
-    // left of the split point because we are inserting to the left and things
-    // are pushed one position to the right; the reserved slot will then be the
+    memmove(node->keys + ind + 1, node->keys + ind,
+            sizeof(int) * (split_ind - ind - 1));
+    memmove(node->spec.internal.children + ind + 2,
+            node->spec.internal.children + ind + 1,
+            sizeof(BPlusNode *) * (split_ind - ind - 1));
+    // Insert the key at the insertion point; the reserved slot will then be the
     // insertion point, i.e., right child of the key
-    split_key = node->keys[split_ind - 1];
     node->keys[ind] = key;
     slot = ind;
     slot_node = node;
@@ -287,10 +421,10 @@ int _push_key(_BPlusNodeAccessStack *stack, int key) {
     // in the same way but with one position offset to the right of the new node
     // because its first child will be the reserved slot
     memcpy(new_node->keys, node->keys + split_ind,
-           sizeof(int) * (BPLUS_TREE_ORDER - split_ind - 1));
+           sizeof(int) * (order - split_ind - 1));
     memcpy(new_node->spec.internal.children + 1,
            node->spec.internal.children + split_ind + 1,
-           sizeof(BPlusNode *) * (BPLUS_TREE_ORDER - split_ind - 1));
+           sizeof(BPlusNode *) * (order - split_ind - 1));
     // There is no need to insert the key because it is promoted; the split key
     // is just the key itself; the reserved slot is the first child of the new
     // node so we need to give slot=-1 so that slot+1=0
@@ -308,10 +442,10 @@ int _push_key(_BPlusNodeAccessStack *stack, int key) {
     // Copy the keys and children to the right of the insertion point to one
     // position from the previous step
     memcpy(new_node->keys + ind - split_ind, node->keys + ind,
-           sizeof(int) * (BPLUS_TREE_ORDER - ind - 1));
+           sizeof(int) * (order - ind - 1));
     memcpy(new_node->spec.internal.children + ind - split_ind + 1,
            node->spec.internal.children + ind + 1,
-           sizeof(BPlusNode *) * (BPLUS_TREE_ORDER - ind - 1));
+           sizeof(BPlusNode *) * (order - ind - 1));
     // Insert the key at the insertion point (mapped to the new node); the split
     // key is the key at the split point because we are inserting to the right
     // and things to the left are unchanged; the reserved slot will then be the
@@ -322,7 +456,13 @@ int _push_key(_BPlusNodeAccessStack *stack, int key) {
     slot_node = new_node;
   }
   node->n_keys = split_ind;
-  new_node->n_keys = BPLUS_TREE_ORDER - split_ind - 1;
+  new_node->n_keys = order - split_ind - 1;
+  slot_node->spec.internal.children[slot + 1] = new_child;
+
+  // The split child stays in the original node unless the insertion point is
+  // to the right of the split point
+  BPlusNode *follow_node =
+      follow_new ? slot_node : (ind > split_ind ? new_node : node);
 
   // Pop the stack since the original node (i.e., current stack top) will no
   // longer be on the access path; later the new node will be pushed onto stack
@@ -333,7 +473,7 @@ int _push_key(_BPlusNodeAccessStack *stack, int key) {
     // There are no more nodes in the access stack, so we need to create a new
     // root node and link to the current node and the new node; the new root
     // will be pushed to the empty stack
-    BPlusNode *root = _create_internal_node();
+    BPlusNode *root = _create_internal_node(order);
     root->keys[root->n_keys++] = split_key;
     root->spec.internal.children[0] = node;
     root->spec.internal.children[1] = new_node;
@@ -341,20 +481,20 @@ int _push_key(_BPlusNodeAccessStack *stack, int key) {
   } else {
     // There are more nodes in the access stack; we can recursively insert the
     // split key into the parent node
-    int slot = _push_key(stack, split_key);
-    BPlusNode *parent = *(stack->sptr - 1);
-    parent->spec.internal.children[slot + 1] = new_node;
+    _push_key(stack, split_key, order, node, new_node,
+              follow_node == new_node);
   }
 
-  // Push the new node onto stack
-  (*stack->sptr++) = slot_node;
-  return slot;
+  // Push the followed node onto stack
+  (*stack->sptr++) = follow_node;
 }
 
 /**
  * @implements bplus_tree_insert
  */
 int bplus_tree_insert(BPlusTree *tree, int key, size_t value) {
+  int order = tree->order;
+
   // Initialize the access stack; we need one more level than the tree depth
   // because we if all nodes on the access path are full, we need to split the
   // root node and create a new root node which increments depth by one
@@ -368,18 +508,18 @@ int bplus_tree_insert(BPlusTree *tree, int key, size_t value) {
   BPlusNode *node = tree->root;
   while (node->type == BPLUS_NODE_TYPE_INTERNAL) {
     *(stack.sptr++) = node;
-    int ind = binsearch(node->keys, key, node->n_keys, false);
+    int ind = _search_node(node, key, false);
     node = node->spec.internal.children[ind];
   }
 
   // We are now at the leaf node; if there is space, insert the key directly
   // in a sorted manner
-  if (node->n_keys < BPLUS_TREE_ORDER - 1) {
-    int ind = binsearch(node->keys, key, node->n_keys, false);
-    memcpy(node->keys + ind + 1, node->keys + ind,
-           sizeof(int) * (node->n_keys - ind));
-    memcpy(node->spec.leaf.values + ind + 1, node->spec.leaf.values + ind,
-           sizeof(size_t) * (node->n_keys - ind));
+  if (node->n_keys < order - 1) {
+    int ind = _search_node(node, key, false);
+    memmove(node->keys + ind + 1, node->keys + ind,
+            sizeof(int) * (node->n_keys - ind));
+    memmove(node->spec.leaf.values + ind + 1, node->spec.leaf.values + ind,
+            sizeof(size_t) * (node->n_keys - ind));
     node->keys[ind] = key;
     node->spec.leaf.values[ind] = value;
     node->n_keys++;
@@ -394,25 +534,25 @@ int bplus_tree_insert(BPlusTree *tree, int key, size_t value) {
   // keys) so there is no need to care about splitting children, and (2) the
   // split key is also copied to the new node (because the splitting point in
   // leaf node is COPIED when promoted instead of MOVED)
-  int split_ind = BPLUS_TREE_ORDER / 2;
-  int ind = binsearch(node->keys, key, node->n_keys, false);
-  BPlusNode *new_node = _create_leaf_node();
+  int split_ind = order / 2;
+  int ind = _search_node(node, key, false);
+  BPlusNode *new_node = _create_leaf_node(order);
   if (ind < split_ind) {
     memcpy(new_node->keys, node->keys + split_ind - 1,
-           sizeof(int) * (BPLUS_TREE_ORDER - split_ind));
+           sizeof(int) * (order - split_ind));
     memcpy(new_node->spec.leaf.values, node->spec.leaf.values + split_ind - 1,
-           sizeof(size_t) * (BPLUS_TREE_ORDER - split_ind));
-    memcpy(node->keys + ind + 1, node->keys + ind,
-           sizeof(int) * (split_ind - ind - 1));
-    memcpy(node->spec.leaf.values + ind + 1, node->spec.leaf.values + ind,
-           sizeof(size_t) * (split_ind - ind - 1));
+           sizeof(size_t) * (order - split_ind));
+    memmove(node->keys + ind + 1, node->keys + ind,
+            sizeof(int) * (split_ind - ind - 1));
+    memmove(node->spec.leaf.values + ind + 1, node->spec.leaf.values + ind,
+            sizeof(size_t) * (split_ind - ind - 1));
     node->keys[ind] = key;
     node->spec.leaf.values[ind] = value;
   } else if (ind == split_ind) {
     memcpy(new_node->keys + 1, node->keys + split_ind,
-           sizeof(int) * (BPLUS_TREE_ORDER - split_ind - 1));
+           sizeof(int) * (order - split_ind - 1));
     memcpy(new_node->spec.leaf.values + 1, node->spec.leaf.values + split_ind,
-           sizeof(size_t) * (BPLUS_TREE_ORDER - split_ind - 1));
+           sizeof(size_t) * (order - split_ind - 1));
     new_node->keys[0] = key;
     new_node->spec.leaf.values[0] = value;
   } else {
@@ -421,15 +561,15 @@ int bplus_tree_insert(BPlusTree *tree, int key, size_t value) {
     memcpy(new_node->spec.leaf.values, node->spec.leaf.values + split_ind,
            sizeof(size_t) * (ind - split_ind));
     memcpy(new_node->keys + ind - split_ind + 1, node->keys + ind,
-           sizeof(int) * (BPLUS_TREE_ORDER - ind - 1));
+           sizeof(int) * (order - ind - 1));
     memcpy(new_node->spec.leaf.values + ind - split_ind + 1,
            node->spec.leaf.values + ind,
-           sizeof(size_t) * (BPLUS_TREE_ORDER - ind - 1));
+           sizeof(size_t) * (order - ind - 1));
     new_node->keys[ind - split_ind] = key;
     new_node->spec.leaf.values[ind - split_ind] = value;
   }
   node->n_keys = split_ind;
-  new_node->n_keys = BPLUS_TREE_ORDER - split_ind;
+  new_node->n_keys = order - split_ind;
 
   // Rewire the leaf nodes
   BPlusNode *next_node = node->spec.leaf.next;
@@ -437,9 +577,7 @@ int bplus_tree_insert(BPlusTree *tree, int key, size_t value) {
   node->spec.leaf.next = new_node;
 
   // The split key is the first key in the new node; promote it up the tree
-  int slot = _push_key(&stack, new_node->keys[0]);
-  BPlusNode *parent = *(stack.sptr - 1);
-  parent->spec.internal.children[slot + 1] = new_node;
+  _push_key(&stack, new_node->keys[0], order, node, new_node, true);
 
   // Note that the tree root may have changed because of node splitting, but we
   // can guarantee that the root is the deepest node in the stack
@@ -450,6 +588,486 @@ int bplus_tree_insert(BPlusTree *tree, int key, size_t value) {
   return 0;
 }
 
+/**
+ * Helper function to get the i-th key of a batch given as in
+ * `bplus_tree_create`, i.e., by the data and an optional sorter.
+ */
+static inline int _batch_key(const int *data, const size_t *sorter, size_t i) {
+  return sorter == NULL ? data[i] : data[sorter[i]];
+}
+
+/**
+ * Helper function to get the i-th value of a batch given as in
+ * `bplus_tree_create`, i.e., by the data and an optional sorter.
+ */
+static inline size_t _batch_value(const size_t *sorter, size_t i) {
+  return sorter == NULL ? i : sorter[i];
+}
+
+/**
+ * Helper function to create the new leaf nodes for a run of a batch insertion.
+ *
+ * The array of nodes is grown if its capacity is too small. This function
+ * returns 0 on success and -1 on failure, in which case no node is created.
+ */
+static inline int _create_leaf_nodes(BPlusNode ***nodes, size_t *capacity,
+                                     size_t n_nodes, int order) {
+  if (n_nodes > *capacity) {
+    BPlusNode **new_nodes = realloc(*nodes, sizeof(BPlusNode *) * n_nodes);
+    if (new_nodes == NULL) {
+      return -1;
+    }
+    *nodes = new_nodes;
+    *capacity = n_nodes;
+  }
+  for (size_t k = 0; k < n_nodes; k++) {
+    if (((*nodes)[k] = _create_leaf_node(order)) == NULL) {
+      for (size_t l = 0; l < k; l++) {
+        free((*nodes)[l]);
+      }
+      return -1;
+    }
+  }
+  return 0;
+}
+
+/**
+ * @implements bplus_tree_insert_batch
+ */
+int bplus_tree_insert_batch(BPlusTree *tree, int *data, size_t *sorter,
+                            size_t size) {
+  int order = tree->order;
+
+  // The entries of a leaf node are moved aside while being merged with the
+  // batch back into the leaf node and the new leaf nodes after it
+  int *leaf_keys = malloc(sizeof(int) * (order - 1));
+  size_t *leaf_values = malloc(sizeof(size_t) * (order - 1));
+  if (leaf_keys == NULL || leaf_values == NULL) {
+    free(leaf_keys);
+    free(leaf_values);
+    return -1;
+  }
+
+  // The access stack may grow by several levels while splitting for a large
+  // run of the batch, so it is sized for the deepest possible tree
+  BPlusNode *stack_array[_BPLUS_TREE_MAX_LEVELS + 1];
+  BPlusNode **new_leaves = NULL;
+  size_t new_leaves_capacity = 0;
+  size_t i = 0;
+  while (i < size) {
+    // Starting from the root, search for the first key of the rest of the
+    // batch as for inserting it, which also gives the separator that bounds
+    // the landed leaf node from the right (i.e., the deepest one on the path);
+    // the path is searched again for each leaf node since splits change it
+    _BPlusNodeAccessStack stack = {.s = stack_array, .sptr = stack_array};
+    int key = _batch_key(data, sorter, i);
+    long upper = LONG_MAX;
+    BPlusNode *node = tree->root;
+    while (node->type == BPLUS_NODE_TYPE_INTERNAL) {
+      *(stack.sptr++) = node;
+      int ind = _search_node(node, key, false);
+      if (ind < node->n_keys) {
+        upper = node->keys[ind];
+      }
+      node = node->spec.internal.children[ind];
+    }
+
+    // The run of the batch that belongs to the leaf node is the keys less than
+    // the bound, because keys equal to a separator are inserted to its right
+    size_t end = i;
+    while (end < size && _batch_key(data, sorter, end) < upper) {
+      end++;
+    }
+
+    // Spread the merged entries evenly over as many leaf nodes as needed,
+    // starting with the landed one itself; the new leaf nodes are created
+    // before the landed one is rewritten, so that a failure leaves the tree
+    // with the runs inserted so far
+    int n_leaf_keys = node->n_keys;
+    size_t n_merged = n_leaf_keys + (end - i);
+    size_t n_leaves = (n_merged + order - 2) / (order - 1);
+    if (_create_leaf_nodes(&new_leaves, &new_leaves_capacity, n_leaves - 1,
+                           order) == -1) {
+      free(leaf_keys);
+      free(leaf_values);
+      free(new_leaves);
+      return -1;
+    }
+    memcpy(leaf_keys, node->keys, sizeof(int) * n_leaf_keys);
+    memcpy(leaf_values, node->spec.leaf.values, sizeof(size_t) * n_leaf_keys);
+    size_t n_written = 0;
+    size_t leaf_end = n_merged / n_leaves;
+    size_t ith_leaf = 0;
+    int j = 0;
+    node->n_keys = 0;
+    while (n_written < n_merged) {
+      // Take the next entry, where existing keys go before equal new keys
+      int next_key;
+      size_t next_value;
+      if (j < n_leaf_keys &&
+          (i == end || leaf_keys[j] <= _batch_key(data, sorter, i))) {
+        next_key = leaf_keys[j];
+        next_value = leaf_values[j++];
+      } else {
+        next_key = _batch_key(data, sorter, i);
+        next_value = _batch_value(sorter, i++);
+      }
+
+      if (n_written == leaf_end) {
+        // The current leaf node has its share of the entries; link a new leaf
+        // node after it and promote the first key of the new leaf node
+        BPlusNode *new_node = new_leaves[ith_leaf];
+        new_node->spec.leaf.next = node->spec.leaf.next;
+        node->spec.leaf.next = new_node;
+        _push_key(&stack, next_key, order, node, new_node, true);
+        node = new_node;
+        leaf_end = n_merged * (++ith_leaf + 1) / n_leaves;
+      }
+      node->keys[node->n_keys] = next_key;
+      node->spec.leaf.values[node->n_keys++] = next_value;
+      n_written++;
+    }
+
+    // Note that the tree root may have changed because of node splitting, but
+    // we can guarantee that the root is the deepest node in the stack
+    tree->root = *stack.s;
+    tree->n_levels = stack.sptr - stack.s;
+    tree->size += n_merged - n_leaf_keys;
+  }
+
+  free(leaf_keys);
+  free(leaf_values);
+  free(new_leaves);
+  return 0;
+}
+
+/**
+ * Helper function to descend from the root of a B+ tree to the leaf node where
+ * a search for a key lands, recording the access path.
+ */
+static inline void _descend_path(BPlusTree *tree, long key, bool align_left,
+                                 _BPlusTreePath *path) {
+  int level = 0;
+  BPlusNode *node = tree->root;
+  while (node->type == BPLUS_NODE_TYPE_INTERNAL) {
+    int ind = _search_node(node, key, align_left);
+    path->nodes[level] = node;
+    path->inds[level++] = ind;
+    node = node->spec.internal.children[ind];
+  }
+  path->nodes[level] = node;
+  path->n_levels = level;
+}
+
+/**
+ * Helper function to advance an access path to the next leaf node.
+ *
+ * This function returns false if the path is already at the last leaf node, in
+ * which case the path is left unchanged.
+ */
+static inline bool _advance_path(_BPlusTreePath *path) {
+  // Find the deepest node on the path that has a child to the right of the one
+  // taken, then take the leftmost path from that child down to the leaf level
+  int level = path->n_levels - 1;
+  while (level >= 0 && path->inds[level] == path->nodes[level]->n_keys) {
+    level--;
+  }
+  if (level < 0) {
+    return false;
+  }
+  path->inds[level]++;
+  for (; level < path->n_levels; level++) {
+    path->nodes[level + 1] =
+        path->nodes[level]->spec.internal.children[path->inds[level]];
+    if (level + 1 < path->n_levels) {
+      path->inds[level + 1] = 0;
+    }
+  }
+  return true;
+}
+
+/**
+ * Helper function to find a key-value pair in a B+ tree.
+ *
+ * This function sets the access path to the leaf node that holds the pair and
+ * returns the index of the pair in that leaf node, or -1 if the pair is not in
+ * the tree. Duplicates of the key are scanned from the first one, possibly
+ * across multiple leaf nodes, until the value matches.
+ */
+static inline int _find_entry(BPlusTree *tree, int key, size_t value,
+                              _BPlusTreePath *path) {
+  _descend_path(tree, key, true, path);
+  BPlusNode *leaf = path->nodes[path->n_levels];
+  int ind = _search_node(leaf, key, true);
+  while (true) {
+    for (; ind < leaf->n_keys && leaf->keys[ind] == key; ind++) {
+      if (leaf->spec.leaf.values[ind] == value) {
+        return ind;
+      }
+    }
+    if (ind < leaf->n_keys || !_advance_path(path)) {
+      // Hitting a larger key or the end of the tree
+      return -1;
+    }
+    leaf = path->nodes[path->n_levels];
+    ind = 0;
+  }
+}
+
+/**
+ * Helper function to move one key from a node to its sibling, through their
+ * parent.
+ *
+ * The siblings are the children `left_ind` and `left_ind + 1` of the parent,
+ * and the key moves from the left one to the right one if `to_right` is true,
+ * or the other way around otherwise. For leaf nodes the moved key is copied up
+ * as the new separator between the two siblings, while for internal nodes it is
+ * rotated through the parent, taking its child along.
+ */
+static inline void _borrow_key(BPlusNode *parent, int left_ind, bool to_right) {
+  BPlusNode *left = parent->spec.internal.children[left_ind];
+  BPlusNode *right = parent->spec.internal.children[left_ind + 1];
+
+  if (left->type == BPLUS_NODE_TYPE_LEAF) {
+    if (to_right) {
+      memmove(right->keys + 1, right->keys, sizeof(int) * right->n_keys);
+      memmove(right->spec.leaf.values + 1, right->spec.leaf.values,
+              sizeof(size_t) * right->n_keys);
+      right->keys[0] = left->keys[left->n_keys - 1];
+      right->spec.leaf.values[0] = left->spec.leaf.values[left->n_keys - 1];
+      left->n_keys--;
+      right->n_keys++;
+    } else {
+      left->keys[left->n_keys] = right->keys[0];
+      left->spec.leaf.values[left->n_keys] = right->spec.leaf.values[0];
+      left->n_keys++;
+      right->n_keys--;
+      memmove(right->keys, right->keys + 1, sizeof(int) * right->n_keys);
+      memmove(right->spec.leaf.values, right->spec.leaf.values + 1,
+              sizeof(size_t) * right->n_keys);
+    }
+    parent->keys[left_ind] = right->keys[0];
+    return;
+  }
+
+  BPlusNode **left_children = left->spec.internal.children;
+  BPlusNode **right_children = right->spec.internal.children;
+  if (to_right) {
+    memmove(right->keys + 1, right->keys, sizeof(int) * right->n_keys);
+    memmove(right_children + 1, right_children,
+            sizeof(BPlusNode *) * (right->n_keys + 1));
+    right->keys[0] = parent->keys[left_ind];
+    right_children[0] = left_children[left->n_keys];
+    parent->keys[left_ind] = left->keys[left->n_keys - 1];
+    left->n_keys--;
+    right->n_keys++;
+  } else {
+    left->keys[left->n_keys] = parent->keys[left_ind];
+    left_children[left->n_keys + 1] = right_children[0];
+    parent->keys[left_ind] = right->keys[0];
+    left->n_keys++;
+    right->n_keys--;
+    memmove(right->keys, right->keys + 1, sizeof(int) * right->n_keys);
+    memmove(right_children, right_children + 1,
+            sizeof(BPlusNode *) * (right->n_keys + 1));
+  }
+}
+
+/**
+ * Helper function to merge a node into its left sibling.
+ *
+ * The siblings are the children `left_ind` and `left_ind + 1` of the parent,
+ * and together they must fit in one node (with the separator between them in
+ * case of internal nodes). The separator and the right sibling are removed from
+ * the parent, and the right sibling is freed.
+ */
+static inline void _merge_nodes(BPlusNode *parent, int left_ind) {
+  BPlusNode *left = parent->spec.internal.children[left_ind];
+  BPlusNode *right = parent->spec.internal.children[left_ind + 1];
+
+  if (left->type == BPLUS_NODE_TYPE_LEAF) {
+    memcpy(left->keys + left->n_keys, right->keys,
+           sizeof(int) * right->n_keys);
+    memcpy(left->spec.leaf.values + left->n_keys, right->spec.leaf.values,
+           sizeof(size_t) * right->n_keys);
+    left->n_keys += right->n_keys;
+    left->spec.leaf.next = right->spec.leaf.next;
+  } else {
+    // The separator comes down between the keys of the two nodes
+    left->keys[left->n_keys] = parent->keys[left_ind];
+    memcpy(left->keys + left->n_keys + 1, right->keys,
+           sizeof(int) * right->n_keys);
+    memcpy(left->spec.internal.children + left->n_keys + 1,
+           right->spec.internal.children,
+           sizeof(BPlusNode *) * (right->n_keys + 1));
+    left->n_keys += right->n_keys + 1;
+  }
+
+  memmove(parent->keys + left_ind, parent->keys + left_ind + 1,
+          sizeof(int) * (parent->n_keys - left_ind - 1));
+  memmove(parent->spec.internal.children + left_ind + 1,
+          parent->spec.internal.children + left_ind + 2,
+          sizeof(BPlusNode *) * (parent->n_keys - left_ind - 1));
+  parent->n_keys--;
+  free(right);
+}
+
+/**
+ * Helper function to rebalance a B+ tree after deleting from a leaf node.
+ *
+ * The access path leads to the leaf node that was deleted from. Walking up the
+ * path, a node with less than half of the maximum number of keys is merged with
+ * a sibling if they fit in one node, which removes a key from the parent that
+ * may in turn need rebalancing; otherwise it borrows a key from the sibling,
+ * which leaves the parent as it was. The root is exempt, but if it is left with
+ * a single internal child, that child becomes the new root. Note that the last
+ * nodes of each level of a bulk loaded tree may have been underfull from the
+ * beginning, which this function tolerates.
+ */
+static inline void _rebalance_path(BPlusTree *tree, _BPlusTreePath *path) {
+  int min_keys = (tree->order - 1) / 2;
+  for (int level = path->n_levels; level > 0; level--) {
+    BPlusNode *node = path->nodes[level];
+    BPlusNode *parent = path->nodes[level - 1];
+    if (node->n_keys >= min_keys || parent->n_keys == 0) {
+      // The node is full enough, or it is the only leaf node of the tree
+      return;
+    }
+
+    // Pair the node with its left sibling if any, otherwise its right sibling
+    int ind = path->inds[level - 1];
+    int left_ind = ind > 0 ? ind - 1 : 0;
+    BPlusNode *left = parent->spec.internal.children[left_ind];
+    BPlusNode *right = parent->spec.internal.children[left_ind + 1];
+    int n_merged = left->n_keys + right->n_keys +
+                   (node->type == BPLUS_NODE_TYPE_INTERNAL ? 1 : 0);
+    if (n_merged > tree->order - 1) {
+      _borrow_key(parent, left_ind, node == right);
+      return;
+    }
+    _merge_nodes(parent, left_ind);
+  }
+
+  BPlusNode *root = tree->root;
+  if (root->n_keys == 0 &&
+      root->spec.internal.children[0]->type == BPLUS_NODE_TYPE_INTERNAL) {
+    tree->root = root->spec.internal.children[0];
+    tree->n_levels--;
+    free(root);
+  }
+}
+
+/**
+ * Helper function to remove the entry at an index of the leaf node at the end
+ * of an access path, and rebalance the tree.
+ */
+static inline void _delete_entry(BPlusTree *tree, _BPlusTreePath *path,
+                                 int ind) {
+  BPlusNode *leaf = path->nodes[path->n_levels];
+  memmove(leaf->keys + ind, leaf->keys + ind + 1,
+          sizeof(int) * (leaf->n_keys - ind - 1));
+  memmove(leaf->spec.leaf.values + ind, leaf->spec.leaf.values + ind + 1,
+          sizeof(size_t) * (leaf->n_keys - ind - 1));
+  leaf->n_keys--;
+  tree->size--;
+  _rebalance_path(tree, path);
+}
+
+/**
+ * @implements bplus_tree_delete
+ */
+int bplus_tree_delete(BPlusTree *tree, int key, size_t value) {
+  _BPlusTreePath path;
+  int ind = _find_entry(tree, key, value, &path);
+  if (ind == -1) {
+    return -1;
+  }
+  _delete_entry(tree, &path, ind);
+  return 0;
+}
+
+/**
+ * @implements bplus_tree_update
+ */
+int bplus_tree_update(BPlusTree *tree, int old_key, int new_key,
+                      size_t value) {
+  _BPlusTreePath path;
+  int ind = _find_entry(tree, old_key, value, &path);
+  if (ind == -1) {
+    return -1;
+  }
+
+  // If the new key stays between the neighbors of the entry, it can be changed
+  // in place; at either end of the leaf node the key may only move inwards, so
+  // that it stays within the separators of the leaf node
+  BPlusNode *leaf = path.nodes[path.n_levels];
+  int lower = ind > 0 ? leaf->keys[ind - 1] : old_key;
+  int upper = ind < leaf->n_keys - 1 ? leaf->keys[ind + 1] : old_key;
+  if (lower <= new_key && new_key <= upper) {
+    leaf->keys[ind] = new_key;
+    return 0;
+  }
+
+  _delete_entry(tree, &path, ind);
+  return bplus_tree_insert(tree, new_key, value);
+}
+
+/**
+ * Helper function to get the first leaf node of a B+ tree.
+ */
+static inline BPlusNode *_first_leaf(BPlusTree *tree) {
+  BPlusNode *node = tree->root;
+  while (node->type == BPLUS_NODE_TYPE_INTERNAL) {
+    node = node->spec.internal.children[0];
+  }
+  return node;
+}
+
+/**
+ * @implements bplus_tree_compact_values
+ */
+int bplus_tree_compact_values(BPlusTree *tree, const BitVector *removed) {
+  // Count the removed positions before each word of the mask, so that the
+  // number of removed positions before any position takes one more popcount
+  size_t n_slots = _BITNSLOTS(removed->length);
+  size_t *n_removed_before = malloc(sizeof(size_t) * (n_slots + 1));
+  if (n_removed_before == NULL) {
+    return -1;
+  }
+  size_t n_removed = 0;
+  for (size_t slot = 0; slot < n_slots; slot++) {
+    n_removed_before[slot] = n_removed;
+    n_removed += __builtin_popcountll(removed->data[slot]);
+  }
+
+  for (BPlusNode *leaf = _first_leaf(tree); leaf != NULL;
+       leaf = leaf->spec.leaf.next) {
+    size_t *values = leaf->spec.leaf.values;
+    for (int i = 0; i < leaf->n_keys; i++) {
+      size_t slot = _BITSLOT(values[i]);
+      values[i] -= n_removed_before[slot] +
+                   __builtin_popcountll(removed->data[slot] &
+                                        (_BITMASK(values[i]) - 1));
+    }
+  }
+
+  free(n_removed_before);
+  return 0;
+}
+
+/**
+ * @implements bplus_tree_shift_values
+ */
+void bplus_tree_shift_values(BPlusTree *tree, size_t from) {
+  for (BPlusNode *leaf = _first_leaf(tree); leaf != NULL;
+       leaf = leaf->spec.leaf.next) {
+    size_t *values = leaf->spec.leaf.values;
+    for (int i = 0; i < leaf->n_keys; i++) {
+      values[i] += values[i] >= from;
+    }
+  }
+}
+
 /**
  * B+ tree point search helper.
  *
@@ -457,18 +1075,18 @@ int bplus_tree_insert(BPlusTree *tree, int key, size_t value) {
  * the target key in the target node. The target node being NULL means that the
  * key is larger (including equal if aligned right) than all keys in the tree.
  */
-int _bplus_tree_search_helper(BPlusTree *tree, int key, bool align_left,
+int _bplus_tree_search_helper(BPlusTree *tree, long key, bool align_left,
                               BPlusNode **target) {
   // Starting from the root, binary search until reaching a leaf node
   int ind;
   BPlusNode *node = tree->root;
   while (node->type == BPLUS_NODE_TYPE_INTERNAL) {
-    ind = binsearch(node->keys, key, node->n_keys, align_left);
+    ind = _search_node(node, key, align_left);
     node = node->spec.internal.children[ind];
   }
 
   // Binary search the leaf node
-  ind = binsearch(node->keys, key, node->n_keys, align_left);
+  ind = _search_node(node, key, align_left);
   if (ind == node->n_keys) {
     *target = node->spec.leaf.next;
     return 0;
@@ -480,7 +1098,7 @@ int _bplus_tree_search_helper(BPlusTree *tree, int key, bool align_left,
 /**
  * @implements bplus_tree_search_cont
  */
-size_t bplus_tree_search_cont(BPlusTree *tree, int key, bool align_left) {
+size_t bplus_tree_search_cont(BPlusTree *tree, long key, bool align_left) {
   BPlusNode *node;
   int ind = _bplus_tree_search_helper(tree, key, align_left, &node);
   return node == NULL ? tree->size : node->spec.leaf.values[ind];
@@ -9,6 +9,7 @@
 
 #include "bptree.h"
 #include "cindex.h"
+#include "zonemap.h"
 
 /**
  * Helper function to initialize an unclustered sorted index.
@@ -93,7 +94,7 @@ DbSchemaStatus update_sorter(int *arr, size_t *sorter, size_t n_rows,
   }
 
   // Merge sorters of the original and new rows
-  status = amerge(arr, sorter + n_rows, n_rows, new_n_rows);
+  status = amerge(arr, sorter, n_rows, new_n_rows);
   if (status != 0) {
     return DB_SCHEMA_STATUS_INTERNAL_ERROR;
   }
@@ -115,7 +116,9 @@ DbSchemaStatus propagate_sorter(Table *table, size_t *sorter) {
     for (size_t j = 0; j < table->n_rows; j++) {
       table->columns[i].data[j] = old_data[sorter[j]];
     }
+    refresh_zone_map(table, &table->columns[i], 0);
   }
+  free(old_data);
   return DB_SCHEMA_STATUS_OK;
 }
 
@@ -129,13 +132,14 @@ DbSchemaStatus build_index_btree(Column *column, size_t n_rows) {
   case COLUMN_INDEX_TYPE_UNCLUSTERED_SORTED:
     assert(0 && "Unreachable code");
   case COLUMN_INDEX_TYPE_UNCLUSTERED_BTREE:
-    column->index.tree =
-        bplus_tree_create(column->data, column->index.sorter, n_rows);
+    column->index.tree = bplus_tree_create(column->data, column->index.sorter,
+                                           n_rows, column->index.tree_order);
     break;
   case COLUMN_INDEX_TYPE_CLUSTERED_SORTED:
     assert(0 && "Unreachable code");
   case COLUMN_INDEX_TYPE_CLUSTERED_BTREE:
-    column->index.tree = bplus_tree_create(column->data, NULL, n_rows);
+    column->index.tree = bplus_tree_create(column->data, NULL, n_rows,
+                                           column->index.tree_order);
     break;
   }
 
@@ -12,6 +12,8 @@
 // other Unix machines. Please look up _XOPEN_SOURCE for more details.
 #define _XOPEN_SOURCE
 
+#include <poll.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -25,6 +27,7 @@
 #include "io.h"
 #include "logging.h"
 #include "message.h"
+#include "sysinfo.h"
 
 /**
  * Processing status codes of the client.
@@ -36,6 +39,8 @@ typedef enum ClientProcessCode {
   CLIENT_PROCESS_CODE_OK_TERMINATE,
   // Processing failed but the processing loop should continue.
   CLIENT_PROCESS_CODE_ERROR_NONBREAKING,
+  // Processing failed because of failure to send message.
+  CLIENT_PROCESS_CODE_ERROR_SEND,
   // Processing failed because of failure to send message header.
   CLIENT_PROCESS_CODE_ERROR_SEND_HEADER,
   // Processing failed because of failure to send message payload.
@@ -44,6 +49,8 @@ typedef enum ClientProcessCode {
   CLIENT_PROCESS_CODE_ERROR_RECV_HEADER,
   // Processing failed because of failure to receive message payload.
   CLIENT_PROCESS_CODE_ERROR_RECV_PAYLOAD,
+  // Processing failed because the received message is out of sequence.
+  CLIENT_PROCESS_CODE_ERROR_RECV_SEQUENCE,
 } ClientProcessCode;
 
 /**
@@ -71,6 +78,237 @@ int connect_client() {
   return client_socket;
 }
 
+/**
+ * The shared memory channel with the server, or NULL if payloads only go
+ * through the socket.
+ */
+static SharedChannel *shared_channel = NULL;
+
+/**
+ * Print an error, attributed to an input line if the line number is non-zero.
+ */
+static inline void _print_error(size_t line, const char *message) {
+  if (line > 0) {
+    printf_error("Line %zu: %s\n", line, message);
+  } else {
+    printf_error("%s\n", message);
+  }
+}
+
+/**
+ * Receive a response of the server in a load query.
+ *
+ * A successful response may carry a payload of the given size (e.g., the
+ * negotiated batch size), which is received into the buffer. A failure of the
+ * load is displayed and attributed to the given input line if it is non-zero.
+ * The processing status code is returned.
+ */
+static inline ClientProcessCode _receive_load_response(size_t line,
+                                                       int client_socket,
+                                                       void *buffer,
+                                                       size_t size) {
+  Message recv_message;
+  int length = recv_all(client_socket, &recv_message, sizeof(Message));
+  if (length < 0) {
+    return CLIENT_PROCESS_CODE_ERROR_RECV_HEADER;
+  } else if (length == 0) {
+    return CLIENT_PROCESS_CODE_OK_TERMINATE; // Server closed the connection
+  }
+
+  // A successful response carries exactly the expected payload, while a failed
+  // one carries the error message
+  bool is_ok = recv_message.status == MESSAGE_STATUS_OK;
+  if (is_ok && (size_t)recv_message.length != size) {
+    return CLIENT_PROCESS_CODE_ERROR_RECV_PAYLOAD;
+  }
+  if (recv_message.length == 0) {
+    return CLIENT_PROCESS_CODE_OK;
+  }
+  char *payload = malloc(recv_message.length + 1);
+  if (payload == NULL) {
+    return CLIENT_PROCESS_CODE_ERROR_RECV_PAYLOAD;
+  }
+  length = recv_all(client_socket, payload, recv_message.length);
+  if (length <= 0) {
+    free(payload);
+    return CLIENT_PROCESS_CODE_ERROR_RECV_PAYLOAD;
+  }
+  if (is_ok) {
+    memcpy(buffer, payload, size);
+    free(payload);
+    return CLIENT_PROCESS_CODE_OK;
+  }
+  payload[recv_message.length] = '\0';
+  _print_error(line, payload);
+  free(payload);
+  return CLIENT_PROCESS_CODE_ERROR_NONBREAKING;
+}
+
+/**
+ * The state of streaming the rows of a load query to the server.
+ *
+ * Rows are parsed into one of the two buffers while the other one is being sent
+ * by a sender thread, so that parsing overlaps with the transfer and with the
+ * ingestion on the server side. A buffer is free if its length is zero, and
+ * both the parser and the sender go through the buffers alternately, so that
+ * batches are sent in order. The sender stops when parsing is done and all
+ * batches are sent, or on failure. The mutex protects everything but the
+ * socket and the contents of the buffers, and the condition variable is
+ * signaled whenever the state changes.
+ */
+typedef struct LoadStream {
+  int client_socket;
+  int *buffers[2];
+  size_t lengths[2];
+  bool is_parsing_done;
+  bool is_send_failed;
+  pthread_mutex_t mutex;
+  pthread_cond_t cond_changed;
+} LoadStream;
+
+/**
+ * The routine of the sender thread of a load query.
+ */
+void *load_sender(void *arg) {
+  LoadStream *stream = arg;
+  Message send_message;
+  memset(&send_message, 0, sizeof(Message));
+  send_message.status = MESSAGE_STATUS_C_SENDING_CSV_ROWS;
+  send_message.is_malloced = false;
+
+  pthread_mutex_lock(&stream->mutex);
+  for (int i = 0;; i = 1 - i) {
+    while (stream->lengths[i] == 0 && !stream->is_parsing_done) {
+      pthread_cond_wait(&stream->cond_changed, &stream->mutex);
+    }
+    if (stream->lengths[i] == 0) {
+      break; // Parsing is done and all batches are sent
+    }
+    send_message.length = stream->lengths[i];
+    send_message.payload = (char *)stream->buffers[i];
+    pthread_mutex_unlock(&stream->mutex);
+
+    ssize_t sent = send_message_shared(stream->client_socket, shared_channel,
+                                       &send_message);
+
+    pthread_mutex_lock(&stream->mutex);
+    stream->lengths[i] = 0;
+    pthread_cond_signal(&stream->cond_changed);
+    if (sent == -1) {
+      stream->is_send_failed = true;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&stream->mutex);
+  return NULL;
+}
+
+/**
+ * Helper function to check whether the server has responded, without blocking.
+ */
+static inline bool _has_response(int client_socket) {
+  struct pollfd pfd = {.fd = client_socket, .events = POLLIN};
+  return poll(&pfd, 1, 0) > 0;
+}
+
+/**
+ * Helper function to parse and stream the rows of a CSV to the server.
+ *
+ * Rows are parsed into batches of the given size while a sender thread sends
+ * the previous batch. The server only responds during streaming if the load
+ * fails, so we check for a response before each batch and stop early if there
+ * is one. This function returns whether the server has responded, in which
+ * case the processing status code of the response is set; otherwise the
+ * processing status code is set to indicate whether sending has succeeded.
+ */
+static inline bool _stream_csv_rows(CSV *csv, size_t batch_size, size_t line,
+                                    int client_socket,
+                                    ClientProcessCode *cp_code) {
+  *cp_code = CLIENT_PROCESS_CODE_OK;
+  LoadStream stream = {.client_socket = client_socket,
+                       .lengths = {0, 0},
+                       .is_parsing_done = false,
+                       .is_send_failed = false};
+  stream.buffers[0] = malloc(batch_size);
+  stream.buffers[1] = malloc(batch_size);
+  pthread_t sender;
+  if (stream.buffers[0] == NULL || stream.buffers[1] == NULL) {
+    free(stream.buffers[0]);
+    free(stream.buffers[1]);
+    *cp_code = CLIENT_PROCESS_CODE_ERROR_SEND_PAYLOAD;
+    return false;
+  }
+  pthread_mutex_init(&stream.mutex, NULL);
+  pthread_cond_init(&stream.cond_changed, NULL);
+  if (pthread_create(&sender, NULL, load_sender, &stream) != 0) {
+    pthread_mutex_destroy(&stream.mutex);
+    pthread_cond_destroy(&stream.cond_changed);
+    free(stream.buffers[0]);
+    free(stream.buffers[1]);
+    *cp_code = CLIENT_PROCESS_CODE_ERROR_SEND_PAYLOAD;
+    return false;
+  }
+
+  size_t row_stride = csv->n_cols * sizeof(int);
+  size_t batch_n_rows = batch_size / row_stride;
+  bool has_response = false;
+  CSVParseStatus parse_status = CSV_PARSE_STATUS_CONTINUE;
+  for (int i = 0; parse_status == CSV_PARSE_STATUS_CONTINUE; i = 1 - i) {
+    // Wait for the buffer to be free, i.e., its previous batch has been sent
+    pthread_mutex_lock(&stream.mutex);
+    while (stream.lengths[i] != 0 && !stream.is_send_failed) {
+      pthread_cond_wait(&stream.cond_changed, &stream.mutex);
+    }
+    bool is_send_failed = stream.is_send_failed;
+    pthread_mutex_unlock(&stream.mutex);
+    if (is_send_failed) {
+      break;
+    }
+    if (_has_response(client_socket)) {
+      has_response = true;
+      *cp_code = _receive_load_response(line, client_socket, NULL, 0);
+      break;
+    }
+
+    // Parse the next batch; we stop at EOF or an error, in which case whatever
+    // has been parsed is still sent
+    size_t n_rows = 0;
+    while (n_rows < batch_n_rows) {
+      parse_status =
+          parse_next_row(csv, stream.buffers[i] + n_rows * csv->n_cols);
+      if (parse_status != CSV_PARSE_STATUS_CONTINUE) {
+        break;
+      }
+      n_rows++;
+    }
+    if (n_rows == 0) {
+      break;
+    }
+
+    // Hand the batch over to the sender
+    pthread_mutex_lock(&stream.mutex);
+    stream.lengths[i] = n_rows * row_stride;
+    pthread_cond_signal(&stream.cond_changed);
+    pthread_mutex_unlock(&stream.mutex);
+  }
+
+  // Wait for all batches to be sent
+  pthread_mutex_lock(&stream.mutex);
+  stream.is_parsing_done = true;
+  pthread_cond_signal(&stream.cond_changed);
+  pthread_mutex_unlock(&stream.mutex);
+  pthread_join(sender, NULL);
+  if (!has_response && stream.is_send_failed) {
+    *cp_code = CLIENT_PROCESS_CODE_ERROR_SEND_PAYLOAD;
+  }
+
+  pthread_mutex_destroy(&stream.mutex);
+  pthread_cond_destroy(&stream.cond_changed);
+  free(stream.buffers[0]);
+  free(stream.buffers[1]);
+  return has_response;
+}
+
 /**
  * Process a load query.
  *
@@ -78,9 +316,11 @@ int connect_client() {
  * particular, those starting in `load(`. This is because the loaded files are
  * on the client side, so we cannot wait until the server parses the query.
  * Instead, load queries are parsed on the client side with the steps specified
- * in the comments down below. The procecessing status code is returned.
+ * in the comments down below. Errors are attributed to the given input line if
+ * it is non-zero. The procecessing status code is returned.
  */
-ClientProcessCode process_load_command(char *command, int client_socket) {
+ClientProcessCode process_load_command(char *command, size_t line,
+                                       int client_socket) {
   char *tokenizer, *to_free;
   tokenizer = to_free = malloc((strlen(command + 5) + 1) * sizeof(char));
   strcpy(tokenizer, command + 5);
@@ -94,7 +334,7 @@ ClientProcessCode process_load_command(char *command, int client_socket) {
   }
   if (tokenizer[0] != '"' || tokenizer[command_length - 2] != '"' ||
       tokenizer[command_length - 1] != ')') {
-    printf_error("Invalid command.\n", tokenizer);
+    _print_error(line, "Invalid command.");
     free(to_free);
     return CLIENT_PROCESS_CODE_ERROR_NONBREAKING;
   }
@@ -104,7 +344,10 @@ ClientProcessCode process_load_command(char *command, int client_socket) {
   // Load the CSV file
   CSV *csv = load_csv(tokenizer);
   if (csv == NULL) {
-    printf_error("Failed to load CSV file: `%s`.\n", tokenizer);
+    char message[DEFAULT_BUFFER_SIZE + 32];
+    snprintf(message, sizeof(message), "Failed to load CSV file: `%s`.",
+             tokenizer);
+    _print_error(line, message);
     free(to_free);
     return CLIENT_PROCESS_CODE_ERROR_NONBREAKING;
   }
@@ -112,148 +355,129 @@ ClientProcessCode process_load_command(char *command, int client_socket) {
 
   Message send_message;
   memset(&send_message, 0, sizeof(Message));
+  send_message.is_malloced = false;
 
-  // Step I: Send the number of columns to the server
-  send_message.status = MESSAGE_STATUS_C_SENDING_CSV_N_COLS;
-  send_message.length = sizeof(size_t);
-  if (send_all(client_socket, &send_message, sizeof(Message)) == -1) {
+  // Step I: Send the number of columns and the proposed batch size to the
+  // server
+  LoadParameters parameters = {.n_cols = csv->n_cols,
+                               .batch_size = LOAD_BATCH_SIZE};
+  send_message.status = MESSAGE_STATUS_C_SENDING_CSV_PARAMETERS;
+  send_message.length = sizeof(LoadParameters);
+  send_message.payload = (char *)&parameters;
+  if (send_message_all(client_socket, &send_message) == -1) {
     close_csv(csv);
-    return CLIENT_PROCESS_CODE_ERROR_SEND_HEADER;
-  }
-  if (send_all(client_socket, &csv->n_cols, sizeof(size_t)) == -1) {
-    close_csv(csv);
-    return CLIENT_PROCESS_CODE_ERROR_SEND_PAYLOAD;
+    return CLIENT_PROCESS_CODE_ERROR_SEND;
   }
 
-  // Step II: Send the CSV header string to the server
+  // Step II: Send the CSV header string to the server, which responds with the
+  // negotiated batch size, or with an error that terminates the load (e.g., if
+  // the header does not match any table)
   send_message.status = MESSAGE_STATUS_C_SENDING_CSV_HEADER;
   send_message.length = strlen(csv->header) + 1;
-  if (send_all(client_socket, &send_message, sizeof(Message)) == -1) {
+  send_message.payload = csv->header;
+  if (send_message_all(client_socket, &send_message) == -1) {
     close_csv(csv);
-    return CLIENT_PROCESS_CODE_ERROR_SEND_HEADER;
+    return CLIENT_PROCESS_CODE_ERROR_SEND;
   }
-  if (send_all(client_socket, csv->header, send_message.length) == -1) {
+  size_t batch_size = 0;
+  ClientProcessCode cp_code = _receive_load_response(
+      line, client_socket, &batch_size, sizeof(size_t));
+  if (cp_code != CLIENT_PROCESS_CODE_OK) {
     close_csv(csv);
-    return CLIENT_PROCESS_CODE_ERROR_SEND_PAYLOAD;
+    return cp_code;
+  }
+  if (batch_size < csv->n_cols * sizeof(int)) {
+    close_csv(csv);
+    return CLIENT_PROCESS_CODE_ERROR_RECV_PAYLOAD;
   }
 
-  // Step III: Parse and send CSV rows (flattened) to the server in batches
-  send_message.status = MESSAGE_STATUS_C_SENDING_CSV_ROWS;
-  size_t row_stride = csv->n_cols * sizeof(int);
-  int batch_size = NUM_ELEMS_PER_LOAD_BATCH / csv->n_cols;
-  int csv_rows_buffer[NUM_ELEMS_PER_LOAD_BATCH];
-  CSVParseStatus parse_status;
-  while (true) {
-    size_t current_length = 0;
-    for (int i = 0; i < batch_size; i++) {
-      parse_status = parse_next_row(csv, csv_rows_buffer + i * csv->n_cols);
-      if (parse_status != CSV_PARSE_STATUS_CONTINUE) {
-        break; // EOF or error
-      }
-      current_length += row_stride;
-    }
-
-    // This means we have nothing to send in the current batch, either because
-    // we have hit EOF or an error occurred; both cases we should break out of
-    // the loop and move to next step
-    if (current_length == 0) {
-      break;
-    }
-
-    // Send the current batch of CSV rows
-    send_message.length = current_length;
-    if (send_all(client_socket, &send_message, sizeof(Message)) == -1) {
-      close_csv(csv);
-      return CLIENT_PROCESS_CODE_ERROR_SEND_HEADER;
-    }
-    if (send_all(client_socket, csv_rows_buffer, send_message.length) == -1) {
-      close_csv(csv);
-      return CLIENT_PROCESS_CODE_ERROR_SEND_PAYLOAD;
-    }
-
-    if (parse_status != CSV_PARSE_STATUS_CONTINUE) {
-      break; // EOF or error, no more batches will be sent
-    }
+  // Step III: Parse and stream CSV rows (flattened) to the server in batches;
+  // the server responds during streaming only if the load fails
+  bool has_response =
+      _stream_csv_rows(csv, batch_size, line, client_socket, &cp_code);
+  close_csv(csv);
+  if (!has_response && cp_code != CLIENT_PROCESS_CODE_OK) {
+    return cp_code;
   }
 
   // Step IV: Send a final message to indicate end of load; only the header is
   // sent since there is no payload
-  send_message.length = 0;
   send_message.status = MESSAGE_STATUS_C_SENDING_CSV_FINISHED;
-  close_csv(csv);
-  if (send_all(client_socket, &send_message, sizeof(Message)) == -1) {
-    return CLIENT_PROCESS_CODE_ERROR_SEND_HEADER;
+  send_message.length = 0;
+  send_message.payload = NULL;
+  if (send_message_all(client_socket, &send_message) == -1) {
+    return has_response ? cp_code : CLIENT_PROCESS_CODE_ERROR_SEND;
   }
 
-  // Step V: Receive the feedback from the server
-  Message recv_message;
-  int length = recv_all(client_socket, &recv_message, sizeof(Message));
-  if (length < 0) {
-    return CLIENT_PROCESS_CODE_ERROR_RECV_HEADER;
-  } else if (length == 0) {
-    return CLIENT_PROCESS_CODE_OK_TERMINATE; // Server closed the connection
-  }
-  if (recv_message.length != 0) {
-    // We need to receive a second message that contains the actual payload,
-    // and this means the processing on the server side has failed
-    char payload[recv_message.length + 1];
-    length = recv_all(client_socket, payload, recv_message.length);
-    if (length <= 0) {
-      return CLIENT_PROCESS_CODE_ERROR_RECV_PAYLOAD;
-    }
-    payload[recv_message.length] = '\0';
-    printf_error("%s\n", payload);
-    return CLIENT_PROCESS_CODE_ERROR_NONBREAKING;
+  // Step V: Receive the feedback from the server, unless it has responded
+  // already; no payload means that the processing is successful
+  if (has_response) {
+    return cp_code;
   }
-
-  // No payload means the that the processing is successful on the server side
-  // and we do not need to receive a second message
-  return CLIENT_PROCESS_CODE_OK;
+  return _receive_load_response(line, client_socket, NULL, 0);
 }
 
 /**
- * Process a general client query.
- *
- * This follows the ordinary processing routine. First the client sends the
- * header and the payload to the server, where the payload is the query command
- * read from the input. Next the client receives the feedback from the server
- * and displays message if necessary. Except for a few special cases, all client
- * queries should be processed via this routine. The processing status code is
- * returned.
+ * Strip the trailing newline of a command and return its length.
  */
-ClientProcessCode process_command(char *command, int client_socket) {
-  // Do not process empty input
+static inline size_t _strip_command(char *command) {
   size_t command_length = strlen(command);
-  if (command[command_length - 1] == '\n') {
-    command[command_length--] = '\0';
-  }
-  if (command_length == 0) {
-    return CLIENT_PROCESS_CODE_OK;
+  if (command_length > 0 && command[command_length - 1] == '\n') {
+    command[--command_length] = '\0';
   }
+  return command_length;
+}
 
-  // Send the message header then the actual payload
+/**
+ * Send a general client query.
+ *
+ * The header and the payload, which is the query command, are sent together
+ * with the given sequence number. The command should be non-empty and have no
+ * trailing newline. The processing status code is returned.
+ */
+ClientProcessCode send_command(char *command, unsigned int sequence,
+                               int client_socket) {
   Message send_message;
   memset(&send_message, 0, sizeof(Message));
-  send_message.length = command_length;
-  send_message.is_malloced = false;
-  send_message.payload = command;
   send_message.status = MESSAGE_STATUS_C_REQUEST_PROCESS_COMMAND;
-  if (send_all(client_socket, &send_message, sizeof(Message)) == -1) {
-    return CLIENT_PROCESS_CODE_ERROR_SEND_HEADER;
-  }
-  if (send_all(client_socket, send_message.payload, send_message.length) ==
-      -1) {
-    return CLIENT_PROCESS_CODE_ERROR_SEND_PAYLOAD;
+  send_message.sequence = sequence;
+  send_message.length = strlen(command);
+  send_message.payload = command;
+  send_message.is_malloced = false;
+  if (send_message_all(client_socket, &send_message) == -1) {
+    return CLIENT_PROCESS_CODE_ERROR_SEND;
   }
+  return CLIENT_PROCESS_CODE_OK;
+}
 
+/**
+ * Receive a message of the response to a general client query.
+ *
+ * The client receives a message from the server for the query of the given
+ * sequence number and displays message if necessary. Errors are attributed to
+ * the given input line if it is non-zero. Whether the message is partial, i.e.,
+ * more messages of the response follow, is set. The processing status code is
+ * returned.
+ */
+ClientProcessCode receive_response_message(unsigned int sequence, size_t line,
+                                           int client_socket,
+                                           bool *is_partial) {
   // Receive a first message from the server that contains the header
   Message recv_message;
+  *is_partial = false;
   int length = recv_all(client_socket, &recv_message, sizeof(Message));
   if (length < 0) {
     return CLIENT_PROCESS_CODE_ERROR_RECV_HEADER;
   } else if (length == 0) {
     return CLIENT_PROCESS_CODE_OK_TERMINATE; // Server closed the connection
   }
+  *is_partial = recv_message.is_partial;
+
+  // The response must be for the query that we are expecting, otherwise the
+  // framing of the stream is broken and nothing afterwards can be trusted
+  if (recv_message.sequence != sequence) {
+    return CLIENT_PROCESS_CODE_ERROR_RECV_SEQUENCE;
+  }
 
   // We do not receive a second message if the header has specified an empty
   // payload; however, the status of a message with payload length 0 still
@@ -261,10 +485,10 @@ ClientProcessCode process_command(char *command, int client_socket) {
   if (recv_message.length == 0) {
     switch (recv_message.status) {
     case MESSAGE_STATUS_INVALID_COMMAND:
-      printf_error("Invalid command.\n");
+      _print_error(line, "Invalid command.");
       break;
     case MESSAGE_STATUS_UNKNOWN_EXECUTION_ERROR:
-      printf_error("Unknown error encountered during execution.\n");
+      _print_error(line, "Unknown error encountered during execution.");
       break;
     default:
       break;
@@ -277,7 +501,14 @@ ClientProcessCode process_command(char *command, int client_socket) {
   // this payload buffer because it could be very large (e.g., tabular printout
   // of a large table) that exceeds the stack size
   char *payload = malloc(recv_message.length + 1);
-  length = recv_all(client_socket, payload, recv_message.length);
+  if (recv_message.is_shared && shared_channel != NULL) {
+    length = recv_shared_payload(client_socket, shared_channel, payload,
+                                 recv_message.length);
+  } else if (recv_message.is_shared) {
+    length = -1; // The server must not share a payload without a channel
+  } else {
+    length = recv_all(client_socket, payload, recv_message.length);
+  }
   if (length <= 0) {
     free(payload);
     return CLIENT_PROCESS_CODE_ERROR_RECV_PAYLOAD;
@@ -287,8 +518,14 @@ ClientProcessCode process_command(char *command, int client_socket) {
     case MESSAGE_STATUS_OK:
       printf("%s\n", payload);
       break;
+    case MESSAGE_STATUS_OK_COLUMNAR:
+      // The result is sent in binary and it is up to us to format it
+      if (write_columnar_result(stdout, payload, recv_message.length) < 0) {
+        _print_error(line, "Received malformed columnar result.");
+      }
+      break;
     default:
-      printf_error("%s\n", payload);
+      _print_error(line, payload);
       break;
     }
   }
@@ -296,11 +533,339 @@ ClientProcessCode process_command(char *command, int client_socket) {
   return CLIENT_PROCESS_CODE_OK;
 }
 
-int main() {
+/**
+ * Receive the response to a general client query.
+ *
+ * The response may consist of multiple messages (e.g., the results of a script
+ * executed by the server), which are all received and displayed. Errors are
+ * attributed to the given input line if it is non-zero. The processing status
+ * code is returned.
+ */
+ClientProcessCode receive_response(unsigned int sequence, size_t line,
+                                   int client_socket) {
+  ClientProcessCode cp_code;
+  bool is_partial;
+  do {
+    cp_code =
+        receive_response_message(sequence, line, client_socket, &is_partial);
+  } while (cp_code == CLIENT_PROCESS_CODE_OK && is_partial);
+  return cp_code;
+}
+
+/**
+ * Process a general client query.
+ *
+ * This follows the ordinary processing routine. First the client sends the
+ * header and the payload to the server, where the payload is the query command
+ * read from the input. Next the client receives the feedback from the server
+ * and displays message if necessary. Except for a few special cases, all client
+ * queries should be processed via this routine. The processing status code is
+ * returned.
+ */
+ClientProcessCode process_command(char *command, unsigned int sequence,
+                                  int client_socket) {
+  // Do not process empty input
+  if (_strip_command(command) == 0) {
+    return CLIENT_PROCESS_CODE_OK;
+  }
+
+  ClientProcessCode cp_code = send_command(command, sequence, client_socket);
+  if (cp_code != CLIENT_PROCESS_CODE_OK) {
+    return cp_code;
+  }
+  return receive_response(sequence, 0, client_socket);
+}
+
+/**
+ * Report the processing status code of a query.
+ *
+ * Failures are attributed to the given input line if it is non-zero. This
+ * function returns the exit status of the client if the client should
+ * terminate, otherwise -1.
+ */
+int report_process_code(ClientProcessCode cp_code, size_t line) {
+  switch (cp_code) {
+  case CLIENT_PROCESS_CODE_OK:
+  case CLIENT_PROCESS_CODE_ERROR_NONBREAKING:
+    // Both cases we do not terminate the client processing loop; moreover,
+    // non-breaking errors should be handled in their respective processing
+    // routines and not here
+    return -1;
+  case CLIENT_PROCESS_CODE_OK_TERMINATE:
+    return 0;
+  case CLIENT_PROCESS_CODE_ERROR_SEND:
+    _print_error(line, "Failed to send message.");
+    return 1;
+  case CLIENT_PROCESS_CODE_ERROR_SEND_HEADER:
+    _print_error(line, "Failed to send message header.");
+    return 1;
+  case CLIENT_PROCESS_CODE_ERROR_SEND_PAYLOAD:
+    _print_error(line, "Failed to send message payload.");
+    return 1;
+  case CLIENT_PROCESS_CODE_ERROR_RECV_HEADER:
+    _print_error(line, "Failed to receive message header.");
+    return 1;
+  case CLIENT_PROCESS_CODE_ERROR_RECV_PAYLOAD:
+    _print_error(line, "Failed to receive message payload.");
+    return 1;
+  case CLIENT_PROCESS_CODE_ERROR_RECV_SEQUENCE:
+    _print_error(line, "Received response out of sequence.");
+    return 1;
+  }
+  return 1;
+}
+
+/**
+ * A query sent in pipelined mode whose response has not been received yet.
+ *
+ * The input line number is kept so that the response can be attributed to it.
+ */
+typedef struct PendingQuery {
+  unsigned int sequence;
+  size_t line;
+} PendingQuery;
+
+/**
+ * The state of the pipelined mode.
+ *
+ * In pipelined mode the main thread keeps sending queries without waiting for
+ * their responses, while a receiver thread receives the responses in order. The
+ * pending queries are kept in a ring buffer in the order they were sent, which
+ * is also the order the server responds in. The receiver stops when sending is
+ * done and all responses are received, or on termination or failure, in which
+ * case its processing status code and the line of the failed query are kept.
+ * The mutex protects everything but the socket, and the condition variable is
+ * signaled whenever the state changes.
+ */
+typedef struct PipelineState {
+  int client_socket;
+  PendingQuery pending[MAX_PIPELINED_QUERIES];
+  size_t head;
+  size_t n_pending;
+  bool is_sending_done;
+  bool is_receiver_stopped;
+  ClientProcessCode receiver_code;
+  size_t receiver_line;
+  pthread_mutex_t mutex;
+  pthread_cond_t cond_changed;
+} PipelineState;
+
+/**
+ * The routine of the receiver thread in pipelined mode.
+ */
+void *pipeline_receiver(void *arg) {
+  PipelineState *state = arg;
+  ClientProcessCode cp_code = CLIENT_PROCESS_CODE_OK;
+  PendingQuery query = {.sequence = 0, .line = 0};
+
+  pthread_mutex_lock(&state->mutex);
+  while (true) {
+    // Wait for a pending query; note that we must not touch the socket while
+    // there is none, because the main thread may be using it for a load
+    while (state->n_pending == 0 && !state->is_sending_done) {
+      pthread_cond_wait(&state->cond_changed, &state->mutex);
+    }
+    if (state->n_pending == 0) {
+      break; // Sending is done and all responses are received
+    }
+    query = state->pending[state->head];
+    pthread_mutex_unlock(&state->mutex);
+
+    cp_code =
+        receive_response(query.sequence, query.line, state->client_socket);
+
+    pthread_mutex_lock(&state->mutex);
+    state->head = (state->head + 1) % MAX_PIPELINED_QUERIES;
+    state->n_pending--;
+    pthread_cond_signal(&state->cond_changed);
+    if (cp_code != CLIENT_PROCESS_CODE_OK) {
+      break;
+    }
+  }
+  fflush(stdout);
+
+  state->is_receiver_stopped = true;
+  state->receiver_code = cp_code;
+  state->receiver_line = query.line;
+  pthread_cond_signal(&state->cond_changed);
+  pthread_mutex_unlock(&state->mutex);
+  return NULL;
+}
+
+/**
+ * Run the client in pipelined mode.
+ *
+ * Queries are sent as fast as they are read, with up to `MAX_PIPELINED_QUERIES`
+ * of them in flight, and the server processes them strictly in order. Load
+ * queries involve a back-and-forth with the server, so they wait for all
+ * pending queries to complete and are then processed as usual. This function
+ * returns the exit status of the client.
+ */
+int run_pipelined(int client_socket) {
+  PipelineState *state = calloc(1, sizeof(PipelineState));
+  if (state == NULL) {
+    printf_error("Failed to set up pipelined mode.\n");
+    return 1;
+  }
+  state->client_socket = client_socket;
+  pthread_mutex_init(&state->mutex, NULL);
+  pthread_cond_init(&state->cond_changed, NULL);
+  pthread_t receiver;
+  if (pthread_create(&receiver, NULL, pipeline_receiver, state) != 0) {
+    printf_error("Failed to set up pipelined mode.\n");
+    free(state);
+    return 1;
+  }
+
+  char read_buffer[DEFAULT_BUFFER_SIZE];
+  unsigned int sequence = 0;
+  size_t line = 0;
+  int exit_status = -1;
+  while (exit_status < 0 &&
+         fgets(read_buffer, DEFAULT_BUFFER_SIZE, stdin) != NULL) {
+    line++;
+    bool is_load = strncmp(read_buffer, "load(", 5) == 0;
+    if (!is_load && _strip_command(read_buffer) == 0) {
+      continue; // Do not process empty input
+    }
+
+    // Wait until there is room for another pending query, or until there is
+    // no pending query at all for a load
+    pthread_mutex_lock(&state->mutex);
+    while (!state->is_receiver_stopped &&
+           state->n_pending >= (is_load ? 1 : MAX_PIPELINED_QUERIES)) {
+      pthread_cond_wait(&state->cond_changed, &state->mutex);
+    }
+    bool is_receiver_stopped = state->is_receiver_stopped;
+    pthread_mutex_unlock(&state->mutex);
+    if (is_receiver_stopped) {
+      break;
+    }
+
+    if (is_load) {
+      fflush(stdout); // Keep the output of the previous queries in order
+      exit_status = report_process_code(
+          process_load_command(read_buffer, line, client_socket), line);
+      continue;
+    }
+    ClientProcessCode cp_code =
+        send_command(read_buffer, sequence, client_socket);
+    if (cp_code != CLIENT_PROCESS_CODE_OK) {
+      // The server may have closed the connection on purpose (e.g., shutdown),
+      // in which case the receiver reports the termination instead
+      pthread_mutex_lock(&state->mutex);
+      while (!state->is_receiver_stopped && state->n_pending > 0) {
+        pthread_cond_wait(&state->cond_changed, &state->mutex);
+      }
+      is_receiver_stopped = state->is_receiver_stopped;
+      pthread_mutex_unlock(&state->mutex);
+      if (!is_receiver_stopped) {
+        exit_status = report_process_code(cp_code, line);
+      }
+      break;
+    }
+
+    // Record the query as pending only after it is sent so that the receiver
+    // never waits for a response to a query that the server never got
+    pthread_mutex_lock(&state->mutex);
+    size_t tail = (state->head + state->n_pending) % MAX_PIPELINED_QUERIES;
+    state->pending[tail].sequence = sequence++;
+    state->pending[tail].line = line;
+    state->n_pending++;
+    pthread_cond_signal(&state->cond_changed);
+    pthread_mutex_unlock(&state->mutex);
+
+    // The server closes the connection on shutdown, so nothing after it would
+    // be processed; stop sending so that the connection is closed cleanly
+    if (strncmp(read_buffer, "shutdown", 8) == 0) {
+      break;
+    }
+  }
+
+  // Wait for all responses to be received
+  pthread_mutex_lock(&state->mutex);
+  state->is_sending_done = true;
+  pthread_cond_signal(&state->cond_changed);
+  pthread_mutex_unlock(&state->mutex);
+  pthread_join(receiver, NULL);
+  if (exit_status < 0) {
+    exit_status =
+        report_process_code(state->receiver_code, state->receiver_line);
+  }
+
+  pthread_mutex_destroy(&state->mutex);
+  pthread_cond_destroy(&state->cond_changed);
+  free(state);
+  return exit_status < 0 ? 0 : exit_status;
+}
+
+/**
+ * Set up a shared memory channel with the server.
+ *
+ * The channel is created and its file descriptor is passed to the server over
+ * the socket. If anything fails, a warning is displayed and the client keeps
+ * using the socket only; a failure to communicate with the server is left to
+ * be discovered by the first query.
+ */
+void setup_shared_channel(int client_socket) {
+  int fd;
+  SharedChannel *channel = shared_channel_create(&fd);
+  if (channel == NULL) {
+    printf_error("Failed to create shared memory; using the socket only.\n");
+    return;
+  }
+
+  // The response has the same shape as a load response, i.e., an empty payload
+  // on success or an error message on failure
+  Message send_message;
+  memset(&send_message, 0, sizeof(Message));
+  send_message.status = MESSAGE_STATUS_C_SHARING_MEMORY;
+  ssize_t sent = send_message_fd(client_socket, &send_message, fd);
+  close(fd);
+  if (sent == -1 || _receive_load_response(0, client_socket, NULL, 0) !=
+                        CLIENT_PROCESS_CODE_OK) {
+    printf_error("Failed to share memory with the server; using the socket "
+                 "only.\n");
+    shared_channel_close(channel);
+    return;
+  }
+  shared_channel = channel;
+}
+
+int main(int argc, char *argv[]) {
+  init_sysinfo();
+
+  // Parse the command line arguments
+  bool pipelined = false;
+  bool shared = false;
+  int opt;
+  while ((opt = getopt(argc, argv, "pm")) != -1) {
+    switch (opt) {
+    case 'p':
+      pipelined = true;
+      break;
+    case 'm':
+      shared = true;
+      break;
+    default:
+      printf_error("Usage: %s [-p] [-m]\n", argv[0]);
+      return 1;
+    }
+  }
+
   int client_socket = connect_client();
   if (client_socket < 0) {
     return 1;
   }
+  if (shared) {
+    setup_shared_channel(client_socket);
+  }
+  if (pipelined) {
+    int exit_status = run_pipelined(client_socket);
+    close(client_socket);
+    shared_channel_close(shared_channel);
+    return exit_status;
+  }
 
   // Output an interactive marker at the start of each command if the input is
   // from a file descriptor associated with a terminal; otherwise do not output
@@ -309,6 +874,7 @@ int main() {
 
   char read_buffer[DEFAULT_BUFFER_SIZE];
   char *read_ptr; // Used the check if read was successful
+  unsigned int sequence = 0;
   while (true) {
     printf("%s", prefix);
     read_ptr = fgets(read_buffer, DEFAULT_BUFFER_SIZE, stdin);
@@ -319,40 +885,20 @@ int main() {
     // Process the command
     ClientProcessCode cp_code;
     if (strncmp(read_buffer, "load(", 5) == 0) {
-      cp_code = process_load_command(read_buffer, client_socket);
+      cp_code = process_load_command(read_buffer, 0, client_socket);
     } else {
-      cp_code = process_command(read_buffer, client_socket);
+      cp_code = process_command(read_buffer, sequence++, client_socket);
     }
 
     // Check the process code and take appropriate action
-    switch (cp_code) {
-    case CLIENT_PROCESS_CODE_OK:
-    case CLIENT_PROCESS_CODE_ERROR_NONBREAKING:
-      // Both cases we do not terminate the client processing loop; moreover,
-      // non-breaking errors should be handled in their respective processing
-      // routines and not here
-      break;
-    case CLIENT_PROCESS_CODE_OK_TERMINATE:
+    int exit_status = report_process_code(cp_code, 0);
+    if (exit_status >= 0) {
       close(client_socket);
-      return 0;
-    case CLIENT_PROCESS_CODE_ERROR_SEND_HEADER:
-      printf_error("Failed to send message header.\n");
-      close(client_socket);
-      return 1;
-    case CLIENT_PROCESS_CODE_ERROR_SEND_PAYLOAD:
-      printf_error("Failed to send message payload.\n");
-      close(client_socket);
-      return 1;
-    case CLIENT_PROCESS_CODE_ERROR_RECV_HEADER:
-      printf_error("Failed to receive message header.\n");
-      close(client_socket);
-      return 1;
-    case CLIENT_PROCESS_CODE_ERROR_RECV_PAYLOAD:
-      printf_error("Failed to receive message payload.\n");
-      close(client_socket);
-      return 1;
+      shared_channel_close(shared_channel);
+      return exit_status;
     }
   }
 
+  shared_channel_close(shared_channel);
   return 0;
 }
@@ -78,20 +78,7 @@ void free_client_context(ClientContext *context) {
 
   // Free internals of each position vector handle and the handles themselves
   for (size_t i = 0; i < context->n_posvec_handles; i++) {
-    switch (context->posvec_handles[i].generalized_posvec.posvec_type) {
-    case GENERALIZED_POSVEC_TYPE_INDEX_ARRAY:
-      free(context->posvec_handles[i]
-               .generalized_posvec.posvec_pointer.index_array->indices);
-      free(context->posvec_handles[i]
-               .generalized_posvec.posvec_pointer.index_array);
-      break;
-    case GENERALIZED_POSVEC_TYPE_BOOLEAN_MASK:
-      free(context->posvec_handles[i]
-               .generalized_posvec.posvec_pointer.boolean_mask->mask);
-      free(context->posvec_handles[i]
-               .generalized_posvec.posvec_pointer.boolean_mask);
-      break;
-    }
+    free_posvec_internals(&context->posvec_handles[i].generalized_posvec);
   }
   free(context->posvec_handles);
 
@@ -225,17 +212,7 @@ DbSchemaStatus insert_posvec_handle(ClientContext *context, char *name,
   if (posvec_handle != NULL) {
     // There is already a handle with the same name so we need to overwrite it;
     // we free the original first then point to the new one
-    switch (posvec_handle->generalized_posvec.posvec_type) {
-    case GENERALIZED_POSVEC_TYPE_INDEX_ARRAY:
-      free(posvec_handle->generalized_posvec.posvec_pointer.index_array
-               ->indices);
-      free(posvec_handle->generalized_posvec.posvec_pointer.index_array);
-      break;
-    case GENERALIZED_POSVEC_TYPE_BOOLEAN_MASK:
-      free(posvec_handle->generalized_posvec.posvec_pointer.boolean_mask->mask);
-      free(posvec_handle->generalized_posvec.posvec_pointer.boolean_mask);
-      break;
-    }
+    free_posvec_internals(&posvec_handle->generalized_posvec);
     posvec_handle->generalized_posvec = *posvec;
     free(posvec);
   } else {
@@ -332,6 +309,101 @@ GeneralizedPosvec *wrap_index_array(size_t *indices, size_t n_indices,
   return posvec;
 }
 
+/**
+ * @implements wrap_boolean_mask
+ */
+GeneralizedPosvec *wrap_boolean_mask(BitVector *mask, size_t n_set,
+                                     DbSchemaStatus *status) {
+  BooleanMask *boolean_mask = malloc(sizeof(BooleanMask));
+  if (boolean_mask == NULL) {
+    *status = DB_SCHEMA_STATUS_ALLOC_FAILED;
+    return NULL;
+  }
+  boolean_mask->mask = mask;
+  boolean_mask->n_set = n_set;
+
+  GeneralizedPosvec *posvec = malloc(sizeof(GeneralizedPosvec));
+  if (posvec == NULL) {
+    *status = DB_SCHEMA_STATUS_ALLOC_FAILED;
+    free(boolean_mask);
+    return NULL;
+  }
+  posvec->posvec_type = GENERALIZED_POSVEC_TYPE_BOOLEAN_MASK;
+  posvec->posvec_pointer.boolean_mask = boolean_mask;
+
+  *status = DB_SCHEMA_STATUS_OK;
+  return posvec;
+}
+
+/**
+ * @implements posvec_length
+ */
+size_t posvec_length(GeneralizedPosvec *posvec) {
+  switch (posvec->posvec_type) {
+  case GENERALIZED_POSVEC_TYPE_INDEX_ARRAY:
+    return posvec->posvec_pointer.index_array->n_indices;
+  case GENERALIZED_POSVEC_TYPE_BOOLEAN_MASK:
+    return posvec->posvec_pointer.boolean_mask->n_set;
+  }
+  assert(0 && "Unreachable code");
+  return 0;
+}
+
+/**
+ * @implements posvec_to_index_array
+ */
+IndexArray *posvec_to_index_array(GeneralizedPosvec *posvec,
+                                  DbSchemaStatus *status) {
+  *status = DB_SCHEMA_STATUS_OK;
+  if (posvec->posvec_type == GENERALIZED_POSVEC_TYPE_INDEX_ARRAY) {
+    return posvec->posvec_pointer.index_array;
+  }
+
+  // Materialize the set bits of the mask in increasing order
+  BooleanMask *boolean_mask = posvec->posvec_pointer.boolean_mask;
+  BitVector *mask = boolean_mask->mask;
+  IndexArray *index_array = malloc(sizeof(IndexArray));
+  if (index_array == NULL) {
+    *status = DB_SCHEMA_STATUS_ALLOC_FAILED;
+    return NULL;
+  }
+  index_array->n_indices = boolean_mask->n_set;
+  index_array->indices = malloc(boolean_mask->n_set * sizeof(size_t));
+  if (index_array->indices == NULL && boolean_mask->n_set > 0) {
+    free(index_array);
+    *status = DB_SCHEMA_STATUS_ALLOC_FAILED;
+    return NULL;
+  }
+  size_t count = 0;
+  for (size_t pos = bitvector_next_set(mask, 0); pos < mask->length;
+       pos = bitvector_next_set(mask, pos + 1)) {
+    index_array->indices[count++] = pos;
+  }
+  assert(count == boolean_mask->n_set);
+
+  // Replace the mask with the index array
+  free_posvec_internals(posvec);
+  posvec->posvec_type = GENERALIZED_POSVEC_TYPE_INDEX_ARRAY;
+  posvec->posvec_pointer.index_array = index_array;
+  return index_array;
+}
+
+/**
+ * @implements free_posvec_internals
+ */
+void free_posvec_internals(GeneralizedPosvec *posvec) {
+  switch (posvec->posvec_type) {
+  case GENERALIZED_POSVEC_TYPE_INDEX_ARRAY:
+    free(posvec->posvec_pointer.index_array->indices);
+    free(posvec->posvec_pointer.index_array);
+    break;
+  case GENERALIZED_POSVEC_TYPE_BOOLEAN_MASK:
+    bitvector_free(posvec->posvec_pointer.boolean_mask->mask);
+    free(posvec->posvec_pointer.boolean_mask);
+    break;
+  }
+}
+
 /**
  * @implements wrap_partial_column
  */
@@ -3,7 +3,66 @@
  * @implements cmdaddsub.h
  */
 
+#include <immintrin.h>
+
 #include "cmdaddsub.h"
+#include "consts.h"
+#include "sysinfo.h"
+#include "thread_pool.h"
+
+/**
+ * Helper function to add or subtract a range of values 8 at a time with AVX2.
+ *
+ * The range is processed in whole blocks of 8 and the position after the last
+ * block is returned, where the trailing values are left to be processed.
+ */
+TARGET_AVX2 static inline size_t _addsub_range_avx2(const int *data1,
+                                                    const int *data2,
+                                                    int *values, size_t start,
+                                                    size_t end, bool is_add) {
+  size_t i = start;
+  for (; i + 8 <= end; i += 8) {
+    __m256i values1 = _mm256_loadu_si256((const __m256i *)(data1 + i));
+    __m256i values2 = _mm256_loadu_si256((const __m256i *)(data2 + i));
+    _mm256_storeu_si256((__m256i *)(values + i),
+                        is_add ? _mm256_add_epi32(values1, values2)
+                               : _mm256_sub_epi32(values1, values2));
+  }
+  return i;
+}
+
+/**
+ * Helper function to add or subtract a range of values.
+ *
+ * The values are processed 8 at a time with AVX2 if the processor supports it,
+ * and the trailing values (or all values otherwise) one at a time. Like the
+ * vector instructions, the scalar operations wrap around on overflow.
+ */
+static inline void _addsub_range(const int *data1, const int *data2,
+                                 int *values, size_t start, size_t end,
+                                 bool is_add) {
+  size_t i = start;
+  if (__has_avx2__) {
+    i = _addsub_range_avx2(data1, data2, values, start, end, is_add);
+  }
+  if (is_add) {
+    for (; i < end; i++) {
+      values[i] = (int)((unsigned)data1[i] + (unsigned)data2[i]);
+    }
+  } else {
+    for (; i < end; i++) {
+      values[i] = (int)((unsigned)data1[i] - (unsigned)data2[i]);
+    }
+  }
+}
+
+/**
+ * @implements cmdaddsub_chunk_subroutine
+ */
+void cmdaddsub_chunk_subroutine(AddsubChunkTaskData *task_data) {
+  _addsub_range(task_data->data1, task_data->data2, task_data->values,
+                task_data->start, task_data->end, task_data->is_add);
+}
 
 /**
  * @implements cmdaddsub
@@ -11,6 +70,11 @@
 GeneralizedValvec *cmdaddsub(GeneralizedValvec *valvec1,
                              GeneralizedValvec *valvec2, bool is_add,
                              DbSchemaStatus *status) {
+  if (__multi_threaded__ && __thread_pool__ == NULL) {
+    *status = DB_SCHEMA_STATUS_PARALLEL_NOT_INITIALIZED;
+    return NULL;
+  }
+
   int *data1 = valvec1->valvec_type == GENERALIZED_VALVEC_TYPE_COLUMN
                    ? valvec1->valvec_pointer.column->data
                    : valvec1->valvec_pointer.partial_column->values;
@@ -27,15 +91,35 @@ GeneralizedValvec *cmdaddsub(GeneralizedValvec *valvec1,
     return NULL;
   }
 
-  // Perform the addition or subtraction
-  if (is_add) {
-    for (size_t i = 0; i < length; i++) {
-      values[i] = data1[i] + data2[i];
-    }
+  // Perform the addition or subtraction, split into chunks of consecutive
+  // values that run in parallel if the vectors are large enough
+  int n_tasks = thread_pool_n_tasks(length, MIN_NUM_VALUES_PER_VECTOR_TASK);
+  if (n_tasks == 1) {
+    _addsub_range(data1, data2, values, 0, length, is_add);
   } else {
-    for (size_t i = 0; i < length; i++) {
-      values[i] = data1[i] - data2[i];
+    AddsubChunkTaskData *chunks = malloc(n_tasks * sizeof(AddsubChunkTaskData));
+    if (chunks == NULL) {
+      free(values);
+      *status = DB_SCHEMA_STATUS_ALLOC_FAILED;
+      return NULL;
+    }
+    for (int i = 0; i < n_tasks; i++) {
+      chunks[i] = (AddsubChunkTaskData){
+          .data1 = data1,
+          .data2 = data2,
+          .values = values,
+          .start = length * i / n_tasks,
+          .end = length * (i + 1) / n_tasks,
+          .is_add = is_add,
+      };
     }
+    ThreadTaskGroup group;
+    thread_task_group_init(&group);
+    thread_pool_enqueue_group(__thread_pool__, &group,
+                              THREAD_TASK_TYPE_ADDSUB_CHUNK, chunks,
+                              sizeof(AddsubChunkTaskData), n_tasks);
+    thread_pool_wait_group(__thread_pool__, &group);
+    free(chunks);
   }
 
   // Wrap the result values in a value vector
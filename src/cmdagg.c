@@ -4,64 +4,119 @@
  */
 
 #include <assert.h>
+#include <stdlib.h>
 
 #include "cmdagg.h"
+#include "cmdselect.h"
 #include "scan.h"
 
 /**
- * @implements cmdagg
+ * Helper function to determine the (single) flag to use for the shared scan
+ * function of an aggregation.
  */
-NumericValue cmdagg(GeneralizedValvec *valvec, int type_code,
-                    DbSchemaStatus *status) {
-  ScanContext ctx = init_empty_scan_context();
-
-  // Determine the (single) flag to use for the shared scan function
-  int flag;
+static inline int _agg_scan_flag(int type_code) {
   switch (type_code) {
   case 0:
-    flag = SCAN_CALLBACK_MIN_FLAG;
-    break;
+    return SCAN_CALLBACK_MIN_FLAG;
   case 1:
-    flag = SCAN_CALLBACK_MAX_FLAG;
-    break;
+    return SCAN_CALLBACK_MAX_FLAG;
   case 2:
   case 3:
     // SUM and AVG both fall into this category; for AVG we will do additional
     // post-processing after the scan
-    flag = SCAN_CALLBACK_SUM_FLAG;
-    break;
+    return SCAN_CALLBACK_SUM_FLAG;
   default:
     assert(0 && "Invalid type code");
   }
+  return 0;
+}
 
-  // Perform the actual scanning and aggregation
-  *status = shared_scan(valvec, NULL, &ctx, flag);
-  if (*status != DB_SCHEMA_STATUS_OK) {
-    return (NumericValue){0};
-  }
-
-  // Post-processing
+/**
+ * Helper function to extract the result of an aggregation from the context of
+ * its shared scan, given the number of aggregated values.
+ */
+static inline NumericValue _agg_result(ScanContext *ctx, int type_code,
+                                       size_t length) {
   NumericValue agg_result;
   switch (type_code) {
   case 0:
-    agg_result.int_value = ctx.min_result;
+    agg_result.int_value = ctx->min_result;
     break;
   case 1:
-    agg_result.int_value = ctx.max_result;
+    agg_result.int_value = ctx->max_result;
     break;
   case 2:
-    agg_result.long_long_value = ctx.sum_result;
+    agg_result.long_long_value = ctx->sum_result;
     break;
   case 3:
     // NaN (when length is 0) should be treated as zero
     agg_result.double_value =
-        valvec->valvec_length == 0
-            ? 0.0
-            : (double)ctx.sum_result / valvec->valvec_length;
+        length == 0 ? 0.0 : (double)ctx->sum_result / length;
     break;
   default:
     assert(0 && "Invalid type code");
   }
-
   return agg_result;
 }
+
+/**
+ * @implements cmdagg
+ */
+NumericValue cmdagg(GeneralizedValvec *valvec, GeneralizedPosvec *posvec,
+                    int type_code, DbSchemaStatus *status) {
+  ScanContext ctx = init_empty_scan_context();
+  int flag = _agg_scan_flag(type_code);
+
+  // Perform the actual scanning and aggregation; with a position vector, the
+  // values are aggregated as they are gathered
+  *status = posvec == NULL ? shared_scan(valvec, NULL, &ctx, flag)
+                           : shared_scan_gather(valvec, posvec, &ctx, flag);
+  if (*status != DB_SCHEMA_STATUS_OK) {
+    return (NumericValue){0};
+  }
+
+  // Post-processing
+  size_t length =
+      posvec == NULL ? valvec->valvec_length : posvec_length(posvec);
+  return _agg_result(&ctx, type_code, length);
+}
+
+/**
+ * @implements cmdagg_select
+ */
+NumericValue cmdagg_select(GeneralizedValvec *valvec,
+                           GeneralizedValvec *select_valvec, long lower_bound,
+                           long upper_bound, int type_code,
+                           DbSchemaStatus *status) {
+  // An indexed column is rather selected via its index, which can be much
+  // cheaper than a scan; the values at the selected positions are then
+  // aggregated as they are gathered in position order, so only the positions
+  // are materialized
+  if (select_valvec->valvec_type == GENERALIZED_VALVEC_TYPE_COLUMN &&
+      select_valvec->valvec_pointer.column->index_type !=
+          COLUMN_INDEX_TYPE_NONE) {
+    GeneralizedPosvec *posvec = cmdselect_index(
+        select_valvec->valvec_pointer.column, select_valvec->valvec_length,
+        NULL, lower_bound, upper_bound, true, status);
+    if (posvec == NULL) {
+      return (NumericValue){0};
+    }
+    NumericValue agg_result = cmdagg(valvec, posvec, type_code, status);
+    free_posvec_internals(posvec);
+    free(posvec);
+    return agg_result;
+  }
+
+  ScanContext ctx = init_empty_scan_context();
+  ctx.n_select_queries = 1;
+  ctx.lower_bound_arr = &lower_bound;
+  ctx.upper_bound_arr = &upper_bound;
+  int flag = _agg_scan_flag(type_code);
+
+  // Perform the select, fetch, and aggregation in a single scan
+  *status = shared_scan_fused(select_valvec, valvec, &ctx, flag);
+  if (*status != DB_SCHEMA_STATUS_OK) {
+    return (NumericValue){0};
+  }
+  return _agg_result(&ctx, type_code, ctx.count_result);
+}
@@ -19,24 +19,51 @@ DbSchemaStatus cmdbatch(GeneralizedValvec *valvec, GeneralizedPosvec *posvec,
   ctx.lower_bound_arr = lower_bound_arr;
   ctx.upper_bound_arr = upper_bound_arr;
 
+  // Decide per select query whether to output a boolean mask
+  BitVector *selected_masks_arr[n_select_queries + 1];
+  for (size_t i = 0; i < n_select_queries; i++) {
+    size_t mask_length = select_mask_length(
+        valvec, posvec, lower_bound_arr[i], upper_bound_arr[i]);
+    selected_masks_arr[i] = NULL;
+    if (mask_length > 0) {
+      selected_masks_arr[i] = bitvector_create(mask_length);
+      if (selected_masks_arr[i] == NULL) {
+        for (size_t j = 0; j < i; j++) {
+          bitvector_free(selected_masks_arr[j]);
+        }
+        return DB_SCHEMA_STATUS_ALLOC_FAILED;
+      }
+    }
+  }
+  ctx.selected_masks_arr = selected_masks_arr;
+
   DbSchemaStatus status = shared_scan(valvec, posvec, &ctx, flags);
   if (status != DB_SCHEMA_STATUS_OK) {
+    for (size_t i = 0; i < n_select_queries; i++) {
+      bitvector_free(selected_masks_arr[i]);
+    }
     return status;
   }
 
   // Process the results of select queries
   for (size_t i = 0; i < n_select_queries; i++) {
-    // Wrap the indices in a position vector
-    GeneralizedPosvec *new_posvec = wrap_index_array(
-        ctx.selected_indices_arr[i], ctx.n_selected_indices_arr[i], &status);
+    // Wrap the mask or the indices in a position vector
+    GeneralizedPosvec *new_posvec =
+        selected_masks_arr[i] != NULL
+            ? wrap_boolean_mask(selected_masks_arr[i],
+                                ctx.n_selected_indices_arr[i], &status)
+            : wrap_index_array(ctx.selected_indices_arr[i],
+                               ctx.n_selected_indices_arr[i], &status);
     if (new_posvec == NULL) {
       // Free all previously allocated memory
       for (size_t j = 0; j < i; j++) {
-        free(select_results[j]->posvec_pointer.index_array->indices);
-        free(select_results[j]->posvec_pointer.index_array);
+        free_posvec_internals(select_results[j]);
         free(select_results[j]);
       }
-      free(ctx.selected_indices_arr[i]);
+      for (size_t j = i; j < n_select_queries; j++) {
+        bitvector_free(selected_masks_arr[j]);
+        free(ctx.selected_indices_arr[j]);
+      }
       free(ctx.selected_indices_arr);
       free(ctx.n_selected_indices_arr);
       return status;
@@ -10,6 +10,7 @@
 #include "cindex.h"
 #include "cmdcreate.h"
 #include "io.h"
+#include "zonemap.h"
 
 /**
  * @implements cmdcreate_db
@@ -74,6 +75,7 @@ DbSchemaStatus cmdcreate_tbl(Db *db, char *name, size_t n_cols) {
   table.n_rows = 0;
   table.capacity = INIT_NUM_ROWS_IN_TABLE;
   table.primary = __SIZE_MAX__;
+  table.loader = NULL;
 
   // Check if the database needs to be resized to accommodate the new table
   if (db->n_tables >= db->capacity) {
@@ -122,6 +124,7 @@ DbSchemaStatus cmdcreate_col(Table *table, char *name) {
   column.index_type = COLUMN_INDEX_TYPE_NONE;
   column.index.sorter = NULL;
   column.index.tree = NULL;
+  column.index.tree_order = BPLUS_TREE_ORDER;
 
   // Create a mmap'ed file for the column data
   column.data =
@@ -130,6 +133,13 @@ DbSchemaStatus cmdcreate_col(Table *table, char *name) {
     return DB_SCHEMA_STATUS_ALLOC_FAILED;
   }
 
+  // Create the zone map of the column
+  DbSchemaStatus status = init_zone_map(table, &column, false);
+  if (status != DB_SCHEMA_STATUS_OK) {
+    munmap_column_file(column.data, table->capacity, column.fd);
+    return status;
+  }
+
   // Add the column to the table
   table->columns[table->n_inited_cols++] = column;
   return DB_SCHEMA_STATUS_OK;
@@ -139,7 +149,7 @@ DbSchemaStatus cmdcreate_col(Table *table, char *name) {
  * @implements cmdcreate_idx
  */
 DbSchemaStatus cmdcreate_idx(Table *table, size_t ith_column,
-                             ColumnIndexType type) {
+                             ColumnIndexType type, int tree_order) {
   // Check if the column already has an index
   Column *column = &table->columns[ith_column];
   if (column->index_type != COLUMN_INDEX_TYPE_NONE) {
@@ -156,5 +166,6 @@ DbSchemaStatus cmdcreate_idx(Table *table, size_t ith_column,
   }
 
   column->index_type = type;
+  column->index.tree_order = tree_order;
   return init_cindex(table, column, false);
 }
@@ -3,29 +3,19 @@
  * @implements cmddelete.h
  */
 
-#include <assert.h>
-
 #include "bitvector.h"
 #include "cindex.h"
 #include "cmddelete.h"
+#include "zonemap.h"
 
 /**
  * Helper function to delete from a column with no index.
+ *
+ * The removal mask is true for rows to be removed, which allows O(1) lookup of
+ * whether a row should be removed when iterating over the rows.
  */
 static inline DbSchemaStatus _delete_from_raw(Table *table, Column *column,
-                                              size_t *indices,
-                                              size_t n_indices) {
-  // Create a boolean mask that is true for rows to be removed; this will play
-  // the role of a hashset to allow O(1) lookup of whether a row should be
-  // removed when iterating over the rows
-  BitVector *removal_mask = bitvector_create(table->n_rows);
-  if (removal_mask == NULL) {
-    return DB_SCHEMA_STATUS_ALLOC_FAILED;
-  }
-  for (size_t i = 0; i < n_indices; i++) {
-    bitvector_set(removal_mask, indices[i]);
-  }
-
+                                              BitVector *removal_mask) {
   // Remove rows in-place using fast and slow pointers
   size_t slow = 0;
   for (size_t i = 0; i < table->n_rows; i++) {
@@ -33,35 +23,28 @@ static inline DbSchemaStatus _delete_from_raw(Table *table, Column *column,
       column->data[slow++] = column->data[i];
     }
   }
-
-  bitvector_free(removal_mask);
   return DB_SCHEMA_STATUS_OK;
 }
 
 /**
  * Helper function to delete from a column with an unclustered sorted index.
  */
-static inline DbSchemaStatus _delete_from_unclustered_sorted(Table *table,
-                                                             Column *column,
-                                                             size_t *indices,
-                                                             size_t n_indices) {
+static inline DbSchemaStatus
+_delete_from_unclustered_sorted(Table *table, Column *column,
+                                BitVector *removal_mask) {
   // Create an array that simulates a hashmap from old positions to new
-  // positions after removing the rows; first mark the rows to be removed by
-  // __SIZE_MAX__ (similar to the bitvector in _delete_from_raw)
-  size_t *old_to_new = calloc(table->n_rows, sizeof(size_t));
-  if (old_to_new == NULL) {
+  // positions after removing the rows
+  size_t *old_to_new = malloc(table->n_rows * sizeof(size_t));
+  if (old_to_new == NULL && table->n_rows > 0) {
     return DB_SCHEMA_STATUS_ALLOC_FAILED;
   }
-  for (size_t i = 0; i < n_indices; i++) {
-    old_to_new[indices[i]] = __SIZE_MAX__;
-  }
 
   // Remove rows in-place using fast and slow pointers; meanwhile update the
   // mapping; e.g., if we remove rows at index 1 and 3 from 6 rows, the mapping
-  // would become [0, __SIZE_MAX__, 1, __SIZE_MAX__, 2, 3]
+  // would become [0, (removed), 1, (removed), 2, 3]
   size_t slow = 0;
   for (size_t i = 0; i < table->n_rows; i++) {
-    if (old_to_new[i] != __SIZE_MAX__) {
+    if (!bitvector_test(removal_mask, i)) {
       column->data[slow] = column->data[i];
       old_to_new[i] = slow++;
     }
@@ -70,7 +53,7 @@ static inline DbSchemaStatus _delete_from_unclustered_sorted(Table *table,
   // Update the sorter
   slow = 0;
   for (size_t i = 0; i < table->n_rows; i++) {
-    if (old_to_new[i] != __SIZE_MAX__) {
+    if (!bitvector_test(removal_mask, column->index.sorter[i])) {
       column->index.sorter[slow++] = old_to_new[column->index.sorter[i]];
     }
   }
@@ -80,118 +63,171 @@ static inline DbSchemaStatus _delete_from_unclustered_sorted(Table *table,
 }
 
 /**
- * Helper function to delete from a column with an unclustered B+ tree index.
+ * Helper function to delete the entries of the removed rows from the B+ tree
+ * index of a column.
+ *
+ * This must be done before the column data is compacted, since the entries are
+ * located by their keys.
  */
-static inline DbSchemaStatus _delete_from_unclustered_btree(Table *table,
-                                                            Column *column,
-                                                            size_t *indices,
-                                                            size_t n_indices) {
-  DbSchemaStatus status =
-      _delete_from_unclustered_sorted(table, column, indices, n_indices);
-  if (status != DB_SCHEMA_STATUS_OK) {
-    return status;
+static inline DbSchemaStatus _delete_btree_entries(Column *column,
+                                                   BitVector *removal_mask) {
+  for (size_t pos = bitvector_next_set(removal_mask, 0);
+       pos < removal_mask->length;
+       pos = bitvector_next_set(removal_mask, pos + 1)) {
+    if (bplus_tree_delete(column->index.tree, column->data[pos], pos) == -1) {
+      return DB_SCHEMA_STATUS_INTERNAL_ERROR;
+    }
   }
+  return DB_SCHEMA_STATUS_OK;
+}
 
+/**
+ * Helper function to bring the B+ tree index of a column up to date after its
+ * data (and sorter, if any) have been compacted.
+ *
+ * If the entries of the removed rows have been deleted from the B+ tree, the
+ * positions of the remaining entries are compacted in place; otherwise the B+
+ * tree is rebuilt over the `n_rows` remaining rows.
+ */
+static inline DbSchemaStatus _compact_btree(Column *column,
+                                            BitVector *removal_mask,
+                                            size_t n_rows, bool maintained) {
+  if (maintained) {
+    return bplus_tree_compact_values(column->index.tree, removal_mask) == -1
+               ? DB_SCHEMA_STATUS_ALLOC_FAILED
+               : DB_SCHEMA_STATUS_OK;
+  }
   bplus_tree_free(column->index.tree);
-  return build_index_btree(column, table->n_rows);
+  return build_index_btree(column, n_rows);
 }
 
 /**
- * Helper function to delete from a column with a clustered sorted index.
+ * Helper function to delete from a column with an unclustered B+ tree index.
  */
 static inline DbSchemaStatus
-_delete_from_clustered_sorted(Table *table, size_t *indices, size_t n_indices) {
+_delete_from_unclustered_btree(Table *table, Column *column,
+                               BitVector *removal_mask, size_t n_removed) {
   DbSchemaStatus status;
-
-  // There is no difference from deleting rows with no index, since the given
-  // indices would also be with respect to sorted physical data
-  for (size_t i = 0; i < table->n_cols; i++) {
-    status = _delete_from_raw(table, &table->columns[i], indices, n_indices);
+  bool maintained = should_maintain_btree(table->n_rows, n_removed);
+  if (maintained) {
+    status = _delete_btree_entries(column, removal_mask);
     if (status != DB_SCHEMA_STATUS_OK) {
       return status;
     }
   }
 
-  table->n_rows -= n_indices;
-  return DB_SCHEMA_STATUS_OK;
+  status = _delete_from_unclustered_sorted(table, column, removal_mask);
+  if (status != DB_SCHEMA_STATUS_OK) {
+    return status;
+  }
+  return _compact_btree(column, removal_mask, table->n_rows - n_removed,
+                        maintained);
 }
 
 /**
  * Helper function to delete from a column with a clustered B+ tree index.
  */
 static inline DbSchemaStatus
-_delete_from_clustered_btree(Table *table, size_t *indices, size_t n_indices) {
-  DbSchemaStatus status =
-      _delete_from_clustered_sorted(table, indices, n_indices);
+_delete_from_clustered_btree(Table *table, Column *column,
+                             BitVector *removal_mask, size_t n_removed) {
+  DbSchemaStatus status;
+  bool maintained = should_maintain_btree(table->n_rows, n_removed);
+  if (maintained) {
+    status = _delete_btree_entries(column, removal_mask);
+    if (status != DB_SCHEMA_STATUS_OK) {
+      return status;
+    }
+  }
+
+  // The given positions are with respect to the sorted physical data, so
+  // removing them keeps the data sorted
+  status = _delete_from_raw(table, column, removal_mask);
   if (status != DB_SCHEMA_STATUS_OK) {
     return status;
   }
+  return _compact_btree(column, removal_mask, table->n_rows - n_removed,
+                        maintained);
+}
 
-  Column *column = &table->columns[table->primary];
-  bplus_tree_free(column->index.tree);
-  return build_index_btree(column, table->n_rows);
+/**
+ * Helper function to refresh the zone maps of all columns after deleting rows,
+ * where the rows before the first removed one are not shifted.
+ */
+static inline void _refresh_zone_maps(Table *table, BitVector *removal_mask) {
+  size_t first_removed = bitvector_next_set(removal_mask, 0);
+  for (size_t i = 0; i < table->n_cols; i++) {
+    refresh_zone_map(table, &table->columns[i], first_removed);
+  }
 }
 
 /**
- * @implements cmddelete
+ * Helper function to delete rows given by a removal mask.
+ *
+ * Removing rows keeps the remaining ones in the same order, so a clustered
+ * index stays sorted, and the positions in every index only need to be
+ * compacted rather than rebuilt.
  */
-DbSchemaStatus cmddelete(Table *table, GeneralizedPosvec *posvec) {
+static inline DbSchemaStatus _delete_rows(Table *table, BitVector *removal_mask,
+                                          size_t n_removed) {
   DbSchemaStatus status = DB_SCHEMA_STATUS_OK;
-  size_t *indices = posvec->posvec_pointer.index_array->indices;
-  size_t n_indices = posvec->posvec_pointer.index_array->n_indices;
-
-  // There is a clustered index in the table
-  if (table->primary != __SIZE_MAX__) {
-    switch (table->columns[table->primary].index_type) {
-    case COLUMN_INDEX_TYPE_NONE:
-      assert(0 && "Unreachable code");
-    case COLUMN_INDEX_TYPE_UNCLUSTERED_SORTED:
-      assert(0 && "Unreachable code");
-    case COLUMN_INDEX_TYPE_UNCLUSTERED_BTREE:
-      assert(0 && "Unreachable code");
-    case COLUMN_INDEX_TYPE_CLUSTERED_SORTED:
-      status = _delete_from_clustered_sorted(table, indices, n_indices);
-      break;
-    case COLUMN_INDEX_TYPE_CLUSTERED_BTREE:
-      status = _delete_from_clustered_btree(table, indices, n_indices);
-      break;
-    }
-    return status != DB_SCHEMA_STATUS_OK
-               ? status
-               : reconstruct_unclustered_indexes(table);
-  }
 
-  // There is no clustered index in the table
   for (size_t i = 0; i < table->n_cols; i++) {
     Column *column = &table->columns[i];
-    switch (table->columns[i].index_type) {
+    switch (column->index_type) {
     case COLUMN_INDEX_TYPE_NONE:
-      status = _delete_from_raw(table, column, indices, n_indices);
-      if (status != DB_SCHEMA_STATUS_OK) {
-        return status;
-      }
+    case COLUMN_INDEX_TYPE_CLUSTERED_SORTED:
+      status = _delete_from_raw(table, column, removal_mask);
       break;
     case COLUMN_INDEX_TYPE_UNCLUSTERED_SORTED:
-      status =
-          _delete_from_unclustered_sorted(table, column, indices, n_indices);
-      if (status != DB_SCHEMA_STATUS_OK) {
-        return status;
-      }
+      status = _delete_from_unclustered_sorted(table, column, removal_mask);
       break;
     case COLUMN_INDEX_TYPE_UNCLUSTERED_BTREE:
-      status =
-          _delete_from_unclustered_btree(table, column, indices, n_indices);
-      if (status != DB_SCHEMA_STATUS_OK) {
-        return status;
-      }
+      status = _delete_from_unclustered_btree(table, column, removal_mask,
+                                              n_removed);
       break;
-    case COLUMN_INDEX_TYPE_CLUSTERED_SORTED:
-      assert(0 && "Unreachable code");
     case COLUMN_INDEX_TYPE_CLUSTERED_BTREE:
-      assert(0 && "Unreachable code");
+      status =
+          _delete_from_clustered_btree(table, column, removal_mask, n_removed);
+      break;
+    }
+    if (status != DB_SCHEMA_STATUS_OK) {
+      return status;
     }
   }
 
-  table->n_rows -= n_indices;
+  table->n_rows -= n_removed;
+  _refresh_zone_maps(table, removal_mask);
   return maybe_shrink_table(table);
 }
+
+/**
+ * @implements cmddelete
+ */
+DbSchemaStatus cmddelete(Table *table, GeneralizedPosvec *posvec) {
+  // Removing rows would shift the rows that a load in progress stages past the
+  // last row, and may shrink the table under them
+  if (table->loader != NULL) {
+    return DB_SCHEMA_STATUS_TABLE_LOADING;
+  }
+
+  // A boolean mask can be used as the removal mask directly
+  if (posvec->posvec_type == GENERALIZED_POSVEC_TYPE_BOOLEAN_MASK) {
+    BooleanMask *boolean_mask = posvec->posvec_pointer.boolean_mask;
+    return _delete_rows(table, boolean_mask->mask, boolean_mask->n_set);
+  }
+
+  // Otherwise create the removal mask from the index array
+  size_t *indices = posvec->posvec_pointer.index_array->indices;
+  size_t n_indices = posvec->posvec_pointer.index_array->n_indices;
+  BitVector *removal_mask = bitvector_create(table->n_rows);
+  if (removal_mask == NULL) {
+    return DB_SCHEMA_STATUS_ALLOC_FAILED;
+  }
+  for (size_t i = 0; i < n_indices; i++) {
+    bitvector_set(removal_mask, indices[i]);
+  }
+
+  DbSchemaStatus status = _delete_rows(table, removal_mask, n_indices);
+  bitvector_free(removal_mask);
+  return status;
+}
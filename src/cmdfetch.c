@@ -3,29 +3,175 @@
  * @implements cmdfetch.h
  */
 
+#include <immintrin.h>
+#include <string.h>
+
 #include "cmdfetch.h"
+#include "consts.h"
+#include "sysinfo.h"
+#include "thread_pool.h"
+
+/**
+ * Helper function to gather the values at a range of entries of an index array
+ * 8 at a time with AVX2, prefetching up to `prefetch_end`.
+ *
+ * The range is processed in whole blocks of 8 and the position after the last
+ * block is returned, where the trailing entries are left to be fetched.
+ */
+TARGET_AVX2 static inline size_t
+_fetch_indices_avx2(const int *data, const size_t *indices, int *values,
+                    size_t start, size_t end, size_t prefetch_end) {
+  size_t i = start;
+  for (; i + 8 <= end; i += 8) {
+    for (size_t j = i; j < i + 8 && j < prefetch_end; j++) {
+      __builtin_prefetch(data + indices[j + FETCH_PREFETCH_DISTANCE]);
+    }
+    __m128i lower = _mm256_i64gather_epi32(
+        data, _mm256_loadu_si256((const __m256i *)(indices + i)), 4);
+    __m128i upper = _mm256_i64gather_epi32(
+        data, _mm256_loadu_si256((const __m256i *)(indices + i + 4)), 4);
+    _mm256_storeu_si256((__m256i *)(values + i),
+                        _mm256_set_m128i(upper, lower));
+  }
+  return i;
+}
+
+/**
+ * Helper function to fetch the values at a range of entries of an index array,
+ * writing them to the same range of the output.
+ *
+ * The values at the positions `FETCH_PREFETCH_DISTANCE` entries ahead are
+ * prefetched, since the positions are usually spread over a much larger column
+ * than the caches. With AVX2, the values are gathered 8 at a time.
+ */
+static inline void _fetch_indices(const int *data, const size_t *indices,
+                                  int *values, size_t start, size_t end) {
+  size_t i = start;
+  size_t prefetch_end =
+      end > FETCH_PREFETCH_DISTANCE ? end - FETCH_PREFETCH_DISTANCE : 0;
+  if (__has_avx2__) {
+    i = _fetch_indices_avx2(data, indices, values, start, end, prefetch_end);
+  }
+  for (; i < end; i++) {
+    if (i < prefetch_end) {
+      __builtin_prefetch(data + indices[i + FETCH_PREFETCH_DISTANCE]);
+    }
+    values[i] = data[indices[i]];
+  }
+}
+
+/**
+ * Helper function to fetch the values at the set bits of a range of a boolean
+ * mask, writing them contiguously to the output.
+ *
+ * The range must start at a multiple of 64 and end either at a multiple of 64
+ * or at the end of the mask, so that it consists of whole words. The mask is
+ * processed a word at a time, where fully set words are copied as a block.
+ */
+static inline void _fetch_mask(const int *data, const BitVector *mask,
+                               int *values, size_t start, size_t end) {
+  size_t n = 0;
+  for (size_t slot = _BITSLOT(start); slot < _BITNSLOTS(end); slot++) {
+    uint64_t word = mask->data[slot];
+    if (word == ~(uint64_t)0) {
+      memcpy(values + n, data + slot * 64, 64 * sizeof(int));
+      n += 64;
+      continue;
+    }
+    for (; word != 0; word &= word - 1) {
+      values[n++] = data[slot * 64 + __builtin_ctzll(word)];
+    }
+  }
+}
+
+/**
+ * @implements cmdfetch_chunk_subroutine
+ */
+void cmdfetch_chunk_subroutine(FetchChunkTaskData *task_data) {
+  if (task_data->mask != NULL) {
+    _fetch_mask(task_data->data, task_data->mask, task_data->values,
+                task_data->start, task_data->end);
+  } else {
+    _fetch_indices(task_data->data, task_data->indices, task_data->values,
+                   task_data->start, task_data->end);
+  }
+}
 
 /**
  * @implements cmdfetch
  */
 GeneralizedValvec *cmdfetch(GeneralizedValvec *valvec,
                             GeneralizedPosvec *posvec, DbSchemaStatus *status) {
+  if (__multi_threaded__ && __thread_pool__ == NULL) {
+    *status = DB_SCHEMA_STATUS_PARALLEL_NOT_INITIALIZED;
+    return NULL;
+  }
+
   int *data = valvec->valvec_type == GENERALIZED_VALVEC_TYPE_COLUMN
                   ? valvec->valvec_pointer.column->data
                   : valvec->valvec_pointer.partial_column->values;
 
   // Allocate memory for the values according to meta information stored in the
   // generalized position vector
-  size_t length = posvec->posvec_pointer.index_array->n_indices;
+  size_t length = posvec_length(posvec);
   int *values = malloc(length * sizeof(int));
   if (values == NULL) {
     *status = DB_SCHEMA_STATUS_ALLOC_FAILED;
     return NULL;
   }
 
-  // Fetch the values at the specified positions
-  for (size_t i = 0; i < length; i++) {
-    values[i] = data[posvec->posvec_pointer.index_array->indices[i]];
+  // Prepare the fetch over the entries of an index array or the bits of a
+  // boolean mask, split into chunks that run in parallel if there are enough
+  // positions; chunks of a boolean mask consist of whole words, and each starts
+  // writing at the number of set bits before it
+  BitVector *mask = posvec->posvec_type == GENERALIZED_POSVEC_TYPE_BOOLEAN_MASK
+                        ? posvec->posvec_pointer.boolean_mask->mask
+                        : NULL;
+  size_t n_positions = mask == NULL ? length : mask->length;
+  int n_tasks =
+      thread_pool_n_tasks(n_positions, MIN_NUM_VALUES_PER_VECTOR_TASK);
+  FetchChunkTaskData chunk_template = {
+      .data = data,
+      .indices = mask == NULL ? posvec->posvec_pointer.index_array->indices
+                              : NULL,
+      .mask = mask,
+      .values = values,
+      .start = 0,
+      .end = n_positions,
+  };
+  if (n_tasks == 1) {
+    cmdfetch_chunk_subroutine(&chunk_template);
+  } else {
+    FetchChunkTaskData *chunks = malloc(n_tasks * sizeof(FetchChunkTaskData));
+    if (chunks == NULL) {
+      free(values);
+      *status = DB_SCHEMA_STATUS_ALLOC_FAILED;
+      return NULL;
+    }
+    size_t rank = 0;
+    for (int i = 0; i < n_tasks; i++) {
+      chunks[i] = chunk_template;
+      chunks[i].start = n_positions * i / n_tasks;
+      chunks[i].end = n_positions * (i + 1) / n_tasks;
+      if (mask != NULL) {
+        chunks[i].start = chunks[i].start / 64 * 64;
+        if (i < n_tasks - 1) {
+          chunks[i].end = chunks[i].end / 64 * 64;
+        }
+        chunks[i].values = values + rank;
+        for (size_t slot = _BITSLOT(chunks[i].start);
+             slot < _BITNSLOTS(chunks[i].end); slot++) {
+          rank += __builtin_popcountll(mask->data[slot]);
+        }
+      }
+    }
+    ThreadTaskGroup group;
+    thread_task_group_init(&group);
+    thread_pool_enqueue_group(__thread_pool__, &group,
+                              THREAD_TASK_TYPE_FETCH_CHUNK, chunks,
+                              sizeof(FetchChunkTaskData), n_tasks);
+    thread_pool_wait_group(__thread_pool__, &group);
+    free(chunks);
   }
 
   // Wrap the values in a value vector
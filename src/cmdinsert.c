@@ -9,6 +9,7 @@
 #include "binsearch.h"
 #include "cindex.h"
 #include "cmdinsert.h"
+#include "zonemap.h"
 
 /**
  * Helper function to insert a row into the table at a specific position.
@@ -18,18 +19,23 @@ static inline void _insert_at(Table *table, size_t ind, int *values) {
     // If the insert position is the end of the table, we can directly append
     for (size_t i = 0; i < table->n_cols; i++) {
       table->columns[i].data[ind] = values[i];
+      widen_zone_map(&table->columns[i], ind, values[i]);
     }
     table->n_rows++;
     return;
   }
 
-  // Shift all rows after the insert position to the right by one
+  // Shift all rows after the insert position to the right by one, which shifts
+  // the zones after the insert position as well
   for (size_t i = 0; i < table->n_cols; i++) {
     memmove(table->columns[i].data + ind + 1, table->columns[i].data + ind,
             sizeof(int) * (table->n_rows - ind));
     table->columns[i].data[ind] = values[i];
   }
   table->n_rows++;
+  for (size_t i = 0; i < table->n_cols; i++) {
+    refresh_zone_map(table, &table->columns[i], ind);
+  }
 }
 
 /**
@@ -98,7 +104,9 @@ static inline DbSchemaStatus _insert_clustered_btree(Table *table,
   size_t ind = bplus_tree_search_cont(column->index.tree, value, false);
   _insert_at(table, ind, values);
 
-  // Insert the value into the B+ tree
+  // Insert the value into the B+ tree, after shifting the positions of the rows
+  // that have been shifted by the insertion
+  bplus_tree_shift_values(column->index.tree, ind);
   return bplus_tree_insert(column->index.tree, value, ind) == -1
              ? DB_SCHEMA_STATUS_INTERNAL_ERROR
              : DB_SCHEMA_STATUS_OK;
@@ -118,6 +126,11 @@ DbSchemaStatus cmdinsert(Table *table, int *values) {
     return DB_SCHEMA_STATUS_TABLE_NOT_FULL;
   }
 
+  // The new row would go where a load in progress stages its rows
+  if (table->loader != NULL) {
+    return DB_SCHEMA_STATUS_TABLE_LOADING;
+  }
+
   // Resize the table if necessary
   DbSchemaStatus expand_status = maybe_expand_table(table, 1);
   if (expand_status != DB_SCHEMA_STATUS_OK) {
@@ -151,6 +164,7 @@ DbSchemaStatus cmdinsert(Table *table, int *values) {
   for (size_t i = 0; i < table->n_cols; i++) {
     Column *column = &table->columns[i];
     column->data[table->n_rows] = values[i];
+    widen_zone_map(column, table->n_rows, values[i]);
 
     switch (column->index_type) {
     case COLUMN_INDEX_TYPE_NONE:
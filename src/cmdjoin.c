@@ -13,8 +13,10 @@
  * Helper macro to prepare the data for join operations.
  *
  * This extracts `datax`, `indicesx` and `sizex` from the given value and
- * position vectors, where `x=1,2`. This also declares `resultx` where `x=1,2`
- * and `count`, prepared for the join outputs.
+ * position vectors, where `x=1,2`. The join algorithms need random access to
+ * the positions, so boolean mask position vectors are converted into index
+ * arrays first. This also declares `resultx` where `x=1,2`, `count`, and
+ * `status`, prepared for the join outputs.
  */
 #define _PREPARE_DATA                                                          \
   int *data1 = valvec1->valvec_type == GENERALIZED_VALVEC_TYPE_COLUMN          \
@@ -23,10 +25,19 @@
   int *data2 = valvec2->valvec_type == GENERALIZED_VALVEC_TYPE_COLUMN          \
                    ? valvec2->valvec_pointer.column->data                      \
                    : valvec2->valvec_pointer.partial_column->values;           \
-  size_t *indices1 = posvec1->posvec_pointer.index_array->indices;             \
-  size_t *indices2 = posvec2->posvec_pointer.index_array->indices;             \
-  size_t size1 = posvec1->posvec_pointer.index_array->n_indices;               \
-  size_t size2 = posvec2->posvec_pointer.index_array->n_indices;               \
+  DbSchemaStatus status;                                                       \
+  IndexArray *index_array1 = posvec_to_index_array(posvec1, &status);          \
+  if (index_array1 == NULL) {                                                  \
+    return status;                                                             \
+  }                                                                            \
+  IndexArray *index_array2 = posvec_to_index_array(posvec2, &status);          \
+  if (index_array2 == NULL) {                                                  \
+    return status;                                                             \
+  }                                                                            \
+  size_t *indices1 = index_array1->indices;                                    \
+  size_t *indices2 = index_array2->indices;                                    \
+  size_t size1 = index_array1->n_indices;                                      \
+  size_t size2 = index_array2->n_indices;                                      \
   size_t *result1, *result2, count;
 
 /**
@@ -70,9 +81,8 @@ DbSchemaStatus cmdjoin_nested_loop(GeneralizedValvec *valvec1,
                                    GeneralizedPosvec **posvec_out1,
                                    GeneralizedPosvec **posvec_out2) {
   _PREPARE_DATA;
-  DbSchemaStatus status =
-      join_nested_loop(data1, data2, indices1, indices2, size1, size2, &result1,
-                       &result2, &count);
+  status = join_nested_loop(data1, data2, indices1, indices2, size1, size2,
+                            &result1, &result2, &count);
   if (status != DB_SCHEMA_STATUS_OK) {
     return status;
   }
@@ -89,9 +99,8 @@ DbSchemaStatus cmdjoin_naive_hash(GeneralizedValvec *valvec1,
                                   GeneralizedPosvec **posvec_out1,
                                   GeneralizedPosvec **posvec_out2) {
   _PREPARE_DATA;
-  DbSchemaStatus status =
-      join_naive_hash(data1, data2, indices1, indices2, size1, size2, &result1,
-                      &result2, &count);
+  status = join_naive_hash(data1, data2, indices1, indices2, size1, size2,
+                           &result1, &result2, &count);
   if (status != DB_SCHEMA_STATUS_OK) {
     return status;
   }
@@ -108,9 +117,8 @@ DbSchemaStatus cmdjoin_grace_hash(GeneralizedValvec *valvec1,
                                   GeneralizedPosvec **posvec_out1,
                                   GeneralizedPosvec **posvec_out2) {
   _PREPARE_DATA;
-  DbSchemaStatus status =
-      join_radix_hash(data1, data2, indices1, indices2, size1, size2, &result1,
-                      &result2, &count);
+  status = join_radix_hash(data1, data2, indices1, indices2, size1, size2,
+                           &result1, &result2, &count);
   if (status != DB_SCHEMA_STATUS_OK) {
     return status;
   }
@@ -127,7 +135,6 @@ cmdjoin_hash(GeneralizedValvec *valvec1, GeneralizedValvec *valvec2,
   _PREPARE_DATA;
 
   // Use naive-hash for small data sizes and grace-hash for large data sizes
-  DbSchemaStatus status;
   size_t msize = size1 > size2 ? size1 : size2;
   if (msize < NAIVE_GRACE_JOIN_THRESHOLD) {
     status = join_naive_hash(data1, data2, indices1, indices2, size1, size2,
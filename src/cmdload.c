@@ -9,7 +9,11 @@
 
 #include "cindex.h"
 #include "cmdload.h"
+#include "logging.h"
 #include "sort.h"
+#include "sysinfo.h"
+#include "thread_pool.h"
+#include "zonemap.h"
 
 /**
  * Helper to conclude loading of an unclustered sorted column.
@@ -22,16 +26,44 @@ _conclude_unclustered_sorted(Table *table, Column *column, size_t n_cumu_rows) {
 
 /**
  * Helper to conclude loading of an unclustered B+ tree column.
+ *
+ * The loaded rows are argsorted and inserted into the B+ tree as one sorted
+ * batch, before the sorted run is merged into the sorter, so that the existing
+ * part of the B+ tree is only touched where the new keys go. If the table was
+ * empty, the B+ tree is bulk loaded instead, which is cheaper.
  */
 static inline DbSchemaStatus
 _conclude_unclustered_btree(Table *table, Column *column, size_t n_cumu_rows) {
-  DbSchemaStatus status =
-      _conclude_unclustered_sorted(table, column, n_cumu_rows);
-  if (status != DB_SCHEMA_STATUS_OK) {
-    return status;
+  size_t n_old_rows = table->n_rows - n_cumu_rows;
+  if (n_old_rows == 0) {
+    DbSchemaStatus status =
+        _conclude_unclustered_sorted(table, column, n_cumu_rows);
+    if (status != DB_SCHEMA_STATUS_OK) {
+      return status;
+    }
+    bplus_tree_free(column->index.tree);
+    return build_index_btree(column, table->n_rows);
   }
-  bplus_tree_free(column->index.tree);
-  return build_index_btree(column, table->n_rows);
+
+  size_t *sorter = column->index.sorter;
+  fill_range(sorter, n_old_rows, table->n_rows);
+  if (aquicksort(column->data, sorter + n_old_rows, n_cumu_rows) != 0) {
+    return DB_SCHEMA_STATUS_INTERNAL_ERROR;
+  }
+
+  int insert_status = bplus_tree_insert_batch(
+      column->index.tree, column->data, sorter + n_old_rows, n_cumu_rows);
+  if (amerge(column->data, sorter, n_old_rows, n_cumu_rows) != 0) {
+    return DB_SCHEMA_STATUS_INTERNAL_ERROR;
+  }
+
+  // The B+ tree may hold only part of the loaded rows if the batch insertion
+  // failed, in which case it is rebuilt from the merged sorter
+  if (insert_status != 0) {
+    bplus_tree_free(column->index.tree);
+    return build_index_btree(column, table->n_rows);
+  }
+  return DB_SCHEMA_STATUS_OK;
 }
 
 /**
@@ -80,6 +112,9 @@ DbSchemaStatus cmdload_validate_header(char *header, size_t n_cols,
                                        Table **table) {
   // We need a tokenizer so that we can free the copied header later since
   // strsep destroys its input
+  if (n_cols == 0) {
+    return DB_SCHEMA_STATUS_CSV_INVALID_HEADER;
+  }
   char *header_copy = strdup(header);
   char *tokenizer = header_copy;
 
@@ -113,6 +148,10 @@ DbSchemaStatus cmdload_validate_header(char *header, size_t n_cols,
         free(header_copy);
         return DB_SCHEMA_STATUS_TABLE_NOT_FULL;
       }
+      if (current_table->loader != NULL) {
+        free(header_copy);
+        return DB_SCHEMA_STATUS_TABLE_LOADING;
+      }
       *table = current_table;
     } else {
       // This is not the first column, and we check if the column belongs to the
@@ -125,13 +164,20 @@ DbSchemaStatus cmdload_validate_header(char *header, size_t n_cols,
   }
 
   free(header_copy);
+
+  // The CSV must provide all columns of the table, otherwise the rows cannot be
+  // laid out as the table expects
+  if (n_cols != (*table)->n_cols) {
+    return DB_SCHEMA_STATUS_CSV_INVALID_HEADER;
+  }
   return DB_SCHEMA_STATUS_OK;
 }
 
 /**
  * @implements cmdload_rows
  */
-DbSchemaStatus cmdload_rows(Table *table, int *data, size_t n_rows) {
+DbSchemaStatus cmdload_rows(Table *table, int *data, size_t n_rows,
+                            size_t n_staged_rows) {
   if (table == NULL) {
     return DB_SCHEMA_STATUS_TABLE_NOT_EXIST;
   }
@@ -141,22 +187,18 @@ DbSchemaStatus cmdload_rows(Table *table, int *data, size_t n_rows) {
   if (table->n_inited_cols != table->n_cols) {
     return DB_SCHEMA_STATUS_TABLE_NOT_FULL;
   }
+  assert(table->n_rows + n_staged_rows + n_rows <= table->capacity &&
+         "Table is not expanded for the staged rows");
 
-  // Expand the table if necessary
-  DbSchemaStatus expand_status = maybe_expand_table(table, n_rows);
-  if (expand_status != DB_SCHEMA_STATUS_OK) {
-    return expand_status;
-  }
-
-  // Insert the rows into the table; we are not caring about column indexes
-  // here, because they will be dealt with when concluding the load command
+  // Scatter the rows into the columns past the last row; we are not caring
+  // about zone maps and column indexes here, because they will be dealt with
+  // when concluding the load command
+  size_t offset = table->n_rows + n_staged_rows;
   for (size_t i = 0; i < table->n_cols; i++) {
     for (size_t j = 0; j < n_rows; j++) {
-      table->columns[i].data[table->n_rows + j] = data[j * table->n_cols + i];
+      table->columns[i].data[offset + j] = data[j * table->n_cols + i];
     }
   }
-
-  table->n_rows += n_rows;
   return DB_SCHEMA_STATUS_OK;
 }
 
@@ -166,6 +208,13 @@ DbSchemaStatus cmdload_rows(Table *table, int *data, size_t n_rows) {
 DbSchemaStatus cmdload_conclude(Table *table, size_t n_cumu_rows) {
   DbSchemaStatus status = DB_SCHEMA_STATUS_OK;
 
+  // Make the staged rows part of the table
+  size_t old_n_rows = table->n_rows;
+  table->n_rows += n_cumu_rows;
+  for (size_t i = 0; i < table->n_cols; i++) {
+    refresh_zone_map(table, &table->columns[i], old_n_rows);
+  }
+
   // There is a clustered index in the table
   if (table->primary != __SIZE_MAX__) {
     switch (table->columns[table->primary].index_type) {
@@ -214,3 +263,171 @@ DbSchemaStatus cmdload_conclude(Table *table, size_t n_cumu_rows) {
 
   return DB_SCHEMA_STATUS_OK;
 }
+
+/**
+ * Helper function to count the rows in a range of a CSV file.
+ *
+ * Consistent with `parse_next_row`, empty lines are not counted as rows.
+ */
+static inline size_t _count_rows(char *start, char *end) {
+  size_t n_rows = 0;
+  while (start < end) {
+    char *newline = memchr(start, '\n', end - start);
+    if (newline == NULL) {
+      newline = end;
+    }
+    if (newline > start) {
+      n_rows++;
+    }
+    start = newline + 1;
+  }
+  return n_rows;
+}
+
+/**
+ * @implements cmdload_chunk_subroutine
+ */
+void cmdload_chunk_subroutine(LoadChunkTaskData *task_data) {
+  CSV *csv = task_data->csv;
+  if (task_data->is_counting) {
+    task_data->n_rows = _count_rows(csv->data + task_data->start,
+                                    csv->data + task_data->end);
+    return;
+  }
+
+  // Parse the chunk as if it were a CSV file on its own; the parser does not
+  // read past the end of the chunk because the chunk ends at a row boundary
+  CSV chunk = *csv;
+  chunk.offset = task_data->start;
+  chunk.size = task_data->end;
+
+  // Parse the rows one by one and scatter the values into the columns
+  Table *table = task_data->table;
+  int row[table->n_cols];
+  size_t n_rows = 0;
+  CSVParseStatus status;
+  while ((status = parse_next_row(&chunk, row)) == CSV_PARSE_STATUS_CONTINUE) {
+    if (n_rows == task_data->n_rows) {
+      task_data->is_failed = true; // More rows than counted
+      return;
+    }
+    size_t ith_row = task_data->row_offset + n_rows++;
+    for (size_t i = 0; i < table->n_cols; i++) {
+      table->columns[i].data[ith_row] = row[i];
+    }
+  }
+  task_data->is_failed =
+      status == CSV_PARSE_STATUS_ERROR || n_rows != task_data->n_rows;
+}
+
+/**
+ * Helper function to run load chunk tasks, in parallel if possible.
+ */
+static inline void _run_load_chunks(LoadChunkTaskData *chunks,
+                                    size_t n_chunks) {
+  if (n_chunks == 1) {
+    cmdload_chunk_subroutine(&chunks[0]);
+    return;
+  }
+
+  ThreadTaskGroup group;
+  thread_task_group_init(&group);
+  thread_pool_enqueue_group(__thread_pool__, &group,
+                            THREAD_TASK_TYPE_LOAD_CHUNK, chunks,
+                            sizeof(LoadChunkTaskData), (int)n_chunks);
+  thread_pool_wait_group(__thread_pool__, &group);
+}
+
+/**
+ * @implements cmdload_file
+ */
+DbSchemaStatus cmdload_file(char *path, size_t *n_rows) {
+  *n_rows = 0;
+  if (__multi_threaded__ && __thread_pool__ == NULL) {
+    return DB_SCHEMA_STATUS_PARALLEL_NOT_INITIALIZED;
+  }
+
+  CSV *csv = load_csv(path);
+  if (csv == NULL) {
+    return DB_SCHEMA_STATUS_CSV_OPEN_FAILED;
+  }
+  Table *table;
+  DbSchemaStatus status =
+      cmdload_validate_header(csv->header, csv->n_cols, &table);
+  if (status != DB_SCHEMA_STATUS_OK) {
+    close_csv(csv);
+    return status;
+  }
+
+  // Split the rows into chunks of at least a minimum size, one per worker plus
+  // one for the current thread which helps executing the tasks while waiting
+  size_t data_size = csv->size - csv->offset;
+  size_t min_chunk_size = MIN_NUM_PAGES_PER_LOAD_TASK * __page_size__;
+  size_t n_chunks = 1;
+  if (__multi_threaded__) {
+    n_chunks = __thread_pool__->n_workers + 1;
+    if (n_chunks > data_size / min_chunk_size) {
+      n_chunks = data_size / min_chunk_size;
+    }
+    if (n_chunks == 0) {
+      n_chunks = 1;
+    }
+  }
+  LoadChunkTaskData *chunks = calloc(n_chunks, sizeof(LoadChunkTaskData));
+  if (chunks == NULL) {
+    close_csv(csv);
+    return DB_SCHEMA_STATUS_ALLOC_FAILED;
+  }
+
+  // Each chunk boundary is moved forward to right after a newline so that no
+  // row is split across chunks
+  size_t start = csv->offset;
+  for (size_t i = 0; i < n_chunks; i++) {
+    size_t end = csv->size;
+    if (i < n_chunks - 1) {
+      end = csv->offset + data_size / n_chunks * (i + 1);
+      end = end < start ? start : end;
+      char *newline = memchr(csv->data + end, '\n', csv->size - end);
+      end = newline == NULL ? csv->size : (size_t)(newline - csv->data) + 1;
+    }
+    chunks[i].csv = csv;
+    chunks[i].start = start;
+    chunks[i].end = end;
+    chunks[i].is_counting = true;
+    chunks[i].table = table;
+    start = end;
+  }
+
+  // First pass: count the rows in each chunk to know where each chunk goes in
+  // the table, so that the table needs to be expanded only once
+  _run_load_chunks(chunks, n_chunks);
+  size_t total_rows = 0;
+  for (size_t i = 0; i < n_chunks; i++) {
+    chunks[i].is_counting = false;
+    chunks[i].row_offset = table->n_rows + total_rows;
+    total_rows += chunks[i].n_rows;
+  }
+  status = maybe_expand_table(table, total_rows);
+  if (status != DB_SCHEMA_STATUS_OK) {
+    free(chunks);
+    close_csv(csv);
+    return status;
+  }
+
+  // Second pass: parse the rows directly into the columns; the rows are only
+  // made visible (by concluding the load) if all chunks succeed
+  _run_load_chunks(chunks, n_chunks);
+  for (size_t i = 0; i < n_chunks; i++) {
+    if (chunks[i].is_failed) {
+      status = DB_SCHEMA_STATUS_CSV_INVALID_DATA;
+    }
+  }
+  free(chunks);
+  close_csv(csv);
+  if (status != DB_SCHEMA_STATUS_OK) {
+    return status;
+  }
+
+  *n_rows = total_rows;
+  return cmdload_conclude(table, total_rows);
+}
@@ -8,7 +8,9 @@
 #include "binsearch.h"
 #include "bptree.h"
 #include "cmdselect.h"
+#include "consts.h"
 #include "scan.h"
+#include "sort.h"
 
 /**
  * Helper function to select from a column with an unclustered sorted index.
@@ -144,6 +146,46 @@ _select_clustered_btree(Column *column, long lower_bound, long upper_bound,
   return DB_SCHEMA_STATUS_OK;
 }
 
+/**
+ * Helper function to wrap the positions selected via an unclustered index into
+ * a position vector in position order.
+ *
+ * If the positions are positions of the column itself and many of them are
+ * selected, they are materialized as a boolean mask of the column; otherwise
+ * they are radix sorted. The positions are freed if a boolean mask is created,
+ * and kept otherwise.
+ */
+static inline GeneralizedPosvec *
+_wrap_position_order(size_t *selected_indices, size_t n_selected_indices,
+                     size_t n_rows, bool column_positions,
+                     DbSchemaStatus *status) {
+  if (column_positions &&
+      n_selected_indices >= n_rows * BOOLEAN_MASK_MIN_SELECTIVITY) {
+    BitVector *mask = bitvector_create(n_rows);
+    if (mask == NULL) {
+      *status = DB_SCHEMA_STATUS_ALLOC_FAILED;
+      return NULL;
+    }
+    for (size_t i = 0; i < n_selected_indices; i++) {
+      bitvector_set(mask, selected_indices[i]);
+    }
+    GeneralizedPosvec *new_posvec =
+        wrap_boolean_mask(mask, n_selected_indices, status);
+    if (*status != DB_SCHEMA_STATUS_OK) {
+      bitvector_free(mask);
+      return NULL;
+    }
+    free(selected_indices);
+    return new_posvec;
+  }
+
+  if (radixsort(selected_indices, n_selected_indices) != 0) {
+    *status = DB_SCHEMA_STATUS_ALLOC_FAILED;
+    return NULL;
+  }
+  return wrap_index_array(selected_indices, n_selected_indices, status);
+}
+
 /**
  * @implements cmdselect_raw
  */
@@ -158,11 +200,38 @@ GeneralizedPosvec *cmdselect_raw(GeneralizedValvec *valvec,
   ctx.lower_bound_arr = lower_bound_arr;
   ctx.upper_bound_arr = upper_bound_arr;
 
+  // If many positions are expected to be selected, let the scan set them in a
+  // boolean mask directly
+  BitVector *selected_masks_arr[1] = {NULL};
+  size_t mask_length =
+      select_mask_length(valvec, posvec, lower_bound, upper_bound);
+  if (mask_length > 0) {
+    selected_masks_arr[0] = bitvector_create(mask_length);
+    if (selected_masks_arr[0] == NULL) {
+      *status = DB_SCHEMA_STATUS_ALLOC_FAILED;
+      return NULL;
+    }
+    ctx.selected_masks_arr = selected_masks_arr;
+  }
+
   *status = shared_scan(valvec, posvec, &ctx, SCAN_CALLBACK_SELECT_FLAG);
   if (*status != DB_SCHEMA_STATUS_OK) {
+    bitvector_free(selected_masks_arr[0]);
     return NULL;
   }
 
+  if (selected_masks_arr[0] != NULL) {
+    // Wrap the mask into a position vector
+    GeneralizedPosvec *new_posvec = wrap_boolean_mask(
+        selected_masks_arr[0], ctx.n_selected_indices_arr[0], status);
+    if (*status != DB_SCHEMA_STATUS_OK) {
+      bitvector_free(selected_masks_arr[0]);
+    }
+    free(ctx.selected_indices_arr);
+    free(ctx.n_selected_indices_arr);
+    return new_posvec;
+  }
+
   // Wrap the indices into a position vector
   GeneralizedPosvec *new_posvec = wrap_index_array(
       ctx.selected_indices_arr[0], ctx.n_selected_indices_arr[0], status);
@@ -182,10 +251,16 @@ GeneralizedPosvec *cmdselect_raw(GeneralizedValvec *valvec,
  */
 GeneralizedPosvec *cmdselect_index(Column *column, size_t n_rows,
                                    GeneralizedPosvec *posvec, long lower_bound,
-                                   long upper_bound, DbSchemaStatus *status) {
+                                   long upper_bound, bool position_order,
+                                   DbSchemaStatus *status) {
   size_t n_selected_indices = 0;
   size_t *selected_indices = NULL;
 
+  // Index lookups need random access to the positions
+  if (posvec != NULL && posvec_to_index_array(posvec, status) == NULL) {
+    return NULL;
+  }
+
   switch (column->index_type) {
   case COLUMN_INDEX_TYPE_NONE:
     assert(0 && "Invalid routine");
@@ -214,9 +289,16 @@ GeneralizedPosvec *cmdselect_index(Column *column, size_t n_rows,
     return NULL;
   }
 
-  // Wrap the indices into a position vector
+  // Wrap the indices into a position vector; those from an unclustered index
+  // are in value order, so they are reordered by position if requested
+  bool unclustered =
+      column->index_type == COLUMN_INDEX_TYPE_UNCLUSTERED_SORTED ||
+      column->index_type == COLUMN_INDEX_TYPE_UNCLUSTERED_BTREE;
   GeneralizedPosvec *new_posvec =
-      wrap_index_array(selected_indices, n_selected_indices, status);
+      position_order && unclustered
+          ? _wrap_position_order(selected_indices, n_selected_indices, n_rows,
+                                 posvec == NULL, status)
+          : wrap_index_array(selected_indices, n_selected_indices, status);
   if (*status != DB_SCHEMA_STATUS_OK) {
     free(selected_indices);
     return NULL;
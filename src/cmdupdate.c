@@ -4,22 +4,128 @@
  */
 
 #include <assert.h>
+#include <string.h>
 
+#include "binsearch.h"
 #include "cindex.h"
 #include "cmdupdate.h"
+#include "zonemap.h"
 
+/**
+ * Helper function to set the updated rows of a column to the new value.
+ */
+static inline void _set_values(Column *column, BitVector *update_mask,
+                               int value) {
+  for (size_t pos = bitvector_next_set(update_mask, 0);
+       pos < update_mask->length;
+       pos = bitvector_next_set(update_mask, pos + 1)) {
+    column->data[pos] = value;
+    widen_zone_map(column, pos, value);
+  }
+}
+
+/**
+ * Helper function to update the sorter of an unclustered index.
+ *
+ * The data of the updated rows must already hold the new value. The other rows
+ * keep their relative order, so the updated positions are dropped from the
+ * sorter in one pass and then inserted together where the new value belongs,
+ * instead of sorting the whole column again.
+ */
+static inline void _update_sorter(Table *table, Column *column,
+                                  BitVector *update_mask, int value) {
+  size_t *sorter = column->index.sorter;
+  size_t slow = 0;
+  for (size_t i = 0; i < table->n_rows; i++) {
+    if (!bitvector_test(update_mask, sorter[i])) {
+      sorter[slow++] = sorter[i];
+    }
+  }
+
+  size_t ind = abinsearch(column->data, value, sorter, slow, false);
+  memmove(sorter + ind + table->n_rows - slow, sorter + ind,
+          sizeof(size_t) * (slow - ind));
+  for (size_t pos = bitvector_next_set(update_mask, 0);
+       pos < update_mask->length;
+       pos = bitvector_next_set(update_mask, pos + 1)) {
+    sorter[ind++] = pos;
+  }
+}
+
+/**
+ * Helper function to update rows given by an update mask.
+ */
+static inline DbSchemaStatus _update_rows(Table *table, size_t ith_column,
+                                          BitVector *update_mask,
+                                          size_t n_updated, int value) {
+  Column *column = &table->columns[ith_column];
+
+  switch (column->index_type) {
+  case COLUMN_INDEX_TYPE_NONE:
+    _set_values(column, update_mask, value);
+    return DB_SCHEMA_STATUS_OK;
+  case COLUMN_INDEX_TYPE_UNCLUSTERED_SORTED:
+    _set_values(column, update_mask, value);
+    _update_sorter(table, column, update_mask, value);
+    return DB_SCHEMA_STATUS_OK;
+  case COLUMN_INDEX_TYPE_UNCLUSTERED_BTREE:
+    if (!should_maintain_btree(table->n_rows, n_updated)) {
+      _set_values(column, update_mask, value);
+      _update_sorter(table, column, update_mask, value);
+      bplus_tree_free(column->index.tree);
+      return build_index_btree(column, table->n_rows);
+    }
+
+    // Move the entries to the new key before the data is overwritten, since
+    // the entries are located by their old keys
+    for (size_t pos = bitvector_next_set(update_mask, 0);
+         pos < update_mask->length;
+         pos = bitvector_next_set(update_mask, pos + 1)) {
+      if (bplus_tree_update(column->index.tree, column->data[pos], value,
+                            pos) == -1) {
+        return DB_SCHEMA_STATUS_INTERNAL_ERROR;
+      }
+    }
+    _set_values(column, update_mask, value);
+    _update_sorter(table, column, update_mask, value);
+    return DB_SCHEMA_STATUS_OK;
+  case COLUMN_INDEX_TYPE_CLUSTERED_SORTED:
+  case COLUMN_INDEX_TYPE_CLUSTERED_BTREE:
+    // The update does not preserve the order that the whole table is sorted
+    // by, so the table is sorted again, which rebuilds all indexes
+    _set_values(column, update_mask, value);
+    free_cindex(column);
+    return init_cindex(table, column, false);
+  }
+
+  assert(0 && "Unreachable code");
+}
+
+/**
+ * @implements cmdupdate
+ */
 DbSchemaStatus cmdupdate(Table *table, size_t ith_column,
                          GeneralizedPosvec *posvec, int value) {
-  Column *column = &table->columns[ith_column];
+  // A boolean mask can be used as the update mask directly
+  if (posvec->posvec_type == GENERALIZED_POSVEC_TYPE_BOOLEAN_MASK) {
+    BooleanMask *boolean_mask = posvec->posvec_pointer.boolean_mask;
+    return _update_rows(table, ith_column, boolean_mask->mask,
+                        boolean_mask->n_set, value);
+  }
+
+  // Otherwise create the update mask from the index array
   size_t *indices = posvec->posvec_pointer.index_array->indices;
   size_t n_indices = posvec->posvec_pointer.index_array->n_indices;
-
+  BitVector *update_mask = bitvector_create(table->n_rows);
+  if (update_mask == NULL) {
+    return DB_SCHEMA_STATUS_ALLOC_FAILED;
+  }
   for (size_t i = 0; i < n_indices; i++) {
-    column->data[indices[i]] = value;
+    bitvector_set(update_mask, indices[i]);
   }
 
-  // Free the old index and reinitialize it; we cannot skip sorting for
-  // clustered indexes because our update does not preserve sorted data
-  free_cindex(column);
-  return init_cindex(table, column, false);
+  DbSchemaStatus status =
+      _update_rows(table, ith_column, update_mask, n_indices, value);
+  bitvector_free(update_mask);
+  return status;
 }
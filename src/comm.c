@@ -3,7 +3,17 @@
  * @implements comm.h
  */
 
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <semaphore.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
 
 #include "comm.h"
 #include "consts.h"
@@ -31,6 +41,87 @@ ssize_t recv_all(int socket, void *buf, size_t length) {
   return total_received;
 }
 
+/**
+ * @implements recv_available
+ */
+ssize_t recv_available(int socket, void *buf, size_t length, bool *closed) {
+  size_t total_received = 0;
+  *closed = false;
+
+  // Receive data in chunks until no more data is immediately available
+  ssize_t current_received;
+  while (total_received < length) {
+    size_t remaining = length - total_received;
+    size_t to_read = remaining > DEFAULT_SOCKET_BUFFER_SIZE
+                         ? DEFAULT_SOCKET_BUFFER_SIZE
+                         : remaining;
+    current_received =
+        recv(socket, (char *)buf + total_received, to_read, MSG_DONTWAIT);
+    if (current_received == 0) {
+      *closed = true;
+      break;
+    } else if (current_received < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        break; // No more data for now
+      } else if (errno == EINTR) {
+        continue;
+      }
+      return -1;
+    }
+    total_received += current_received;
+  }
+
+  return total_received;
+}
+
+/**
+ * @implements recv_available_fd
+ */
+ssize_t recv_available_fd(int socket, void *buf, size_t length, bool *closed,
+                          int *fd) {
+  *closed = false;
+  if (length == 0) {
+    return 0;
+  }
+
+  // The file descriptor is attached to the first byte of the data it is sent
+  // with, so it is enough to look for it in the first receive call and let
+  // recv_available take care of the rest
+  char control[CMSG_SPACE(sizeof(int))];
+  struct iovec segment = {.iov_base = buf, .iov_len = length};
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(struct msghdr));
+  msg.msg_iov = &segment;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+
+  ssize_t received;
+  do {
+    received = recvmsg(socket, &msg, MSG_DONTWAIT | MSG_CMSG_CLOEXEC);
+  } while (received < 0 && errno == EINTR);
+  if (received == 0) {
+    *closed = true;
+    return 0;
+  } else if (received < 0) {
+    return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+  }
+
+  for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL;
+       cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+    if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+      if (*fd >= 0) {
+        close(*fd);
+      }
+      memcpy(fd, CMSG_DATA(cmsg), sizeof(int));
+    }
+  }
+
+  ssize_t rest =
+      recv_available(socket, (char *)buf + received, length - received, closed);
+  return rest < 0 ? rest : received + rest;
+}
+
 /**
  * @implements send_all
  */
@@ -44,12 +135,437 @@ ssize_t send_all(int socket, void *buf, size_t length) {
     size_t to_send = remaining > DEFAULT_SOCKET_BUFFER_SIZE
                          ? DEFAULT_SOCKET_BUFFER_SIZE
                          : remaining;
-    current_sent = send(socket, (char *)buf + total_sent, to_send, 0);
+    current_sent =
+        send(socket, (char *)buf + total_sent, to_send, MSG_NOSIGNAL);
+    if (current_sent < 0) {
+      return current_sent; // Error
+    }
+    total_sent += current_sent;
+  }
+
+  return total_sent;
+}
+
+/**
+ * Helper function to skip the sent data in multiple segments.
+ *
+ * The segments that are completely sent are emptied and skipped, and the first
+ * segment that is partially sent, if any, is advanced.
+ */
+static inline void _skip_sent_segments(struct iovec **segments, int *n_segments,
+                                       size_t sent) {
+  while (*n_segments > 0 && sent >= (*segments)->iov_len) {
+    sent -= (*segments)->iov_len;
+    (*segments)->iov_len = 0;
+    (*segments)++;
+    (*n_segments)--;
+  }
+  if (*n_segments > 0) {
+    (*segments)->iov_base = (char *)(*segments)->iov_base + sent;
+    (*segments)->iov_len -= sent;
+  }
+}
+
+/**
+ * @implements sendv_all
+ */
+ssize_t sendv_all(int socket, struct iovec *segments, int n_segments) {
+  size_t total_sent = 0;
+
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(struct msghdr));
+  ssize_t current_sent;
+  while (n_segments > 0) {
+    msg.msg_iov = segments;
+    msg.msg_iovlen = n_segments > IOV_MAX ? IOV_MAX : n_segments;
+    // Do not raise SIGPIPE if the peer has gone away, e.g., a client that
+    // closes its connection with pipelined responses still pending; the error
+    // is reported through the return value instead
+    current_sent = sendmsg(socket, &msg, MSG_NOSIGNAL);
     if (current_sent < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
       return current_sent; // Error
     }
     total_sent += current_sent;
+    _skip_sent_segments(&segments, &n_segments, current_sent);
   }
 
   return total_sent;
 }
+
+/**
+ * @implements sendv_available
+ */
+ssize_t sendv_available(int socket, struct iovec *segments, int n_segments) {
+  size_t total_sent = 0;
+
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(struct msghdr));
+  ssize_t current_sent;
+  while (n_segments > 0) {
+    msg.msg_iov = segments;
+    msg.msg_iovlen = n_segments > IOV_MAX ? IOV_MAX : n_segments;
+    current_sent = sendmsg(socket, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (current_sent < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        break; // The socket cannot take more for now
+      } else if (errno == EINTR) {
+        continue;
+      }
+      return current_sent; // Error
+    }
+    total_sent += current_sent;
+    _skip_sent_segments(&segments, &n_segments, current_sent);
+  }
+
+  return total_sent;
+}
+
+/**
+ * @implements send_message_all
+ */
+ssize_t send_message_all(int socket, Message *message) {
+  ssize_t sent;
+  if (message->n_segments > 0) {
+    // Gather the header and all payload segments
+    struct iovec segments[message->n_segments + 1];
+    segments[0].iov_base = message;
+    segments[0].iov_len = sizeof(Message);
+    memcpy(segments + 1, message->segments,
+           message->n_segments * sizeof(struct iovec));
+    sent = sendv_all(socket, segments, message->n_segments + 1);
+    free(message->segments);
+  } else {
+    // Gather the header and the payload buffer, if any
+    struct iovec segments[2] = {
+        {.iov_base = message, .iov_len = sizeof(Message)},
+        {.iov_base = message->payload, .iov_len = message->length},
+    };
+    sent = sendv_all(socket, segments, message->length > 0 ? 2 : 1);
+  }
+
+  if (message->is_malloced) {
+    free(message->payload);
+  }
+  return sent;
+}
+
+/**
+ * @implements send_message_fd
+ */
+ssize_t send_message_fd(int socket, Message *message, int fd) {
+  char control[CMSG_SPACE(sizeof(int))];
+  memset(control, 0, sizeof(control));
+  struct iovec segment = {.iov_base = message, .iov_len = sizeof(Message)};
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(struct msghdr));
+  msg.msg_iov = &segment;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+
+  struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+  memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+
+  // The file descriptor must go out with the first byte of the header, so send
+  // that with sendmsg and leave whatever is left of the header to send_all
+  ssize_t sent;
+  do {
+    sent = sendmsg(socket, &msg, MSG_NOSIGNAL);
+  } while (sent < 0 && errno == EINTR);
+  if (sent < 0) {
+    return sent;
+  }
+  if ((size_t)sent < sizeof(Message)) {
+    ssize_t rest = send_all(socket, (char *)message + sent,
+                            sizeof(Message) - sent);
+    if (rest < 0) {
+      return rest;
+    }
+    sent += rest;
+  }
+  return sent;
+}
+
+/**
+ * Indices of the two rings in a shared memory channel.
+ */
+#define SHARED_RING_TO_SERVER 0
+#define SHARED_RING_TO_CLIENT 1
+
+/**
+ * The header of the memory region of a shared memory channel.
+ *
+ * The header is followed by the slots of the ring to the server and then the
+ * slots of the ring to the client, starting at a cache-line-aligned offset.
+ * Each ring is guarded by a pair of process-shared semaphores counting its free
+ * and filled slots; since each ring has exactly one producer and one consumer,
+ * both sides can walk the ring with a private index and no further locking.
+ */
+struct SharedRegion {
+  size_t n_slots;
+  size_t slot_size;
+  sem_t n_free[2];
+  sem_t n_filled[2];
+};
+
+/**
+ * Helper function to get the offset of the slots in a shared memory region.
+ */
+static inline size_t _shared_region_data_offset() {
+  return (sizeof(struct SharedRegion) + 63) & ~(size_t)63;
+}
+
+/**
+ * Helper function to get a slot in one of the rings of a shared memory channel.
+ */
+static inline char *_shared_slot(SharedChannel *channel, int ring,
+                                 size_t slot) {
+  return (char *)channel->region + _shared_region_data_offset() +
+         (ring * channel->n_slots + slot) * channel->slot_size;
+}
+
+/**
+ * Helper function to wait on a semaphore of a shared memory channel.
+ *
+ * The wait is done in intervals, checking in between whether the peer is still
+ * connected to the socket, so that a peer that has crashed or disconnected
+ * midway through a payload does not leave this process waiting forever. This
+ * returns true if the semaphore is acquired, and false otherwise.
+ */
+static inline bool _shared_wait(int socket, sem_t *sem) {
+  while (true) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_nsec += SHARED_CHANNEL_POLL_INTERVAL * 1000000L;
+    deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+    deadline.tv_nsec %= 1000000000L;
+    if (sem_timedwait(sem, &deadline) == 0) {
+      return true;
+    } else if (errno == EINTR) {
+      continue;
+    } else if (errno != ETIMEDOUT) {
+      return false;
+    }
+
+    struct pollfd pfd = {.fd = socket, .events = POLLRDHUP, .revents = 0};
+    if (poll(&pfd, 1, 0) < 0 && errno != EINTR) {
+      return false;
+    }
+    if (pfd.revents & (POLLRDHUP | POLLHUP | POLLERR | POLLNVAL)) {
+      return false;
+    }
+  }
+}
+
+/**
+ * Helper function to map a shared memory region into a channel.
+ */
+static inline SharedChannel *_shared_channel_map(int fd, size_t size,
+                                                 bool is_server) {
+  SharedChannel *channel = malloc(sizeof(SharedChannel));
+  if (channel == NULL) {
+    return NULL;
+  }
+  void *region =
+      mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (region == MAP_FAILED) {
+    free(channel);
+    return NULL;
+  }
+  channel->region = region;
+  channel->size = size;
+  channel->n_slots = 0;
+  channel->slot_size = 0;
+  channel->is_server = is_server;
+  channel->next_send_slot = 0;
+  channel->next_recv_slot = 0;
+  return channel;
+}
+
+/**
+ * @implements shared_channel_create
+ */
+SharedChannel *shared_channel_create(int *fd) {
+  size_t size = _shared_region_data_offset() +
+                2 * SHARED_CHANNEL_N_SLOTS * SHARED_CHANNEL_SLOT_SIZE;
+  *fd = memfd_create("shared_channel", MFD_CLOEXEC);
+  if (*fd < 0) {
+    return NULL;
+  }
+  if (ftruncate(*fd, size) < 0) {
+    close(*fd);
+    *fd = -1;
+    return NULL;
+  }
+  SharedChannel *channel = _shared_channel_map(*fd, size, false);
+  if (channel == NULL) {
+    close(*fd);
+    *fd = -1;
+    return NULL;
+  }
+
+  struct SharedRegion *region = channel->region;
+  region->n_slots = SHARED_CHANNEL_N_SLOTS;
+  region->slot_size = SHARED_CHANNEL_SLOT_SIZE;
+  channel->n_slots = SHARED_CHANNEL_N_SLOTS;
+  channel->slot_size = SHARED_CHANNEL_SLOT_SIZE;
+  for (int ring = 0; ring < 2; ring++) {
+    sem_init(&region->n_free[ring], 1, SHARED_CHANNEL_N_SLOTS);
+    sem_init(&region->n_filled[ring], 1, 0);
+  }
+  return channel;
+}
+
+/**
+ * @implements shared_channel_attach
+ */
+SharedChannel *shared_channel_attach(int fd) {
+  struct stat st;
+  if (fstat(fd, &st) < 0 ||
+      (size_t)st.st_size < _shared_region_data_offset()) {
+    return NULL;
+  }
+  SharedChannel *channel = _shared_channel_map(fd, st.st_size, true);
+  if (channel == NULL) {
+    return NULL;
+  }
+
+  // The region is set up by the client, which can keep writing to it, so read
+  // the geometry of the rings exactly once, make sure that the rings actually
+  // fit in the region, and use only this copy from now on
+  volatile struct SharedRegion *region = channel->region;
+  size_t n_slots = region->n_slots;
+  size_t slot_size = region->slot_size;
+  size_t data_size = channel->size - _shared_region_data_offset();
+  if (n_slots == 0 || slot_size == 0 || n_slots > data_size / 2 / slot_size) {
+    shared_channel_close(channel);
+    return NULL;
+  }
+  channel->n_slots = n_slots;
+  channel->slot_size = slot_size;
+  return channel;
+}
+
+/**
+ * @implements shared_channel_close
+ */
+void shared_channel_close(SharedChannel *channel) {
+  if (channel == NULL) {
+    return;
+  }
+  munmap(channel->region, channel->size);
+  free(channel);
+}
+
+/**
+ * Helper function to copy data into the sending ring of a shared memory
+ * channel, filling up the slots one by one.
+ */
+static inline bool _shared_send(int socket, SharedChannel *channel, void *buf,
+                                size_t length, size_t *slot_offset) {
+  struct SharedRegion *region = channel->region;
+  int ring = channel->is_server ? SHARED_RING_TO_CLIENT : SHARED_RING_TO_SERVER;
+
+  while (length > 0) {
+    if (*slot_offset == 0 && !_shared_wait(socket, &region->n_free[ring])) {
+      return false;
+    }
+    size_t to_copy = channel->slot_size - *slot_offset;
+    to_copy = to_copy > length ? length : to_copy;
+    memcpy(_shared_slot(channel, ring, channel->next_send_slot) + *slot_offset,
+           buf, to_copy);
+    buf = (char *)buf + to_copy;
+    length -= to_copy;
+    *slot_offset += to_copy;
+
+    // Hand the slot over to the peer as soon as it is full
+    if (*slot_offset == channel->slot_size) {
+      sem_post(&region->n_filled[ring]);
+      channel->next_send_slot =
+          (channel->next_send_slot + 1) % channel->n_slots;
+      *slot_offset = 0;
+    }
+  }
+  return true;
+}
+
+/**
+ * @implements send_message_shared
+ */
+ssize_t send_message_shared(int socket, SharedChannel *channel,
+                            Message *message) {
+  if (channel == NULL || message->length < SHARED_CHANNEL_MIN_PAYLOAD_SIZE) {
+    return send_message_all(socket, message);
+  }
+
+  // The header goes through the socket to keep the order of the messages, and
+  // tells the peer to pick up the payload from the channel
+  message->is_shared = true;
+  ssize_t sent = send_all(socket, message, sizeof(Message));
+  if (sent >= 0) {
+    // The payload segments are packed back to back into the slots, so the peer
+    // sees one contiguous payload just as with the socket
+    size_t slot_offset = 0;
+    bool ok = true;
+    if (message->n_segments > 0) {
+      for (int i = 0; ok && i < message->n_segments; i++) {
+        ok = _shared_send(socket, channel, message->segments[i].iov_base,
+                          message->segments[i].iov_len, &slot_offset);
+      }
+    } else {
+      ok = _shared_send(socket, channel, message->payload, message->length,
+                        &slot_offset);
+    }
+
+    // Hand over the last slot, which is partially filled
+    if (ok && slot_offset > 0) {
+      struct SharedRegion *region = channel->region;
+      int ring =
+          channel->is_server ? SHARED_RING_TO_CLIENT : SHARED_RING_TO_SERVER;
+      sem_post(&region->n_filled[ring]);
+      channel->next_send_slot =
+          (channel->next_send_slot + 1) % channel->n_slots;
+    }
+    sent = ok ? sent + message->length : -1;
+  }
+
+  if (message->n_segments > 0) {
+    free(message->segments);
+  }
+  if (message->is_malloced) {
+    free(message->payload);
+  }
+  return sent;
+}
+
+/**
+ * @implements recv_shared_payload
+ */
+ssize_t recv_shared_payload(int socket, SharedChannel *channel, void *buf,
+                            size_t length) {
+  struct SharedRegion *region = channel->region;
+  int ring = channel->is_server ? SHARED_RING_TO_SERVER : SHARED_RING_TO_CLIENT;
+
+  size_t total_received = 0;
+  while (total_received < length) {
+    if (!_shared_wait(socket, &region->n_filled[ring])) {
+      return -1;
+    }
+    size_t remaining = length - total_received;
+    size_t to_copy =
+        remaining > channel->slot_size ? channel->slot_size : remaining;
+    memcpy((char *)buf + total_received,
+           _shared_slot(channel, ring, channel->next_recv_slot), to_copy);
+    total_received += to_copy;
+    sem_post(&region->n_free[ring]);
+    channel->next_recv_slot =
+        (channel->next_recv_slot + 1) % channel->n_slots;
+  }
+  return total_received;
+}
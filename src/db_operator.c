@@ -24,23 +24,6 @@
 #include "db_operator.h"
 #include "logging.h"
 
-/**
- * Helper function to free a value vector handle if it wraps a column.
- *
- * This function is used to free a generalized value vector handle if it
- * internally wraps a column. This is because such handles are only for
- * temporary use. The wrapped column belongs to the database and will be freed
- * upon database destruction, but such a handle itself does not belong to either
- * the client context or the database, so it should be freed manually somewhere.
- */
-static inline void
-_free_if_wraps_column(GeneralizedValvecHandle *valvec_handle) {
-  if (valvec_handle->generalized_valvec.valvec_type ==
-      GENERALIZED_VALVEC_TYPE_COLUMN) {
-    free(valvec_handle);
-  }
-}
-
 /**
  * Free the operators wrapped in a batch operator.
  */
@@ -73,8 +56,8 @@ static inline void execute_addsub(DbOperator *query, Message *send_message) {
   // because what we are inserting and what we are freeing are the same type of
   // handles (i.e., value vector handles) while insertion may reallocate memory
   // that leads to invalid read of the handles stored in the operator
-  _free_if_wraps_column(op.valvec_handle1);
-  _free_if_wraps_column(op.valvec_handle2);
+  free_if_wraps_column(op.valvec_handle1);
+  free_if_wraps_column(op.valvec_handle2);
 
   // Insert the value vector into the client context
   DbSchemaStatus insert_status =
@@ -125,9 +108,26 @@ static inline void execute_agg(DbOperator *query, Message *send_message) {
   // Aggregate and get the resulting numeric value (and position vector, if
   // applicable)
   DbSchemaStatus agg_status;
-  NumericValue result =
-      cmdagg(&op.valvec_handle->generalized_valvec, type_code, &agg_status);
-  _free_if_wraps_column(op.valvec_handle);
+  NumericValue result;
+  if (op.select_valvec_handle != NULL) {
+    result = cmdagg_select(&op.valvec_handle->generalized_valvec,
+                           &op.select_valvec_handle->generalized_valvec,
+                           op.lower_bound, op.upper_bound, type_code,
+                           &agg_status);
+    free_if_wraps_column(op.select_valvec_handle);
+  } else {
+    result = cmdagg(
+        &op.valvec_handle->generalized_valvec,
+        op.posvec_handle == NULL ? NULL : &op.posvec_handle->generalized_posvec,
+        type_code, &agg_status);
+  }
+  free_if_wraps_column(op.valvec_handle);
+  if (agg_status != DB_SCHEMA_STATUS_OK) {
+    send_message->status = MESSAGE_STATUS_EXECUTION_ERROR;
+    send_message->payload = format_status(agg_status);
+    send_message->length = strlen(send_message->payload);
+    return;
+  }
 
   // Insert the numeric value into the client context
   DbSchemaStatus insert_status =
@@ -203,10 +203,10 @@ static inline void execute_batch(DbOperator *query, Message *send_message) {
                select_results, &min_result, &max_result, &sum_result);
 
   for (size_t i = 0; i < op.n_select_ops; i++) {
-    _free_if_wraps_column(select_ops[i]->fields.select.valvec_handle);
+    free_if_wraps_column(select_ops[i]->fields.select.valvec_handle);
   }
   for (size_t i = 0; i < op.n_agg_ops; i++) {
-    _free_if_wraps_column(agg_ops[i]->fields.agg.valvec_handle);
+    free_if_wraps_column(agg_ops[i]->fields.agg.valvec_handle);
   }
 
   if (status != DB_SCHEMA_STATUS_OK) {
@@ -325,7 +325,8 @@ static inline void execute_create(DbOperator *query, Message *send_message) {
   case CREATE_TYPE_INDEX:
     status = cmdcreate_idx(query->fields.create.spec.idx.table,
                            query->fields.create.spec.idx.ith_column,
-                           query->fields.create.spec.idx.index_type);
+                           query->fields.create.spec.idx.index_type,
+                           query->fields.create.spec.idx.tree_order);
     if (status == DB_SCHEMA_STATUS_OK) {
       log_file(stdout, "  [OK] Index created.\n");
     } else {
@@ -375,7 +376,7 @@ static inline void execute_fetch(DbOperator *query, Message *send_message) {
     send_message->length = strlen(send_message->payload);
     return;
   }
-  _free_if_wraps_column(op.valvec_handle);
+  free_if_wraps_column(op.valvec_handle);
 
   // Insert the value vector into the client context
   DbSchemaStatus insert_status =
@@ -472,8 +473,8 @@ static inline void execute_join(DbOperator *query, Message *send_message) {
     return;
   }
 
-  _free_if_wraps_column(query->fields.join.valvec_handle1);
-  _free_if_wraps_column(query->fields.join.valvec_handle2);
+  free_if_wraps_column(query->fields.join.valvec_handle1);
+  free_if_wraps_column(query->fields.join.valvec_handle2);
 }
 
 /**
@@ -485,9 +486,9 @@ static inline void execute_join(DbOperator *query, Message *send_message) {
 static inline void execute_load(DbOperator *query, Message *send_message) {
   DbSchemaStatus status =
       cmdload_rows(query->fields.load.table, query->fields.load.data,
-                   query->fields.load.n_rows);
+                   query->fields.load.n_rows, query->fields.load.n_staged_rows);
   if (status == DB_SCHEMA_STATUS_OK) {
-    log_file(stdout, "  [OK] %zu rows of CSV data loaded.\n",
+    log_file(stdout, "  [OK] %zu rows of CSV data staged.\n",
              query->fields.load.n_rows);
   } else {
     send_message->status = MESSAGE_STATUS_EXECUTION_ERROR;
@@ -497,6 +498,25 @@ static inline void execute_load(DbOperator *query, Message *send_message) {
   }
 }
 
+/**
+ * Execute a load file DbOperator.
+ */
+static inline void execute_load_file(DbOperator *query,
+                                     Message *send_message) {
+  size_t n_rows;
+  DbSchemaStatus status = cmdload_file(query->fields.load_file.path, &n_rows);
+  if (status == DB_SCHEMA_STATUS_OK) {
+    log_file(stdout, "  [OK] %zu rows of CSV data loaded from %s.\n", n_rows,
+             query->fields.load_file.path);
+  } else {
+    send_message->status = MESSAGE_STATUS_EXECUTION_ERROR;
+    send_message->payload = format_status(status);
+    send_message->length = strlen(send_message->payload);
+    log_file(stdout, "  [ERR] %s\n", send_message->payload);
+  }
+  free(query->fields.load_file.path);
+}
+
 /**
  * Execute a print DbOperator.
  */
@@ -504,26 +524,33 @@ static inline void execute_print(DbOperator *query, Message *send_message) {
   DbSchemaStatus status;
   size_t output_len;
   char *output;
+  struct iovec *segments = NULL;
+  int n_segments = 0;
 
   if (query->fields.print.is_numval) {
     output = cmdprint_vals(query->fields.print.numval_handles,
                            query->fields.print.n_handles, &output_len, &status);
     free(query->fields.print.numval_handles);
   } else {
+    // Note that freeing the handles that wrap columns does not free the column
+    // data that the segments refer to
     output = cmdprint_vecs(query->fields.print.valvec_handles,
-                           query->fields.print.n_handles, &output_len, &status);
+                           query->fields.print.n_handles, &output_len,
+                           &segments, &n_segments, &status);
     for (size_t i = 0; i < query->fields.print.n_handles; i++) {
-      _free_if_wraps_column(query->fields.print.valvec_handles[i]);
+      free_if_wraps_column(query->fields.print.valvec_handles[i]);
     }
     free(query->fields.print.valvec_handles);
   }
 
   if (status == DB_SCHEMA_STATUS_OK) {
-    send_message->status = MESSAGE_STATUS_OK;
+    send_message->status = MESSAGE_STATUS_OK_COLUMNAR;
     send_message->payload = output;
     send_message->length = output_len;
     send_message->is_malloced = true;
-    log_file(stdout, "  [OK] Formatted print output.\n", output);
+    send_message->segments = segments;
+    send_message->n_segments = n_segments;
+    log_file(stdout, "  [OK] Serialized columnar print output.\n");
   } else {
     send_message->status = MESSAGE_STATUS_EXECUTION_ERROR;
     send_message->payload = format_status(status);
@@ -548,11 +575,14 @@ static inline void execute_select(DbOperator *query, Message *send_message) {
           GENERALIZED_VALVEC_TYPE_COLUMN &&
       op.valvec_handle->generalized_valvec.valvec_pointer.column->index_type !=
           COLUMN_INDEX_TYPE_NONE) {
+    // The selected positions only ever feed consumers that do not depend on
+    // their order (fetch, aggregates, updates, deletes, and joins), so they
+    // are always put in position order for sequential access
     posvec = cmdselect_index(
         op.valvec_handle->generalized_valvec.valvec_pointer.column,
         op.valvec_handle->generalized_valvec.valvec_length,
         op.posvec_handle == NULL ? NULL : &op.posvec_handle->generalized_posvec,
-        op.lower_bound, op.upper_bound, &select_status);
+        op.lower_bound, op.upper_bound, true, &select_status);
   } else {
     posvec = cmdselect_raw(
         &op.valvec_handle->generalized_valvec,
@@ -565,7 +595,7 @@ static inline void execute_select(DbOperator *query, Message *send_message) {
     send_message->length = strlen(send_message->payload);
     return;
   }
-  _free_if_wraps_column(op.valvec_handle);
+  free_if_wraps_column(op.valvec_handle);
 
   // Insert the position vector into the client context
   DbSchemaStatus insert_status =
@@ -632,6 +662,9 @@ void execute_db_operator(DbOperator *query, Message *send_message) {
   case OPERATOR_TYPE_LOAD:
     execute_load(query, send_message);
     break;
+  case OPERATOR_TYPE_LOAD_FILE:
+    execute_load_file(query, send_message);
+    break;
   case OPERATOR_TYPE_PRINT:
     execute_print(query, send_message);
     break;
@@ -10,6 +10,7 @@
 #include "cindex.h"
 #include "db_schema.h"
 #include "io.h"
+#include "zonemap.h"
 
 /**
  * Convenience macro to return -1 on fread failure.
@@ -73,6 +74,11 @@ static inline DbSchemaStatus _resize_table(Table *table, size_t new_capacity) {
     if (status != DB_SCHEMA_STATUS_OK) {
       return status;
     }
+
+    status = resize_zone_map(&table->columns[i], new_capacity);
+    if (status != DB_SCHEMA_STATUS_OK) {
+      return status;
+    }
   }
 
   table->capacity = new_capacity;
@@ -80,6 +86,22 @@ static inline DbSchemaStatus _resize_table(Table *table, size_t new_capacity) {
 }
 
 Db *__DB__;
+pthread_rwlock_t __catalog_lock__ = PTHREAD_RWLOCK_INITIALIZER;
+
+/**
+ * @implements catalog_read_lock
+ */
+void catalog_read_lock() { pthread_rwlock_rdlock(&__catalog_lock__); }
+
+/**
+ * @implements catalog_write_lock
+ */
+void catalog_write_lock() { pthread_rwlock_wrlock(&__catalog_lock__); }
+
+/**
+ * @implements catalog_unlock
+ */
+void catalog_unlock() { pthread_rwlock_unlock(&__catalog_lock__); }
 
 /**
  * @implements format_status
@@ -100,6 +122,8 @@ char *format_status(DbSchemaStatus status) {
     return "Table cannot hold more columns.";
   case DB_SCHEMA_STATUS_TABLE_NOT_FULL:
     return "Table does not have the specified number of columns initialized.";
+  case DB_SCHEMA_STATUS_TABLE_LOADING:
+    return "Table is being loaded by another client.";
   case DB_SCHEMA_STATUS_COLUMN_ALREADY_EXISTS:
     return "Column already exists.";
   case DB_SCHEMA_STATUS_COLUMN_NOT_EXIST:
@@ -122,6 +146,10 @@ char *format_status(DbSchemaStatus status) {
     return "Memory reallocation failed.";
   case DB_SCHEMA_STATUS_CSV_INVALID_HEADER:
     return "CSV header is not valid for loading.";
+  case DB_SCHEMA_STATUS_CSV_OPEN_FAILED:
+    return "Failed to open the CSV file.";
+  case DB_SCHEMA_STATUS_CSV_INVALID_DATA:
+    return "CSV data is not valid for loading.";
   case DB_SCHEMA_STATUS_PARALLEL_NOT_INITIALIZED:
     return "Parallelization requested but not initialized.";
   case DB_SCHEMA_STATUS_INTERNAL_ERROR:
@@ -166,6 +194,7 @@ int system_launch() {
     _CHECKED_FREAD(&table->n_rows, sizeof(size_t), 1, catalog);
     _CHECKED_FREAD(&table->capacity, sizeof(size_t), 1, catalog);
     _CHECKED_FREAD(&table->primary, sizeof(size_t), 1, catalog);
+    table->loader = NULL;
     table->columns = malloc(sizeof(Column) * table->n_cols);
 
     // Construct the columns from the catalog
@@ -173,12 +202,26 @@ int system_launch() {
       Column *column = &table->columns[j];
       _CHECKED_FREAD(column->name, sizeof(char), MAX_SIZE_NAME, catalog);
       _CHECKED_FREAD(&column->index_type, sizeof(ColumnIndexType), 1, catalog);
+      _CHECKED_FREAD(&column->index.tree_order, sizeof(int), 1, catalog);
       column->data = mmap_column_file(table->name, column->name,
                                       table->capacity, &column->fd);
       if (column->data == NULL) {
         return -1;
       }
 
+      // Read the zone map, whose zones past the persisted ones (i.e., beyond
+      // the last row) are empty
+      if (init_zone_map(table, column, true) != DB_SCHEMA_STATUS_OK) {
+        return -1;
+      }
+      size_t n_zones;
+      _CHECKED_FREAD(&n_zones, sizeof(size_t), 1, catalog);
+      if (n_zones > column->zone_map.n_zones) {
+        return -1;
+      }
+      _CHECKED_FREAD(column->zone_map.mins, sizeof(int), n_zones, catalog);
+      _CHECKED_FREAD(column->zone_map.maxs, sizeof(int), n_zones, catalog);
+
       // Initialize the column index; in this case the underlying data for
       // clustered indexes is already sorted (if any), so we take short-circuit,
       // and we do not need to deal with clustered first since it will not
@@ -232,6 +275,14 @@ int system_shutdown() {
       Column *column = &table->columns[j];
       _CHECKED_FWRITE(column->name, sizeof(char), MAX_SIZE_NAME, catalog);
       _CHECKED_FWRITE(&column->index_type, sizeof(ColumnIndexType), 1, catalog);
+      _CHECKED_FWRITE(&column->index.tree_order, sizeof(int), 1, catalog);
+
+      // Only the zones covering the rows are written
+      size_t n_zones = table->n_rows / ZONE_MAP_BLOCK_SIZE +
+                       (table->n_rows % ZONE_MAP_BLOCK_SIZE != 0);
+      _CHECKED_FWRITE(&n_zones, sizeof(size_t), 1, catalog);
+      _CHECKED_FWRITE(column->zone_map.mins, sizeof(int), n_zones, catalog);
+      _CHECKED_FWRITE(column->zone_map.maxs, sizeof(int), n_zones, catalog);
     }
   }
   fclose(catalog);
@@ -338,6 +389,7 @@ void free_db() {
       munmap_column_file(table->columns[j].data, table->capacity,
                          table->columns[j].fd);
       free_cindex(&table->columns[j]);
+      free_zone_map(&table->columns[j]);
     }
     free(table->columns);
   }
@@ -3,22 +3,26 @@
  *
  * This header defines the bit vector structure, partially referring to:
  * https://c-faq.com/misc/bitsets.html
+ *
+ * Bits are stored in 64-bit words, with bit `b` being bit `b % 64` of word
+ * `b / 64`, so that counting and iterating over set bits can work on a whole
+ * word at a time.
  */
 
 #ifndef BITVECTOR_H__
 #define BITVECTOR_H__
 
-#include <limits.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdlib.h>
 
-#define _BITMASK(b) (1 << ((b) % CHAR_BIT))
-#define _BITSLOT(b) ((b) / CHAR_BIT)
-#define _BITNSLOTS(nb) ((nb + CHAR_BIT - 1) / CHAR_BIT)
+#define _BITMASK(b) ((uint64_t)1 << ((b) % 64))
+#define _BITSLOT(b) ((b) / 64)
+#define _BITNSLOTS(nb) (((nb) + 63) / 64)
 
 typedef struct BitVector {
-  unsigned char *data;
+  uint64_t *data;
   size_t length;
 } BitVector;
 
@@ -34,7 +38,8 @@ static inline BitVector *bitvector_create(size_t length) {
     return NULL;
   }
   bv->length = length;
-  bv->data = (unsigned char *)calloc(_BITNSLOTS(length), sizeof(unsigned char));
+  // Always allocate at least one word so that NULL only means failure
+  bv->data = calloc(length > 0 ? _BITNSLOTS(length) : 1, sizeof(uint64_t));
   if (bv->data == NULL) {
     free(bv);
     return NULL;
@@ -79,4 +84,39 @@ static inline bool bitvector_test(const BitVector *bv, size_t bit) {
   return false;
 }
 
+/**
+ * Count the number of bits set to true.
+ */
+static inline size_t bitvector_count(const BitVector *bv) {
+  size_t count = 0;
+  for (size_t i = 0; i < _BITNSLOTS(bv->length); i++) {
+    count += __builtin_popcountll(bv->data[i]);
+  }
+  return count;
+}
+
+/**
+ * Find the first bit set to true at or after the specified bit.
+ *
+ * This returns the length of the bit vector if there is no such bit. Iterating
+ * over the set bits can thus be written as:
+ *
+ *   for (size_t b = bitvector_next_set(bv, 0); b < bv->length;
+ *        b = bitvector_next_set(bv, b + 1)) { ... }
+ */
+static inline size_t bitvector_next_set(const BitVector *bv, size_t bit) {
+  if (bit >= bv->length) {
+    return bv->length;
+  }
+  size_t slot = _BITSLOT(bit);
+  uint64_t word = bv->data[slot] & (~(uint64_t)0 << (bit % 64));
+  while (word == 0) {
+    if (++slot >= _BITNSLOTS(bv->length)) {
+      return bv->length;
+    }
+    word = bv->data[slot];
+  }
+  return slot * 64 + __builtin_ctzll(word);
+}
+
 #endif /* BITVECTOR_H__ */
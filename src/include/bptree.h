@@ -11,6 +11,7 @@
 #include <stdbool.h>
 #include <stddef.h>
 
+#include "bitvector.h"
 #include "consts.h"
 
 /**
@@ -30,20 +31,26 @@ typedef enum BPlusNodeType {
  *
  * There is always the same number of values as the number of keys for leaf
  * nodes, and there is always one more child than the number of keys for
- * internal nodes. The maximum number of children is fixed, which is the order
- * of the B+ tree. The maximum number of keys and values is thus one less than
- * the order of the B+ tree.
+ * internal nodes. The maximum number of children is fixed per tree, which is
+ * the order of the B+ tree. The maximum number of keys and values is thus one
+ * less than the order of the B+ tree.
+ *
+ * The arrays are allocated in the same cache line aligned block as the node,
+ * with the keys directly following the node and the children or values
+ * following the keys. A search within a node thus reads only the cache lines of
+ * the keys and then a single child or value, and a node of a small order spans
+ * only a few cache lines.
  */
 typedef struct BPlusNode {
   enum BPlusNodeType type;
   int n_keys;
-  int keys[BPLUS_TREE_ORDER - 1];
+  int *keys;
   union {
     struct {
-      struct BPlusNode *children[BPLUS_TREE_ORDER];
+      struct BPlusNode **children;
     } internal;
     struct {
-      size_t values[BPLUS_TREE_ORDER - 1];
+      size_t *values;
       struct BPlusNode *next;
     } leaf;
   } spec;
@@ -53,12 +60,13 @@ typedef struct BPlusNode {
  * The B+ tree structure.
  *
  * The tree contains a pointer to the root node, the number of levels (which
- * includes the root node but not the leaf level), and the number of values in
- * the tree (i.e., not counting the internal nodes).
+ * includes the root node but not the leaf level), the order of the tree, and
+ * the number of values in the tree (i.e., not counting the internal nodes).
  */
 typedef struct BPlusTree {
   BPlusNode *root;
   int n_levels;
+  int order;
   size_t size;
 } BPlusTree;
 
@@ -68,10 +76,12 @@ typedef struct BPlusTree {
  * If the sorter is not provided, then data must be sorted itself. Otherwise,
  * the data can be unsorted and the sorter gives the order of the data, commonly
  * obtained by argsorting the data. The size is the number of elements in the
- * data. This function returns the created B+ tree on success or NULL on
- * failure.
+ * data. The order must be between `BPLUS_TREE_MIN_ORDER` and
+ * `BPLUS_TREE_MAX_ORDER`. This function returns the created B+ tree on success
+ * or NULL on failure.
  */
-BPlusTree *bplus_tree_create(int *data, size_t *sorter, size_t size);
+BPlusTree *bplus_tree_create(int *data, size_t *sorter, size_t size,
+                             int order);
 
 /**
  * Insert a key-value pair into the B+ tree.
@@ -80,6 +90,61 @@ BPlusTree *bplus_tree_create(int *data, size_t *sorter, size_t size);
  */
 int bplus_tree_insert(BPlusTree *tree, int key, size_t value);
 
+/**
+ * Insert a sorted batch of key-value pairs into the B+ tree.
+ *
+ * The batch is given as in `bplus_tree_create`, i.e., the values are the
+ * indices of the data, in the order of the sorter if provided; the keys must be
+ * sorted in that order. The batch is merged into the leaf level from left to
+ * right: each leaf node that some of the keys belong to is merged with all of
+ * them at once, and the result is spread evenly over the leaf node and as many
+ * new leaf nodes as needed. This costs time linear in the size of the batch and
+ * the number of touched leaf nodes, rather than in the size of the tree. This
+ * function returns 0 on success and -1 on failure, in which case the tree is
+ * still valid but holds only the keys of the batch before some point.
+ */
+int bplus_tree_insert_batch(BPlusTree *tree, int *data, size_t *sorter,
+                            size_t size);
+
+/**
+ * Delete a key-value pair from the B+ tree.
+ *
+ * The pair is located by its key, and among duplicates of the key by its value.
+ * Nodes that become less than half full are merged with or borrow from a
+ * sibling, so the tree stays balanced. This function returns 0 on success and
+ * -1 if the pair is not in the tree.
+ */
+int bplus_tree_delete(BPlusTree *tree, int key, size_t value);
+
+/**
+ * Change the key of a key-value pair in the B+ tree.
+ *
+ * The key is changed in place if the pair would stay at the same place in its
+ * leaf node, and otherwise the pair is deleted and inserted with the new key.
+ * This function returns 0 on success and -1 if the pair is not in the tree or
+ * the insertion failed.
+ */
+int bplus_tree_update(BPlusTree *tree, int old_key, int new_key,
+                      size_t value);
+
+/**
+ * Compact the values (indices) of the B+ tree after removing positions.
+ *
+ * The mask is true for the removed positions, whose pairs must have been
+ * deleted from the tree already. Every remaining value is decreased by the
+ * number of removed positions before it, in one pass over the leaf level. This
+ * function returns 0 on success and -1 on failure.
+ */
+int bplus_tree_compact_values(BPlusTree *tree, const BitVector *removed);
+
+/**
+ * Shift the values (indices) of the B+ tree after inserting a position.
+ *
+ * Every value greater than or equal to the inserted position is increased by
+ * one, in one pass over the leaf level.
+ */
+void bplus_tree_shift_values(BPlusTree *tree, size_t from);
+
 /**
  * Perform a point search on the B+ tree, assuming contiguous values.
  *
@@ -90,7 +155,7 @@ int bplus_tree_insert(BPlusTree *tree, int key, size_t value);
  * in general, but only with the assumption that the values (indices) are
  * contiguous.
  */
-size_t bplus_tree_search_cont(BPlusTree *tree, int key, bool align_left);
+size_t bplus_tree_search_cont(BPlusTree *tree, long key, bool align_left);
 
 /**
  * Perform a range search on the B+ tree, assuming contiguous values.
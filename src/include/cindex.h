@@ -31,6 +31,17 @@ static inline int init_sorter(int *arr, size_t *sorter, size_t n_rows) {
   return aquicksort(arr, sorter, n_rows);
 }
 
+/**
+ * Check whether to maintain a B+ tree index entry by entry.
+ *
+ * This is the case if a delete or update affects `n_affected` out of `n_rows`
+ * rows, which is at most `BPLUS_TREE_MAX_MAINTAINED_FRACTION` of them;
+ * otherwise the B+ tree should be rebuilt.
+ */
+static inline bool should_maintain_btree(size_t n_rows, size_t n_affected) {
+  return n_affected <= n_rows * BPLUS_TREE_MAX_MAINTAINED_FRACTION;
+}
+
 /**
  * Update a sorter.
  *
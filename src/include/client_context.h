@@ -8,6 +8,8 @@
 #ifndef CLIENT_CONTEXT_H__
 #define CLIENT_CONTEXT_H__
 
+#include <stdlib.h>
+
 #include "bitvector.h"
 #include "db_schema.h"
 
@@ -82,7 +84,9 @@ typedef struct IndexArray {
  *
  * This struct contains a pointer to a bit vector. It represents the boolean
  * mask that indicates whether a certain position satisfies certain filtering
- * conditions. It also records the number of bits set to true.
+ * conditions. It also records the number of bits set to true. When used as a
+ * position vector, the positions are the set bits in increasing order, which
+ * takes 64x less memory than an index array once many positions are selected.
  */
 typedef struct BooleanMask {
   size_t n_set;
@@ -216,6 +220,22 @@ void free_client_context(ClientContext *context);
 GeneralizedValvecHandle *lookup_valvec_handle(ClientContext *context,
                                               char *name, bool consider_column);
 
+/**
+ * Free a value vector handle if it wraps a column.
+ *
+ * Handles that wrap a column are created by `lookup_valvec_handle` for
+ * temporary use. The wrapped column belongs to the database, but such a handle
+ * itself does not belong to either the client context or the database, so it
+ * should be freed manually once it is no longer used.
+ */
+static inline void
+free_if_wraps_column(GeneralizedValvecHandle *valvec_handle) {
+  if (valvec_handle->generalized_valvec.valvec_type ==
+      GENERALIZED_VALVEC_TYPE_COLUMN) {
+    free(valvec_handle);
+  }
+}
+
 /**
  * Look up a position vector handle by name.
  *
@@ -273,6 +293,39 @@ DbSchemaStatus insert_numval_handle(ClientContext *context, char *name,
 GeneralizedPosvec *wrap_index_array(size_t *indices, size_t n_indices,
                                     DbSchemaStatus *status);
 
+/**
+ * Wrap a bit vector into a generalized position vector.
+ *
+ * The number of bits set in the bit vector should be given as `n_set`.
+ */
+GeneralizedPosvec *wrap_boolean_mask(BitVector *mask, size_t n_set,
+                                     DbSchemaStatus *status);
+
+/**
+ * Get the number of positions in a generalized position vector.
+ */
+size_t posvec_length(GeneralizedPosvec *posvec);
+
+/**
+ * Get a generalized position vector as an index array.
+ *
+ * A boolean mask is converted into an index array in place, so that later uses
+ * of the same position vector do not need to convert again; consumers should
+ * only call this when they cannot work with a boolean mask directly, e.g., when
+ * they need random access to the i-th position. This function returns NULL if
+ * the conversion fails. The status code is properly set.
+ */
+IndexArray *posvec_to_index_array(GeneralizedPosvec *posvec,
+                                  DbSchemaStatus *status);
+
+/**
+ * Free the internals of a generalized position vector.
+ *
+ * This does not free the generalized position vector itself, which may be
+ * embedded in a handle.
+ */
+void free_posvec_internals(GeneralizedPosvec *posvec);
+
 /**
  * Wrap an array of data into a generalized value vector.
  */
@@ -9,14 +9,37 @@
 
 #include "client_context.h"
 
+/**
+ * The data for an add or sub chunk task.
+ *
+ * This data is used for tasks of adding or subtracting two value vectors in
+ * multi-threaded execution. A chunk is the range of positions from `start`
+ * (inclusive) to `end` (exclusive), whose results are written to the same
+ * positions of `values`.
+ */
+typedef struct AddsubChunkTaskData {
+  const int *data1;
+  const int *data2;
+  int *values;
+  size_t start;
+  size_t end;
+  bool is_add;
+} AddsubChunkTaskData;
+
+/**
+ * Worker subroutine for adding or subtracting a chunk of two value vectors.
+ */
+void cmdaddsub_chunk_subroutine(AddsubChunkTaskData *task_data);
+
 /**
  * Add or subtract two value vectors.
  *
  * This function adds or subtracts the values in the two value vectors and
  * returns the wrapped result values as a generalized value vector wrapping a
  * partial column. The `is_add` flag determines whether addition or subtraction
- * is performed. If the operation fails, NULL is returned. The status code is
- * properly set.
+ * is performed. Large value vectors are processed in parallel chunks depending
+ * on the global configuration. If the operation fails, NULL is returned. The
+ * status code is properly set.
  */
 GeneralizedValvec *cmdaddsub(GeneralizedValvec *valvec1,
                              GeneralizedValvec *valvec2, bool is_add,
@@ -13,14 +13,33 @@
 /**
  * Aggregate the values in a value vector.
  *
- * This function aggregates the values in the value vector and returns the
+ * This function aggregates the values in the value vector, or only those at the
+ * positions of the position vector if it is not NULL, and returns the
  * aggregation result wrapped as a numeric value. The type code determines the
  * type of the aggregation operation, where 0, 1, 2, 3 correspond to MIN, MAX,
  * SUM, AVG respectively. Average of no elements will be treated as 0.0 instead
  * of NaN. If the operation fails, an all-zero numeric value is returned. The
  * status code is properly set.
  */
-NumericValue cmdagg(GeneralizedValvec *valvec, int type_code,
-                    DbSchemaStatus *status);
+NumericValue cmdagg(GeneralizedValvec *valvec, GeneralizedPosvec *posvec,
+                    int type_code, DbSchemaStatus *status);
+
+/**
+ * Aggregate the values in a value vector at the positions selected from another
+ * value vector.
+ *
+ * This function has the same result as selecting from the select value vector
+ * with the specified lower bound (inclusive) and upper bound (exclusive),
+ * fetching the values in the value vector at the selected positions, and then
+ * aggregating them with `cmdagg`. However, neither the selected positions nor
+ * the fetched values are materialized, except for the positions if the select
+ * value vector wraps an indexed column, which is selected via its index. The
+ * value vectors must have the same length. If the operation fails, an all-zero
+ * numeric value is returned. The status code is properly set.
+ */
+NumericValue cmdagg_select(GeneralizedValvec *valvec,
+                           GeneralizedValvec *select_valvec, long lower_bound,
+                           long upper_bound, int type_code,
+                           DbSchemaStatus *status);
 
 #endif /* CMDAGG_H__ */
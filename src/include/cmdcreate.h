@@ -41,9 +41,10 @@ DbSchemaStatus cmdcreate_col(Table *table, char *name);
  * This function creates an index on the column with the given type and returns
  * the status code of the operation. If a column already has an index, this is
  * an error. If some column in the table has a clustered index and the type to
- * create is also clustered, this is again an error.
+ * create is also clustered, this is again an error. The tree order is the order
+ * of the B+ tree of a B+ tree index, and is ignored for other index types.
  */
 DbSchemaStatus cmdcreate_idx(Table *table, size_t ith_column,
-                             ColumnIndexType type);
+                             ColumnIndexType type, int tree_order);
 
 #endif /* CMDCREATE_H__ */
@@ -9,12 +9,37 @@
 
 #include "client_context.h"
 
+/**
+ * The data for a fetch chunk task.
+ *
+ * This data is used for tasks of fetching values in multi-threaded execution. A
+ * chunk is either the range of entries of an index array (if `mask` is NULL),
+ * whose values are written to the same range of `values`, or the range of bits
+ * of a boolean mask, whose values are written contiguously from `values`. The
+ * range goes from `start` (inclusive) to `end` (exclusive), where the range of
+ * a boolean mask consists of whole words.
+ */
+typedef struct FetchChunkTaskData {
+  const int *data;
+  const size_t *indices;
+  const BitVector *mask;
+  int *values;
+  size_t start;
+  size_t end;
+} FetchChunkTaskData;
+
+/**
+ * Worker subroutine for fetching the values at a chunk of positions.
+ */
+void cmdfetch_chunk_subroutine(FetchChunkTaskData *task_data);
+
 /**
  * Fetch the values at specified positions of a value vector.
  *
  * This function returns the fetched values as a generalized value vector
- * wrapping a partial column. If the operation fails, NULL is returned. The
- * status code is properly set.
+ * wrapping a partial column. Large position vectors are processed in parallel
+ * chunks depending on the global configuration. If the operation fails, NULL
+ * is returned. The status code is properly set.
  */
 GeneralizedValvec *cmdfetch(GeneralizedValvec *valvec,
                             GeneralizedPosvec *posvec, DbSchemaStatus *status);
@@ -8,35 +8,81 @@
 #define CMDLOAD_H__
 
 #include "db_schema.h"
+#include "io.h"
+
+/**
+ * The data for a load chunk task.
+ *
+ * This data is used for tasks of loading a CSV file on the server side in
+ * multi-threaded execution. A chunk is a range of complete rows of the CSV
+ * file, from byte `start` (inclusive) to byte `end` (exclusive). A task either
+ * counts the rows in the chunk, or parses the rows directly into the columns of
+ * the table, starting at row `row_offset` of the table. The number of rows and
+ * whether the task failed (i.e., the chunk has malformed rows) are set by the
+ * task.
+ */
+typedef struct LoadChunkTaskData {
+  CSV *csv;
+  size_t start;
+  size_t end;
+  bool is_counting;
+  Table *table;
+  size_t row_offset;
+  size_t n_rows;
+  bool is_failed;
+} LoadChunkTaskData;
 
 /**
  * Validate the header string of a loaded CSV and grab the table and columns.
  *
  * This function will check that the columns specified in the CSV header are
- * all columns of the same table in the same order. It will store the table in
- * the given pointer. This function returns the status code of the operation.
+ * exactly the columns of the same table in the same order, and that no other
+ * load is streaming rows into the table. It will store the table in the given
+ * pointer. This function returns the status code of the operation.
  */
 DbSchemaStatus cmdload_validate_header(char *header, size_t n_cols,
                                        Table **table);
 
 /**
- * Insert multiple new rows into the table.
+ * Stage multiple new rows past the last row of the table.
+ *
+ * The rows are placed right after the `n_staged_rows` rows that are already
+ * staged, and the table must have the capacity for them (see
+ * `maybe_expand_table`). Staged rows are not part of the table until the load
+ * is concluded (see `cmdload_conclude`). This function returns the status code
+ * of the operation. The data is flattened in row-major order (n_rows x n_cols),
+ * and the second dimension should match the number of columns in the table.
+ * Refer to the load DbOperator for more details on the flattened data array.
+ */
+DbSchemaStatus cmdload_rows(Table *table, int *data, size_t n_rows,
+                            size_t n_staged_rows);
+
+/**
+ * Worker subroutine for loading a chunk of a CSV file.
+ */
+void cmdload_chunk_subroutine(LoadChunkTaskData *task_data);
+
+/**
+ * Load a CSV file on the server side into the table given by its header.
  *
- * This function returns the status code of the operation. The data is flattened
- * in row-major order (n_rows x n_cols), and the second dimension should match
- * the number of columns in the table. Refer to the load DbOperator for more
- * details on the flattened data array.
+ * The file is mapped to memory and split into chunks at row boundaries, which
+ * are parsed in parallel (depending on the global configuration) directly into
+ * the columns of the table. The table is left untouched if the data is not
+ * valid. The load is concluded (see `cmdload_conclude`) on success, and the
+ * number of loaded rows is stored in the given pointer. This function returns
+ * the status code of the operation.
  */
-DbSchemaStatus cmdload_rows(Table *table, int *data, size_t n_rows);
+DbSchemaStatus cmdload_file(char *path, size_t *n_rows);
 
 /**
  * Conclude a load command.
  *
  * This function serves as the post-processing step after all batches of rows
- * are loaded. `n_rows` is the number of rows inserted during the whole load
- * process, i.e., originally the table has `table->n_rows - n_rows` rows and now
- * it has `table->n_rows` rows. This function returns the status code of the
- * operation.
+ * are staged. `n_cumu_rows` is the number of rows staged during the whole load
+ * process, which are appended to the table, i.e., originally the table has
+ * `table->n_rows` rows and afterwards it has `n_cumu_rows` more. The zone maps
+ * and the indexes are updated for the new rows. This function returns the
+ * status code of the operation.
  */
 DbSchemaStatus cmdload_conclude(Table *table, size_t n_cumu_rows);
 
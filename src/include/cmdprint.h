@@ -7,31 +7,38 @@
 #ifndef CMDPRINT_H__
 #define CMDPRINT_H__
 
+#include <sys/uio.h>
+
 #include "client_context.h"
 
 /**
- * Format the value vectors in tabular format.
+ * Serialize the value vectors into a columnar result.
  *
- * This function makes a tabular printout of the generalized value vector
- * handles, each representing a column in the printout. It also sets the output
- * length, which is the actual length of the formatted printout, which can be
- * smaller than the allocated memory. Note that this function assumes that all
- * value vectors have the same length. If the operation fails, NULL is returned
- * and output length is set to 0. The status code is properly set.
+ * This function makes a binary columnar result (see `ColumnarResultHeader`) of
+ * the generalized value vector handles, each representing an integer column in
+ * the printout, so that the formatting can be done by the client. The values
+ * are not copied; instead, the result is described by a malloc'ed array of
+ * segments, the first being the returned header and the rest pointing directly
+ * to the data of each value vector, so the result is valid only as long as the
+ * value vectors are. It also sets the output length, which is the total length
+ * of the segments. Note that this function assumes that all value vectors have
+ * the same length. If the operation fails, NULL is returned, output length and
+ * the number of segments are set to 0, and segments are set to NULL. The status
+ * code is properly set.
  */
 char *cmdprint_vecs(GeneralizedValvecHandle **valvec_handles,
                     size_t n_valvec_handles, size_t *output_len,
+                    struct iovec **segments, int *n_segments,
                     DbSchemaStatus *status);
 
 /**
- * Format the numeric values in array format.
+ * Serialize the numeric values into a columnar result.
  *
- * This function makes a comma-separated string representation of the numeric
- * value handles. It also sets the output length, which is the actual length of
- * the formatted printout, which can be smaller than the allocated memory.
- * Floating-point numbers are formatted by rounding to two decimal places. If
- * the operation fails, NULL is returned and output length is set to 0. The
- * status code is properly set.
+ * This function makes a binary columnar result (see `ColumnarResultHeader`) of
+ * a single row, where each numeric value handle is a column of its own type. It
+ * also sets the output length, which is the length of the result. If the
+ * operation fails, NULL is returned and output length is set to 0. The status
+ * code is properly set.
  */
 char *cmdprint_vals(NumericValueHandle **numval_handles,
                     size_t n_numval_handles, size_t *output_len,
@@ -16,8 +16,10 @@
  * (inclusive) and upper bound (exclusive) and returns the resulting position
  * vector. If the position vector is not provided, the selected positions
  * correspond to the indices of the value vector; otherwise the selected
- * positions mapped by the give position vector. This function returns NULL if
- * the operation fails. The status code is properly set.
+ * positions mapped by the give position vector. The result is a boolean mask if
+ * the selection is estimated to match enough positions (see
+ * `select_mask_length`), and an index array otherwise. This function returns
+ * NULL if the operation fails. The status code is properly set.
  */
 GeneralizedPosvec *cmdselect_raw(GeneralizedValvec *valvec,
                                  GeneralizedPosvec *posvec, long lower_bound,
@@ -30,9 +32,16 @@ GeneralizedPosvec *cmdselect_raw(GeneralizedValvec *valvec,
  * specifically designed for value vectors that wrap actual columns which are
  * indexed. This function returns NULL if the operation fails. The status code
  * is properly set.
+ *
+ * An unclustered index yields the selected positions in the order of their
+ * values. If `position_order` is set, they are instead returned in ascending
+ * order, so that consumers such as fetch access the positions sequentially
+ * rather than randomly; the result is then a boolean mask if enough positions
+ * of the column are selected, and a sorted index array otherwise.
  */
 GeneralizedPosvec *cmdselect_index(Column *column, size_t n_rows,
                                    GeneralizedPosvec *posvec, long lower_bound,
-                                   long upper_bound, DbSchemaStatus *status);
+                                   long upper_bound, bool position_order,
+                                   DbSchemaStatus *status);
 
 #endif /* CMDSELECT_H__ */
@@ -7,6 +7,10 @@
 #ifndef COMM_H__
 #define COMM_H__
 
+#include <stdbool.h>
+#include <sys/uio.h>
+
+#include "message.h"
 #include "sys/types.h"
 
 /**
@@ -20,6 +24,29 @@
  */
 ssize_t recv_all(int socket, void *buf, size_t length);
 
+/**
+ * Receive up to a certain amount of data from a socket without blocking.
+ *
+ * This function will receive data in chunks until either the specified amount
+ * of data is received or no more data is currently available on the socket.
+ * The received data will be stored in the payload buffer. This function returns
+ * the number of bytes received, which can be anywhere from 0 to the specified
+ * amount, or -1 to indicate an error. If the connection is closed, the closed
+ * flag will be set and the number of bytes received before that is returned.
+ */
+ssize_t recv_available(int socket, void *buf, size_t length, bool *closed);
+
+/**
+ * Receive up to a certain amount of data from a socket without blocking, along
+ * with a file descriptor if one is passed.
+ *
+ * This function behaves like `recv_available`, except that if a file descriptor
+ * is passed along with the received data, it is stored in the given pointer
+ * (closing the one previously stored there, if any).
+ */
+ssize_t recv_available_fd(int socket, void *buf, size_t length, bool *closed,
+                          int *fd);
+
 /**
  * Send a certain amount of data to a socket.
  *
@@ -30,4 +57,119 @@ ssize_t recv_all(int socket, void *buf, size_t length);
  */
 ssize_t send_all(int socket, void *buf, size_t length);
 
+/**
+ * Send multiple segments of data to a socket.
+ *
+ * This function will send the segments one after another, gathering as many as
+ * possible per system call, until all data are sent. Note that the segments
+ * array is updated in the process to keep track of what is left to send. This
+ * function returns the number of bytes sent if all data are sent successfully,
+ * or -1 to indicate an error.
+ */
+ssize_t sendv_all(int socket, struct iovec *segments, int n_segments);
+
+/**
+ * Send multiple segments of data to a socket without blocking.
+ *
+ * This function behaves like `sendv_all`, except that it stops as soon as the
+ * socket cannot take more data. The segments array is updated in place so that
+ * it describes exactly what is left to send, i.e., completely sent segments are
+ * emptied and a partially sent segment is advanced. This function returns the
+ * number of bytes sent, which can be anywhere from 0 to the total size of the
+ * segments, or -1 to indicate an error.
+ */
+ssize_t sendv_available(int socket, struct iovec *segments, int n_segments);
+
+/**
+ * Send a message, i.e., its header followed by its payload, to a socket.
+ *
+ * The header and the payload are sent together without copying the payload,
+ * which is either the payload buffer or the payload segments of the message if
+ * any. This function returns the number of bytes sent if the whole message is
+ * sent successfully, or -1 to indicate an error. Regardless of the outcome, the
+ * payload segments array is freed, and so is the payload if it is malloc'ed.
+ */
+ssize_t send_message_all(int socket, Message *message);
+
+/**
+ * Send a message without payload to a socket, along with a file descriptor.
+ *
+ * This function returns the number of bytes sent if the message is sent
+ * successfully, or -1 to indicate an error.
+ */
+ssize_t send_message_fd(int socket, Message *message, int fd);
+
+/**
+ * A shared memory channel between a client and the server.
+ *
+ * The channel is a memory region, created by the client as a memfd and passed
+ * to the server over the socket, that holds two rings of fixed-size slots, one
+ * for each direction. Large payloads are moved through the rings in slot-sized
+ * pieces, while the message headers stay on the socket and keep the order of
+ * the messages, so the payloads never go through the kernel. The region is
+ * mapped by both processes; the rest of this struct is local to each of them
+ * and keeps track of the geometry of the rings and of the next slot to send to
+ * and to receive from. The geometry is copied out of the region once when the
+ * channel is set up, since the peer can still write to the region afterwards.
+ */
+typedef struct SharedChannel {
+  struct SharedRegion *region;
+  size_t size;
+  size_t n_slots;
+  size_t slot_size;
+  bool is_server;
+  size_t next_send_slot;
+  size_t next_recv_slot;
+} SharedChannel;
+
+/**
+ * Create a shared memory channel on the client side.
+ *
+ * The file descriptor of the channel is stored in the given pointer, and should
+ * be passed to the server and then closed. This function returns the channel on
+ * success, or NULL on failure.
+ */
+SharedChannel *shared_channel_create(int *fd);
+
+/**
+ * Attach to a shared memory channel on the server side.
+ *
+ * The file descriptor is the one passed by the client, and can be closed once
+ * this function returns. This function returns the channel on success, or NULL
+ * if the file descriptor does not refer to a valid channel.
+ */
+SharedChannel *shared_channel_attach(int fd);
+
+/**
+ * Close a shared memory channel and free its resources.
+ */
+void shared_channel_close(SharedChannel *channel);
+
+/**
+ * Send a message to a socket, moving its payload through a shared memory
+ * channel if possible.
+ *
+ * If there is a channel and the payload is large enough, the header is sent to
+ * the socket with the shared flag set, and the payload (i.e., the payload
+ * buffer or the payload segments) is copied into the channel, waiting for the
+ * peer to free up slots as needed; otherwise this is the same as
+ * `send_message_all`. This function returns the number of bytes sent if the
+ * whole message is sent successfully, or -1 to indicate an error (including
+ * the peer being disconnected while waiting). The payload segments array and
+ * the malloc'ed payload are freed in the same way as `send_message_all`.
+ */
+ssize_t send_message_shared(int socket, SharedChannel *channel,
+                            Message *message);
+
+/**
+ * Receive the payload of a shared message from a shared memory channel.
+ *
+ * The payload of the specified length is copied from the channel into the
+ * buffer, waiting for the peer to fill up slots as needed. The socket is only
+ * used to check whether the peer is still connected. This function returns the
+ * number of bytes received, or -1 to indicate an error.
+ */
+ssize_t recv_shared_payload(int socket, SharedChannel *channel, void *buf,
+                            size_t length);
+
 #endif /* COMM_H__ */
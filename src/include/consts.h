@@ -58,11 +58,89 @@
  */
 #define DEFAULT_SOCKET_BUFFER_SIZE 4096
 
+/**
+ * The maximum number of client connections that the server can hold open at the
+ * same time. Connections are multiplexed by a single event loop, so this is not
+ * tied to the number of threads.
+ */
+#define MAX_CLIENT_CONNECTIONS 4096
+
+/**
+ * The maximum number of events to handle per wait in the server event loop.
+ */
+#define MAX_EPOLL_EVENTS 64
+
+/**
+ * The maximum number of pipelined messages of a client connection that are
+ * processed in a row before the connection goes back to the event loop.
+ */
+#define MAX_PIPELINED_MESSAGES_PER_TASK 256
+
+/**
+ * The maximum number of queries that the client may have in flight (i.e., sent
+ * but without response yet) in pipelined mode.
+ */
+#define MAX_PIPELINED_QUERIES 4096
+
+/**
+ * The maximum payload size in bytes of a result that is sent straight from the
+ * column memory while holding the catalog lock, as far as the socket takes it
+ * without blocking. Larger results are copied out of the columns first.
+ */
+#define MAX_ZERO_COPY_RESULT_SIZE (64 << 10)
+
+/**
+ * The number of slots in each direction of a shared memory channel.
+ */
+#define SHARED_CHANNEL_N_SLOTS 8
+
+/**
+ * The size in bytes of each slot of a shared memory channel. Payloads larger
+ * than this are moved through the channel in multiple slots.
+ */
+#define SHARED_CHANNEL_SLOT_SIZE (1 << 20)
+
+/**
+ * The minimum payload size in bytes for a message to be sent through a shared
+ * memory channel. Smaller payloads are cheaper to send over the socket.
+ */
+#define SHARED_CHANNEL_MIN_PAYLOAD_SIZE (64 << 10)
+
+/**
+ * The interval in milliseconds at which a process waiting on a shared memory
+ * channel checks whether its peer is still connected.
+ */
+#define SHARED_CHANNEL_POLL_INTERVAL 100
+
+/**
+ * The size of the buffer used when formatting columnar results for display.
+ */
+#define COLUMNAR_FORMAT_BUFFER_SIZE 65536
+
 /**
  * The size of the thread task queue.
  */
 #define THREAD_TASK_QUEUE_SIZE 1024
 
+/**
+ * The size of the task deque of each worker of a thread pool. This must be a
+ * power of two.
+ */
+#define THREAD_TASK_DEQUE_SIZE 1024
+
+/**
+ * The number of times an idle worker of a thread pool looks for a task to run
+ * or steal, yielding in between, before it parks until a task is enqueued.
+ */
+#define THREAD_POOL_SPIN_ROUNDS 64
+
+/**
+ * The maximum depth of nested waits for task groups on a single thread, i.e.,
+ * of tasks that fork subtasks and wait for them while helping to execute other
+ * tasks. A thread that waits at this depth no longer helps executing tasks.
+ */
+#define THREAD_POOL_MAX_WAIT_DEPTH 16
+
 /**
  * The size limit of the name of an object in the database.
  */
@@ -138,29 +216,150 @@
 #define EXPAND_FACTOR_JOIN_RESULT 2
 
 /**
- * The number of elements per batch when loading multiple rows of data. The
- * elements are integers (4B), so per batch is 4KB which is the typical page
- * size.
+ * The batch size in bytes that the client proposes for sending rows of data
+ * when loading. Batches are large so that the load is bounded by parsing rather
+ * than by the per-message overhead.
+ */
+#define LOAD_BATCH_SIZE (4 << 20)
+
+/**
+ * The maximum batch size in bytes that the server accepts for rows of data when
+ * loading. The client may buffer two batches at a time.
  */
-#define NUM_ELEMS_PER_LOAD_BATCH 1024
+#define MAX_LOAD_BATCH_SIZE (16 << 20)
 
 /**
- * The number of pages per scan task, if the scan is parallelized.
+ * The default size of the level 1 data cache of a processor in bytes, if it
+ * cannot be read from the system.
  */
-#define NUM_PAGES_PER_SCAN_TASK 32
+#define DEFAULT_L1D_CACHE_SIZE (32 << 10)
 
 /**
- * The order of the B+ tree.
+ * The default size of the level 2 cache of a processor in bytes, if it cannot
+ * be read from the system.
+ */
+#define DEFAULT_L2_CACHE_SIZE (256 << 10)
+
+/**
+ * The default size of the level 3 cache in bytes, if it cannot be read from the
+ * system.
+ */
+#define DEFAULT_L3_CACHE_SIZE (8 << 20)
+
+/**
+ * The number of tasks per thread that a parallel scan aims for, so that tasks
+ * of uneven cost (e.g., due to selectivity or skipped zones) are balanced by
+ * the threads that finish early taking more tasks.
+ */
+#define NUM_SCAN_TASKS_PER_THREAD 4
+
+/**
+ * The number of values a shared scan processes between two checks of the
+ * capacity of its selected indices buffers.
+ *
+ * The buffers of a select query grow geometrically, and each check makes sure
+ * that the block can be scanned even if all its values are selected. This must
+ * be a multiple of 8 so that the AVX2 kernels never split a vector of values
+ * across two blocks.
+ */
+#define SCAN_OUTPUT_BLOCK_SIZE 4096
+
+/**
+ * The factor by which to expand a selected indices buffer of a shared scan when
+ * it cannot take another block of values.
+ */
+#define EXPAND_FACTOR_SCAN_OUTPUT 2
+
+/**
+ * The minimum number of select queries in a shared scan for the queries that
+ * match each value to be located via the elementary intervals of the queries,
+ * instead of comparing the value against every query.
+ */
+#define MIN_NUM_QUERIES_FOR_SELECT_INTERVALS 16
+
+/**
+ * The number of rows per zone of a column zone map.
+ */
+#define ZONE_MAP_BLOCK_SIZE 4096
+
+/**
+ * The number of values sampled to estimate the selectivity of a select.
+ */
+#define SELECTIVITY_SAMPLE_SIZE 1024
+
+/**
+ * The minimum estimated fraction of positions selected for a select to output a
+ * boolean mask instead of an index array.
+ *
+ * A boolean mask takes 1 bit per position while an index array takes 64 bits
+ * per selected position, so the two break even at 1/64. The threshold is set a
+ * bit higher to absorb estimation errors, as some consumers (e.g., join) still
+ * need to convert a boolean mask into an index array.
+ */
+#define BOOLEAN_MASK_MIN_SELECTIVITY 0.03
+
+/**
+ * The minimum number of values per task of a parallel vector operation, i.e.,
+ * add, sub, or fetch; a vector operation over fewer values than twice this
+ * number is not parallelized.
+ */
+#define MIN_NUM_VALUES_PER_VECTOR_TASK (1 << 18)
+
+/**
+ * The number of positions ahead of the current one whose values are prefetched
+ * when fetching through an index array, so that the cache misses of the random
+ * accesses overlap with each other instead of stalling one after another.
+ */
+#define FETCH_PREFETCH_DISTANCE 32
+
+/**
+ * The minimum number of pages of a CSV file per load task, if the server-side
+ * load is parallelized.
+ */
+#define MIN_NUM_PAGES_PER_LOAD_TASK 256
+
+/**
+ * The default order of a B+ tree, used unless an order is given when creating
+ * the index.
  *
  * A node holds `order-1` keys, then either `order` children (internal nodes) or
- * `order-1` values (leaf nodes). Assume that keys (int) are 4 bytes, values
- * (size_t) are 8 bytes, and child pointers are 8 bytes. Also assume that page
- * size is 4096 bytes, order 320 fits in a page. However, this may not be the
- * ideal order in practice depending on various factors, and may need to be
- * tuned by experimentation.
+ * `order-1` values (leaf nodes). Keys (int) are 4 bytes, values (size_t) are 8
+ * bytes, and child pointers are 8 bytes, so a node of order 320 about fills a
+ * 4096-byte page, while the keys of a node of order 16 span two cache lines.
+ * Smaller orders read fewer cache lines per node but make the tree deeper and
+ * take more memory per key, so they mostly pay off for trees that stay in the
+ * caches; see `bench_bptree` for measurements.
  */
 #define BPLUS_TREE_ORDER 320
 
+/**
+ * The minimum order of a B+ tree.
+ */
+#define BPLUS_TREE_MIN_ORDER 4
+
+/**
+ * The maximum order of a B+ tree.
+ */
+#define BPLUS_TREE_MAX_ORDER 4096
+
+/**
+ * The number of keys of a B+ tree node up to which the search within the node
+ * counts the keys before the target (with AVX2, 8 at a time) instead of binary
+ * searching them. Larger nodes are binary searched until the range of
+ * candidate keys is this small.
+ */
+#define BPLUS_TREE_LINEAR_SEARCH_KEYS 32
+
+/**
+ * The maximum fraction of the rows of a table that a delete or an update may
+ * affect for the B+ tree indexes of the table to be maintained entry by entry.
+ *
+ * Each affected entry costs a search from the root plus possibly rebalancing,
+ * with random accesses all over the tree, so beyond this fraction it is cheaper
+ * to rebuild the trees by bulk loading.
+ */
+#define BPLUS_TREE_MAX_MAINTAINED_FRACTION 0.05
+
 /**
  * The threshold for the hash join algorithm to choose naive-hash or grace-hash.
  *
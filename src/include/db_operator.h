@@ -62,12 +62,21 @@ typedef struct AddsubOperatorFields {
  * The fields of the aggregate DbOperator.
  *
  * This records the name of the output handle, the type of the aggregation, and
- * the generalized value vector to aggregate on.
+ * the generalized value vector to aggregate on. The generalized position vector
+ * is optional. If it is provided, only the values at its positions are
+ * aggregated, as if they were fetched first. Similarly, the select value vector
+ * is optional. If it is provided, only the values at the positions selected
+ * from it with the lower and upper bounds are aggregated, as if they were
+ * selected and fetched first.
  */
 typedef struct AggOperatorFields {
   char out[HANDLE_MAX_SIZE];
   AggType agg_type;
   GeneralizedValvecHandle *valvec_handle;
+  GeneralizedPosvecHandle *posvec_handle;
+  GeneralizedValvecHandle *select_valvec_handle;
+  long lower_bound;
+  long upper_bound;
 } AggOperatorFields;
 
 /**
@@ -103,8 +112,8 @@ typedef struct BatchOperatorFields {
  *   number of columns in the table to create.
  * - Column: Name of the column to create, the table it belongs to, and the
  *   database the table belongs to.
- * - Index: The table in which to create index on its i-th column, and the type
- *   of the index to create.
+ * - Index: The table in which to create index on its i-th column, the type of
+ *   the index to create, and the order of the B+ tree for B+ tree indexes.
  */
 typedef struct CreateOperatorFields {
   CreateType create_type;
@@ -126,6 +135,7 @@ typedef struct CreateOperatorFields {
       Table *table;
       size_t ith_column;
       ColumnIndexType index_type;
+      int tree_order;
     } idx;
   } spec;
 } CreateOperatorFields;
@@ -190,15 +200,27 @@ typedef struct JoinOperatorFields {
  * order, with the first dimension corresponding to the number of rows and the
  * second dimension corresponding to the number of columns. This DbOperator will
  * be executed in multiple steps, with data and number of rows being updated
- * between steps.
+ * between steps, each staging the rows past the `n_staged_rows` rows staged by
+ * the previous steps.
  */
 typedef struct LoadOperatorFields {
   Table *table;
   int *data;
   size_t n_cols;
   size_t n_rows;
+  size_t n_staged_rows;
 } LoadOperatorFields;
 
+/**
+ * The fields of the load file DbOperator.
+ *
+ * This records the path of the CSV file on the server side to load. The table
+ * to load into is determined by the header of the file.
+ */
+typedef struct LoadFileOperatorFields {
+  char *path;
+} LoadFileOperatorFields;
+
 /**
  * The fields of the print DbOperator.
  *
@@ -257,6 +279,7 @@ typedef union OperatorFields {
   InsertOperatorFields insert;
   JoinOperatorFields join;
   LoadOperatorFields load;
+  LoadFileOperatorFields load_file;
   PrintOperatorFields print;
   SelectOperatorFields select;
   UpdateOperatorFields update;
@@ -275,6 +298,7 @@ typedef enum OperatorType {
   OPERATOR_TYPE_INSERT,
   OPERATOR_TYPE_JOIN,
   OPERATOR_TYPE_LOAD,
+  OPERATOR_TYPE_LOAD_FILE,
   OPERATOR_TYPE_PRINT,
   OPERATOR_TYPE_SELECT,
   OPERATOR_TYPE_UPDATE,
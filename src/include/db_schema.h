@@ -9,6 +9,7 @@
 #ifndef DB_SCHEMA_H__
 #define DB_SCHEMA_H__
 
+#include <pthread.h>
 #include <stddef.h>
 
 #include "bptree.h"
@@ -33,19 +34,38 @@ typedef enum ColumnIndexType {
  * Clustered sorted index carries no extra information, while unclustered sorted
  * index carries the sorter array of the column data. Clustered and unclustered
  * B+ tree indexes carry an additional B+ tree structure on top of clustered and
- * unclustered sorted indexes, respectively.
+ * unclustered sorted indexes, respectively, and the order that the B+ tree is
+ * built with.
  */
 typedef struct ColumnIndex {
   size_t *sorter;
   BPlusTree *tree;
+  int tree_order;
 } ColumnIndex;
 
+/**
+ * The zone map of a column.
+ *
+ * The rows of the column are split into zones of `ZONE_MAP_BLOCK_SIZE` rows,
+ * and the zone map keeps the minimum and maximum value of each zone, so that
+ * scans can skip the zones that a predicate cannot match. The bounds of a zone
+ * always contain all of its values, but may be wider than necessary after rows
+ * are overwritten. Zones without rows are empty, i.e., with the minimum above
+ * the maximum. There are `n_zones` zones covering the capacity of the table.
+ */
+typedef struct ZoneMap {
+  int *mins;
+  int *maxs;
+  size_t n_zones;
+} ZoneMap;
+
 /**
  * A column in a table.
  *
  * This struct contains the name of the column, a pointer to the column data,
- * the file descriptor of the column data, and the column index (NULL if not
- * exist). The column data is always mmap'ed (instead of malloc'ed).
+ * the file descriptor of the column data, the column index (NULL if not
+ * exist), and the zone map. The column data is always mmap'ed (instead of
+ * malloc'ed).
  */
 typedef struct Column {
   char name[MAX_SIZE_NAME];
@@ -53,6 +73,7 @@ typedef struct Column {
   int fd;
   ColumnIndexType index_type;
   ColumnIndex index;
+  ZoneMap zone_map;
 } Column;
 
 /**
@@ -66,7 +87,11 @@ typedef struct Column {
  * initialized, which is useful when we iteratively create the columns of a new
  * table. The capacity of the table, however, will be adjusted dynamically as
  * needed. `primary` is the index of the column with a clustered index, or
- * `__SIZE_MAX__` if no column has a clustered index.
+ * `__SIZE_MAX__` if no column has a clustered index. `loader` identifies the
+ * load command that is streaming rows into the table, or is NULL if there is
+ * none; such a load stages the rows past the last row, where they are invisible
+ * until the load is concluded, so no other command may change the number of
+ * rows of the table in the meantime. It is not persisted.
  */
 typedef struct Table {
   char name[MAX_SIZE_NAME];
@@ -76,6 +101,7 @@ typedef struct Table {
   size_t n_rows;
   size_t capacity;
   size_t primary;
+  void *loader;
 } Table;
 
 /**
@@ -101,6 +127,18 @@ typedef struct Db {
  */
 extern Db *__DB__;
 
+/**
+ * The reader/writer lock protecting the catalog.
+ *
+ * Every access to `__DB__` and the tables and columns reachable from it (e.g.,
+ * via `lookup_table` and `lookup_column`) must happen while holding this lock.
+ * Read-only queries take it shared so that they can run concurrently across
+ * client connections, while queries that modify the schema or the data take it
+ * exclusively and are thus serialized. Use `catalog_read_lock`,
+ * `catalog_write_lock`, and `catalog_unlock` instead of touching it directly.
+ */
+extern pthread_rwlock_t __catalog_lock__;
+
 typedef enum DbSchemaStatus {
   // The operation was successful.
   DB_SCHEMA_STATUS_OK,
@@ -116,6 +154,8 @@ typedef enum DbSchemaStatus {
   DB_SCHEMA_STATUS_TABLE_FULL,
   // The table does not have the specified number of columns initialized.
   DB_SCHEMA_STATUS_TABLE_NOT_FULL,
+  // The table is being loaded by another command.
+  DB_SCHEMA_STATUS_TABLE_LOADING,
   // The column already exists in the table while it should not.
   DB_SCHEMA_STATUS_COLUMN_ALREADY_EXISTS,
   // The column does not exist while it should.
@@ -138,6 +178,10 @@ typedef enum DbSchemaStatus {
   DB_SCHEMA_STATUS_REALLOC_FAILED,
   // CSV header is not valid for loading.
   DB_SCHEMA_STATUS_CSV_INVALID_HEADER,
+  // CSV file cannot be opened for loading.
+  DB_SCHEMA_STATUS_CSV_OPEN_FAILED,
+  // CSV data is not valid for loading.
+  DB_SCHEMA_STATUS_CSV_INVALID_DATA,
   // Parallelization is requested by not initialized.
   DB_SCHEMA_STATUS_PARALLEL_NOT_INITIALIZED,
   // Internal execution error for none of the reasons above.
@@ -161,6 +205,26 @@ int system_launch();
  */
 int system_shutdown();
 
+/**
+ * Acquire the catalog lock for shared (read-only) access.
+ *
+ * This function blocks until no writer holds the lock.
+ */
+void catalog_read_lock();
+
+/**
+ * Acquire the catalog lock for exclusive (read-write) access.
+ *
+ * This function blocks until no other reader or writer holds the lock.
+ */
+void catalog_write_lock();
+
+/**
+ * Release the catalog lock acquired by either `catalog_read_lock` or
+ * `catalog_write_lock`.
+ */
+void catalog_unlock();
+
 /**
  * Format the status code into a human-readable string.
  */
@@ -62,10 +62,20 @@ void close_csv(CSV *csv);
  * Parse the next row of the CSV file.
  *
  * This function will store the parsed integers in the buffer and returns the
- * parsing status code.
+ * parsing status code. Values that do not fit in an int are parsing errors.
  */
 CSVParseStatus parse_next_row(CSV *csv, int *buffer);
 
+/**
+ * Write a columnar result in text format to a file stream.
+ *
+ * The payload is a binary columnar result (see `ColumnarResultHeader`) of the
+ * given length. Each row is written on its own line with values separated by
+ * commas, where floating-point numbers are formatted by rounding to two decimal
+ * places. This function returns 0 on success, or -1 if the payload is malformed.
+ */
+int write_columnar_result(FILE *out, char *payload, size_t length);
+
 /**
  * Get the catalog file for database persistence.
  *
@@ -1,113 +1,211 @@
-/**
- * @file message.h
- *
- * This header defines the message interface used for communication between
- * client and server.
- */
-
-#ifndef MESSAGE_H__
-#define MESSAGE_H__
-
-#include <stdbool.h>
-
-/**
- * A message status that indicates the status of the previous request.
- */
-typedef enum MessageStatus {
-  /**
-   * Server successfully processed the client request.
-   *
-   * The corresponding payload should be the execution result of the request
-   * that needs to be displayed on the client side, if any. If there is nothing
-   * to display, the payload should be left empty.
-   */
-  MESSAGE_STATUS_OK,
-  /**
-   * Server received an invalid command from the client.
-   *
-   * The corresponding payload is empty and should be ignored.
-   */
-  MESSAGE_STATUS_INVALID_COMMAND,
-  /**
-   * Server received a valid command but cannot parse into a valid DbOperator.
-   *
-   * The corresponding payload is the error message.
-   */
-  MESSAGE_STATUS_PARSE_ERROR,
-  /**
-   * Server failed to batch the command as requested.
-   *
-   * The corresponding payload is the error message.
-   */
-  MESSAGE_STATUS_BATCH_ERROR,
-  /**
-   * Server failed to execute the client request.
-   *
-   * In this case, though the command is parsed into a valid DbOperator, the
-   * server failed to execute that DbOperator. The corresponding payload is the
-   * error message.
-   */
-  MESSAGE_STATUS_EXECUTION_ERROR,
-  /**
-   * Server failed to execute the client request and the reason is unknown.
-   *
-   * In this case, though the command is parsed into a valid DbOperator, the
-   * server failed to execute that DbOperator and the reason is unknown. The
-   * corresponding payload is empty and should be ignored.
-   */
-  MESSAGE_STATUS_UNKNOWN_EXECUTION_ERROR,
-  /**
-   * Client requested the server to process the command.
-   *
-   * The corresponding payload is the command to be processed.
-   */
-  MESSAGE_STATUS_C_REQUEST_PROCESS_COMMAND,
-  /**
-   * Client sent the number of columns in the CSV to the server.
-   *
-   * The corresponding payload is the number of columns (size_t).
-   */
-  MESSAGE_STATUS_C_SENDING_CSV_N_COLS,
-  /**
-   * Client sent the CSV header to the server.
-   *
-   * The corresponding payload is the string of the header row in the loaded
-   * CSV file.
-   */
-  MESSAGE_STATUS_C_SENDING_CSV_HEADER,
-  /**
-   * Client sent a batch of CSV rows to the server.
-   *
-   * The corresponding payload is a 2D array of integers flattened into 1D, with
-   * the first dimension corresponding to the number of rows in the batch,
-   * computed as `length / (n_cols * sizeof(int))`, and the second dimension
-   * corresponding to the number of columns in the CSV that should have been
-   * sent in a previous MESSAGE_STATUS_C_SENDING_CSV_N_COLS message.
-   */
-  MESSAGE_STATUS_C_SENDING_CSV_ROWS,
-  /**
-   * Client finished sending the CSV file to the server.
-   *
-   * The corresponding payload is empty.
-   */
-  MESSAGE_STATUS_C_SENDING_CSV_FINISHED,
-} MessageStatus;
-
-/**
- * A single message to be sent between client and server.
- *
- * This struct contains the status of the message, the length of the payload,
- * the payload itself, and a flag indicating whether the payload is malloc'ed.
- * Note that the flag is not telling the receiver to free the payload - the
- * payload is always copied to a buffer and sent over network to the receiver;
- * it is telling the sender whether it should be freed after copying to the
- * buffer.
- */
-typedef struct Message {
-  MessageStatus status;
-  int length;
-  char *payload;
-  bool is_malloced;
-} Message;
-
-#endif /* MESSAGE_H__ */
+/**
+ * @file message.h
+ *
+ * This header defines the message interface used for communication between
+ * client and server.
+ */
+
+#ifndef MESSAGE_H__
+#define MESSAGE_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/uio.h>
+
+#include "consts.h"
+
+/**
+ * A message status that indicates the status of the previous request.
+ */
+typedef enum MessageStatus {
+  /**
+   * Server successfully processed the client request.
+   *
+   * The corresponding payload should be the execution result of the request
+   * that needs to be displayed on the client side, if any. If there is nothing
+   * to display, the payload should be left empty.
+   */
+  MESSAGE_STATUS_OK,
+  /**
+   * Server successfully processed the client request with a columnar result.
+   *
+   * The corresponding payload is the execution result in binary columnar
+   * format (see `ColumnarResultHeader`), which the client is responsible for
+   * formatting for display.
+   */
+  MESSAGE_STATUS_OK_COLUMNAR,
+  /**
+   * Server received an invalid command from the client.
+   *
+   * The corresponding payload is empty and should be ignored.
+   */
+  MESSAGE_STATUS_INVALID_COMMAND,
+  /**
+   * Server received a valid command but cannot parse into a valid DbOperator.
+   *
+   * The corresponding payload is the error message.
+   */
+  MESSAGE_STATUS_PARSE_ERROR,
+  /**
+   * Server failed to batch the command as requested.
+   *
+   * The corresponding payload is the error message.
+   */
+  MESSAGE_STATUS_BATCH_ERROR,
+  /**
+   * Server failed to execute the client request.
+   *
+   * In this case, though the command is parsed into a valid DbOperator, the
+   * server failed to execute that DbOperator. The corresponding payload is the
+   * error message.
+   */
+  MESSAGE_STATUS_EXECUTION_ERROR,
+  /**
+   * Server failed to execute the client request and the reason is unknown.
+   *
+   * In this case, though the command is parsed into a valid DbOperator, the
+   * server failed to execute that DbOperator and the reason is unknown. The
+   * corresponding payload is empty and should be ignored.
+   */
+  MESSAGE_STATUS_UNKNOWN_EXECUTION_ERROR,
+  /**
+   * Client requested the server to process the command.
+   *
+   * The corresponding payload is the command to be processed.
+   */
+  MESSAGE_STATUS_C_REQUEST_PROCESS_COMMAND,
+  /**
+   * Client sent the parameters of loading a CSV to the server.
+   *
+   * The corresponding payload is a `LoadParameters` struct.
+   */
+  MESSAGE_STATUS_C_SENDING_CSV_PARAMETERS,
+  /**
+   * Client sent the CSV header to the server.
+   *
+   * The corresponding payload is the string of the header row in the loaded
+   * CSV file. The server responds with the negotiated batch size in bytes
+   * (size_t) on success, or with an error that terminates the load.
+   */
+  MESSAGE_STATUS_C_SENDING_CSV_HEADER,
+  /**
+   * Client sent a batch of CSV rows to the server.
+   *
+   * The corresponding payload is a 2D array of integers flattened into 1D, with
+   * the first dimension corresponding to the number of rows in the batch,
+   * computed as `length / (n_cols * sizeof(int))`, and the second dimension
+   * corresponding to the number of columns in the CSV that should have been
+   * sent in a previous MESSAGE_STATUS_C_SENDING_CSV_PARAMETERS message. The
+   * payload must not exceed the negotiated batch size. The server does not
+   * respond unless it fails, in which case it responds with an error once and
+   * ignores the rest of the load.
+   */
+  MESSAGE_STATUS_C_SENDING_CSV_ROWS,
+  /**
+   * Client finished sending the CSV file to the server.
+   *
+   * The corresponding payload is empty. The server responds with the result of
+   * the load, unless it has already responded with an error.
+   */
+  MESSAGE_STATUS_C_SENDING_CSV_FINISHED,
+  /**
+   * Client sent a shared memory channel to the server.
+   *
+   * The corresponding payload is empty. The file descriptor of the channel is
+   * passed along with the message header as ancillary data.
+   */
+  MESSAGE_STATUS_C_SHARING_MEMORY,
+} MessageStatus;
+
+/**
+ * The type of the values in a column of a columnar result.
+ */
+typedef enum ColumnarValueType {
+  COLUMNAR_VALUE_TYPE_INT,
+  COLUMNAR_VALUE_TYPE_LONG_LONG,
+  COLUMNAR_VALUE_TYPE_DOUBLE,
+} ColumnarValueType;
+
+/**
+ * Get the size of a value of a columnar value type, or 0 if the type is
+ * invalid.
+ */
+static inline size_t columnar_value_size(ColumnarValueType type) {
+  switch (type) {
+  case COLUMNAR_VALUE_TYPE_INT:
+    return sizeof(int);
+  case COLUMNAR_VALUE_TYPE_LONG_LONG:
+    return sizeof(long long);
+  case COLUMNAR_VALUE_TYPE_DOUBLE:
+    return sizeof(double);
+  }
+  return 0;
+}
+
+/**
+ * The header of a columnar result.
+ *
+ * A columnar result payload starts with this header, followed by the raw values
+ * of each of the `n_cols` columns one after another. Each column consists of
+ * `n_rows` values of the corresponding type in `types` stored contiguously,
+ * i.e., `n_rows * sizeof(<type>)` bytes. Note that the values are not
+ * necessarily aligned in the payload.
+ */
+typedef struct ColumnarResultHeader {
+  size_t n_cols;
+  size_t n_rows;
+  ColumnarValueType types[MAX_PRINT_HANDLES];
+} ColumnarResultHeader;
+
+/**
+ * The parameters of loading a CSV.
+ *
+ * This records the number of columns in the CSV and the batch size in bytes
+ * proposed by the client for sending the rows. The server may lower the batch
+ * size and responds with the negotiated one.
+ */
+typedef struct LoadParameters {
+  size_t n_cols;
+  size_t batch_size;
+} LoadParameters;
+
+/**
+ * A single message to be sent between client and server.
+ *
+ * This struct contains the status of the message, the sequence number of the
+ * message, the length of the payload, the payload itself, and a flag indicating
+ * whether the payload is malloc'ed. The sequence number is chosen by the client
+ * for each request, and the server echoes it in the corresponding response, so
+ * that the client can match responses to pipelined requests. A response may
+ * consist of multiple messages of the same sequence number (e.g., the results
+ * of a script streamed back line by line), in which case all but the last one
+ * are marked as partial.
+ * Note that the flag is not telling the receiver to free the payload - the
+ * payload is sent over network to the receiver directly from its buffer; it is
+ * telling the sender whether it should be freed after being sent.
+ *
+ * Alternatively, the sender may specify the payload as a malloc'ed array of
+ * `n_segments` segments (in which case `n_segments` is positive) that are sent
+ * one after another as is, e.g., to send views of column memory without copying
+ * them into a single buffer. `length` is then the total length of all segments,
+ * and the segment array (but not the memory it points to) is always freed
+ * after being sent; `payload` and `is_malloced` still apply, so a segment may
+ * point into `payload`. None of these pointers mean anything to the receiver.
+ *
+ * If the client and the server share a memory channel, a large payload may be
+ * moved through that channel instead of the socket, in which case `is_shared`
+ * is set and only the header is sent over the socket.
+ */
+typedef struct Message {
+  MessageStatus status;
+  unsigned int sequence;
+  bool is_partial;
+  bool is_shared;
+  int length;
+  char *payload;
+  bool is_malloced;
+  struct iovec *segments;
+  int n_segments;
+} Message;
+
+#endif /* MESSAGE_H__ */
@@ -45,6 +45,28 @@ DbOperator *parse_command(char *query_command, Message *send_message,
                           int client, ClientContext *context,
                           BatchContext *batch_context);
 
+/**
+ * Check whether a command string requires exclusive access to the catalog.
+ *
+ * This is a lightweight check on the raw command string (i.e., before being
+ * parsed) that allows the caller to acquire the catalog lock in the proper mode
+ * before parsing and executing the command. Comments and unrecognized commands
+ * are considered non-exclusive.
+ */
+bool command_requires_exclusive_access(const char *query_command);
+
+/**
+ * Parse a source command into the paths of the script and the output file.
+ *
+ * The command should be in the form of `source("<script>")` or
+ * `source("<script>","<output>")`, with optional whitespaces around the quoted
+ * paths. The paths point into the command string, which is modified in place,
+ * and the output path is set to NULL if not given. This function returns
+ * whether the command is well-formed.
+ */
+bool parse_source_command(char *query_command, char **script_path,
+                          char **output_path);
+
 /**
  * Set or reset a batch context to initial state.
  *
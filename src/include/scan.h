@@ -11,6 +11,24 @@
 
 #include "client_context.h"
 
+/**
+ * The elementary intervals of a batch of select queries.
+ *
+ * The distinct bounds of all queries, sorted, are the `n_boundaries` entries of
+ * `boundaries`. They split the values into `n_boundaries + 1` elementary
+ * intervals, where the k-th interval contains the values with exactly k
+ * boundaries at or below them. Every query either matches all values of an
+ * elementary interval or none of them, so the matching queries can be listed
+ * per interval: those of the k-th interval are `queries[query_offsets[k]]` up
+ * to (exclusive) `queries[query_offsets[k + 1]]`.
+ */
+typedef struct SelectIntervals {
+  long *boundaries;
+  size_t n_boundaries;
+  size_t *query_offsets;
+  size_t *queries;
+} SelectIntervals;
+
 /**
  * The context of a shared scanning.
  *
@@ -20,20 +38,54 @@
  *
  * NOTE: `selected_indices_arr` is `n_select_queries` pointers, each pointing to
  * the selected indices data. It is meant to be used by the caller of the shared
- * scan. `selected_indices_arr_flattened` is a flattened and "transposed" array,
- * which can be viewed as shape (data_length, n_select_queries). It is used
- * internally for better cache locality to reduce cache write misses.
+ * scan. During the scan, the kernels write directly to these buffers, whose
+ * capacities are tracked in `selected_capacity_arr` and grown geometrically as
+ * needed, so that memory is proportional to the number of selected indices
+ * rather than the length of the scan. If growing a buffer fails, the scan stops
+ * early and `status` is set accordingly.
+ *
+ * If `selected_masks_arr` is given, the select queries with a non-NULL entry
+ * set their selected positions in that (caller-allocated) bit vector instead,
+ * and their entries in `selected_indices_arr` are NULL. The counts are kept in
+ * `n_selected_indices_arr` either way. When scanning values that correspond to
+ * the set bits of a boolean mask position vector, `mask_position` is the bit
+ * at which to start looking for the position of the first value of the range.
+ *
+ * For large batches of select queries, `select_intervals` is set internally so
+ * that each value is matched against the queries in logarithmic time instead of
+ * comparing against every query.
+ *
+ * If `zone_map` is set, the zones of the scanned column that no select query
+ * can match are skipped entirely. This is set internally for scans over a whole
+ * column that only select.
+ *
+ * If `gather_posvec` is set, the scan aggregates the values at the positions of
+ * that position vector instead of all values, and the scan ranges are over its
+ * positions. This is set internally by `shared_scan_gather`.
+ *
+ * If `fetch_valvec` is set, the scan aggregates the values of that value vector
+ * at the positions where the scanned values match the single select query, and
+ * counts these positions in `count_result`. This is set internally by
+ * `shared_scan_fused`.
  */
 typedef struct ScanContext {
   long *lower_bound_arr;
   long *upper_bound_arr;
   size_t **selected_indices_arr;
-  size_t *selected_indices_arr_flattened;
+  size_t *selected_capacity_arr;
+  BitVector **selected_masks_arr;
+  SelectIntervals *select_intervals;
+  ZoneMap *zone_map;
+  GeneralizedPosvec *gather_posvec;
+  GeneralizedValvec *fetch_valvec;
   size_t *n_selected_indices_arr;
   size_t n_select_queries;
+  size_t mask_position;
   int min_result;
   int max_result;
   long long sum_result;
+  size_t count_result;
+  DbSchemaStatus status;
 } ScanContext;
 
 /**
@@ -45,9 +97,11 @@ typedef void (*SharedScanFunc)(GeneralizedValvec *, GeneralizedPosvec *,
 /**
  * The data for a shared scan task.
  *
- * This data is used for tasks in the shared scan task queue in multi-threaded
+ * This data is used for tasks in the shared scan task group in multi-threaded
  * execution. The start and end indices mark the range of the value vector to
- * scan through, with starting index inclusive and ending index exclusive.
+ * scan through, with starting index inclusive and ending index exclusive. Each
+ * task scans into its own context, which is merged into the overall context
+ * once all tasks are completed.
  */
 typedef struct SharedScanTaskData {
   SharedScanFunc shared_scan_func;
@@ -55,7 +109,7 @@ typedef struct SharedScanTaskData {
   GeneralizedPosvec *posvec;
   size_t start;
   size_t end;
-  ScanContext *ctx;
+  ScanContext ctx;
 } SharedScanTaskData;
 
 /**
@@ -66,6 +120,19 @@ typedef struct SharedScanTaskData {
  */
 ScanContext init_empty_scan_context();
 
+/**
+ * Decide the output of a select query over a value vector.
+ *
+ * The selectivity is estimated from a sample of the values. If enough positions
+ * are expected to be selected for a boolean mask to be the more compact output,
+ * this returns the length of the mask, i.e., the number of positions that can
+ * be selected; otherwise this returns 0 and the output should be an index
+ * array. Selections within an index array position vector always output index
+ * arrays, since the range of their positions is unknown.
+ */
+size_t select_mask_length(GeneralizedValvec *valvec, GeneralizedPosvec *posvec,
+                          long lower_bound, long upper_bound);
+
 /**
  * Worker subroutine for shared scan.
  */
@@ -75,12 +142,45 @@ void shared_scan_subroutine(SharedScanTaskData *task_data);
  * The main shared scan function.
  *
  * Given the flags, this function will dispatch a suitable shared scan routine
- * either in parallel or sequentially depending on the global configuration.
- * The scan context should be properly initialized before calling this function,
+ * either in parallel or sequentially depending on the global configuration;
+ * even in multi-threaded mode, scans that are too small to benefit from the
+ * parallelization on the current processors and caches are sequential. The
+ * scan context should be properly initialized before calling this function,
  * which will be updated with the results on successful return. The function
  * will return the status code of the operation.
  */
 DbSchemaStatus shared_scan(GeneralizedValvec *valvec, GeneralizedPosvec *posvec,
                            ScanContext *ctx, int flags);
 
+/**
+ * The shared scan function for aggregations over the values at the positions of
+ * a position vector.
+ *
+ * This is equivalent to fetching the values at the positions and then running
+ * `shared_scan` over them, but the values are aggregated as they are gathered
+ * without being materialized. The flags must not include SELECT. The scan is
+ * parallelized over the positions like `shared_scan`, with the partial
+ * aggregates of the tasks merged at the end. The function will return the
+ * status code of the operation.
+ */
+DbSchemaStatus shared_scan_gather(GeneralizedValvec *valvec,
+                                  GeneralizedPosvec *posvec, ScanContext *ctx,
+                                  int flags);
+
+/**
+ * The shared scan function for aggregations over the values of a value vector
+ * at the positions selected from another value vector.
+ *
+ * This is equivalent to selecting from `valvec` with the single select query of
+ * the context, fetching the values of `fetch_valvec` at the selected positions,
+ * and then running `shared_scan` over them, but all three are done in a single
+ * pass without materializing the positions or the fetched values. The value
+ * vectors must have the same length, and the flags must not include SELECT.
+ * The number of selected positions is set in `count_result`. The function will
+ * return the status code of the operation.
+ */
+DbSchemaStatus shared_scan_fused(GeneralizedValvec *valvec,
+                                 GeneralizedValvec *fetch_valvec,
+                                 ScanContext *ctx, int flags);
+
 #endif /* SCAN_H__ */
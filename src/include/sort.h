@@ -99,4 +99,18 @@ int kmerge(int *arr, size_t k, size_t *sizes, size_t total_size);
 int akmerge(int *arr, size_t *tosort, size_t k, size_t *sizes,
             size_t total_size);
 
+/**
+ * Sort positions via LSD radix sort.
+ *
+ * This function takes an array of positions and the size. The array will be
+ * sorted in ascending order in-place. The function returns 0 on success and -1
+ * on failure.
+ *
+ * Note that this sorting is stable and takes linear time. The number of passes
+ * depends on the largest position, and digits that are the same for all
+ * positions are skipped, so positions within a column of n rows take about
+ * log2(n)/11 passes. It needs a temporary buffer of the same size as the array.
+ */
+int radixsort(size_t *arr, size_t size);
+
 #endif // SORT_H__
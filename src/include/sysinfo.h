@@ -8,6 +8,8 @@
 #ifndef SYSINFO_H__
 #define SYSINFO_H__
 
+#include <stdbool.h>
+
 /**
  * The number of processors currently available in the system.
  */
@@ -18,6 +20,21 @@ extern int __n_processors__;
  */
 extern int __page_size__;
 
+/**
+ * The size of the level 1 data cache of a processor in bytes.
+ */
+extern long __l1d_cache_size__;
+
+/**
+ * The size of the level 2 cache of a processor in bytes.
+ */
+extern long __l2_cache_size__;
+
+/**
+ * The size of the level 3 cache in bytes.
+ */
+extern long __l3_cache_size__;
+
 /**
  * The average load of the system in the last 1 minute.
  */
@@ -33,8 +50,26 @@ extern double __avg_load_5__;
  */
 extern double __avg_load_15__;
 
+/**
+ * Whether the processor supports AVX2 instructions.
+ */
+extern bool __has_avx2__;
+
+/**
+ * Attribute to compile a function for processors with AVX2 instructions.
+ *
+ * The system is otherwise compiled for the baseline instruction set, so such a
+ * function must only be called if `__has_avx2__` is true. Helpers that use AVX2
+ * intrinsics need it as well, since they can only be inlined into functions
+ * that are compiled for AVX2.
+ */
+#define TARGET_AVX2 __attribute__((target("avx2")))
+
 /**
  * Initialize system information.
+ *
+ * Cache sizes are read from sysfs for the first processor, and fall back to
+ * default values if they are not available (e.g., in some containers).
  */
 void init_sysinfo();
 
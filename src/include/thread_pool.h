@@ -1,10 +1,10 @@
 /**
  * @file thread_pool.h
  *
- * This header defines the thread pool and task queue structures and operations
- * for multi-threaded execution. It also provides global variables for thread
- * pools and task queues used in the system so that they can be accessed from
- * different parts of the system.
+ * This header defines the work-stealing thread pool and task queue structures
+ * and operations for multi-threaded execution. It also provides global
+ * variables for thread pools and task queues used in the system so that they
+ * can be accessed from different parts of the system.
  */
 
 #ifndef THREAD_POOL_H__
@@ -12,6 +12,7 @@
 
 #include <pthread.h>
 #include <stdbool.h>
+#include <stddef.h>
 
 #include "consts.h"
 
@@ -19,14 +20,35 @@
  * The type of a thread task.
  *
  * Specially, `THREAD_TASK_TYPE_TERMINATE` is used to signal the worker threads
- * to terminate.
+ * to terminate. `THREAD_TASK_TYPE_CLIENT_REQUEST` is the processing of a
+ * complete message received from a client connection; it is enqueued on its own
+ * rather than as part of a task group, since no one waits for its completion.
  */
 typedef enum ThreadTaskType {
   THREAD_TASK_TYPE_TERMINATE,
   THREAD_TASK_TYPE_SHARED_SCAN,
   THREAD_TASK_TYPE_HASH_JOIN,
+  THREAD_TASK_TYPE_LOAD_CHUNK,
+  THREAD_TASK_TYPE_ADDSUB_CHUNK,
+  THREAD_TASK_TYPE_FETCH_CHUNK,
+  THREAD_TASK_TYPE_CLIENT_REQUEST,
 } ThreadTaskType;
 
+/**
+ * A group of thread tasks.
+ *
+ * This is a completion latch owned by the producer of the tasks, typically on
+ * its stack, so that the tasks of concurrent producers (e.g., two queries) are
+ * accounted for separately. The number of tasks is only touched by the producer
+ * when enqueueing, while the number of completed tasks is incremented by the
+ * threads executing the tasks. A task may itself fork a nested group of
+ * subtasks and wait for them.
+ */
+typedef struct ThreadTaskGroup {
+  int n_tasks;
+  int n_completed;
+} ThreadTaskGroup;
+
 /**
  * A thread task structure.
  *
@@ -34,49 +56,88 @@ typedef enum ThreadTaskType {
  * the worker threads (which can essentially be any data type as long as it can
  * be handled by the corresponding worker function). Task type indicates how the
  * task data is meant to be handled. The ID servers as a unique identifier that
- * is mainly for debugging and logging purposes.
+ * is mainly for debugging and logging purposes. The group is NULL if the task
+ * is not part of any task group.
  */
 typedef struct ThreadTask {
   int id;
   ThreadTaskType type;
   void *data;
+  ThreadTaskGroup *group;
 } ThreadTask;
 
 /**
  * A thread task queue structure.
  *
  * This structure contains a circular buffer of thread tasks, which is used to
- * store tasks for the worker threads to consume. The queue is thread-safe and
- * supports blocking operations for both enqueue and dequeue operations. The
- * mutex is used to protect the queue from concurrent access. The mutexes
- * respectively signal when the queue is not empty, the queue is not full, and
- * some task is completed.
+ * store the tasks enqueued by threads outside of the thread pool (e.g., client
+ * requests dispatched by the event loop). The mutex is used to protect the
+ * queue from concurrent access, and the condition variable signals when the
+ * queue is not full.
  */
 typedef struct ThreadTaskQueue {
   ThreadTask tasks[THREAD_TASK_QUEUE_SIZE];
   int front;
   int rear;
   int count;
-  int n_completed;
   pthread_mutex_t mutex;
-  pthread_cond_t cond_non_empty;
   pthread_cond_t cond_non_full;
-  pthread_cond_t cond_completed;
 } ThreadTaskQueue;
 
+/**
+ * A work-stealing task deque structure.
+ *
+ * This is a fixed-size lock-free deque in the style of Chase and Lev. The owner
+ * worker pushes and pops tasks at the bottom, while other threads steal tasks
+ * from the top, so the owner runs its most recently forked tasks first and the
+ * thieves take the oldest (usually largest) ones. The tasks are placed between
+ * the two indices so that the owner and the thieves do not write to the same
+ * cache line.
+ */
+typedef struct ThreadTaskDeque {
+  long top;
+  ThreadTask tasks[THREAD_TASK_DEQUE_SIZE];
+  long bottom;
+} ThreadTaskDeque;
+
+struct ThreadPool;
+
+/**
+ * A worker thread structure, holding the task deque of the worker.
+ */
+typedef struct ThreadWorker {
+  pthread_t thread;
+  int index;
+  struct ThreadPool *pool;
+  ThreadTaskDeque deque;
+} ThreadWorker;
+
 /**
  * A thread pool structure.
  *
- * This structure contains the task queue, the worker threads, and the number of
- * workers in the thread pool. It also contains a flag indicating whether the
- * thread pool has initialized a shutdown, which is useful when signaling
- * workers to exit.
+ * This structure contains the shared task queue, the worker threads, and the
+ * number of workers in the thread pool. It also contains a flag indicating
+ * whether the thread pool has initialized a shutdown, which is useful when
+ * signaling workers to exit. Tasks enqueued by a worker go to its own deque and
+ * may be stolen by other workers; tasks enqueued by other threads go to the
+ * shared task queue. Idle workers park on the park condition variable, and
+ * threads waiting for a task group sleep on the completion condition
+ * variable; the counters tell whether anyone needs to be waked up, so that the
+ * busy paths never take the corresponding mutexes. The task handler is called
+ * by the workers on each dequeued task.
  */
 typedef struct ThreadPool {
   ThreadTaskQueue queue;
-  pthread_t *workers;
+  ThreadWorker *workers;
   int n_workers;
   bool shutdown_inited;
+  pthread_mutex_t park_mutex;
+  pthread_cond_t cond_park;
+  int n_parked;
+  pthread_mutex_t completion_mutex;
+  pthread_cond_t cond_completed;
+  int n_waiting;
+  void (*task_handler)(ThreadTask *);
 } ThreadPool;
 
 /**
@@ -92,63 +153,75 @@ int next_task_id();
  * Initialize a thread pool.
  *
  * This function initializes a thread pool with the specified number of worker
- * threads and a task queue.
+ * threads, their task deques, and the shared task queue. Each worker runs the
+ * tasks of its own deque, then those of the shared queue, then steals from the
+ * other workers, and parks when there is no task anywhere, until the thread
+ * pool is shut down.
  */
 void thread_pool_init(ThreadPool *pool, int n_workers,
-                      void *(*worker_func)(void *));
+                      void (*task_handler)(ThreadTask *));
 
 /**
  * Shutdown a thread pool.
  *
- * This function will mark the thread pool as shutdown initialized and signal
+ * This function will mark the thread pool as shutdown initialized and wake up
  * all worker threads. It will then join all worker threads and destroy the task
  * queue.
  */
 void thread_pool_shutdown(ThreadPool *pool);
 
 /**
- * Enqueue a task into the task queue of a thread pool.
+ * Enqueue a task that is not part of any task group into a thread pool.
  *
- * This function enqueues a task into the task queue. If the queue is full, it
- * will block until a consumer dequeues a task.
+ * The task is enqueued into the shared task queue, blocking until a worker
+ * dequeues a task if the queue is full, and a parked worker is waked up to run
+ * it.
  */
 void thread_pool_enqueue_task(ThreadPool *pool, ThreadTask *task);
 
 /**
- * Dequeue a task from the task queue of a thread pool.
- *
- * This function dequeues a task from the task queue. If the queue is empty, it
- * will block until a producer enqueues a task. If the thread pool has
- * initialized a shutdown, it will return a termination task.
+ * Initialize an empty task group.
  */
-ThreadTask thread_pool_dequeue_task(ThreadPool *pool);
+void thread_task_group_init(ThreadTaskGroup *group);
 
 /**
- * Reset the completion status of a thread task queue.
+ * Enqueue a batch of tasks of the same type into a thread pool as part of a
+ * task group.
  *
- * This essentially resets the number of completed tasks in the task queue to
- * zero, which is useful when we need to wait for a certain number of tasks to
- * complete.
+ * The data of the tasks are held in a caller-provided arena of `n_tasks`
+ * consecutive elements of `data_size` bytes each, which must stay valid until
+ * the task group is waited for. If the calling thread is a worker of the thread
+ * pool, the tasks are pushed to its own deque, each being executed right away
+ * if the deque is full; otherwise, the tasks are enqueued into the shared task
+ * queue, blocking whenever the queue is full. Parked workers are waked up to
+ * run or steal the tasks.
  */
-void thread_pool_reset_queue_completion(ThreadPool *pool);
+void thread_pool_enqueue_group(ThreadPool *pool, ThreadTaskGroup *group,
+                               ThreadTaskType type, void *data,
+                               size_t data_size, int n_tasks);
 
 /**
- * Mark a single task completion in a thread task queue.
+ * Wait for all tasks of a task group to complete.
  *
- * This function increments the number of completed tasks in the task queue and
- * signals that a task is completed, so that the checker thread can be waked up.
+ * While waiting, the calling thread helps executing tasks that are part of any
+ * task group, starting from those in its own deque; this is necessary when the
+ * caller is itself a worker (e.g., processing a client request or a task that
+ * forks subtasks), otherwise all workers may end up waiting for tasks that no
+ * one is available to execute.
  */
-void thread_pool_mark_task_completion(ThreadPool *pool);
+void thread_pool_wait_group(ThreadPool *pool, ThreadTaskGroup *group);
 
 /**
- * Wait for a certain number of tasks to complete in a thread task queue.
+ * Choose the number of tasks to split a job of `n_units` evenly costly units
+ * into.
  *
- * This function will block until the number of completed tasks in the task
- * queue reaches the specified number of tasks. Note that this function must be
- * called after a completion status reset, and that no irrelevant tasks should
- * be enqueued after the reset.
+ * There is at most one task per thread that can execute them, i.e., the workers
+ * of the global thread pool and the current thread which helps executing the
+ * tasks while waiting, and each task has at least `min_units_per_task` units.
+ * This returns 1 if the job should rather run directly on the current thread,
+ * including when the system is not in multi-threaded mode.
  */
-void thread_pool_wait_queue_completion(ThreadPool *pool, int n_tasks);
+int thread_pool_n_tasks(size_t n_units, size_t min_units_per_task);
 
 /**
  * A global flag indicating whether the system is in multi-threaded mode.
@@ -157,6 +230,11 @@ void thread_pool_wait_queue_completion(ThreadPool *pool, int n_tasks);
  * `single_core()` and `single_core_execute()` commands. The system will run
  * operations in multi-threaded mode when possible if this flag is on.
  *
+ * The mode is server-wide: a switch by any client applies to the queries of all
+ * clients from then on. The flag is only switched with the catalog write lock
+ * held, and only read by queries that execute with the catalog lock held, so a
+ * query never sees the mode change while it is being executed.
+ *
  * Note that this flag has nothing to do with whether a specific thread pool or
  * task queue is initialized or not. In particular, if we are in multi-threaded
  * mode and the thread pool or task queue is not initialized, it is an error.
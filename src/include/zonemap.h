@@ -0,0 +1,56 @@
+/**
+ * @file zonemap.h
+ *
+ * This header contains utilities for maintaining the zone maps of columns.
+ */
+
+#ifndef ZONEMAP_H__
+#define ZONEMAP_H__
+
+#include <stdbool.h>
+
+#include "db_schema.h"
+
+/**
+ * Initialize the zone map of a column.
+ *
+ * Zones are allocated for the capacity of the table, and those covering the
+ * existing rows are computed from the column data, unless `skip_computing` is
+ * true (e.g., when the zones are to be read from the persisted catalog), in
+ * which case all zones are empty. This function returns the status code of the
+ * operation.
+ */
+DbSchemaStatus init_zone_map(Table *table, Column *column, bool skip_computing);
+
+/**
+ * Resize the zone map of a column to cover a new table capacity.
+ *
+ * Zones within both the old and the new capacity are kept, and new zones are
+ * empty. This function returns the status code of the operation.
+ */
+DbSchemaStatus resize_zone_map(Column *column, size_t new_capacity);
+
+/**
+ * Widen the zone containing the specified row to include the value.
+ *
+ * This is meant for rows that are appended or overwritten in place, and leaves
+ * the zone conservative rather than exact if the row used to hold an extreme
+ * value of the zone.
+ */
+void widen_zone_map(Column *column, size_t row, int value);
+
+/**
+ * Recompute the zones of a column from the zone containing the specified row
+ * to the end of the table.
+ *
+ * This is meant for modifications that shift or reorder rows, after which the
+ * zones are exact again. Zones past the last row become empty.
+ */
+void refresh_zone_map(Table *table, Column *column, size_t from);
+
+/**
+ * Free the zone map of a column.
+ */
+void free_zone_map(Column *column);
+
+#endif /* ZONEMAP_H__ */
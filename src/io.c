@@ -6,6 +6,9 @@
 #include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <immintrin.h>
+#include <limits.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/mman.h>
@@ -14,6 +17,43 @@
 
 #include "consts.h"
 #include "io.h"
+#include "message.h"
+#include "sysinfo.h"
+
+/**
+ * The maximum length of a formatted value in a columnar result, plus one for
+ * the separator; the largest double can be ~10^308, which is much longer than
+ * the integer types when formatted with two decimal places.
+ */
+#define MAX_FORMATTED_VALUE_LENGTH 320
+
+/**
+ * Helper function to format an integer in decimal into the buffer.
+ *
+ * This is a much cheaper alternative to `snprintf` for the most common case of
+ * formatting integer columns. It returns the number of characters written,
+ * without null termination.
+ */
+static inline int _format_int(char *buffer, int value) {
+  // Work on the magnitude as unsigned so that INT_MIN does not overflow
+  unsigned int magnitude =
+      value < 0 ? 0u - (unsigned int)value : (unsigned int)value;
+  char digits[10];
+  int n_digits = 0;
+  do {
+    digits[n_digits++] = '0' + magnitude % 10;
+    magnitude /= 10;
+  } while (magnitude > 0);
+
+  int len = 0;
+  if (value < 0) {
+    buffer[len++] = '-';
+  }
+  while (n_digits > 0) {
+    buffer[len++] = digits[--n_digits];
+  }
+  return len;
+}
 
 /**
  * @implements load_csv
@@ -90,58 +130,309 @@ void close_csv(CSV *csv) {
 }
 
 /**
- * @implements parse_next_row
+ * The delimiter scanner for parsing a CSV row.
+ *
+ * This keeps a bitmask of the commas and newlines in a block of 32 bytes
+ * starting at `block`, where the i-th bit is set if the i-th byte is a
+ * delimiter. Fields are then located by bit manipulation instead of being
+ * scanned byte by byte.
  */
-CSVParseStatus parse_next_row(CSV *csv, int *buffer) {
+typedef struct DelimiterScanner {
+  char *block;
+  char *end;
+  uint32_t mask;
+} DelimiterScanner;
+
+/**
+ * Helper function to compute the delimiter bitmask of a full block with AVX2.
+ */
+TARGET_AVX2 static inline uint32_t _scan_block_avx2(char *block) {
+  __m256i bytes = _mm256_loadu_si256((const __m256i *)block);
+  __m256i is_comma = _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(','));
+  __m256i is_newline = _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('\n'));
+  return (uint32_t)_mm256_movemask_epi8(_mm256_or_si256(is_comma, is_newline));
+}
+
+/**
+ * Helper function to compute the delimiter bitmask of a block.
+ *
+ * Blocks with at least 32 bytes before the end are compared with AVX2 if
+ * `use_avx2` is set. Other blocks fall back to a scalar loop, which stops at
+ * the end of the last partial block so that we never read past the end of the
+ * data.
+ */
+static inline void _scan_block(DelimiterScanner *scanner, char *block,
+                               bool use_avx2) {
+  scanner->block = block;
+  if (use_avx2 && scanner->end - block >= 32) {
+    scanner->mask = _scan_block_avx2(block);
+    return;
+  }
+  scanner->mask = 0;
+  int n_bytes = scanner->end - block < 32 ? (int)(scanner->end - block) : 32;
+  for (int i = 0; i < n_bytes; i++) {
+    if (block[i] == ',' || block[i] == '\n') {
+      scanner->mask |= 1u << i;
+    }
+  }
+}
+
+/**
+ * Helper function to find the first delimiter at or after the pointer.
+ *
+ * The pointer must not be before the current block of the scanner. This returns
+ * the end of the data if there is no more delimiter.
+ */
+static inline char *_next_delimiter(DelimiterScanner *scanner, char *ptr,
+                                    bool use_avx2) {
+  while (true) {
+    // The pointer falls before the block once the field spans multiple blocks
+    size_t offset = ptr > scanner->block ? (size_t)(ptr - scanner->block) : 0;
+    if (offset < 32) {
+      uint32_t mask = scanner->mask & (UINT32_MAX << offset);
+      if (mask != 0) {
+        return scanner->block + __builtin_ctz(mask);
+      }
+    }
+    if (scanner->end - scanner->block <= 32) {
+      return scanner->end;
+    }
+    _scan_block(scanner, scanner->block + 32, use_avx2);
+  }
+}
+
+/**
+ * Helper function to convert a run of at most 10 decimal digits that ends right
+ * before `end` into its value, with AVX2 (or rather its SSE subset).
+ *
+ * The 16 bytes ending at `end` are loaded so that the digits are right-aligned
+ * in the register, and the bytes before the digits are masked out. Adjacent
+ * digits are then combined pairwise by multiply-adds, from 16 digits to 8
+ * 2-digit groups, to 4 4-digit groups, and finally to 2 8-digit groups. This
+ * returns false if any of the bytes is not a digit.
+ */
+TARGET_AVX2 static inline bool _convert_digits_simd(char *end, size_t n_digits,
+                                                    uint64_t *value) {
+  // Table for masking the last n_digits lanes via an unaligned load at offset
+  // n_digits, which gives 16 - n_digits zero bytes followed by n_digits ones
+  static const uint8_t lane_masks[32] = {
+      0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+      0x00, 0x00, 0x00, 0x00, 0x00, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+      0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+  __m128i lane_mask =
+      _mm_loadu_si128((const __m128i *)(lane_masks + n_digits));
+
+  // Check that all lanes of interest are digits; subtracting '0' maps digits
+  // to 0~9 and everything else to unsigned values above 9
+  __m128i digits = _mm_sub_epi8(_mm_loadu_si128((const __m128i *)(end - 16)),
+                                _mm_set1_epi8('0'));
+  __m128i is_digit =
+      _mm_cmpeq_epi8(_mm_min_epu8(digits, _mm_set1_epi8(9)), digits);
+  if (!_mm_testc_si128(is_digit, lane_mask)) {
+    return false;
+  }
+  digits = _mm_and_si128(digits, lane_mask);
+
+  __m128i groups2 = _mm_maddubs_epi16(digits, _mm_set1_epi16(0x010A));
+  __m128i groups4 = _mm_madd_epi16(groups2, _mm_set1_epi32(0x00010064));
+  groups4 = _mm_packus_epi32(groups4, groups4);
+  __m128i groups8 = _mm_madd_epi16(groups4, _mm_set1_epi32(0x00012710));
+  *value = (uint64_t)(uint32_t)_mm_cvtsi128_si32(groups8) * 100000000 +
+           (uint32_t)_mm_extract_epi32(groups8, 1);
+  return true;
+}
+
+/**
+ * Helper function to parse an integer field of a CSV row.
+ *
+ * The field spans from `ptr` (inclusive) to `end` (exclusive), and `data` is
+ * the start of the readable memory. Consistent with `strtol`, leading
+ * whitespaces, a sign, and leading zeros are allowed. This returns false if the
+ * field is not a valid integer or does not fit in an int.
+ */
+static inline bool _parse_int_field(char *ptr, char *end, char *data,
+                                    int *value, bool use_avx2) {
+  while (ptr < end && (*ptr == ' ' || *ptr == '\t' || *ptr == '\r' ||
+                       *ptr == '\v' || *ptr == '\f')) {
+    ptr++;
+  }
+  bool is_negative = false;
+  if (ptr < end && (*ptr == '-' || *ptr == '+')) {
+    is_negative = *ptr == '-';
+    ptr++;
+  }
+
+  // Skip the leading zeros so that the number of significant digits tells
+  // whether the value can possibly fit in an int
+  char *digits = ptr;
+  while (ptr < end && *ptr == '0') {
+    ptr++;
+  }
+  size_t n_digits = end - ptr;
+  if (n_digits == 0) {
+    *value = 0;
+    return ptr > digits;
+  }
+  if (n_digits > 10) {
+    return false;
+  }
+
+  uint64_t magnitude = 0;
+  if (use_avx2 && end - data >= 16) {
+    if (!_convert_digits_simd(end, n_digits, &magnitude)) {
+      return false;
+    }
+  } else {
+    for (; ptr < end; ptr++) {
+      if (*ptr < '0' || *ptr > '9') {
+        return false;
+      }
+      magnitude = magnitude * 10 + (*ptr - '0');
+    }
+  }
+
+  // The magnitude of INT_MIN is one more than INT_MAX
+  if (magnitude > (uint64_t)INT_MAX + is_negative) {
+    return false;
+  }
+  *value = is_negative ? (int)-(int64_t)magnitude : (int)magnitude;
+  return true;
+}
+
+/**
+ * Helper function to parse the next row of a CSV file.
+ *
+ * This has the same semantic as `parse_next_row`, where the delimiters and the
+ * digits are processed with AVX2 if `use_avx2` is set.
+ */
+static inline CSVParseStatus _parse_next_row(CSV *csv, int *buffer,
+                                             bool use_avx2) {
   char *ptr = csv->data + csv->offset;
+  char *end = csv->data + csv->size;
 
   // Jump to the first non-empty row since the last read
-  while (*ptr == '\n') {
+  while (ptr < end && *ptr == '\n') {
     ptr++;
   }
 
   // Check if we have reached the end of the file
-  if (ptr >= csv->data + csv->size) {
+  if (ptr >= end) {
     return CSV_PARSE_STATUS_EOF;
   }
 
-  // Find the end of the row
-  size_t current = 0;
-  while (csv->offset < csv->size) {
-    char *endptr;
-    errno = 0; // Reset errno before calling strtol so we can check for status
-    long value = strtol(ptr, &endptr, 10);
-
-    // Check if the parsing was successful
-    if (errno != 0 || ptr == endptr) {
+  DelimiterScanner scanner = {.end = end};
+  _scan_block(&scanner, ptr, use_avx2);
+  for (size_t i = 0; i < csv->n_cols; i++) {
+    char *delimiter = _next_delimiter(&scanner, ptr, use_avx2);
+    if (!_parse_int_field(ptr, delimiter, csv->data, &buffer[i], use_avx2)) {
       return CSV_PARSE_STATUS_ERROR;
     }
 
-    // Set the value in the buffer and move the pointer to after the integer
-    buffer[current++] = (int)value; // XXX: This is unsafe conversion
-    ptr = endptr;
-
-    // The character after the last element in a row should be a newline or a
-    // null-terminator
-    if (current == csv->n_cols) {
-      if (*ptr != '\n' && *ptr != '\0') {
+    // The last element in a row should be followed by a newline or the end of
+    // the file, and the other elements by a comma
+    if (i == csv->n_cols - 1) {
+      if (delimiter < end && *delimiter != '\n') {
         return CSV_PARSE_STATUS_ERROR;
       }
-      // Move the offset to the start of the next row and break
-      csv->offset = (ptr - csv->data) + 1;
-      break;
-    }
-
-    // This is not the last element in the row, so we expect a comma
-    if (*ptr != ',') {
+    } else if (delimiter == end || *delimiter != ',') {
       return CSV_PARSE_STATUS_ERROR;
     }
-    ptr++; // Skip the comma
+    ptr = delimiter + 1;
   }
 
+  // Move the offset to the start of the next row
+  csv->offset = ptr < end ? (size_t)(ptr - csv->data) : csv->size;
   return CSV_PARSE_STATUS_CONTINUE;
 }
 
+/**
+ * Helper function to parse the next row of a CSV file with AVX2.
+ *
+ * This is compiled for AVX2 as a whole so that the vector helpers are inlined
+ * into the parsing loop.
+ */
+TARGET_AVX2 static CSVParseStatus _parse_next_row_avx2(CSV *csv, int *buffer) {
+  return _parse_next_row(csv, buffer, true);
+}
+
+/**
+ * @implements parse_next_row
+ */
+CSVParseStatus parse_next_row(CSV *csv, int *buffer) {
+  if (__has_avx2__) {
+    return _parse_next_row_avx2(csv, buffer);
+  }
+  return _parse_next_row(csv, buffer, false);
+}
+
+/**
+ * @implements write_columnar_result
+ */
+int write_columnar_result(FILE *out, char *payload, size_t length) {
+  if (length < sizeof(ColumnarResultHeader)) {
+    return -1;
+  }
+  ColumnarResultHeader header;
+  memcpy(&header, payload, sizeof(ColumnarResultHeader));
+  if (header.n_cols == 0 || header.n_cols > MAX_PRINT_HANDLES) {
+    return -1;
+  }
+
+  // Locate each column in the payload and validate the total length
+  char *columns[MAX_PRINT_HANDLES];
+  size_t value_sizes[MAX_PRINT_HANDLES];
+  size_t offset = sizeof(ColumnarResultHeader);
+  for (size_t j = 0; j < header.n_cols; j++) {
+    value_sizes[j] = columnar_value_size(header.types[j]);
+    if (value_sizes[j] == 0) {
+      return -1;
+    }
+    columns[j] = payload + offset;
+    offset += header.n_rows * value_sizes[j];
+  }
+  if (offset != length) {
+    return -1;
+  }
+
+  // Format row by row into a local buffer that is flushed whenever it may not
+  // be able to hold the next value; values are memcpy'ed out of the payload
+  // because they are not necessarily aligned
+  char buffer[COLUMNAR_FORMAT_BUFFER_SIZE];
+  size_t used = 0;
+  for (size_t i = 0; i < header.n_rows; i++) {
+    for (size_t j = 0; j < header.n_cols; j++) {
+      if (used + MAX_FORMATTED_VALUE_LENGTH > COLUMNAR_FORMAT_BUFFER_SIZE) {
+        fwrite(buffer, sizeof(char), used, out);
+        used = 0;
+      }
+
+      char *value = columns[j] + i * value_sizes[j];
+      int int_value;
+      long long long_long_value;
+      double double_value;
+      switch (header.types[j]) {
+      case COLUMNAR_VALUE_TYPE_INT:
+        memcpy(&int_value, value, sizeof(int));
+        used += _format_int(buffer + used, int_value);
+        break;
+      case COLUMNAR_VALUE_TYPE_LONG_LONG:
+        memcpy(&long_long_value, value, sizeof(long long));
+        used += snprintf(buffer + used, MAX_FORMATTED_VALUE_LENGTH, "%lld",
+                         long_long_value);
+        break;
+      case COLUMNAR_VALUE_TYPE_DOUBLE:
+        memcpy(&double_value, value, sizeof(double));
+        used += snprintf(buffer + used, MAX_FORMATTED_VALUE_LENGTH, "%.2f",
+                         double_value);
+        break;
+      }
+      buffer[used++] = j == header.n_cols - 1 ? '\n' : ',';
+    }
+  }
+  fwrite(buffer, sizeof(char), used, out);
+  return 0;
+}
+
 /**
  * @implements get_catalog_file
  */
@@ -396,7 +396,6 @@ DbSchemaStatus join_radix_hash(int *data1, int *data2, size_t *indices1,
   }
 
   // Build and probe: embarrassingly parallelized on each partition
-  thread_pool_reset_queue_completion(__thread_pool__);
   HashJoinTaskData task_data[RADIX_JOIN_NUM_BUCKETS];
   for (size_t i = 0; i < RADIX_JOIN_NUM_BUCKETS; i++) {
     task_data[i].data1 = partitioned_data1 + prefix_sum1[i];
@@ -408,13 +407,13 @@ DbSchemaStatus join_radix_hash(int *data1, int *data2, size_t *indices1,
     task_data[i].result1 = NULL;
     task_data[i].result2 = NULL;
     task_data[i].result_size = 0;
-    ThreadTask task = {.id = next_task_id(),
-                       .type = THREAD_TASK_TYPE_HASH_JOIN,
-                       .data = &task_data[i]};
-    thread_pool_enqueue_task(__thread_pool__, &task);
-    log_file(stdout, "  [LOG] Enqueued hash join task %d\n", task.id);
   }
-  thread_pool_wait_queue_completion(__thread_pool__, RADIX_JOIN_NUM_BUCKETS);
+  ThreadTaskGroup group;
+  thread_task_group_init(&group);
+  thread_pool_enqueue_group(__thread_pool__, &group, THREAD_TASK_TYPE_HASH_JOIN,
+                            task_data, sizeof(HashJoinTaskData),
+                            RADIX_JOIN_NUM_BUCKETS);
+  thread_pool_wait_group(__thread_pool__, &group);
   log_file(stdout, "  [LOG] Hash joins completed\n");
 
   // Get the size of the final result as the sum of all partition results
@@ -176,6 +176,8 @@ static char *COLUMN_ERROR =
     "The column variable must be an existing column in the table.";
 static char *INDEX_ERROR =
     "The index variable must be an existing index on the column.";
+static char *TREE_ORDER_ERROR = "The B+ tree order is only valid for B+ tree "
+                                "indexes and must be between 4 and 4096.";
 
 static char *VALVEC_ERROR = "The value vector variable does not exist in the "
                             "context and is not an existing column.";
@@ -361,6 +363,7 @@ static inline DbOperator *_parse_create_idx(ParserContext *ctx, char *tokenizer,
   _NEXT_TOKEN(col_name);
   _NEXT_TOKEN(index_type);
   _NEXT_TOKEN(index_metatype);
+  char *tree_order = strsep(&tokenizer, ",");
   _EXPECT_NO_MORE_TOKENS;
 
   // Initialize the operator
@@ -397,6 +400,20 @@ static inline DbOperator *_parse_create_idx(ParserContext *ctx, char *tokenizer,
     _THROW_PARSE_ERROR_IF(true, INDEX_ERROR);
   }
 
+  // Set the order of the B+ tree if given, which is only valid for B+ tree
+  // indexes, e.g., `create(idx,db1.tbl1.col1,btree,unclustered,32)`
+  dbo->fields.create.spec.idx.tree_order = BPLUS_TREE_ORDER;
+  if (tree_order != NULL) {
+    char *endptr;
+    long order = strtol(tree_order, &endptr, 10);
+    _THROW_PARSE_ERROR_IF(strcmp(index_type, "btree") != 0 ||
+                              endptr == tree_order || *endptr != '\0' ||
+                              order < BPLUS_TREE_MIN_ORDER ||
+                              order > BPLUS_TREE_MAX_ORDER,
+                          TREE_ORDER_ERROR);
+    dbo->fields.create.spec.idx.tree_order = (int)order;
+  }
+
   // Check that the column argument is an existing column
   Table *table;
   size_t ith_column;
@@ -630,8 +647,43 @@ static DbOperator *parse_addsub(ParserContext *ctx) {
  * Parse the arguments of a aggregate command into a DbOperator.
  */
 static DbOperator *parse_agg(ParserContext *ctx) {
+  // The aggregate may be over a nested fetch, i.e., `agg(fetch(valvec,posvec))`
+  // or `agg(fetch(valvec,select(valvec,lower,upper)))`, which is parsed into a
+  // single operator so that the fetched values (and the selected positions) are
+  // never materialized; the arguments of the fetch are then parsed in place of
+  // those of the aggregate
+  size_t args_length = strlen(ctx->args);
+  bool over_fetch = strncmp(ctx->args, "fetch(", 6) == 0 &&
+                    ctx->args[args_length - 1] == ')';
+  if (over_fetch) {
+    ctx->args[args_length - 1] = '\0';
+    ctx->args += 6;
+  }
+
   _TOKENIZE_ARGS;
   _NEXT_TOKEN(valvec);
+
+  // The position vector is optional, i.e., there are either one or two
+  // arguments, unless the aggregate is over a fetch; a select nested in the
+  // fetch takes the place of the position vector with its own arguments
+  char *posvec = NULL, *select_valvec = NULL, *lower = NULL, *upper = NULL;
+  if (over_fetch && tokenizer != NULL &&
+      strncmp(tokenizer, "select(", 7) == 0 &&
+      tokenizer[strlen(tokenizer) - 1] == ')') {
+    tokenizer[strlen(tokenizer) - 1] = '\0';
+    tokenizer += 7;
+    _NEXT_TOKEN(select_valvec_token);
+    _NEXT_TOKEN(lower_token);
+    _NEXT_TOKEN(upper_token);
+    select_valvec = select_valvec_token;
+    lower = lower_token;
+    upper = upper_token;
+  } else if (over_fetch) {
+    _NEXT_TOKEN(posvec_token);
+    posvec = posvec_token;
+  } else {
+    posvec = strsep(&tokenizer, ",");
+  }
   _EXPECT_NO_MORE_TOKENS;
 
   // Initialize the operator
@@ -643,12 +695,56 @@ static DbOperator *parse_agg(ParserContext *ctx) {
   dbo->type = OPERATOR_TYPE_AGG;
   dbo->fields.agg.agg_type = ctx->flag;
 
+  // Look up the generalized position vector or set it to NULL; this is done
+  // first since the value vector may need to be freed on errors
+  GeneralizedPosvecHandle *posvec_handle = NULL;
+  if (posvec != NULL) {
+    posvec_handle = lookup_posvec_handle(ctx->context, posvec);
+    _THROW_PARSE_ERROR_IF(posvec_handle == NULL, POSVEC_ERROR);
+  }
+  dbo->fields.agg.posvec_handle = posvec_handle;
+
+  // Parse the range of the nested select, if any
+  if (select_valvec != NULL) {
+    dbo->fields.agg.lower_bound = _parse_range_bound(ctx, lower, true);
+    dbo->fields.agg.upper_bound = _parse_range_bound(ctx, upper, false);
+    if (ctx->send_message->status != MESSAGE_STATUS_OK) {
+      free(dbo);
+      free(to_free);
+      return NULL;
+    }
+  }
+
   // Look up the generalized value vector
   GeneralizedValvecHandle *valvec_handle =
       lookup_valvec_handle(ctx->context, valvec, true);
   _THROW_PARSE_ERROR_IF(valvec_handle == NULL, VALVEC_ERROR);
   dbo->fields.agg.valvec_handle = valvec_handle;
 
+  // Look up the value vector of the nested select or set it to NULL; either
+  // value vector may wrap a column, which must be freed on errors
+  GeneralizedValvecHandle *select_valvec_handle = NULL;
+  if (select_valvec != NULL) {
+    select_valvec_handle =
+        lookup_valvec_handle(ctx->context, select_valvec, true);
+    _THROW_PARSE_ERROR_CUSTOM_CLEANUP_IF(select_valvec_handle == NULL,
+                                         VALVEC_ERROR, {
+                                           free_if_wraps_column(valvec_handle);
+                                           free(dbo);
+                                           free(to_free);
+                                         });
+    _THROW_PARSE_ERROR_CUSTOM_CLEANUP_IF(
+        select_valvec_handle->generalized_valvec.valvec_length !=
+            valvec_handle->generalized_valvec.valvec_length,
+        "The value vectors must have the same length.", {
+          free_if_wraps_column(valvec_handle);
+          free_if_wraps_column(select_valvec_handle);
+          free(dbo);
+          free(to_free);
+        });
+  }
+  dbo->fields.agg.select_valvec_handle = select_valvec_handle;
+
   _SET_HANDLE_NAME(agg.out, ctx->handle_name);
   free(to_free);
 
@@ -662,23 +758,31 @@ static DbOperator *parse_agg(ParserContext *ctx) {
   // Now we are having an active batch context, so we need to store the operator
   // in the batch context instead of returning for immediate execution; we first
   // check if the operator is compatible with the current batch
-  if (batch_context->n_select_ops + batch_context->n_agg_ops == 0) {
+  bool batchable = posvec_handle == NULL && select_valvec_handle == NULL;
+  if (batchable &&
+      batch_context->n_select_ops + batch_context->n_agg_ops == 0) {
     // This is the very first operator in the current batch so it is always
     // compatible
     batch_context->shared_valvec_handle = valvec_handle;
-  } else if (_valvec_handles_are_equal(batch_context->shared_valvec_handle,
+  } else if (batchable &&
+             _valvec_handles_are_equal(batch_context->shared_valvec_handle,
                                        valvec_handle)) {
     // This is not the first operator in the current batch; we must have exactly
-    // the same value vector to be compatible (note that aggregate operators do
-    // not care about position vectors)
+    // the same value vector to be compatible
   } else {
     // Except for the above cases, the operator is not compatible with the
-    // current batch, so we set an error message and return NULL
+    // current batch, so we set an error message and return NULL; this includes
+    // aggregates over a position vector or a nested select, which do not scan
+    // the shared value vector as a whole
     ctx->send_message->status = MESSAGE_STATUS_BATCH_ERROR;
     ctx->send_message->payload =
         "The operator is incompatible with the current "
         "batch.";
     ctx->send_message->length = strlen(ctx->send_message->payload);
+    free_if_wraps_column(valvec_handle);
+    if (select_valvec_handle != NULL) {
+      free_if_wraps_column(select_valvec_handle);
+    }
     free(dbo);
     return NULL;
   }
@@ -923,6 +1027,44 @@ static DbOperator *parse_join(ParserContext *ctx) {
   return dbo;
 }
 
+/**
+ * Parse the arguments of a load file command into a DbOperator.
+ */
+static DbOperator *parse_load_file(ParserContext *ctx) {
+  _ERROR_IF_BATCHING;
+
+  _TOKENIZE_ARGS;
+  _NEXT_TOKEN(path);
+  _EXPECT_NO_MORE_TOKENS;
+
+  // Initialize the operator
+  DbOperator *dbo = _internal_malloc(sizeof(DbOperator), ctx->send_message);
+  if (dbo == NULL) {
+    free(to_free);
+    return NULL;
+  }
+  dbo->type = OPERATOR_TYPE_LOAD_FILE;
+
+  // The path should be surrounded by double quotes; the executor is responsible
+  // for freeing the copy of the path
+  size_t path_length = strlen(path);
+  _THROW_PARSE_ERROR_IF(path_length < 3 || path[0] != '"' ||
+                            path[path_length - 1] != '"',
+                        "The file path must be a non-empty quoted string.");
+  path[path_length - 1] = '\0';
+  dbo->fields.load_file.path =
+      _internal_malloc(path_length - 1, ctx->send_message);
+  if (dbo->fields.load_file.path == NULL) {
+    free(dbo);
+    free(to_free);
+    return NULL;
+  }
+  strcpy(dbo->fields.load_file.path, path + 1);
+
+  free(to_free);
+  return dbo;
+}
+
 /**
  * Parse the arguments of a print command into a DbOperator.
  */
@@ -1147,11 +1289,64 @@ static const CommandHandler commands[] = {
     {parse_fetch, "fetch(", 6, 0},               /* Fetch  */
     {parse_insert, "relational_insert(", 18, 0}, /* Insert */
     {parse_join, "join(", 5, 0},                 /* Join   */
+    {parse_load_file, "load_file(", 10, 0},      /* Load   */
     {parse_print, "print(", 6, 0},               /* Print  */
     {parse_select, "select(", 7, 0},             /* Select */
     {parse_update, "relational_update(", 18, 0}, /* Update */
 };
 
+/**
+ * The list of command prefixes whose execution modifies the catalog.
+ *
+ * Queries starting with any of these prefixes must be executed with exclusive
+ * access to the catalog. The load command is also exclusive but is recognized
+ * by the server through its own message protocol, so it is not included here.
+ */
+static const char *exclusive_prefixes[] = {
+    "create(",
+    "relational_insert(",
+    "relational_delete(",
+    "relational_update(",
+    "load_file(",
+};
+
+/**
+ * @implements command_requires_exclusive_access
+ */
+bool command_requires_exclusive_access(const char *query_command) {
+  // Skip the handle name if any; handle names cannot contain parentheses so an
+  // equals sign before the first opening parenthesis must be an assignment
+  const char *command = query_command;
+  for (const char *c = query_command; *c != '\0' && *c != '('; c++) {
+    if (*c == '=') {
+      command = c + 1;
+      break;
+    }
+  }
+
+  // Match each prefix while ignoring whitespaces in the query, consistent with
+  // how the query is trimmed before parsing
+  for (size_t i = 0;
+       i < sizeof(exclusive_prefixes) / sizeof(exclusive_prefixes[0]); i++) {
+    const char *prefix = exclusive_prefixes[i];
+    const char *c = command;
+    while (*prefix != '\0' && *c != '\0') {
+      if (isspace(*c)) {
+        c++;
+      } else if (*c == *prefix) {
+        c++;
+        prefix++;
+      } else {
+        break;
+      }
+    }
+    if (*prefix == '\0') {
+      return true;
+    }
+  }
+  return false;
+}
+
 /**
  * @implements parse_command
  */
@@ -1252,6 +1447,72 @@ DbOperator *parse_command(char *query_command, Message *send_message,
   return dbo;
 }
 
+/**
+ * Helper function to parse a quoted string at the cursor.
+ *
+ * Leading whitespaces are skipped. The closing quote is replaced by a null
+ * terminator and the cursor is advanced past it. The string without quotes is
+ * returned, or NULL if there is no quoted string at the cursor.
+ */
+static inline char *_parse_quoted_string(char **cursor) {
+  char *c = *cursor;
+  while (isspace(*c)) {
+    c++;
+  }
+  if (*c != '"') {
+    return NULL;
+  }
+  char *start = c + 1;
+  char *end = strchr(start, '"');
+  if (end == NULL) {
+    return NULL;
+  }
+  *end = '\0';
+  *cursor = end + 1;
+  return start;
+}
+
+/**
+ * @implements parse_source_command
+ */
+bool parse_source_command(char *query_command, char **script_path,
+                          char **output_path) {
+  if (strncmp(query_command, "source(", 7) != 0) {
+    return false;
+  }
+  char *cursor = query_command + 7;
+  *script_path = _parse_quoted_string(&cursor);
+  *output_path = NULL;
+  if (*script_path == NULL) {
+    return false;
+  }
+
+  // The output path is optional
+  while (isspace(*cursor)) {
+    cursor++;
+  }
+  if (*cursor == ',') {
+    cursor++;
+    *output_path = _parse_quoted_string(&cursor);
+    if (*output_path == NULL) {
+      return false;
+    }
+    while (isspace(*cursor)) {
+      cursor++;
+    }
+  }
+
+  // Expect the closing parenthesis with nothing but whitespaces after it
+  if (*cursor != ')') {
+    return false;
+  }
+  cursor++;
+  while (isspace(*cursor)) {
+    cursor++;
+  }
+  return *cursor == '\0';
+}
+
 /**
  * @implements reset_batch_context
  */
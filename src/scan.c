@@ -4,18 +4,64 @@
  */
 
 #include <assert.h>
+#include <immintrin.h>
 #include <limits.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "bitvector.h"
 #include "consts.h"
 #include "logging.h"
 #include "scan.h"
 #include "sysinfo.h"
 #include "thread_pool.h"
 
+/**
+ * Helper macro to get the output boolean mask of a select query, or NULL if the
+ * query outputs an index array.
+ */
+#define _SELECTED_MASK(CTX, C)                                                 \
+  (CTX->selected_masks_arr == NULL ? NULL : CTX->selected_masks_arr[C])
+
+/**
+ * Helper function to make sure that the selected indices buffer of each select
+ * query that outputs an index array has room for `n_values` more entries.
+ *
+ * A buffer that is too small is grown by at least `EXPAND_FACTOR_SCAN_OUTPUT`.
+ * This returns false and sets the status of the context if growing a buffer
+ * failed, in which case the scan should stop.
+ */
+static inline bool _reserve_selected_indices(ScanContext *ctx,
+                                             size_t n_values) {
+  for (size_t c = 0; c < ctx->n_select_queries; c++) {
+    size_t required = ctx->n_selected_indices_arr[c] + n_values;
+    if (_SELECTED_MASK(ctx, c) != NULL ||
+        ctx->selected_capacity_arr[c] >= required) {
+      continue;
+    }
+    size_t capacity = ctx->selected_capacity_arr[c] * EXPAND_FACTOR_SCAN_OUTPUT;
+    if (capacity < required) {
+      capacity = required;
+    }
+    size_t *indices =
+        realloc(ctx->selected_indices_arr[c], capacity * sizeof(size_t));
+    if (indices == NULL) {
+      ctx->status = DB_SCHEMA_STATUS_ALLOC_FAILED;
+      return false;
+    }
+    ctx->selected_indices_arr[c] = indices;
+    ctx->selected_capacity_arr[c] = capacity;
+  }
+  return true;
+}
+
 /**
  * Helper macro to define a single SELECT iteration.
+ *
+ * The selected position is appended to the selected indices buffer of each
+ * matching query, which must have been reserved beforehand, unless the query
+ * outputs a boolean mask.
  */
 #define _SHARED_SCAN_SELECT_ITER(VALUE, POSITION, CTX, FLAGS)                  \
   do {                                                                         \
@@ -23,14 +69,77 @@
       for (size_t _c = 0; _c < CTX->n_select_queries; _c++) {                  \
         if (VALUE >= CTX->lower_bound_arr[_c] &&                               \
             VALUE < CTX->upper_bound_arr[_c]) {                                \
-          CTX->selected_indices_arr_flattened                                  \
-              [ctx->n_selected_indices_arr[_c]++ * ctx->n_select_queries +     \
-               _c] = POSITION;                                                 \
+          size_t _n = CTX->n_selected_indices_arr[_c]++;                       \
+          BitVector *_mask = _SELECTED_MASK(CTX, _c);                          \
+          if (_mask != NULL) {                                                 \
+            bitvector_set(_mask, POSITION);                                    \
+          } else {                                                             \
+            CTX->selected_indices_arr[_c][_n] = POSITION;                      \
+          }                                                                    \
         }                                                                      \
       }                                                                        \
     }                                                                          \
   } while (0)
 
+/**
+ * Helper function to count the boundaries that are at most the given value,
+ * i.e., to find the elementary interval containing the value (see
+ * `SelectIntervals`).
+ *
+ * The binary search is branchless, since the comparisons are hardly
+ * predictable for values in random order; `n_boundaries` must be positive.
+ */
+static inline size_t _find_select_interval(const long *boundaries,
+                                           size_t n_boundaries, long value) {
+  const long *base = boundaries;
+  size_t n = n_boundaries;
+  while (n > 1) {
+    size_t half = n / 2;
+    base += (base[half - 1] <= value) * half;
+    n -= half;
+  }
+  return (size_t)(base - boundaries) + (*base <= value);
+}
+
+/**
+ * Helper macro to define a single SELECT iteration via the elementary intervals
+ * of the select queries.
+ *
+ * This has the same effect as `_SHARED_SCAN_SELECT_ITER`, but only visits the
+ * queries that match the value instead of comparing against all of them.
+ */
+#define _SHARED_SCAN_INTERVALS_SELECT_ITER(VALUE, POSITION, CTX, FLAGS)        \
+  do {                                                                         \
+    if (FLAGS & SCAN_CALLBACK_SELECT_FLAG) {                                   \
+      SelectIntervals *_intervals = CTX->select_intervals;                     \
+      size_t _k = _find_select_interval(_intervals->boundaries,                \
+                                        _intervals->n_boundaries, VALUE);      \
+      for (size_t _q = _intervals->query_offsets[_k];                          \
+           _q < _intervals->query_offsets[_k + 1]; _q++) {                     \
+        size_t _c = _intervals->queries[_q];                                   \
+        size_t _n = CTX->n_selected_indices_arr[_c]++;                         \
+        BitVector *_mask = _SELECTED_MASK(CTX, _c);                            \
+        if (_mask != NULL) {                                                   \
+          bitvector_set(_mask, POSITION);                                      \
+        } else {                                                               \
+          CTX->selected_indices_arr[_c][_n] = POSITION;                        \
+        }                                                                      \
+      }                                                                        \
+    }                                                                          \
+  } while (0)
+
+/**
+ * Helper macro to reserve the selected indices buffers for a block of values,
+ * returning from the enclosing scan function on failure.
+ */
+#define _SHARED_SCAN_RESERVE_BLOCK(CTX, N_VALUES, FLAGS)                       \
+  do {                                                                         \
+    if ((FLAGS & SCAN_CALLBACK_SELECT_FLAG) &&                                 \
+        !_reserve_selected_indices(CTX, N_VALUES)) {                           \
+      return;                                                                  \
+    }                                                                          \
+  } while (0)
+
 /**
  * Helper macro to define a single MIN iteration.
  */
@@ -66,7 +175,8 @@
   } while (0)
 
 /**
- * Shared scan function for a specific combination of scan operations.
+ * Shared scan function body for a specific combination of scan operations, with
+ * the given name and SELECT iteration macro.
  *
  * This function is generated by a macro for a specific combination of scan
  * operations. Consider a single function that handles all possible combinations
@@ -75,32 +185,66 @@
  * the if statements in each iteration. On the other hand, this generated
  * function is dedicated to a specific combination of scan operations, causing
  * the if statements to be resolved at compile time, thus mitigating the runtime
- * overhead.
+ * overhead. Values are scanned in blocks of `SCAN_OUTPUT_BLOCK_SIZE`, before
+ * each of which the selected indices buffers are reserved for the whole block.
  */
-#define _SHARED_SCAN(FLAGS)                                                    \
-  void shared_scan_##FLAGS(GeneralizedValvec *valvec,                          \
-                           GeneralizedPosvec *posvec, ScanContext *ctx,        \
-                           size_t start, size_t end) {                         \
+#define _SHARED_SCAN_KERNEL(NAME, SELECT_ITER, FLAGS)                         \
+  void NAME(GeneralizedValvec *valvec, GeneralizedPosvec *posvec,              \
+            ScanContext *ctx, size_t start, size_t end) {                      \
     int *data = valvec->valvec_type == GENERALIZED_VALVEC_TYPE_COLUMN          \
                     ? valvec->valvec_pointer.column->data                      \
                     : valvec->valvec_pointer.partial_column->values;           \
+    BitVector *mask =                                                          \
+        posvec != NULL &&                                                      \
+                posvec->posvec_type == GENERALIZED_POSVEC_TYPE_BOOLEAN_MASK    \
+            ? posvec->posvec_pointer.boolean_mask->mask                        \
+            : NULL;                                                            \
+    size_t position = ctx->mask_position;                                      \
                                                                                \
-    if (posvec == NULL) {                                                      \
-      for (size_t i = start; i < end; i++) {                                   \
-        _SHARED_SCAN_SELECT_ITER(data[i], i, ctx, FLAGS);                      \
-        _SHARED_SCAN_MIN_ITER(data[i], ctx, FLAGS);                            \
-        _SHARED_SCAN_MAX_ITER(data[i], ctx, FLAGS);                            \
-        _SHARED_SCAN_SUM_ITER(data[i], ctx, FLAGS);                            \
-      }                                                                        \
-      return;                                                                  \
-    }                                                                          \
+    for (size_t block = start; block < end; block += SCAN_OUTPUT_BLOCK_SIZE) { \
+      size_t block_end = end - block > SCAN_OUTPUT_BLOCK_SIZE                  \
+                             ? block + SCAN_OUTPUT_BLOCK_SIZE                  \
+                             : end;                                            \
+      _SHARED_SCAN_RESERVE_BLOCK(ctx, block_end - block, FLAGS);               \
                                                                                \
-    for (size_t i = start; i < end; i++) {                                     \
-      size_t index = posvec->posvec_pointer.index_array->indices[i];           \
-      _SHARED_SCAN_SELECT_ITER(data[i], index, ctx, FLAGS);                    \
+      if (posvec == NULL) {                                                    \
+        for (size_t i = block; i < block_end; i++) {                           \
+          SELECT_ITER(data[i], i, ctx, FLAGS);                                 \
+          _SHARED_SCAN_MIN_ITER(data[i], ctx, FLAGS);                          \
+          _SHARED_SCAN_MAX_ITER(data[i], ctx, FLAGS);                          \
+          _SHARED_SCAN_SUM_ITER(data[i], ctx, FLAGS);                          \
+        }                                                                      \
+      } else if (mask != NULL) {                                               \
+        for (size_t i = block; i < block_end; i++) {                           \
+          position = bitvector_next_set(mask, position);                       \
+          SELECT_ITER(data[i], position, ctx, FLAGS);                          \
+          position++;                                                          \
+        }                                                                      \
+      } else {                                                                 \
+        for (size_t i = block; i < block_end; i++) {                           \
+          size_t index = posvec->posvec_pointer.index_array->indices[i];       \
+          SELECT_ITER(data[i], index, ctx, FLAGS);                             \
+        }                                                                      \
+      }                                                                        \
     }                                                                          \
   }
 
+/**
+ * Shared scan function for a specific combination of scan operations, which
+ * compares each value against every select query.
+ */
+#define _SHARED_SCAN(FLAGS)                                                    \
+  _SHARED_SCAN_KERNEL(shared_scan_##FLAGS, _SHARED_SCAN_SELECT_ITER, FLAGS)
+
+/**
+ * Shared scan function for a specific combination of scan operations, which
+ * locates the select queries matching each value via their elementary
+ * intervals; only combinations with SELECT are generated.
+ */
+#define _SHARED_SCAN_INTERVALS(FLAGS)                                          \
+  _SHARED_SCAN_KERNEL(shared_scan_intervals_##FLAGS,                           \
+                      _SHARED_SCAN_INTERVALS_SELECT_ITER, FLAGS)
+
 _SHARED_SCAN(0x01)
 _SHARED_SCAN(0x02)
 _SHARED_SCAN(0x03)
@@ -117,6 +261,535 @@ _SHARED_SCAN(0x0d)
 _SHARED_SCAN(0x0e)
 _SHARED_SCAN(0x0f)
 
+_SHARED_SCAN_INTERVALS(0x01)
+_SHARED_SCAN_INTERVALS(0x03)
+_SHARED_SCAN_INTERVALS(0x05)
+_SHARED_SCAN_INTERVALS(0x07)
+_SHARED_SCAN_INTERVALS(0x09)
+_SHARED_SCAN_INTERVALS(0x0b)
+_SHARED_SCAN_INTERVALS(0x0d)
+_SHARED_SCAN_INTERVALS(0x0f)
+
+/**
+ * Lookup table for compacting the lanes of an 8-lane comparison mask.
+ *
+ * The entry for a movemask `m` packs, in its nibbles from low to high, the lane
+ * numbers of the set bits of `m` in increasing order. The unused nibbles are
+ * zero, which still refer to a valid lane.
+ */
+static const uint32_t _COMPACT_LANES_LUT[256] = {
+    0x00000000, 0x00000000, 0x00000001, 0x00000010, 0x00000002, 0x00000020,
+    0x00000021, 0x00000210, 0x00000003, 0x00000030, 0x00000031, 0x00000310,
+    0x00000032, 0x00000320, 0x00000321, 0x00003210, 0x00000004, 0x00000040,
+    0x00000041, 0x00000410, 0x00000042, 0x00000420, 0x00000421, 0x00004210,
+    0x00000043, 0x00000430, 0x00000431, 0x00004310, 0x00000432, 0x00004320,
+    0x00004321, 0x00043210, 0x00000005, 0x00000050, 0x00000051, 0x00000510,
+    0x00000052, 0x00000520, 0x00000521, 0x00005210, 0x00000053, 0x00000530,
+    0x00000531, 0x00005310, 0x00000532, 0x00005320, 0x00005321, 0x00053210,
+    0x00000054, 0x00000540, 0x00000541, 0x00005410, 0x00000542, 0x00005420,
+    0x00005421, 0x00054210, 0x00000543, 0x00005430, 0x00005431, 0x00054310,
+    0x00005432, 0x00054320, 0x00054321, 0x00543210, 0x00000006, 0x00000060,
+    0x00000061, 0x00000610, 0x00000062, 0x00000620, 0x00000621, 0x00006210,
+    0x00000063, 0x00000630, 0x00000631, 0x00006310, 0x00000632, 0x00006320,
+    0x00006321, 0x00063210, 0x00000064, 0x00000640, 0x00000641, 0x00006410,
+    0x00000642, 0x00006420, 0x00006421, 0x00064210, 0x00000643, 0x00006430,
+    0x00006431, 0x00064310, 0x00006432, 0x00064320, 0x00064321, 0x00643210,
+    0x00000065, 0x00000650, 0x00000651, 0x00006510, 0x00000652, 0x00006520,
+    0x00006521, 0x00065210, 0x00000653, 0x00006530, 0x00006531, 0x00065310,
+    0x00006532, 0x00065320, 0x00065321, 0x00653210, 0x00000654, 0x00006540,
+    0x00006541, 0x00065410, 0x00006542, 0x00065420, 0x00065421, 0x00654210,
+    0x00006543, 0x00065430, 0x00065431, 0x00654310, 0x00065432, 0x00654320,
+    0x00654321, 0x06543210, 0x00000007, 0x00000070, 0x00000071, 0x00000710,
+    0x00000072, 0x00000720, 0x00000721, 0x00007210, 0x00000073, 0x00000730,
+    0x00000731, 0x00007310, 0x00000732, 0x00007320, 0x00007321, 0x00073210,
+    0x00000074, 0x00000740, 0x00000741, 0x00007410, 0x00000742, 0x00007420,
+    0x00007421, 0x00074210, 0x00000743, 0x00007430, 0x00007431, 0x00074310,
+    0x00007432, 0x00074320, 0x00074321, 0x00743210, 0x00000075, 0x00000750,
+    0x00000751, 0x00007510, 0x00000752, 0x00007520, 0x00007521, 0x00075210,
+    0x00000753, 0x00007530, 0x00007531, 0x00075310, 0x00007532, 0x00075320,
+    0x00075321, 0x00753210, 0x00000754, 0x00007540, 0x00007541, 0x00075410,
+    0x00007542, 0x00075420, 0x00075421, 0x00754210, 0x00007543, 0x00075430,
+    0x00075431, 0x00754310, 0x00075432, 0x00754320, 0x00754321, 0x07543210,
+    0x00000076, 0x00000760, 0x00000761, 0x00007610, 0x00000762, 0x00007620,
+    0x00007621, 0x00076210, 0x00000763, 0x00007630, 0x00007631, 0x00076310,
+    0x00007632, 0x00076320, 0x00076321, 0x00763210, 0x00000764, 0x00007640,
+    0x00007641, 0x00076410, 0x00007642, 0x00076420, 0x00076421, 0x00764210,
+    0x00007643, 0x00076430, 0x00076431, 0x00764310, 0x00076432, 0x00764320,
+    0x00764321, 0x07643210, 0x00000765, 0x00007650, 0x00007651, 0x00076510,
+    0x00007652, 0x00076520, 0x00076521, 0x00765210, 0x00007653, 0x00076530,
+    0x00076531, 0x00765310, 0x00076532, 0x00765320, 0x00765321, 0x07653210,
+    0x00007654, 0x00076540, 0x00076541, 0x00765410, 0x00076542, 0x00765420,
+    0x00765421, 0x07654210, 0x00076543, 0x00765430, 0x00765431, 0x07654310,
+    0x00765432, 0x07654320, 0x07654321, 0x76543210,
+};
+
+/**
+ * Helper function to expand the compacted lane numbers of a movemask into
+ * 32-bit lanes, ready to be used as a permutation or gather index.
+ */
+TARGET_AVX2 static inline __m256i _compact_lanes(int mask) {
+  __m256i nibbles = _mm256_srlv_epi32(
+      _mm256_set1_epi32(_COMPACT_LANES_LUT[mask]),
+      _mm256_setr_epi32(0, 4, 8, 12, 16, 20, 24, 28));
+  return _mm256_and_si256(nibbles, _mm256_set1_epi32(0xF));
+}
+
+/**
+ * Helper function to write the positions `base + lane` of the matching lanes
+ * contiguously to the output.
+ *
+ * This always stores 8 positions, so the output must have room for 8 entries
+ * even if fewer lanes match; only the first popcount(mask) of them are valid.
+ */
+TARGET_AVX2 static inline void _compact_positions(size_t *out, int mask,
+                                                  size_t base) {
+  __m256i lanes = _compact_lanes(mask);
+  __m256i base_vec = _mm256_set1_epi64x((long long)base);
+  _mm256_storeu_si256(
+      (__m256i *)out,
+      _mm256_add_epi64(base_vec,
+                       _mm256_cvtepu32_epi64(_mm256_castsi256_si128(lanes))));
+  _mm256_storeu_si256(
+      (__m256i *)(out + 4),
+      _mm256_add_epi64(base_vec, _mm256_cvtepu32_epi64(
+                                     _mm256_extracti128_si256(lanes, 1))));
+}
+
+/**
+ * Helper function to write the indices of the matching lanes contiguously to
+ * the output, where `indices` points to the 8 indices of the current block.
+ *
+ * The same room requirement as `_compact_positions` applies.
+ */
+TARGET_AVX2 static inline void _compact_indices(size_t *out, int mask,
+                                                const size_t *indices) {
+  __m256i lanes = _compact_lanes(mask);
+  const long long *base = (const long long *)indices;
+  _mm256_storeu_si256(
+      (__m256i *)out,
+      _mm256_i32gather_epi64(base, _mm256_castsi256_si128(lanes), 8));
+  _mm256_storeu_si256(
+      (__m256i *)(out + 4),
+      _mm256_i32gather_epi64(base, _mm256_extracti128_si256(lanes, 1), 8));
+}
+
+/**
+ * Helper function to convert the bounds of a select query into inclusive int
+ * bounds, so that the range check can be done with 32-bit comparisons.
+ *
+ * Queries that can match no int at all are mapped to an empty range, i.e., a
+ * lower bound above the inclusive upper bound.
+ */
+static inline void _clamp_select_bounds(long lower_bound, long upper_bound,
+                                        int *lower, int *upper) {
+  if (lower_bound >= upper_bound || lower_bound > INT_MAX ||
+      upper_bound <= INT_MIN) {
+    *lower = INT_MAX;
+    *upper = INT_MIN;
+    return;
+  }
+  *lower = lower_bound < INT_MIN ? INT_MIN : (int)lower_bound;
+  *upper = upper_bound > INT_MAX ? INT_MAX : (int)(upper_bound - 1);
+}
+
+/**
+ * Helper function to compute the horizontal minimum of 8 ints.
+ */
+TARGET_AVX2 static inline int _hmin_epi32(__m256i vec) {
+  __m128i v = _mm_min_epi32(_mm256_castsi256_si128(vec),
+                            _mm256_extracti128_si256(vec, 1));
+  v = _mm_min_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+  v = _mm_min_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+  return _mm_cvtsi128_si32(v);
+}
+
+/**
+ * Helper function to compute the horizontal maximum of 8 ints.
+ */
+TARGET_AVX2 static inline int _hmax_epi32(__m256i vec) {
+  __m128i v = _mm_max_epi32(_mm256_castsi256_si128(vec),
+                            _mm256_extracti128_si256(vec, 1));
+  v = _mm_max_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+  v = _mm_max_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+  return _mm_cvtsi128_si32(v);
+}
+
+/**
+ * Helper function to compute the horizontal sum of 4 long longs.
+ */
+TARGET_AVX2 static inline long long _hsum_epi64(__m256i vec) {
+  __m128i v = _mm_add_epi64(_mm256_castsi256_si128(vec),
+                            _mm256_extracti128_si256(vec, 1));
+  return _mm_cvtsi128_si64(v) + _mm_extract_epi64(v, 1);
+}
+
+/**
+ * AVX2 shared scan function for a specific combination of scan operations.
+ *
+ * Like `_SHARED_SCAN`, this is generated per combination of flags, but compares
+ * 8 values against a select query in one instruction. The resulting mask is
+ * turned into a permutation via `_COMPACT_LANES_LUT`, so the matching positions
+ * are written without any data-dependent branch. MIN, MAX, and SUM are kept in
+ * vector accumulators in the same pass. Each vector of 8 values writes 8
+ * entries past the current count of a query; this never overflows its output
+ * because the output is reserved for whole blocks of `SCAN_OUTPUT_BLOCK_SIZE`
+ * values, and vectors never cross the boundary of such a block. A query
+ * that outputs a boolean mask gets the comparison mask stored as a byte of the
+ * bit vector instead; this relies on scan ranges starting at multiples of 64,
+ * which also keeps parallel tasks from writing to the same word. The trailing
+ * values that do not fill a block are handled as in `_SHARED_SCAN`, and so are
+ * the values of a boolean mask position vector.
+ */
+#define _SHARED_SCAN_AVX2(FLAGS)                                               \
+  TARGET_AVX2 void shared_scan_avx2_##FLAGS(                                   \
+      GeneralizedValvec *valvec, GeneralizedPosvec *posvec, ScanContext *ctx,  \
+      size_t start, size_t end) {                                              \
+    if (posvec != NULL &&                                                      \
+        posvec->posvec_type == GENERALIZED_POSVEC_TYPE_BOOLEAN_MASK) {         \
+      shared_scan_##FLAGS(valvec, posvec, ctx, start, end);                    \
+      return;                                                                  \
+    }                                                                          \
+                                                                               \
+    int *data = valvec->valvec_type == GENERALIZED_VALVEC_TYPE_COLUMN          \
+                    ? valvec->valvec_pointer.column->data                      \
+                    : valvec->valvec_pointer.partial_column->values;           \
+    size_t *indices =                                                          \
+        posvec == NULL ? NULL : posvec->posvec_pointer.index_array->indices;   \
+                                                                               \
+    size_t n_queries =                                                         \
+        FLAGS & SCAN_CALLBACK_SELECT_FLAG ? ctx->n_select_queries : 0;         \
+    int lowers[n_queries + 1];                                                 \
+    int uppers[n_queries + 1];                                                 \
+    for (size_t c = 0; c < n_queries; c++) {                                   \
+      _clamp_select_bounds(ctx->lower_bound_arr[c], ctx->upper_bound_arr[c],   \
+                           &lowers[c], &uppers[c]);                            \
+    }                                                                          \
+                                                                               \
+    __m256i min_vec = _mm256_set1_epi32(INT_MAX);                              \
+    __m256i max_vec = _mm256_set1_epi32(INT_MIN);                              \
+    __m256i sum_vec = _mm256_setzero_si256();                                  \
+                                                                               \
+    size_t i = start;                                                          \
+    size_t block_end = start;                                                  \
+    for (; i + 8 <= end; i += 8) {                                             \
+      if (i == block_end) {                                                    \
+        block_end = end - i > SCAN_OUTPUT_BLOCK_SIZE                           \
+                        ? i + SCAN_OUTPUT_BLOCK_SIZE                           \
+                        : end;                                                 \
+        _SHARED_SCAN_RESERVE_BLOCK(ctx, block_end - i, FLAGS);                 \
+      }                                                                        \
+      __m256i values = _mm256_loadu_si256((const __m256i *)(data + i));        \
+                                                                               \
+      for (size_t c = 0; c < n_queries; c++) {                                 \
+        __m256i outside = _mm256_or_si256(                                     \
+            _mm256_cmpgt_epi32(_mm256_set1_epi32(lowers[c]), values),          \
+            _mm256_cmpgt_epi32(values, _mm256_set1_epi32(uppers[c])));         \
+        int mask =                                                             \
+            ~_mm256_movemask_ps(_mm256_castsi256_ps(outside)) & 0xFF;          \
+        BitVector *out_mask = _SELECTED_MASK(ctx, c);                          \
+        size_t *out = ctx->selected_indices_arr[c];                            \
+        size_t n = ctx->n_selected_indices_arr[c];                             \
+        if (out_mask != NULL && indices == NULL) {                             \
+          ((uint8_t *)out_mask->data)[i / 8] = (uint8_t)mask;                  \
+        } else if (out_mask != NULL) {                                         \
+          for (int m = mask; m != 0; m &= m - 1) {                             \
+            bitvector_set(out_mask, indices[i + __builtin_ctz(m)]);            \
+          }                                                                    \
+        } else if (indices == NULL) {                                          \
+          _compact_positions(out + n, mask, i);                                \
+        } else {                                                               \
+          _compact_indices(out + n, mask, indices + i);                        \
+        }                                                                      \
+        ctx->n_selected_indices_arr[c] = n + __builtin_popcount(mask);         \
+      }                                                                        \
+                                                                               \
+      if (indices == NULL) {                                                   \
+        if (FLAGS & SCAN_CALLBACK_MIN_FLAG) {                                  \
+          min_vec = _mm256_min_epi32(min_vec, values);                         \
+        }                                                                      \
+        if (FLAGS & SCAN_CALLBACK_MAX_FLAG) {                                  \
+          max_vec = _mm256_max_epi32(max_vec, values);                         \
+        }                                                                      \
+        if (FLAGS & SCAN_CALLBACK_SUM_FLAG) {                                  \
+          sum_vec = _mm256_add_epi64(                                          \
+              sum_vec, _mm256_cvtepi32_epi64(_mm256_castsi256_si128(values))); \
+          sum_vec = _mm256_add_epi64(                                          \
+              sum_vec,                                                         \
+              _mm256_cvtepi32_epi64(_mm256_extracti128_si256(values, 1)));     \
+        }                                                                      \
+      }                                                                        \
+    }                                                                          \
+    if (i == block_end) {                                                      \
+      _SHARED_SCAN_RESERVE_BLOCK(ctx, end - i, FLAGS);                         \
+    }                                                                          \
+                                                                               \
+    if (indices == NULL) {                                                     \
+      if (FLAGS & SCAN_CALLBACK_MIN_FLAG) {                                    \
+        int min_value = _hmin_epi32(min_vec);                                  \
+        _SHARED_SCAN_MIN_ITER(min_value, ctx, FLAGS);                          \
+      }                                                                        \
+      if (FLAGS & SCAN_CALLBACK_MAX_FLAG) {                                    \
+        int max_value = _hmax_epi32(max_vec);                                  \
+        _SHARED_SCAN_MAX_ITER(max_value, ctx, FLAGS);                          \
+      }                                                                        \
+      if (FLAGS & SCAN_CALLBACK_SUM_FLAG) {                                    \
+        long long sum_value = _hsum_epi64(sum_vec);                            \
+        _SHARED_SCAN_SUM_ITER(sum_value, ctx, FLAGS);                          \
+      }                                                                        \
+      for (; i < end; i++) {                                                   \
+        _SHARED_SCAN_SELECT_ITER(data[i], i, ctx, FLAGS);                      \
+        _SHARED_SCAN_MIN_ITER(data[i], ctx, FLAGS);                            \
+        _SHARED_SCAN_MAX_ITER(data[i], ctx, FLAGS);                            \
+        _SHARED_SCAN_SUM_ITER(data[i], ctx, FLAGS);                            \
+      }                                                                        \
+      return;                                                                  \
+    }                                                                          \
+                                                                               \
+    for (; i < end; i++) {                                                     \
+      _SHARED_SCAN_SELECT_ITER(data[i], indices[i], ctx, FLAGS);               \
+    }                                                                          \
+  }
+
+_SHARED_SCAN_AVX2(0x01)
+_SHARED_SCAN_AVX2(0x02)
+_SHARED_SCAN_AVX2(0x03)
+_SHARED_SCAN_AVX2(0x04)
+_SHARED_SCAN_AVX2(0x05)
+_SHARED_SCAN_AVX2(0x06)
+_SHARED_SCAN_AVX2(0x07)
+_SHARED_SCAN_AVX2(0x08)
+_SHARED_SCAN_AVX2(0x09)
+_SHARED_SCAN_AVX2(0x0a)
+_SHARED_SCAN_AVX2(0x0b)
+_SHARED_SCAN_AVX2(0x0c)
+_SHARED_SCAN_AVX2(0x0d)
+_SHARED_SCAN_AVX2(0x0e)
+_SHARED_SCAN_AVX2(0x0f)
+
+/**
+ * Helper macro to accumulate a single value into the local aggregates of a
+ * gather scan.
+ */
+#define _SHARED_SCAN_GATHER_ITER(VALUE, FLAGS)                                 \
+  do {                                                                         \
+    if (FLAGS & SCAN_CALLBACK_MIN_FLAG) {                                      \
+      min_value = VALUE < min_value ? VALUE : min_value;                       \
+    }                                                                          \
+    if (FLAGS & SCAN_CALLBACK_MAX_FLAG) {                                      \
+      max_value = VALUE > max_value ? VALUE : max_value;                       \
+    }                                                                          \
+    if (FLAGS & SCAN_CALLBACK_SUM_FLAG) {                                      \
+      sum_value += VALUE;                                                      \
+    }                                                                          \
+  } while (0)
+
+/**
+ * Shared scan function for a specific combination of aggregations over the
+ * values at the positions of `ctx->gather_posvec`; only combinations without
+ * SELECT are generated.
+ *
+ * Unlike the other shared scan functions, the range is over the positions
+ * rather than the values, i.e., over the entries of an index array or the bits
+ * of a boolean mask. The set bits of a boolean mask are visited a word at a
+ * time, with the words at the ends of the range masked to the range. The
+ * aggregates are kept in locals and merged into the context at the end, so the
+ * values are aggregated right where they are gathered without materializing
+ * them.
+ */
+#define _SHARED_SCAN_GATHER(FLAGS)                                             \
+  void shared_scan_gather_##FLAGS(GeneralizedValvec *valvec,                   \
+                                  GeneralizedPosvec *posvec, ScanContext *ctx, \
+                                  size_t start, size_t end) {                  \
+    (void)posvec;                                                              \
+    int *data = valvec->valvec_type == GENERALIZED_VALVEC_TYPE_COLUMN          \
+                    ? valvec->valvec_pointer.column->data                      \
+                    : valvec->valvec_pointer.partial_column->values;           \
+    GeneralizedPosvec *gather = ctx->gather_posvec;                            \
+    int min_value = INT_MAX;                                                   \
+    int max_value = INT_MIN;                                                   \
+    long long sum_value = 0;                                                   \
+                                                                               \
+    if (gather->posvec_type == GENERALIZED_POSVEC_TYPE_INDEX_ARRAY) {          \
+      size_t *indices = gather->posvec_pointer.index_array->indices;           \
+      for (size_t i = start; i < end; i++) {                                   \
+        int value = data[indices[i]];                                          \
+        _SHARED_SCAN_GATHER_ITER(value, FLAGS);                                \
+      }                                                                        \
+    } else if (start < end) {                                                  \
+      uint64_t *words = gather->posvec_pointer.boolean_mask->mask->data;       \
+      size_t last_slot = _BITSLOT(end - 1);                                    \
+      for (size_t slot = _BITSLOT(start); slot <= last_slot; slot++) {         \
+        uint64_t word = words[slot];                                           \
+        if (slot == _BITSLOT(start)) {                                         \
+          word &= ~(uint64_t)0 << (start % 64);                                \
+        }                                                                      \
+        if (slot == last_slot && end % 64 != 0) {                              \
+          word &= _BITMASK(end) - 1;                                           \
+        }                                                                      \
+        for (; word != 0; word &= word - 1) {                                  \
+          int value = data[slot * 64 + __builtin_ctzll(word)];                 \
+          _SHARED_SCAN_GATHER_ITER(value, FLAGS);                              \
+        }                                                                      \
+      }                                                                        \
+    }                                                                          \
+                                                                               \
+    _SHARED_SCAN_MIN_ITER(min_value, ctx, FLAGS);                              \
+    _SHARED_SCAN_MAX_ITER(max_value, ctx, FLAGS);                              \
+    _SHARED_SCAN_SUM_ITER(sum_value, ctx, FLAGS);                              \
+  }
+
+_SHARED_SCAN_GATHER(0x02)
+_SHARED_SCAN_GATHER(0x04)
+_SHARED_SCAN_GATHER(0x06)
+_SHARED_SCAN_GATHER(0x08)
+_SHARED_SCAN_GATHER(0x0a)
+_SHARED_SCAN_GATHER(0x0c)
+_SHARED_SCAN_GATHER(0x0e)
+
+/**
+ * Shared scan function for a specific combination of aggregations over the
+ * values of `ctx->fetch_valvec` at the positions where the scanned values match
+ * the (single) select query; only combinations without SELECT are generated.
+ *
+ * This evaluates a select, a fetch, and an aggregation in one pass over the two
+ * value vectors side by side, so neither the selected positions nor the fetched
+ * values are materialized. The number of matching positions is counted in the
+ * context for averaging.
+ */
+#define _SHARED_SCAN_FUSED(FLAGS)                                              \
+  void shared_scan_fused_##FLAGS(GeneralizedValvec *valvec,                    \
+                                 GeneralizedPosvec *posvec, ScanContext *ctx,  \
+                                 size_t start, size_t end) {                   \
+    (void)posvec;                                                              \
+    int *data = valvec->valvec_type == GENERALIZED_VALVEC_TYPE_COLUMN          \
+                    ? valvec->valvec_pointer.column->data                      \
+                    : valvec->valvec_pointer.partial_column->values;           \
+    GeneralizedValvec *fetch_valvec = ctx->fetch_valvec;                       \
+    int *fetch_data =                                                          \
+        fetch_valvec->valvec_type == GENERALIZED_VALVEC_TYPE_COLUMN            \
+            ? fetch_valvec->valvec_pointer.column->data                        \
+            : fetch_valvec->valvec_pointer.partial_column->values;             \
+    long lower_bound = ctx->lower_bound_arr[0];                                \
+    long upper_bound = ctx->upper_bound_arr[0];                                \
+    int min_value = INT_MAX;                                                   \
+    int max_value = INT_MIN;                                                   \
+    long long sum_value = 0;                                                   \
+    size_t count = 0;                                                          \
+                                                                               \
+    for (size_t i = start; i < end; i++) {                                     \
+      if (data[i] >= lower_bound && data[i] < upper_bound) {                   \
+        int value = fetch_data[i];                                             \
+        _SHARED_SCAN_GATHER_ITER(value, FLAGS);                                \
+        count++;                                                               \
+      }                                                                        \
+    }                                                                          \
+                                                                               \
+    _SHARED_SCAN_MIN_ITER(min_value, ctx, FLAGS);                              \
+    _SHARED_SCAN_MAX_ITER(max_value, ctx, FLAGS);                              \
+    _SHARED_SCAN_SUM_ITER(sum_value, ctx, FLAGS);                              \
+    ctx->count_result += count;                                                \
+  }
+
+/**
+ * AVX2 shared scan function for a specific combination of aggregations fused
+ * with a select and a fetch, with the same effect as `_SHARED_SCAN_FUSED`.
+ *
+ * The comparison mask of 8 scanned values is applied to the 8 values fetched at
+ * the same positions by blending in the identity of each aggregation, so the
+ * vector accumulators can take every lane. Vectors without any match skip the
+ * fetch altogether.
+ */
+#define _SHARED_SCAN_FUSED_AVX2(FLAGS)                                         \
+  TARGET_AVX2 void shared_scan_fused_avx2_##FLAGS(                             \
+      GeneralizedValvec *valvec, GeneralizedPosvec *posvec, ScanContext *ctx,  \
+      size_t start, size_t end) {                                              \
+    (void)posvec;                                                              \
+    int *data = valvec->valvec_type == GENERALIZED_VALVEC_TYPE_COLUMN          \
+                    ? valvec->valvec_pointer.column->data                      \
+                    : valvec->valvec_pointer.partial_column->values;           \
+    GeneralizedValvec *fetch_valvec = ctx->fetch_valvec;                       \
+    int *fetch_data =                                                          \
+        fetch_valvec->valvec_type == GENERALIZED_VALVEC_TYPE_COLUMN            \
+            ? fetch_valvec->valvec_pointer.column->data                        \
+            : fetch_valvec->valvec_pointer.partial_column->values;             \
+    int lower, upper;                                                          \
+    _clamp_select_bounds(ctx->lower_bound_arr[0], ctx->upper_bound_arr[0],     \
+                         &lower, &upper);                                      \
+    __m256i lower_vec = _mm256_set1_epi32(lower);                              \
+    __m256i upper_vec = _mm256_set1_epi32(upper);                              \
+                                                                               \
+    __m256i min_identity = _mm256_set1_epi32(INT_MAX);                         \
+    __m256i max_identity = _mm256_set1_epi32(INT_MIN);                         \
+    __m256i min_vec = min_identity;                                            \
+    __m256i max_vec = max_identity;                                            \
+    __m256i sum_vec = _mm256_setzero_si256();                                  \
+    size_t count = 0;                                                          \
+                                                                               \
+    size_t i = start;                                                          \
+    for (; i + 8 <= end; i += 8) {                                             \
+      __m256i values = _mm256_loadu_si256((const __m256i *)(data + i));        \
+      __m256i outside =                                                        \
+          _mm256_or_si256(_mm256_cmpgt_epi32(lower_vec, values),               \
+                          _mm256_cmpgt_epi32(values, upper_vec));              \
+      int mask = ~_mm256_movemask_ps(_mm256_castsi256_ps(outside)) & 0xFF;     \
+      if (mask == 0) {                                                         \
+        continue;                                                              \
+      }                                                                        \
+      count += __builtin_popcount(mask);                                       \
+                                                                               \
+      __m256i fetched =                                                        \
+          _mm256_loadu_si256((const __m256i *)(fetch_data + i));               \
+      if (FLAGS & SCAN_CALLBACK_MIN_FLAG) {                                    \
+        min_vec = _mm256_min_epi32(                                            \
+            min_vec, _mm256_blendv_epi8(fetched, min_identity, outside));      \
+      }                                                                        \
+      if (FLAGS & SCAN_CALLBACK_MAX_FLAG) {                                    \
+        max_vec = _mm256_max_epi32(                                            \
+            max_vec, _mm256_blendv_epi8(fetched, max_identity, outside));      \
+      }                                                                        \
+      if (FLAGS & SCAN_CALLBACK_SUM_FLAG) {                                    \
+        __m256i kept = _mm256_andnot_si256(outside, fetched);                  \
+        sum_vec = _mm256_add_epi64(                                            \
+            sum_vec, _mm256_cvtepi32_epi64(_mm256_castsi256_si128(kept)));     \
+        sum_vec = _mm256_add_epi64(                                            \
+            sum_vec,                                                           \
+            _mm256_cvtepi32_epi64(_mm256_extracti128_si256(kept, 1)));         \
+      }                                                                        \
+    }                                                                          \
+                                                                               \
+    int min_value = _hmin_epi32(min_vec);                                      \
+    int max_value = _hmax_epi32(max_vec);                                      \
+    long long sum_value = _hsum_epi64(sum_vec);                                \
+    for (; i < end; i++) {                                                     \
+      if (data[i] >= lower && data[i] <= upper) {                              \
+        int value = fetch_data[i];                                             \
+        _SHARED_SCAN_GATHER_ITER(value, FLAGS);                                \
+        count++;                                                               \
+      }                                                                        \
+    }                                                                          \
+                                                                               \
+    _SHARED_SCAN_MIN_ITER(min_value, ctx, FLAGS);                              \
+    _SHARED_SCAN_MAX_ITER(max_value, ctx, FLAGS);                              \
+    _SHARED_SCAN_SUM_ITER(sum_value, ctx, FLAGS);                              \
+    ctx->count_result += count;                                                \
+  }
+
+_SHARED_SCAN_FUSED(0x02)
+_SHARED_SCAN_FUSED(0x04)
+_SHARED_SCAN_FUSED(0x06)
+_SHARED_SCAN_FUSED(0x08)
+_SHARED_SCAN_FUSED(0x0a)
+_SHARED_SCAN_FUSED(0x0c)
+_SHARED_SCAN_FUSED(0x0e)
+
+_SHARED_SCAN_FUSED_AVX2(0x02)
+_SHARED_SCAN_FUSED_AVX2(0x04)
+_SHARED_SCAN_FUSED_AVX2(0x06)
+_SHARED_SCAN_FUSED_AVX2(0x08)
+_SHARED_SCAN_FUSED_AVX2(0x0a)
+_SHARED_SCAN_FUSED_AVX2(0x0c)
+_SHARED_SCAN_FUSED_AVX2(0x0e)
+
 /**
  * @implements init_empty_scan_context
  */
@@ -125,20 +798,131 @@ ScanContext init_empty_scan_context() {
       .lower_bound_arr = NULL,
       .upper_bound_arr = NULL,
       .selected_indices_arr = NULL,
+      .selected_capacity_arr = NULL,
+      .selected_masks_arr = NULL,
+      .select_intervals = NULL,
+      .zone_map = NULL,
+      .gather_posvec = NULL,
+      .fetch_valvec = NULL,
       .n_selected_indices_arr = NULL,
       .n_select_queries = 0,
+      .mask_position = 0,
       .min_result = INT_MAX,
       .max_result = INT_MIN,
       .sum_result = 0,
+      .count_result = 0,
+      .status = DB_SCHEMA_STATUS_OK,
   };
 }
 
+/**
+ * @implements select_mask_length
+ */
+size_t select_mask_length(GeneralizedValvec *valvec, GeneralizedPosvec *posvec,
+                          long lower_bound, long upper_bound) {
+  size_t n_positions;
+  if (posvec == NULL) {
+    n_positions = valvec->valvec_length;
+  } else if (posvec->posvec_type == GENERALIZED_POSVEC_TYPE_BOOLEAN_MASK) {
+    n_positions = posvec->posvec_pointer.boolean_mask->mask->length;
+  } else {
+    return 0;
+  }
+  if (valvec->valvec_length == 0) {
+    return 0;
+  }
+
+  // Sample values evenly spaced over the value vector, which works for sorted
+  // data as well
+  int *data = valvec->valvec_type == GENERALIZED_VALVEC_TYPE_COLUMN
+                  ? valvec->valvec_pointer.column->data
+                  : valvec->valvec_pointer.partial_column->values;
+  size_t n_samples = valvec->valvec_length < SELECTIVITY_SAMPLE_SIZE
+                         ? valvec->valvec_length
+                         : SELECTIVITY_SAMPLE_SIZE;
+  size_t n_matched = 0;
+  for (size_t i = 0; i < n_samples; i++) {
+    int value = data[i * valvec->valvec_length / n_samples];
+    n_matched += value >= lower_bound && value < upper_bound;
+  }
+
+  // The selectivity is relative to the positions rather than the values, since
+  // the size of a boolean mask depends on the former
+  double selectivity = (double)n_matched / n_samples * valvec->valvec_length /
+                       n_positions;
+  return selectivity >= BOOLEAN_MASK_MIN_SELECTIVITY ? n_positions : 0;
+}
+
+/**
+ * Helper function to check whether any select query may match a zone.
+ */
+static inline bool _zone_may_match(ScanContext *ctx, size_t zone) {
+  int min_value = ctx->zone_map->mins[zone];
+  int max_value = ctx->zone_map->maxs[zone];
+  for (size_t c = 0; c < ctx->n_select_queries; c++) {
+    if (ctx->lower_bound_arr[c] <= max_value &&
+        ctx->upper_bound_arr[c] > min_value) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * Helper function to run a shared scan function over a range.
+ *
+ * With a zone map, the range is cut into runs of consecutive zones that some
+ * select query may match, and the scan function is only run over those runs.
+ * Runs start at zone boundaries, which are multiples of 64 like the starts of
+ * the ranges themselves, so boolean mask outputs are still written by whole
+ * words.
+ */
+static inline void _scan_range(SharedScanFunc shared_scan_func,
+                               GeneralizedValvec *valvec,
+                               GeneralizedPosvec *posvec, ScanContext *ctx,
+                               size_t start, size_t end) {
+  if (ctx->zone_map == NULL) {
+    shared_scan_func(valvec, posvec, ctx, start, end);
+    return;
+  }
+
+  size_t run_start = start;
+  for (size_t i = start; i < end;) {
+    size_t zone = i / ZONE_MAP_BLOCK_SIZE;
+    size_t zone_end = (zone + 1) * ZONE_MAP_BLOCK_SIZE;
+    zone_end = zone_end < end ? zone_end : end;
+    if (!_zone_may_match(ctx, zone)) {
+      if (run_start < i) {
+        shared_scan_func(valvec, posvec, ctx, run_start, i);
+      }
+      run_start = zone_end;
+    }
+    i = zone_end;
+  }
+  if (run_start < end) {
+    shared_scan_func(valvec, posvec, ctx, run_start, end);
+  }
+}
+
 /**
  * @implements shared_scan_worker
  */
 void shared_scan_subroutine(SharedScanTaskData *task_data) {
-  task_data->shared_scan_func(task_data->valvec, task_data->posvec,
-                              task_data->ctx, task_data->start, task_data->end);
+  _scan_range(task_data->shared_scan_func, task_data->valvec,
+              task_data->posvec, &task_data->ctx, task_data->start,
+              task_data->end);
+}
+
+/**
+ * Helper function to free the selected indices buffers of `n` select queries,
+ * along with the array holding them.
+ */
+static inline void _free_selected_indices(size_t **selected_indices_arr,
+                                          size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    free(selected_indices_arr[i]);
+  }
+  free(selected_indices_arr);
 }
 
 /**
@@ -150,67 +934,137 @@ DbSchemaStatus _shared_scan_sequential(SharedScanFunc shared_scan_func,
                                        GeneralizedValvec *valvec,
                                        GeneralizedPosvec *posvec,
                                        ScanContext *ctx, int flags) {
-  // Pre-processing for SELECT
-  // 1. Allocate memory for `n_selected_indices_arr`
-  // 2. Allocate memory for `selected_indices_arr_flattened`; this is going to
-  //    be used internally and in post-processing it will be converted to the
-  //    final `selected_indices_arr` and freed
+  // Pre-processing for SELECT: allocate memory for `n_selected_indices_arr`,
+  // `selected_indices_arr`, and `selected_capacity_arr`; the selected indices
+  // buffers themselves are allocated and grown by the scan as needed
   if (flags & SCAN_CALLBACK_SELECT_FLAG) {
     ctx->n_selected_indices_arr = calloc(ctx->n_select_queries, sizeof(size_t));
-    if (ctx->n_selected_indices_arr == NULL) {
-      return DB_SCHEMA_STATUS_ALLOC_FAILED;
-    }
-    ctx->selected_indices_arr_flattened =
-        malloc(valvec->valvec_length * ctx->n_select_queries * sizeof(size_t));
-    if (ctx->selected_indices_arr_flattened == NULL) {
+    ctx->selected_indices_arr = calloc(ctx->n_select_queries, sizeof(size_t *));
+    ctx->selected_capacity_arr = calloc(ctx->n_select_queries, sizeof(size_t));
+    if (ctx->n_selected_indices_arr == NULL ||
+        ctx->selected_indices_arr == NULL ||
+        ctx->selected_capacity_arr == NULL) {
       free(ctx->n_selected_indices_arr);
+      free(ctx->selected_indices_arr);
+      free(ctx->selected_capacity_arr);
       return DB_SCHEMA_STATUS_ALLOC_FAILED;
     }
   }
 
   // Dispatch the shared scan function directly in the main thread, for the
   // entire value vector
-  shared_scan_func(valvec, posvec, ctx, 0, valvec->valvec_length);
+  ctx->mask_position = 0;
+  ctx->status = DB_SCHEMA_STATUS_OK;
+  _scan_range(shared_scan_func, valvec, posvec, ctx, 0, valvec->valvec_length);
 
-  // Post-processing for SELECT
-  // 1. Allocate memory for `selected_indices_arr`, and for each subarray with
-  //    just enough capacity (obtained from the selected indices count)
-  // 2. Copy the selected indices from the flattened array to the each subarray
+  // Post-processing for SELECT: shrink each selected indices buffer to fit, as
+  // it may be kept for long as a handle; failing to shrink is harmless
   if (flags & SCAN_CALLBACK_SELECT_FLAG) {
-    ctx->selected_indices_arr =
-        malloc(ctx->n_select_queries * sizeof(size_t *));
-    if (ctx->selected_indices_arr == NULL) {
+    free(ctx->selected_capacity_arr);
+    ctx->selected_capacity_arr = NULL;
+    if (ctx->status != DB_SCHEMA_STATUS_OK) {
+      _free_selected_indices(ctx->selected_indices_arr, ctx->n_select_queries);
       free(ctx->n_selected_indices_arr);
-      free(ctx->selected_indices_arr_flattened);
-      return DB_SCHEMA_STATUS_ALLOC_FAILED;
+      return ctx->status;
     }
-
     for (size_t i = 0; i < ctx->n_select_queries; i++) {
-      // Allocate just enough capacity for each selected indices array
-      ctx->selected_indices_arr[i] =
-          malloc(ctx->n_selected_indices_arr[i] * sizeof(size_t));
-      if (ctx->selected_indices_arr[i] == NULL) {
-        for (size_t j = 0; j < i; j++) {
-          free(ctx->selected_indices_arr[j]);
+      if (ctx->selected_indices_arr[i] != NULL &&
+          ctx->n_selected_indices_arr[i] > 0) {
+        size_t *indices =
+            realloc(ctx->selected_indices_arr[i],
+                    ctx->n_selected_indices_arr[i] * sizeof(size_t));
+        if (indices != NULL) {
+          ctx->selected_indices_arr[i] = indices;
         }
-        free(ctx->n_selected_indices_arr);
-        free(ctx->selected_indices_arr);
-        free(ctx->selected_indices_arr_flattened);
-        return DB_SCHEMA_STATUS_ALLOC_FAILED;
-      }
-      // Copy the selected indices from the flattened array to the new array
-      for (size_t j = 0; j < ctx->n_selected_indices_arr[i]; j++) {
-        ctx->selected_indices_arr[i][j] =
-            ctx->selected_indices_arr_flattened[j * ctx->n_select_queries + i];
       }
     }
-
-    free(ctx->selected_indices_arr_flattened);
   }
 
   return DB_SCHEMA_STATUS_OK;
 }
 
+/**
+ * Helper function to split a shared scan into the ranges of parallel tasks.
+ *
+ * The i-th task scans from `starts[i]` (inclusive) to `starts[i + 1]`
+ * (exclusive). Without a boolean mask position vector, the value vector is
+ * split evenly into parts of `offset` values. Otherwise, the positions are
+ * split evenly into parts of `offset` positions instead, and the range of
+ * values of a task is determined by the number of set bits before its first
+ * position; this is done in a single pass over the words of the mask. Either
+ * way, since `offset` is a multiple of 64, tasks never write to the same word
+ * of a boolean mask output.
+ */
+static inline void _split_scan_ranges(BitVector *posvec_mask,
+                                      size_t total_length, size_t offset,
+                                      size_t n_tasks, size_t *starts) {
+  if (posvec_mask == NULL) {
+    for (size_t i = 0; i < n_tasks; i++) {
+      starts[i] = i * offset;
+    }
+    starts[n_tasks] = total_length;
+    return;
+  }
+
+  size_t rank = 0;
+  for (size_t i = 0; i < n_tasks; i++) {
+    starts[i] = rank;
+    size_t slot_end = _BITNSLOTS(posvec_mask->length);
+    if ((i + 1) * offset / 64 < slot_end) {
+      slot_end = (i + 1) * offset / 64;
+    }
+    for (size_t slot = i * offset / 64; slot < slot_end; slot++) {
+      rank += __builtin_popcountll(posvec_mask->data[slot]);
+    }
+  }
+  starts[n_tasks] = total_length;
+}
+
+/**
+ * Helper function to choose the number of positions per task of a parallel
+ * shared scan, or 0 if the scan should rather be sequential.
+ *
+ * The cost of a position is estimated by the number of predicates, i.e., the
+ * select queries plus one per aggregation. The scan stays sequential if its
+ * total cost is within the cost of scanning the private L2 cache of a single
+ * core once, or if there is only one thread (including the current one, which
+ * helps executing the tasks) or processor to run it. Otherwise, the positions
+ * are split into a few tasks per thread for balance, while each task scans at
+ * most half of the L2 cache worth of values so that its input stays cached
+ * next to its output blocks, and at least one L1 data cache worth of cost so
+ * that the per-task overhead is amortized. The result is a multiple of 64 so
+ * that tasks never write to the same word of a boolean mask output.
+ */
+static inline size_t _scan_task_length(size_t n_positions, ScanContext *ctx,
+                                       int flags) {
+  size_t n_predicates = ctx->n_select_queries +
+                        __builtin_popcount(flags & ~SCAN_CALLBACK_SELECT_FLAG);
+  if (n_predicates == 0) {
+    n_predicates = 1;
+  }
+  size_t n_threads = __thread_pool__->n_workers + 1;
+  if (n_threads > (size_t)__n_processors__) {
+    n_threads = __n_processors__;
+  }
+  if (n_threads <= 1 || n_positions * n_predicates * sizeof(int) <=
+                            (size_t)__l2_cache_size__) {
+    return 0;
+  }
+
+  size_t max_length = __l2_cache_size__ / 2 / sizeof(int);
+  size_t min_length = __l1d_cache_size__ / sizeof(int) / n_predicates;
+  size_t n_target_tasks = n_threads * NUM_SCAN_TASKS_PER_THREAD;
+  size_t length = (n_positions + n_target_tasks - 1) / n_target_tasks;
+  if (length > max_length) {
+    length = max_length;
+  }
+  if (length < min_length) {
+    length = min_length;
+  }
+  length = (length + 63) / 64 * 64;
+  return length < n_positions ? length : 0;
+}
+
 /**
  * Helper function to perform shared scan in parallel.
  *
@@ -223,102 +1077,129 @@ DbSchemaStatus _shared_scan_parallel(SharedScanFunc shared_scan_func,
                                      GeneralizedPosvec *posvec,
                                      ScanContext *ctx, int flags) {
   size_t total_length = valvec->valvec_length;
+  BitVector *posvec_mask =
+      posvec != NULL &&
+              posvec->posvec_type == GENERALIZED_POSVEC_TYPE_BOOLEAN_MASK
+          ? posvec->posvec_pointer.boolean_mask->mask
+          : NULL;
+
+  // Break the shared scan into parts sized for the processors and caches; if
+  // the scan is too small to pay off the parallelization (including when there
+  // is nothing to split, which the merging below cannot handle), just scan
+  // sequentially
+  size_t n_positions = posvec_mask == NULL ? total_length : posvec_mask->length;
+  size_t offset = _scan_task_length(n_positions, ctx, flags);
+  if (offset == 0) {
+    return _shared_scan_sequential(shared_scan_func, valvec, posvec, ctx,
+                                   flags);
+  }
+  int n_tasks = (int)(n_positions / offset + (n_positions % offset != 0));
+  size_t starts[n_tasks + 1];
+  _split_scan_ranges(posvec_mask, total_length, offset, n_tasks, starts);
 
-  // Break the shared scan into parts, each of page size
-  int offset = __page_size__ * NUM_PAGES_PER_SCAN_TASK / sizeof(int);
-  int n_tasks = total_length / offset + (total_length % offset != 0);
-  ScanContext subctxs[n_tasks];
-
-  // Pre-processing for SELECT (overall)
-  // 1. Allocate memory for `n_selected_indices_arr`; however, we do not just
-  //    allocate `n_select_queries` elements because each task should increment
-  //    its own count to avoid interference; hence we allocate `n_tasks` many
-  //    times the size of `n_select_queries`
-  // 2. Allocate memory for `selected_indices_arr_flattened`; this is going to
-  //    be used internally and in post-processing it will be converted to the
-  //    final `selected_indices_arr` and freed; different tasks would be writing
-  //    to different (contiguous) parts of this array
+  // The data of all tasks, including their subcontexts, live in a single arena
+  // that is handed to the thread pool as a whole
+  SharedScanTaskData *tasks = malloc(n_tasks * sizeof(SharedScanTaskData));
+  if (tasks == NULL) {
+    return DB_SCHEMA_STATUS_ALLOC_FAILED;
+  }
+
+  // Pre-processing for SELECT (overall): allocate memory for
+  // `n_selected_indices_arr`, `selected_indices_arr`, and
+  // `selected_capacity_arr`; however, we do not just allocate
+  // `n_select_queries` elements because each task should have its own counts
+  // and buffers to avoid interference; hence we allocate `n_tasks` many times
+  // the size of `n_select_queries`
+  size_t n_task_queries = ctx->n_select_queries * n_tasks;
+  size_t **task_selected_indices_arr = NULL;
+  size_t *task_capacity_arr = NULL;
   if (flags & SCAN_CALLBACK_SELECT_FLAG) {
-    ctx->n_selected_indices_arr =
-        calloc(ctx->n_select_queries * n_tasks, sizeof(size_t));
-    if (ctx->n_selected_indices_arr == NULL) {
-      return DB_SCHEMA_STATUS_ALLOC_FAILED;
-    }
-    ctx->selected_indices_arr_flattened =
-        malloc(valvec->valvec_length * ctx->n_select_queries * sizeof(size_t));
-    if (ctx->selected_indices_arr_flattened == NULL) {
+    ctx->n_selected_indices_arr = calloc(n_task_queries, sizeof(size_t));
+    task_selected_indices_arr = calloc(n_task_queries, sizeof(size_t *));
+    task_capacity_arr = calloc(n_task_queries, sizeof(size_t));
+    if (ctx->n_selected_indices_arr == NULL ||
+        task_selected_indices_arr == NULL || task_capacity_arr == NULL) {
       free(ctx->n_selected_indices_arr);
+      free(task_selected_indices_arr);
+      free(task_capacity_arr);
+      free(tasks);
       return DB_SCHEMA_STATUS_ALLOC_FAILED;
     }
   }
 
-  int i = 0;
-  thread_pool_reset_queue_completion(__thread_pool__);
-  for (size_t start = 0; start < total_length; start += offset) {
-    size_t end = start + offset < total_length ? start + offset : total_length;
+  for (int i = 0; i < n_tasks; i++) {
+    tasks[i].shared_scan_func = shared_scan_func;
+    tasks[i].valvec = valvec;
+    tasks[i].posvec = posvec;
+    tasks[i].start = starts[i];
+    tasks[i].end = starts[i + 1];
 
     // Initialize subcontext for the part; we first shallow copy the original
     // context and adjust on top of it
-    subctxs[i] = *ctx;
+    tasks[i].ctx = *ctx;
+    tasks[i].ctx.mask_position = i * offset;
+    tasks[i].ctx.status = DB_SCHEMA_STATUS_OK;
 
-    // Pre-processing for SELECT (per task)
-    // 1. Add offset to `n_selected_indices_arr`
-    // 2. Add offset to `selected_indices_arr_flattened`
+    // Pre-processing for SELECT (per task): add offset to
+    // `n_selected_indices_arr`, `selected_indices_arr`, and
+    // `selected_capacity_arr`
     if (flags & SCAN_CALLBACK_SELECT_FLAG) {
-      subctxs[i].n_selected_indices_arr =
+      tasks[i].ctx.n_selected_indices_arr =
           ctx->n_selected_indices_arr + i * ctx->n_select_queries;
-      subctxs[i].selected_indices_arr_flattened =
-          ctx->selected_indices_arr_flattened + start * ctx->n_select_queries;
+      tasks[i].ctx.selected_indices_arr =
+          task_selected_indices_arr + i * ctx->n_select_queries;
+      tasks[i].ctx.selected_capacity_arr =
+          task_capacity_arr + i * ctx->n_select_queries;
     }
+  }
 
-    // Wrap into a thread task and enqueue
-    SharedScanTaskData *task_data = malloc(sizeof(SharedScanTaskData));
-    if (task_data == NULL) {
-      return DB_SCHEMA_STATUS_ALLOC_FAILED;
-    }
-    task_data->shared_scan_func = shared_scan_func;
-    task_data->valvec = valvec;
-    task_data->posvec = posvec;
-    task_data->start = start;
-    task_data->end = end;
-    task_data->ctx = &subctxs[i];
-    ThreadTask task = {.id = next_task_id(),
-                       .type = THREAD_TASK_TYPE_SHARED_SCAN,
-                       .data = task_data};
-    thread_pool_enqueue_task(__thread_pool__, &task);
-    i++;
-
-    log_file(stdout, "  [LOG] Enqueued shared scan task %d\n", task.id);
-  }
-
-  // Wait until the task queue is emptied; since this function is the only
-  // producer to the shared scan task queue, waiting until the task queue is
-  // emptied is equivalent to waiting until our enqueued tasks are completed;
+  // Enqueue all tasks at once and wait for them; the task group belongs to
+  // this scan only, so concurrent scans do not interfere with each other;
   // XXX: perhaps post-processing per task completion (in order) would be more
   // efficient than waiting for all tasks to complete in the first place
-  thread_pool_wait_queue_completion(__thread_pool__, n_tasks);
+  ThreadTaskGroup group;
+  thread_task_group_init(&group);
+  thread_pool_enqueue_group(__thread_pool__, &group,
+                            THREAD_TASK_TYPE_SHARED_SCAN, tasks,
+                            sizeof(SharedScanTaskData), n_tasks);
+  thread_pool_wait_group(__thread_pool__, &group);
   log_file(stdout, "  [LOG] Shared scans completed\n");
 
+  DbSchemaStatus status = DB_SCHEMA_STATUS_OK;
+  for (int i = 0; i < n_tasks; i++) {
+    if (tasks[i].ctx.status != DB_SCHEMA_STATUS_OK) {
+      status = tasks[i].ctx.status;
+    }
+  }
+  free(task_capacity_arr);
+  if (status != DB_SCHEMA_STATUS_OK) {
+    if (flags & SCAN_CALLBACK_SELECT_FLAG) {
+      _free_selected_indices(task_selected_indices_arr, n_task_queries);
+      free(ctx->n_selected_indices_arr);
+    }
+    free(tasks);
+    return status;
+  }
+
   // Post-processing for SELECT
   // 1. Sum aggregate `n_selected_indices_arr` from the subcontexts into a
   //    single array containing the total counts per select query
-  // 2. Allocate memory for `selected_indices_arr`, and for each subarray with
-  //    just enough capacity (obtained from the selected aggregated counts)
-  // 3. Copy the selected indices from the flattened array to the each subarray;
+  // 2. Concatenate the buffers of the tasks per select query, except for
+  //    queries that output boolean masks; the buffer of the first task is grown
+  //    to fit the total count, and the buffers of the other tasks are appended
+  //    and freed one by one, so the peak memory stays close to the result size
   if (flags & SCAN_CALLBACK_SELECT_FLAG) {
     size_t *merged_n_selected_indices_arr =
         calloc(ctx->n_select_queries, sizeof(size_t));
-    if (merged_n_selected_indices_arr == NULL) {
-      free(ctx->n_selected_indices_arr);
-      free(ctx->selected_indices_arr_flattened);
-      return DB_SCHEMA_STATUS_ALLOC_FAILED;
-    }
     ctx->selected_indices_arr =
         malloc(ctx->n_select_queries * sizeof(size_t *));
-    if (ctx->selected_indices_arr == NULL) {
+    if (merged_n_selected_indices_arr == NULL ||
+        ctx->selected_indices_arr == NULL) {
       free(merged_n_selected_indices_arr);
+      free(ctx->selected_indices_arr);
+      _free_selected_indices(task_selected_indices_arr, n_task_queries);
       free(ctx->n_selected_indices_arr);
-      free(ctx->selected_indices_arr_flattened);
+      free(tasks);
       return DB_SCHEMA_STATUS_ALLOC_FAILED;
     }
 
@@ -326,55 +1207,59 @@ DbSchemaStatus _shared_scan_parallel(SharedScanFunc shared_scan_func,
     for (int i = 0; i < n_tasks; i++) {
       for (size_t j = 0; j < ctx->n_select_queries; j++) {
         merged_n_selected_indices_arr[j] +=
-            subctxs[i].n_selected_indices_arr[j];
+            tasks[i].ctx.n_selected_indices_arr[j];
       }
     }
 
-    // Allocate just enough capacity for each selected indices array
+    // Concatenate the selected indices of each query; the buffers of the tasks
+    // that have been taken over are set to NULL so that a failure can free the
+    // remaining ones
     for (size_t j = 0; j < ctx->n_select_queries; j++) {
-      ctx->selected_indices_arr[j] =
-          malloc(merged_n_selected_indices_arr[j] * sizeof(size_t));
-      if (ctx->selected_indices_arr[j] == NULL) {
-        for (size_t k = 0; k < j; k++) {
-          free(ctx->selected_indices_arr[k]);
+      if (_SELECTED_MASK(ctx, j) != NULL) {
+        ctx->selected_indices_arr[j] = NULL;
+        continue;
+      }
+      size_t *merged = tasks[0].ctx.selected_indices_arr[j];
+      tasks[0].ctx.selected_indices_arr[j] = NULL;
+      if (merged_n_selected_indices_arr[j] > 0) {
+        size_t *resized = realloc(
+            merged, merged_n_selected_indices_arr[j] * sizeof(size_t));
+        if (resized == NULL) {
+          free(merged);
+          _free_selected_indices(ctx->selected_indices_arr, j);
+          _free_selected_indices(task_selected_indices_arr, n_task_queries);
+          free(merged_n_selected_indices_arr);
+          free(ctx->n_selected_indices_arr);
+          free(tasks);
+          return DB_SCHEMA_STATUS_ALLOC_FAILED;
         }
-        free(merged_n_selected_indices_arr);
-        free(ctx->n_selected_indices_arr);
-        free(ctx->selected_indices_arr);
-        free(ctx->selected_indices_arr_flattened);
-        return DB_SCHEMA_STATUS_ALLOC_FAILED;
+        merged = resized;
       }
-    }
 
-    // Copy the selected indices from the flattened array to the new array; note
-    // that even though making `j` the outermost loop would mitigate the need of
-    // the `cp_offsets` array, it would be less cache-friendly
-    size_t cp_offsets[ctx->n_select_queries];
-    memset(cp_offsets, 0, sizeof(cp_offsets));
-    for (int i = 0; i < n_tasks; i++) {
-      for (size_t j = 0; j < ctx->n_select_queries; j++) {
-        for (size_t k = 0; k < subctxs[i].n_selected_indices_arr[j]; k++) {
-          ctx->selected_indices_arr[j][cp_offsets[j] + k] =
-              subctxs[i]
-                  .selected_indices_arr_flattened[k * ctx->n_select_queries +
-                                                  j];
+      size_t cp_offset = tasks[0].ctx.n_selected_indices_arr[j];
+      for (int i = 1; i < n_tasks; i++) {
+        if (tasks[i].ctx.n_selected_indices_arr[j] > 0) {
+          memcpy(merged + cp_offset, tasks[i].ctx.selected_indices_arr[j],
+                 tasks[i].ctx.n_selected_indices_arr[j] * sizeof(size_t));
+          cp_offset += tasks[i].ctx.n_selected_indices_arr[j];
         }
-        cp_offsets[j] += subctxs[i].n_selected_indices_arr[j];
+        free(tasks[i].ctx.selected_indices_arr[j]);
+        tasks[i].ctx.selected_indices_arr[j] = NULL;
       }
+      ctx->selected_indices_arr[j] = merged;
     }
 
     // Free intermediate memory and update the context
-    free(ctx->selected_indices_arr_flattened);
+    free(task_selected_indices_arr);
     free(ctx->n_selected_indices_arr);
-    ctx->selected_indices_arr_flattened = NULL;
     ctx->n_selected_indices_arr = merged_n_selected_indices_arr;
   }
 
   // Post-processing for MIN (min reduction)
   if (flags & SCAN_CALLBACK_MIN_FLAG) {
     for (int i = 0; i < n_tasks; i++) {
-      if (subctxs[i].min_result < ctx->min_result) {
-        ctx->min_result = subctxs[i].min_result;
+      if (tasks[i].ctx.min_result < ctx->min_result) {
+        ctx->min_result = tasks[i].ctx.min_result;
       }
     }
   }
@@ -382,8 +1267,8 @@ DbSchemaStatus _shared_scan_parallel(SharedScanFunc shared_scan_func,
   // Post-processing for MAX (max reduction)
   if (flags & SCAN_CALLBACK_MAX_FLAG) {
     for (int i = 0; i < n_tasks; i++) {
-      if (subctxs[i].max_result > ctx->max_result) {
-        ctx->max_result = subctxs[i].max_result;
+      if (tasks[i].ctx.max_result > ctx->max_result) {
+        ctx->max_result = tasks[i].ctx.max_result;
       }
     }
   }
@@ -391,13 +1276,115 @@ DbSchemaStatus _shared_scan_parallel(SharedScanFunc shared_scan_func,
   // Post-processing for SUM (sum reduction)
   if (flags & SCAN_CALLBACK_SUM_FLAG) {
     for (int i = 0; i < n_tasks; i++) {
-      ctx->sum_result += subctxs[i].sum_result;
+      ctx->sum_result += tasks[i].ctx.sum_result;
+    }
+  }
+
+  // Post-processing for the count of a fused scan (sum reduction); this is not
+  // tied to any flag as the count is kept by every fused scan
+  if (ctx->fetch_valvec != NULL) {
+    for (int i = 0; i < n_tasks; i++) {
+      ctx->count_result += tasks[i].ctx.count_result;
     }
   }
 
+  free(tasks);
   return DB_SCHEMA_STATUS_OK;
 }
 
+/**
+ * Helper function to compare two longs for sorting.
+ */
+static int _compare_longs(const void *a, const void *b) {
+  long x = *(const long *)a;
+  long y = *(const long *)b;
+  return (x > y) - (x < y);
+}
+
+/**
+ * Helper function to free the elementary intervals of select queries.
+ */
+static void _free_select_intervals(SelectIntervals *intervals) {
+  if (intervals != NULL) {
+    free(intervals->boundaries);
+    free(intervals->query_offsets);
+    free(intervals->queries);
+    free(intervals);
+  }
+}
+
+/**
+ * Helper function to build the elementary intervals of the select queries in
+ * the scan context.
+ *
+ * A query matches an elementary interval if and only if it matches the lower
+ * end of the interval, i.e., the boundary just below it, since the bounds of
+ * the query are themselves boundaries. Listing the matches takes O(Q^2) time
+ * for Q queries, which is negligible compared to a scan over a large value
+ * vector. This returns NULL if the allocation failed.
+ */
+static SelectIntervals *_build_select_intervals(ScanContext *ctx) {
+  size_t n_queries = ctx->n_select_queries;
+  SelectIntervals *intervals = malloc(sizeof(SelectIntervals));
+  if (intervals == NULL) {
+    return NULL;
+  }
+  intervals->boundaries = malloc(2 * n_queries * sizeof(long));
+  intervals->query_offsets = malloc((2 * n_queries + 2) * sizeof(size_t));
+  intervals->queries = NULL;
+  if (intervals->boundaries == NULL || intervals->query_offsets == NULL) {
+    _free_select_intervals(intervals);
+    return NULL;
+  }
+
+  // Collect the sorted distinct bounds
+  long *boundaries = intervals->boundaries;
+  for (size_t c = 0; c < n_queries; c++) {
+    boundaries[2 * c] = ctx->lower_bound_arr[c];
+    boundaries[2 * c + 1] = ctx->upper_bound_arr[c];
+  }
+  qsort(boundaries, 2 * n_queries, sizeof(long), _compare_longs);
+  size_t n_boundaries = 0;
+  for (size_t i = 0; i < 2 * n_queries; i++) {
+    if (n_boundaries == 0 || boundaries[i] != boundaries[n_boundaries - 1]) {
+      boundaries[n_boundaries++] = boundaries[i];
+    }
+  }
+  intervals->n_boundaries = n_boundaries;
+
+  // Count the matching queries per interval, where no query matches the values
+  // below the smallest boundary (the 0-th interval)
+  size_t *query_offsets = intervals->query_offsets;
+  query_offsets[0] = 0;
+  query_offsets[1] = 0;
+  for (size_t k = 1; k <= n_boundaries; k++) {
+    size_t n_matched = 0;
+    for (size_t c = 0; c < n_queries; c++) {
+      n_matched += ctx->lower_bound_arr[c] <= boundaries[k - 1] &&
+                   boundaries[k - 1] < ctx->upper_bound_arr[c];
+    }
+    query_offsets[k + 1] = query_offsets[k] + n_matched;
+  }
+
+  // List the matching queries per interval
+  intervals->queries =
+      malloc((query_offsets[n_boundaries + 1] + 1) * sizeof(size_t));
+  if (intervals->queries == NULL) {
+    _free_select_intervals(intervals);
+    return NULL;
+  }
+  for (size_t k = 1; k <= n_boundaries; k++) {
+    size_t q = query_offsets[k];
+    for (size_t c = 0; c < n_queries; c++) {
+      if (ctx->lower_bound_arr[c] <= boundaries[k - 1] &&
+          boundaries[k - 1] < ctx->upper_bound_arr[c]) {
+        intervals->queries[q++] = c;
+      }
+    }
+  }
+  return intervals;
+}
+
 /**
  * @implements shared_scan
  */
@@ -410,33 +1397,204 @@ DbSchemaStatus shared_scan(GeneralizedValvec *valvec, GeneralizedPosvec *posvec,
     return DB_SCHEMA_STATUS_PARALLEL_NOT_INITIALIZED;
   }
 
+  // Determine the shared scan function and meanwhile validate the flags; large
+  // batches of select queries use the elementary intervals of the queries, and
+  // otherwise the AVX2 kernels are used whenever the processor supports them
+  SharedScanFunc shared_scan_func;
+
+  bool use_intervals = (flags & SCAN_CALLBACK_SELECT_FLAG) &&
+                       ctx->n_select_queries >=
+                           MIN_NUM_QUERIES_FOR_SELECT_INTERVALS;
+
+  /* clang-format off */
+  if (use_intervals) {
+    switch (flags) {
+      case 0x01: shared_scan_func = shared_scan_intervals_0x01; break;
+      case 0x03: shared_scan_func = shared_scan_intervals_0x03; break;
+      case 0x05: shared_scan_func = shared_scan_intervals_0x05; break;
+      case 0x07: shared_scan_func = shared_scan_intervals_0x07; break;
+      case 0x09: shared_scan_func = shared_scan_intervals_0x09; break;
+      case 0x0b: shared_scan_func = shared_scan_intervals_0x0b; break;
+      case 0x0d: shared_scan_func = shared_scan_intervals_0x0d; break;
+      case 0x0f: shared_scan_func = shared_scan_intervals_0x0f; break;
+      default: assert(0 && "Invalid flags");
+    }
+  } else if (__has_avx2__) {
+    switch (flags) {
+      case 0x01: shared_scan_func = shared_scan_avx2_0x01; break;
+      case 0x02: shared_scan_func = shared_scan_avx2_0x02; break;
+      case 0x03: shared_scan_func = shared_scan_avx2_0x03; break;
+      case 0x04: shared_scan_func = shared_scan_avx2_0x04; break;
+      case 0x05: shared_scan_func = shared_scan_avx2_0x05; break;
+      case 0x06: shared_scan_func = shared_scan_avx2_0x06; break;
+      case 0x07: shared_scan_func = shared_scan_avx2_0x07; break;
+      case 0x08: shared_scan_func = shared_scan_avx2_0x08; break;
+      case 0x09: shared_scan_func = shared_scan_avx2_0x09; break;
+      case 0x0a: shared_scan_func = shared_scan_avx2_0x0a; break;
+      case 0x0b: shared_scan_func = shared_scan_avx2_0x0b; break;
+      case 0x0c: shared_scan_func = shared_scan_avx2_0x0c; break;
+      case 0x0d: shared_scan_func = shared_scan_avx2_0x0d; break;
+      case 0x0e: shared_scan_func = shared_scan_avx2_0x0e; break;
+      case 0x0f: shared_scan_func = shared_scan_avx2_0x0f; break;
+      default: assert(0 && "Invalid flags");
+    }
+  } else {
+    switch (flags) {
+      case 0x01: shared_scan_func = shared_scan_0x01; break;
+      case 0x02: shared_scan_func = shared_scan_0x02; break;
+      case 0x03: shared_scan_func = shared_scan_0x03; break;
+      case 0x04: shared_scan_func = shared_scan_0x04; break;
+      case 0x05: shared_scan_func = shared_scan_0x05; break;
+      case 0x06: shared_scan_func = shared_scan_0x06; break;
+      case 0x07: shared_scan_func = shared_scan_0x07; break;
+      case 0x08: shared_scan_func = shared_scan_0x08; break;
+      case 0x09: shared_scan_func = shared_scan_0x09; break;
+      case 0x0a: shared_scan_func = shared_scan_0x0a; break;
+      case 0x0b: shared_scan_func = shared_scan_0x0b; break;
+      case 0x0c: shared_scan_func = shared_scan_0x0c; break;
+      case 0x0d: shared_scan_func = shared_scan_0x0d; break;
+      case 0x0e: shared_scan_func = shared_scan_0x0e; break;
+      case 0x0f: shared_scan_func = shared_scan_0x0f; break;
+      default: assert(0 && "Invalid flags");
+    }
+  }
+  /* clang-format on */
+
+  // Preprocess the bounds of a large batch of select queries, which is shared
+  // read-only by all tasks of a parallel scan
+  if (use_intervals) {
+    ctx->select_intervals = _build_select_intervals(ctx);
+    if (ctx->select_intervals == NULL) {
+      return DB_SCHEMA_STATUS_ALLOC_FAILED;
+    }
+  }
+
+  // Zone maps apply to scans over a whole column, and only to select queries
+  // since aggregations need every value
+  if (flags == SCAN_CALLBACK_SELECT_FLAG && posvec == NULL &&
+      valvec->valvec_type == GENERALIZED_VALVEC_TYPE_COLUMN) {
+    ctx->zone_map = &valvec->valvec_pointer.column->zone_map;
+  }
+
+  // Perform the shared scan either sequentially or in parallel
+  DbSchemaStatus status =
+      __multi_threaded__
+          ? _shared_scan_parallel(shared_scan_func, valvec, posvec, ctx, flags)
+          : _shared_scan_sequential(shared_scan_func, valvec, posvec, ctx,
+                                    flags);
+  _free_select_intervals(ctx->select_intervals);
+  ctx->select_intervals = NULL;
+  ctx->zone_map = NULL;
+  return status;
+}
+
+/**
+ * @implements shared_scan_gather
+ */
+DbSchemaStatus shared_scan_gather(GeneralizedValvec *valvec,
+                                  GeneralizedPosvec *posvec, ScanContext *ctx,
+                                  int flags) {
+  if (__multi_threaded__ && __thread_pool__ == NULL) {
+    // See `shared_scan` for why this is an error
+    return DB_SCHEMA_STATUS_PARALLEL_NOT_INITIALIZED;
+  }
+
   // Determine the shared scan function and meanwhile validate the flags
   SharedScanFunc shared_scan_func;
 
   /* clang-format off */
   switch (flags) {
-    case 0x01: shared_scan_func = shared_scan_0x01; break;
-    case 0x02: shared_scan_func = shared_scan_0x02; break;
-    case 0x03: shared_scan_func = shared_scan_0x03; break;
-    case 0x04: shared_scan_func = shared_scan_0x04; break;
-    case 0x05: shared_scan_func = shared_scan_0x05; break;
-    case 0x06: shared_scan_func = shared_scan_0x06; break;
-    case 0x07: shared_scan_func = shared_scan_0x07; break;
-    case 0x08: shared_scan_func = shared_scan_0x08; break;
-    case 0x09: shared_scan_func = shared_scan_0x09; break;
-    case 0x0a: shared_scan_func = shared_scan_0x0a; break;
-    case 0x0b: shared_scan_func = shared_scan_0x0b; break;
-    case 0x0c: shared_scan_func = shared_scan_0x0c; break;
-    case 0x0d: shared_scan_func = shared_scan_0x0d; break;
-    case 0x0e: shared_scan_func = shared_scan_0x0e; break;
-    case 0x0f: shared_scan_func = shared_scan_0x0f; break;
+    case 0x02: shared_scan_func = shared_scan_gather_0x02; break;
+    case 0x04: shared_scan_func = shared_scan_gather_0x04; break;
+    case 0x06: shared_scan_func = shared_scan_gather_0x06; break;
+    case 0x08: shared_scan_func = shared_scan_gather_0x08; break;
+    case 0x0a: shared_scan_func = shared_scan_gather_0x0a; break;
+    case 0x0c: shared_scan_func = shared_scan_gather_0x0c; break;
+    case 0x0e: shared_scan_func = shared_scan_gather_0x0e; break;
     default: assert(0 && "Invalid flags");
   }
   /* clang-format on */
 
-  // Perform the shared scan either sequentially or in parallel
-  if (__multi_threaded__) {
-    return _shared_scan_parallel(shared_scan_func, valvec, posvec, ctx, flags);
+  // The scan ranges are over the positions, so the scan is driven by a copy of
+  // the value vector whose length is the number of positions to split; ranges
+  // of a parallel scan then start at multiples of 64, i.e., at whole words of a
+  // boolean mask position vector
+  GeneralizedValvec positions = *valvec;
+  positions.valvec_length =
+      posvec->posvec_type == GENERALIZED_POSVEC_TYPE_BOOLEAN_MASK
+          ? posvec->posvec_pointer.boolean_mask->mask->length
+          : posvec->posvec_pointer.index_array->n_indices;
+
+  // Perform the shared scan either sequentially or in parallel, where the
+  // partial aggregates of the tasks are merged as in any other shared scan
+  ctx->gather_posvec = posvec;
+  DbSchemaStatus status =
+      __multi_threaded__
+          ? _shared_scan_parallel(shared_scan_func, &positions, NULL, ctx,
+                                  flags)
+          : _shared_scan_sequential(shared_scan_func, &positions, NULL, ctx,
+                                    flags);
+  ctx->gather_posvec = NULL;
+  return status;
+}
+
+/**
+ * @implements shared_scan_fused
+ */
+DbSchemaStatus shared_scan_fused(GeneralizedValvec *valvec,
+                                 GeneralizedValvec *fetch_valvec,
+                                 ScanContext *ctx, int flags) {
+  if (__multi_threaded__ && __thread_pool__ == NULL) {
+    // See `shared_scan` for why this is an error
+    return DB_SCHEMA_STATUS_PARALLEL_NOT_INITIALIZED;
+  }
+
+  // Determine the shared scan function and meanwhile validate the flags
+  SharedScanFunc shared_scan_func;
+
+  /* clang-format off */
+  if (__has_avx2__) {
+    switch (flags) {
+      case 0x02: shared_scan_func = shared_scan_fused_avx2_0x02; break;
+      case 0x04: shared_scan_func = shared_scan_fused_avx2_0x04; break;
+      case 0x06: shared_scan_func = shared_scan_fused_avx2_0x06; break;
+      case 0x08: shared_scan_func = shared_scan_fused_avx2_0x08; break;
+      case 0x0a: shared_scan_func = shared_scan_fused_avx2_0x0a; break;
+      case 0x0c: shared_scan_func = shared_scan_fused_avx2_0x0c; break;
+      case 0x0e: shared_scan_func = shared_scan_fused_avx2_0x0e; break;
+      default: assert(0 && "Invalid flags");
+    }
+  } else {
+    switch (flags) {
+      case 0x02: shared_scan_func = shared_scan_fused_0x02; break;
+      case 0x04: shared_scan_func = shared_scan_fused_0x04; break;
+      case 0x06: shared_scan_func = shared_scan_fused_0x06; break;
+      case 0x08: shared_scan_func = shared_scan_fused_0x08; break;
+      case 0x0a: shared_scan_func = shared_scan_fused_0x0a; break;
+      case 0x0c: shared_scan_func = shared_scan_fused_0x0c; break;
+      case 0x0e: shared_scan_func = shared_scan_fused_0x0e; break;
+      default: assert(0 && "Invalid flags");
+    }
   }
-  return _shared_scan_sequential(shared_scan_func, valvec, posvec, ctx, flags);
+  /* clang-format on */
+  assert(ctx->n_select_queries == 1);
+
+  // Only the positions matching the select query contribute to the aggregates,
+  // so zones that the query cannot match are skipped like in a select over a
+  // whole column
+  if (valvec->valvec_type == GENERALIZED_VALVEC_TYPE_COLUMN) {
+    ctx->zone_map = &valvec->valvec_pointer.column->zone_map;
+  }
+
+  // Perform the shared scan either sequentially or in parallel, where the
+  // partial aggregates and counts of the tasks are merged at the end
+  ctx->fetch_valvec = fetch_valvec;
+  DbSchemaStatus status =
+      __multi_threaded__
+          ? _shared_scan_parallel(shared_scan_func, valvec, NULL, ctx, flags)
+          : _shared_scan_sequential(shared_scan_func, valvec, NULL, ctx,
+                                    flags);
+  ctx->fetch_valvec = NULL;
+  ctx->zone_map = NULL;
+  return status;
 }
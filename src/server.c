@@ -4,18 +4,33 @@
  * This file provides a basic Unix socket implementation for a server used in an
  * interactive client-server database.
  *
+ * The server multiplexes all client connections with epoll in the main thread.
+ * Messages are received without blocking and every complete message (i.e., the
+ * header and the full payload) is dispatched to the thread pool for processing,
+ * so the number of (mostly idle) client connections is decoupled from the
+ * number of worker threads. A connection is not polled while one of its
+ * messages is being processed, so the messages of a single connection are
+ * always processed in order.
+ *
  * For more information on Unix sockets, refer to:
  * http://beej.us/guide/bgipc/output/html/multipage/unixsock.html
  */
 
 #include <assert.h>
+#include <errno.h>
+#include <pthread.h>
 #include <stdbool.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <sys/socket.h>
 #include <sys/un.h>
 #include <unistd.h>
 
+#include "cmdaddsub.h"
+#include "cmdfetch.h"
 #include "cmdload.h"
 #include "comm.h"
 #include "consts.h"
@@ -28,6 +43,7 @@
 #include "scan.h"
 #include "sysinfo.h"
 #include "thread_pool.h"
+#include "utlist.h"
 
 /**
  * The context of a load command.
@@ -38,14 +54,99 @@
  * NULL if the load command is not started or is terminated, otherwise malloc'ed
  * and updated in the process. The error is the error message if the load query
  * fails, otherwise NULL. XXX: The error message is currently always non-
- * malloc'ed, i.e., no need to free.
+ * malloc'ed, i.e., no need to free. The client streams the rows without waiting
+ * for responses, so an error is reported as soon as it happens, and the rest of
+ * the load is ignored; the sequence number of the load is kept for that.
+ *
+ * Once the header is validated, the table is marked as being loaded by this
+ * context (see `Table`), and each batch of rows is staged past the last row of
+ * the table as soon as it arrives, so that nothing but the header (malloc'ed)
+ * is buffered; `n_rows` is the number of rows staged so far and `is_staging`
+ * tells whether the table is marked. The staged rows are only made part of the
+ * table when the load is finished, while holding the catalog lock exclusively.
+ * This way the catalog lock is never held across messages, and other
+ * connections never observe a partially loaded table. The table is looked up
+ * again by the header for each step since the catalog may change in between.
+ * The batch size is negotiated with the client and bounds the size of each
+ * batch.
  */
 typedef struct LoadCommandContext {
   DbOperator *query;
   char *error;
-  size_t n_cumu_rows;
+  bool is_error_reported;
+  unsigned int sequence;
+  char *header;
+  size_t batch_size;
+  bool is_staging;
+  size_t n_rows;
 } LoadCommandContext;
 
+/**
+ * A client connection.
+ *
+ * Each connection has its own client context, batch context, and load context,
+ * and these are isolated from other connections. The header and payload of the
+ * message that is currently being received are kept along with the number of
+ * bytes already received, because a message may arrive in multiple pieces. The
+ * payload is malloc'ed with an extra byte for null termination. A file
+ * descriptor passed along with a message is kept until the message is handled,
+ * and the shared memory channel set up with it, if any, is used to move large
+ * payloads in both directions. Connections are linked in a doubly linked list
+ * owned by the server state.
+ */
+typedef struct ClientConnection {
+  int socket;
+  ClientContext *client_context;
+  BatchContext batch_context;
+  LoadCommandContext load_context;
+  Message recv_message;
+  size_t n_header_received;
+  char *payload;
+  size_t n_payload_received;
+  int received_fd;
+  SharedChannel *channel;
+  struct ClientConnection *prev;
+  struct ClientConnection *next;
+} ClientConnection;
+
+/**
+ * The state of the server.
+ *
+ * The epoll instance polls the server socket for new connections, the wakeup
+ * event file descriptor for wakeups from the workers (e.g., for shutdown), and
+ * the client connections for incoming data. The mutex protects the connection
+ * list, the counters, and the shutdown flag. The number of in-flight messages
+ * is the number of messages that are dispatched but not yet fully processed,
+ * and the condition variable is signaled whenever it drops.
+ */
+typedef struct ServerState {
+  int server_socket;
+  int epoll_fd;
+  int wakeup_fd;
+  ClientConnection *connections;
+  int n_connections;
+  int max_connections;
+  int n_in_flight;
+  bool is_accepting;
+  bool shutdown_requested;
+  pthread_mutex_t mutex;
+  pthread_cond_t cond_in_flight;
+} ServerState;
+
+static ServerState server_state = {
+    .server_socket = -1,
+    .epoll_fd = -1,
+    .wakeup_fd = -1,
+    .connections = NULL,
+    .n_connections = 0,
+    .max_connections = MAX_CLIENT_CONNECTIONS,
+    .n_in_flight = 0,
+    .is_accepting = false,
+    .shutdown_requested = false,
+    .mutex = PTHREAD_MUTEX_INITIALIZER,
+    .cond_in_flight = PTHREAD_COND_INITIALIZER,
+};
+
 /**
  * Processing status codes of the server.
  */
@@ -56,14 +157,370 @@ typedef enum ServerProcessCode {
   SERVER_PROCESS_CODE_OK_TERMINATE_SHUTDOWN,
   // Processing failed but the processing loop should continue.
   SERVER_PROCESS_CODE_ERROR_NONBREAKING,
-  // Processing failed because of failure to send message header.
-  SERVER_PROCESS_CODE_ERROR_SEND_HEADER,
-  // Processing failed because of failure to send message payload.
-  SERVER_PROCESS_CODE_ERROR_SEND_PAYLOAD,
-  // Processing failed because of failure to receive message payload.
-  SERVER_PROCESS_CODE_ERROR_RECV_PAYLOAD,
+  // Processing failed because of failure to send message to the client.
+  SERVER_PROCESS_CODE_ERROR_SEND,
 } ServerProcessCode;
 
+/**
+ * Helper function to execute a query command.
+ *
+ * The command is either a switch between single-core and multi-threaded mode
+ * (for all clients), or an ordinary query, and the send message is updated with
+ * the result. This function returns whether the catalog read lock is still
+ * held, in which case the caller must release it once the result is consumed
+ * (i.e., sent or written).
+ */
+static inline bool _execute_command(char *command, Message *send_message,
+                                    ClientContext *client_context,
+                                    BatchContext *batch_context,
+                                    int client_socket) {
+  bool is_single_core = strncmp(command, "single_core()", 13) == 0;
+  if (is_single_core || strncmp(command, "single_core_execute()", 21) == 0) {
+    // Switch to single-core or multi-threaded mode if not already in it,
+    // otherwise this is an error; the mode is server-wide, so it is switched
+    // with exclusive access to the catalog, i.e., while no query is executing
+    catalog_write_lock();
+    if (__multi_threaded__ != is_single_core) {
+      send_message->status = MESSAGE_STATUS_EXECUTION_ERROR;
+      send_message->payload = is_single_core ? "Already in single-core mode."
+                                             : "Not in single-core mode.";
+      send_message->length = strlen(send_message->payload);
+    } else {
+      __multi_threaded__ = !is_single_core;
+    }
+    catalog_unlock();
+    return false;
+  }
+
+  // Ordinary query processing routine: convert the query string into a request
+  // for a database operator and execute the operator; in this process the
+  // message will be updated; the catalog lock is held throughout because the
+  // parsed operator references tables and columns in the catalog
+  if (command_requires_exclusive_access(command)) {
+    catalog_write_lock();
+  } else {
+    catalog_read_lock();
+  }
+  DbOperator *query = parse_command(command, send_message, client_socket,
+                                    client_context, batch_context);
+  execute_db_operator(query, send_message);
+
+  // The lock is released before the result is consumed so that network I/O
+  // does not block other connections, unless the payload segments refer
+  // directly to column memory (i.e., print of columns), in which case the read
+  // lock must be kept until they are sent or copied out so that no writer can
+  // modify or remap the column in the meantime; note that only non-exclusive
+  // commands can produce payload segments so this never holds the write lock
+  if (send_message->n_segments == 0) {
+    catalog_unlock();
+    return false;
+  }
+  return true;
+}
+
+/**
+ * Helper function to gather multiple segments into a single malloc'ed buffer.
+ *
+ * The total size of the segments is given. This function returns the buffer,
+ * or NULL if the allocation fails.
+ */
+static inline char *_gather_segments(struct iovec *segments, int n_segments,
+                                     size_t length) {
+  char *buffer = malloc(length);
+  if (buffer == NULL) {
+    return NULL;
+  }
+  char *current = buffer;
+  for (int i = 0; i < n_segments; i++) {
+    memcpy(current, segments[i].iov_base, segments[i].iov_len);
+    current += segments[i].iov_len;
+  }
+  return buffer;
+}
+
+/**
+ * Helper function to send a message whose payload segments refer to column
+ * memory, releasing the catalog read lock that protects the columns.
+ *
+ * The lock is never held across a blocking send. A small result is sent
+ * directly from the columns as far as the socket takes it without blocking,
+ * and what is left is copied into an owned buffer and sent after releasing the
+ * lock. A large result, or one that goes through the shared memory channel,
+ * whose slots may not be free, is copied out as a whole. If the buffer cannot
+ * be allocated, the rest is sent while still holding the lock.
+ */
+static inline ServerProcessCode _send_locked_result(Message *send_message,
+                                                    SharedChannel *channel,
+                                                    int client_socket) {
+  if ((channel != NULL &&
+       send_message->length >= SHARED_CHANNEL_MIN_PAYLOAD_SIZE) ||
+      send_message->length > MAX_ZERO_COPY_RESULT_SIZE) {
+    char *payload = _gather_segments(
+        send_message->segments, send_message->n_segments, send_message->length);
+    if (payload == NULL) {
+      ssize_t sent = send_message_shared(client_socket, channel, send_message);
+      catalog_unlock();
+      return sent == -1 ? SERVER_PROCESS_CODE_ERROR_SEND
+                        : SERVER_PROCESS_CODE_OK;
+    }
+    free(send_message->segments);
+    if (send_message->is_malloced) {
+      free(send_message->payload);
+    }
+    send_message->segments = NULL;
+    send_message->n_segments = 0;
+    send_message->payload = payload;
+    send_message->is_malloced = true;
+    catalog_unlock();
+    ssize_t sent = send_message_shared(client_socket, channel, send_message);
+    return sent == -1 ? SERVER_PROCESS_CODE_ERROR_SEND : SERVER_PROCESS_CODE_OK;
+  }
+
+  // Gather the header and all payload segments, and send whatever the socket
+  // takes right away
+  int n_segments = send_message->n_segments + 1;
+  struct iovec segments[n_segments];
+  segments[0].iov_base = send_message;
+  segments[0].iov_len = sizeof(Message);
+  memcpy(segments + 1, send_message->segments,
+         send_message->n_segments * sizeof(struct iovec));
+  ssize_t sent = sendv_available(client_socket, segments, n_segments);
+  size_t rest_length = 0;
+  for (int i = 0; sent >= 0 && i < n_segments; i++) {
+    rest_length += segments[i].iov_len;
+  }
+
+  // Copy out the rest so that it can be sent without the lock
+  char *rest = NULL;
+  if (sent >= 0 && rest_length > 0) {
+    rest = _gather_segments(segments, n_segments, rest_length);
+    if (rest == NULL) {
+      sent = sendv_all(client_socket, segments, n_segments);
+      rest_length = 0;
+    }
+  }
+  catalog_unlock();
+  free(send_message->segments);
+  if (send_message->is_malloced) {
+    free(send_message->payload);
+  }
+  if (rest != NULL) {
+    sent = send_all(client_socket, rest, rest_length);
+    free(rest);
+  }
+  return sent == -1 ? SERVER_PROCESS_CODE_ERROR_SEND : SERVER_PROCESS_CODE_OK;
+}
+
+/**
+ * Helper function to send a message and release the catalog lock if held.
+ */
+static inline ServerProcessCode _send_result(Message *send_message,
+                                             bool is_locked,
+                                             SharedChannel *channel,
+                                             int client_socket) {
+  if (is_locked) {
+    return _send_locked_result(send_message, channel, client_socket);
+  }
+
+  // Send the header and the payload together directly from the payload buffer
+  // (which may be binary and is not null-terminated) without copying it, or
+  // through the shared memory channel if the payload is large
+  ssize_t sent = send_message_shared(client_socket, channel, send_message);
+  return sent == -1 ? SERVER_PROCESS_CODE_ERROR_SEND : SERVER_PROCESS_CODE_OK;
+}
+
+/**
+ * Helper function to write a successful result of a script line to a file.
+ *
+ * Columnar results are formatted the same way as by the client. The payload and
+ * the payload segments of the message are freed as if it were sent. This
+ * function returns 0 on success and -1 on failure.
+ */
+static inline int _write_script_result(FILE *out, Message *message) {
+  int status = 0;
+  if (message->status == MESSAGE_STATUS_OK_COLUMNAR) {
+    // Payload segments need to be gathered because the formatter expects the
+    // columnar result in a single buffer
+    char *payload = message->payload;
+    if (message->n_segments > 0) {
+      payload = _gather_segments(message->segments, message->n_segments,
+                                 message->length);
+    }
+    if (payload == NULL ||
+        write_columnar_result(out, payload, message->length) < 0) {
+      status = -1;
+    }
+    if (payload != message->payload) {
+      free(payload);
+    }
+  } else if (message->length > 0) {
+    fprintf(out, "%.*s\n", message->length, message->payload);
+  }
+
+  free(message->segments);
+  if (message->is_malloced) {
+    free(message->payload);
+  }
+  return status;
+}
+
+/**
+ * Helper function to attribute an error result to a line of a script.
+ *
+ * The payload is replaced by the error message (or the description of the
+ * status if there is no error message) prefixed with the script path and the
+ * line number, so that the client can tell where the error comes from.
+ */
+static inline void _attribute_script_error(Message *message,
+                                           const char *script_path,
+                                           size_t line) {
+  const char *error = message->payload;
+  int error_length = message->length;
+  if (error_length == 0) {
+    error = message->status == MESSAGE_STATUS_INVALID_COMMAND
+                ? "Invalid command."
+                : "Unknown error encountered during execution.";
+    error_length = strlen(error);
+  }
+
+  int length = snprintf(NULL, 0, "%s:%zu: %.*s", script_path, line,
+                        error_length, error);
+  char *payload = malloc(length + 1);
+  if (payload != NULL) {
+    snprintf(payload, length + 1, "%s:%zu: %.*s", script_path, line,
+             error_length, error);
+  }
+  if (message->is_malloced) {
+    free(message->payload);
+  }
+  message->payload = payload == NULL ? "Failed to allocate internal memory."
+                                     : payload;
+  message->length = strlen(message->payload);
+  message->is_malloced = payload != NULL;
+}
+
+/**
+ * Process a source command in a MESSAGE_STATUS_C_REQUEST_PROCESS_COMMAND
+ * message.
+ *
+ * The client asks the server to read a script file of queries and execute them
+ * line by line, the same way as if they were sent by the client one by one but
+ * without the round trips. The result of each line, if any, is streamed back to
+ * the client in a partial message as soon as it is ready, unless an output file
+ * is given, in which case successful results are written to that file instead
+ * (errors are still sent back). The response is concluded by a final message
+ * that indicates whether the script as a whole could be processed.
+ */
+ServerProcessCode mproc_source_script(Message *recv_message, char *payload,
+                                      ClientContext *client_context,
+                                      BatchContext *batch_context,
+                                      SharedChannel *channel,
+                                      int client_socket) {
+  Message send_message;
+  memset(&send_message, 0, sizeof(Message));
+  send_message.status = MESSAGE_STATUS_OK;
+  send_message.sequence = recv_message->sequence;
+
+  // Open the script file and the output file if any
+  char *script_path, *output_path;
+  FILE *script = NULL, *out = NULL;
+  if (!parse_source_command(payload, &script_path, &output_path)) {
+    send_message.status = MESSAGE_STATUS_INVALID_COMMAND;
+    return _send_result(&send_message, false, channel, client_socket);
+  }
+  log_file(stdout, "QUERY: `source(\"%s\")`\n", script_path);
+  if ((script = fopen(script_path, "r")) == NULL) {
+    send_message.status = MESSAGE_STATUS_EXECUTION_ERROR;
+    send_message.payload = "Failed to open the script file.";
+    send_message.length = strlen(send_message.payload);
+    return _send_result(&send_message, false, channel, client_socket);
+  }
+  if (output_path != NULL && (out = fopen(output_path, "w")) == NULL) {
+    fclose(script);
+    send_message.status = MESSAGE_STATUS_EXECUTION_ERROR;
+    send_message.payload = "Failed to open the output file.";
+    send_message.length = strlen(send_message.payload);
+    return _send_result(&send_message, false, channel, client_socket);
+  }
+
+  // Execute the script line by line
+  ServerProcessCode sp_code = SERVER_PROCESS_CODE_OK;
+  bool is_write_failed = false;
+  char *command = NULL;
+  size_t capacity = 0;
+  ssize_t command_length;
+  size_t line = 0;
+  while ((command_length = getline(&command, &capacity, script)) != -1) {
+    line++;
+    if (command_length > 0 && command[command_length - 1] == '\n') {
+      command[--command_length] = '\0';
+    }
+    if (command_length == 0) {
+      continue; // Do not process empty lines
+    }
+
+    Message line_message;
+    memset(&line_message, 0, sizeof(Message));
+    line_message.status = MESSAGE_STATUS_OK;
+    line_message.sequence = recv_message->sequence;
+    line_message.is_partial = true;
+
+    // Shutdown and nested scripts are only allowed from the client directly
+    bool is_locked = false;
+    if (strncmp(command, "shutdown", 8) == 0 ||
+        strncmp(command, "source(", 7) == 0) {
+      line_message.status = MESSAGE_STATUS_EXECUTION_ERROR;
+      line_message.payload = "Command is not allowed in a script.";
+      line_message.length = strlen(line_message.payload);
+    } else {
+      is_locked = _execute_command(command, &line_message, client_context,
+                                   batch_context, client_socket);
+    }
+
+    // Write successful results to the output file if given
+    bool is_successful = line_message.status == MESSAGE_STATUS_OK ||
+                         line_message.status == MESSAGE_STATUS_OK_COLUMNAR;
+    if (out != NULL && is_successful) {
+      is_write_failed |= _write_script_result(out, &line_message) < 0;
+      if (is_locked) {
+        catalog_unlock();
+      }
+      continue;
+    }
+
+    // Otherwise send the result back if there is anything to send
+    if (line_message.status == MESSAGE_STATUS_OK && line_message.length == 0) {
+      if (line_message.is_malloced) {
+        free(line_message.payload);
+      }
+      continue;
+    }
+    if (!is_successful) {
+      _attribute_script_error(&line_message, script_path, line);
+    }
+    sp_code = _send_result(&line_message, is_locked, channel, client_socket);
+    if (sp_code != SERVER_PROCESS_CODE_OK) {
+      break;
+    }
+  }
+  free(command);
+  fclose(script);
+  if (out != NULL && fclose(out) != 0) {
+    is_write_failed = true;
+  }
+  if (sp_code != SERVER_PROCESS_CODE_OK) {
+    return sp_code;
+  }
+
+  // Conclude the response with a final message
+  if (is_write_failed) {
+    send_message.status = MESSAGE_STATUS_EXECUTION_ERROR;
+    send_message.payload = "Failed to write the output file.";
+    send_message.length = strlen(send_message.payload);
+  }
+  return _send_result(&send_message, false, channel, client_socket);
+}
+
 /**
  * Process a MESSAGE_STATUS_C_REQUEST_PROCESS_COMMAND message.
  *
@@ -72,121 +529,171 @@ typedef enum ServerProcessCode {
  * query. The query is then executed and the result is sent back to the client.
  */
 ServerProcessCode mproc_request_process_command(Message *recv_message,
+                                                char *payload,
                                                 ClientContext *client_context,
                                                 BatchContext *batch_context,
+                                                SharedChannel *channel,
                                                 int client_socket) {
-  char recv_buffer[recv_message->length + 1];
+  recv_message->payload = payload;
+  recv_message->payload[recv_message->length] = '\0';
 
-  // Receive the second message from the client that contains the payload
-  int length = recv_all(client_socket, recv_buffer, recv_message->length);
-  if (length < 0) {
-    return SERVER_PROCESS_CODE_ERROR_RECV_PAYLOAD;
+  // Process the special shutdown and source commands
+  if (strncmp(recv_message->payload, "shutdown", 8) == 0) {
+    return SERVER_PROCESS_CODE_OK_TERMINATE_SHUTDOWN;
+  } else if (strncmp(recv_message->payload, "source(", 7) == 0) {
+    return mproc_source_script(recv_message, payload, client_context,
+                               batch_context, channel, client_socket);
   }
-  recv_message->payload = recv_buffer;
-  recv_message->payload[recv_message->length] = '\0';
 
   // Initialize the send message
   Message send_message;
   memset(&send_message, 0, sizeof(Message));
   send_message.status = MESSAGE_STATUS_OK;
+  send_message.sequence = recv_message->sequence;
   send_message.length = 0;
   send_message.payload = NULL;
   send_message.is_malloced = false;
 
-  if (strncmp(recv_message->payload, "shutdown", 8) == 0) {
-    // Process the special shutdown command
-    return SERVER_PROCESS_CODE_OK_TERMINATE_SHUTDOWN;
-  } else if (strncmp(recv_message->payload, "single_core()", 13) == 0) {
-    // Switch to single-core mode if not already in single-core mode, otherwise
-    // this is an error
-    if (!__multi_threaded__) {
-      send_message.status = MESSAGE_STATUS_EXECUTION_ERROR;
-      send_message.payload = "Already in single-core mode.";
-      send_message.length = strlen(send_message.payload);
-    } else {
-      __multi_threaded__ = false;
-    }
-  } else if (strncmp(recv_message->payload, "single_core_execute()", 21) == 0) {
-    // Switch to multi-threaded mode if not already in multi-threaded mode,
-    if (__multi_threaded__) {
-      send_message.status = MESSAGE_STATUS_EXECUTION_ERROR;
-      send_message.payload = "Not in single-core mode.";
-      send_message.length = strlen(send_message.payload);
-    } else {
-      __multi_threaded__ = true;
-    }
-  } else {
-    // Ordinary query processing routine: convert the query string into a
-    // request for a database operator and execute the operator; in this process
-    // the message will be updated
-    DbOperator *query =
-        parse_command(recv_message->payload, &send_message, client_socket,
-                      client_context, batch_context);
-    execute_db_operator(query, &send_message);
-  }
+  bool is_locked =
+      _execute_command(recv_message->payload, &send_message, client_context,
+                       batch_context, client_socket);
+  return _send_result(&send_message, is_locked, channel, client_socket);
+}
 
-  // Send a first message that contains the header to the client
-  if (send_all(client_socket, &send_message, sizeof(Message)) == -1) {
-    return SERVER_PROCESS_CODE_ERROR_SEND_HEADER;
+/**
+ * Helper function to look up the table that a load context is staging rows in.
+ *
+ * This function must be called with the catalog lock held. The table is found
+ * by the first column in the header, and it is only returned if it is still
+ * marked as being loaded by the given load context; otherwise the table has
+ * been replaced (e.g., by creating a new database) and NULL is returned.
+ */
+static inline Table *_lookup_load_table(LoadCommandContext *load_context) {
+  char *column_var = strndup(load_context->header,
+                             strcspn(load_context->header, ","));
+  if (column_var == NULL) {
+    return NULL;
+  }
+  Table *table;
+  size_t ith_column;
+  DbSchemaStatus status = lookup_column(column_var, &table, &ith_column);
+  free(column_var);
+  if (status != DB_SCHEMA_STATUS_OK || table->loader != load_context) {
+    return NULL;
   }
+  return table;
+}
 
-  // We do not send a second message if the payload is empty
-  if (send_message.length == 0) {
-    if (send_message.is_malloced) {
-      free(send_message.payload);
+/**
+ * Helper function to reset a load context and free its internal memory.
+ *
+ * The table is no longer marked as being loaded afterwards; the rows staged in
+ * it, if the load is not concluded, are simply left behind past the last row.
+ */
+static inline void _reset_load_context(LoadCommandContext *load_context) {
+  if (load_context->is_staging) {
+    catalog_write_lock();
+    Table *table = _lookup_load_table(load_context);
+    if (table != NULL) {
+      table->loader = NULL;
     }
-    return SERVER_PROCESS_CODE_OK;
+    catalog_unlock();
   }
+  free(load_context->query);
+  free(load_context->header);
+  load_context->query = NULL;
+  load_context->header = NULL;
+  load_context->is_staging = false;
+  load_context->n_rows = 0;
+}
 
-  // Send a second message that contains the actual payload to the client; note
-  // that the payload buffer here is dynamically allocated because it could be
-  // very large (e.g., tabular printout of a large table) that exceeds the stack
-  // size
-  char *result = malloc(send_message.length); // XXX: Not null-terminated
-  strncpy(result, send_message.payload, send_message.length);
-  if (send_message.is_malloced) {
-    free(send_message.payload); // Free malloced payload after copied
+/**
+ * Helper function to send a response to the client in a load command.
+ *
+ * The response reports the error of the load if any, otherwise it is successful
+ * with the given payload, which is not malloc'ed and can be NULL. An error is
+ * only reported once. The server process code is returned.
+ */
+static inline ServerProcessCode
+_send_load_response(LoadCommandContext *load_context, void *payload,
+                    size_t length, int client_socket) {
+  Message send_message;
+  memset(&send_message, 0, sizeof(Message));
+  send_message.sequence = load_context->sequence;
+  send_message.is_malloced = false;
+  if (load_context->error == NULL) {
+    send_message.status = MESSAGE_STATUS_OK;
+    send_message.payload = payload;
+    send_message.length = length;
+  } else {
+    send_message.status = MESSAGE_STATUS_EXECUTION_ERROR;
+    send_message.payload = load_context->error;
+    send_message.length = strlen(send_message.payload);
+    load_context->is_error_reported = true;
   }
-  if (send_all(client_socket, result, send_message.length) == -1) {
-    free(result);
-    return SERVER_PROCESS_CODE_ERROR_SEND_PAYLOAD;
+  if (send_message_all(client_socket, &send_message) == -1) {
+    return SERVER_PROCESS_CODE_ERROR_SEND;
   }
-  free(result);
-  return SERVER_PROCESS_CODE_OK;
+  return load_context->error == NULL ? SERVER_PROCESS_CODE_OK
+                                     : SERVER_PROCESS_CODE_ERROR_NONBREAKING;
 }
 
 /**
- * Process a MESSAGE_STATUS_C_SENDING_CSV_N_COLS message.
+ * Process a MESSAGE_STATUS_C_SENDING_CSV_PARAMETERS message.
  *
  * This is the first step of the load command. The client sends the number of
- * columns in the CSV file to the server. The server then initializes the load
- * query with the number of columns.
+ * columns in the CSV file and its proposed batch size to the server. The server
+ * then initializes the load query with the number of columns, and negotiates
+ * the batch size, i.e., caps it and rounds it down to a multiple of the size of
+ * a row. Nothing is sent unless the parameters are invalid or the load cannot
+ * be started, in which case the server responds with the error right away; the
+ * client takes it as the response to the header, which is then ignored.
  */
-ServerProcessCode mproc_sending_csv_n_cols(Message *recv_message,
-                                           LoadCommandContext *load_context,
-                                           ClientContext *client_context,
-                                           int client_socket) {
+ServerProcessCode mproc_sending_csv_parameters(Message *recv_message,
+                                               char *payload,
+                                               LoadCommandContext *load_context,
+                                               ClientContext *client_context,
+                                               int client_socket) {
   assert(load_context->query == NULL && "Previous load is not terminated");
   log_file(stdout, "QUERY: `load(...)` [preparsed-by-client]\n");
+  load_context->error = NULL;
+  load_context->is_error_reported = false;
+  load_context->sequence = recv_message->sequence;
 
-  // Receive the second message from the client that contains the payload, which
-  // is the number of columns in the CSV file
-  char recv_buffer[recv_message->length + 1];
-  int length = recv_all(client_socket, recv_buffer, recv_message->length);
-  if (length < 0) {
-    return SERVER_PROCESS_CODE_ERROR_RECV_PAYLOAD;
+  // The payload is the parameters of the load; a row must fit in a batch,
+  // which also keeps the size of a row from overflowing
+  LoadParameters parameters;
+  if (recv_message->length < (int)sizeof(LoadParameters)) {
+    load_context->error = format_status(DB_SCHEMA_STATUS_CSV_INVALID_DATA);
+    return _send_load_response(load_context, NULL, 0, client_socket);
+  }
+  memcpy(&parameters, payload, sizeof(LoadParameters));
+  if (parameters.n_cols == 0 ||
+      parameters.n_cols > MAX_LOAD_BATCH_SIZE / sizeof(int)) {
+    load_context->error = format_status(DB_SCHEMA_STATUS_CSV_INVALID_DATA);
+    return _send_load_response(load_context, NULL, 0, client_socket);
   }
-  size_t n_cols;
-  memcpy(&n_cols, recv_buffer, sizeof(size_t));
+  size_t row_size = parameters.n_cols * sizeof(int);
+  size_t batch_size = parameters.batch_size < MAX_LOAD_BATCH_SIZE
+                          ? parameters.batch_size
+                          : MAX_LOAD_BATCH_SIZE;
+  batch_size = batch_size < row_size ? row_size : batch_size;
+  batch_size -= batch_size % row_size;
 
   // Initialize the load query
   load_context->query = malloc(sizeof(DbOperator));
+  if (load_context->query == NULL) {
+    load_context->error = "Failed to allocate internal memory.";
+    return _send_load_response(load_context, NULL, 0, client_socket);
+  }
   load_context->query->type = OPERATOR_TYPE_LOAD;
   load_context->query->client_fd = client_socket;
   load_context->query->context = client_context;
-  load_context->query->fields.load.n_cols = n_cols;
-  load_context->error = NULL;
-  load_context->n_cumu_rows = 0;
+  load_context->query->fields.load.n_cols = parameters.n_cols;
+  load_context->header = NULL;
+  load_context->batch_size = batch_size;
+  load_context->is_staging = false;
+  load_context->n_rows = 0;
   return SERVER_PROCESS_CODE_OK;
 }
 
@@ -194,288 +701,626 @@ ServerProcessCode mproc_sending_csv_n_cols(Message *recv_message,
  * Process a MESSAGE_STATUS_C_SENDING_CSV_HEADER message.
  *
  * This is the second step of the load command. The client sends the header of
- * the CSV file to the server. The server then validates the header and updates
- * the load query with the table and columns.
+ * the CSV file to the server. The server then validates the header, marks the
+ * table as being loaded, keeps the header to look up the table in the later
+ * steps, and responds with the negotiated batch size so that the client can
+ * start streaming the rows. If the header is invalid, the server
+ * responds with the error instead, and the load is terminated. If the load
+ * could not be started, the error is already reported and the header ignored.
  */
-ServerProcessCode mproc_sending_csv_header(Message *recv_message,
+ServerProcessCode mproc_sending_csv_header(Message *recv_message, char *payload,
                                            LoadCommandContext *load_context,
                                            int client_socket) {
-  assert(load_context->query != NULL && "Load is not started");
-
-  // Receive the second message from the client that contains the payload, which
-  // is the header string (i.e., first row) of the CSV file
-  char recv_buffer[recv_message->length + 1];
-  int length = recv_all(client_socket, recv_buffer, recv_message->length);
-  if (length < 0) {
-    return SERVER_PROCESS_CODE_ERROR_RECV_PAYLOAD;
+  if (load_context->query == NULL) {
+    assert(load_context->is_error_reported && "Load is not started");
+    free(payload);
+    return SERVER_PROCESS_CODE_ERROR_NONBREAKING;
   }
-  recv_buffer[recv_message->length] = '\0';
 
-  // Parse the header string to validate the header
+  // The payload is the header string (i.e., first row) of the CSV file; we take
+  // over the payload buffer so that the table can be looked up again in the
+  // later steps, since the catalog may change in the meantime
+  payload[recv_message->length] = '\0';
+  load_context->header = payload;
+
+  // Parse the header string to validate the header, and claim the table so
+  // that no other command changes its number of rows while rows are staged
   size_t n_cols = load_context->query->fields.load.n_cols;
   Table *table;
-  DbSchemaStatus status = cmdload_validate_header(recv_buffer, n_cols, &table);
+  catalog_write_lock();
+  DbSchemaStatus status = cmdload_validate_header(payload, n_cols, &table);
+  if (status == DB_SCHEMA_STATUS_OK) {
+    table->loader = load_context;
+    load_context->is_staging = true;
+  }
+  catalog_unlock();
   if (status != DB_SCHEMA_STATUS_OK) {
     load_context->error = format_status(status);
-    return SERVER_PROCESS_CODE_ERROR_NONBREAKING;
   }
 
-  // Update load query information
-  load_context->query->fields.load.table = table;
-  load_context->query->fields.load.n_rows = 0; // Initialize
-  return SERVER_PROCESS_CODE_OK;
+  ServerProcessCode sp_code =
+      _send_load_response(load_context, &load_context->batch_size,
+                          sizeof(size_t), client_socket);
+  if (load_context->error != NULL) {
+    _reset_load_context(load_context);
+  }
+  return sp_code;
 }
 
 /**
  * Process a MESSAGE_STATUS_C_SENDING_CSV_ROWS message.
  *
  * This is the third step of the load command. The client sends a batch of rows
- * from the CSV file to the server. The server then updates the load query with
- * the data and number of rows. This step can happen multiple times until all
- * rows are sent, and this routine is called for each batch of rows.
+ * from the CSV file to the server. The server then stages the rows in the table
+ * right away and frees the payload. This step can happen multiple times until
+ * all rows are sent, and this routine is called for each batch of rows. The
+ * client does not wait for a response, so nothing is sent unless there is an
+ * error.
  */
-ServerProcessCode mproc_sending_csv_rows(Message *recv_message,
+ServerProcessCode mproc_sending_csv_rows(Message *recv_message, char *payload,
                                          LoadCommandContext *load_context,
                                          int client_socket) {
   assert(load_context->query != NULL && "Load is not started");
 
-  // Receive the second message from the client that contains the payload, which
-  // is a batch of rows from the CSV file
-  char *recv_buffer = malloc(recv_message->length * sizeof(char));
-  int length = recv_all(client_socket, recv_buffer, recv_message->length);
-  if (length < 0) {
-    return SERVER_PROCESS_CODE_ERROR_RECV_PAYLOAD;
-  }
-  int *data = malloc(recv_message->length);
-  if (data == NULL) {
-    load_context->error = "Failed to allocate internal memory.";
+  // No need to stage anything if the load has already failed
+  if (load_context->error != NULL) {
+    free(payload);
     return SERVER_PROCESS_CODE_ERROR_NONBREAKING;
   }
-  memcpy(data, recv_buffer, recv_message->length);
-  free(recv_buffer);
 
-  // Update load query information
-  load_context->query->fields.load.data = data;
-  load_context->query->fields.load.n_rows =
-      recv_message->length /
-      (load_context->query->fields.load.n_cols * sizeof(int));
-  load_context->n_cumu_rows += load_context->query->fields.load.n_rows;
+  // The payload is a batch of rows from the CSV file, which must consist of
+  // whole rows and must not exceed the negotiated batch size
+  size_t row_size = load_context->query->fields.load.n_cols * sizeof(int);
+  size_t length = recv_message->length;
+  if (row_size == 0 || length % row_size != 0 ||
+      length > load_context->batch_size) {
+    load_context->error = format_status(DB_SCHEMA_STATUS_CSV_INVALID_DATA);
+    free(payload);
+    return _send_load_response(load_context, NULL, 0, client_socket);
+  }
 
-  // Initialize the send message
-  Message send_message;
-  memset(&send_message, 0, sizeof(Message));
-  send_message.status = MESSAGE_STATUS_OK;
-  send_message.length = 0;
-  send_message.payload = NULL;
-  send_message.is_malloced = false;
+  // Stage the rows past the rows staged so far; readers never look past the
+  // last row, so the shared catalog lock suffices unless the table has to be
+  // expanded, which moves the columns and thus needs the lock exclusively
+  DbOperator *query = load_context->query;
+  size_t n_rows = length / row_size;
+  catalog_read_lock();
+  Table *table = _lookup_load_table(load_context);
+  DbSchemaStatus status = DB_SCHEMA_STATUS_OK;
+  if (table != NULL &&
+      table->n_rows + load_context->n_rows + n_rows > table->capacity) {
+    catalog_unlock();
+    catalog_write_lock();
+    table = _lookup_load_table(load_context);
+    if (table != NULL) {
+      status = maybe_expand_table(table, load_context->n_rows + n_rows);
+    }
+  }
+  if (table == NULL) {
+    status = DB_SCHEMA_STATUS_TABLE_NOT_EXIST;
+  }
+  if (status == DB_SCHEMA_STATUS_OK) {
+    query->fields.load.table = table;
+    query->fields.load.data = (int *)payload;
+    query->fields.load.n_rows = n_rows;
+    query->fields.load.n_staged_rows = load_context->n_rows;
+    Message send_message;
+    memset(&send_message, 0, sizeof(Message));
+    send_message.status = MESSAGE_STATUS_OK;
+    execute_db_operator(query, &send_message);
 
-  // Execute the load query
-  execute_db_operator(load_context->query, &send_message);
-  if (send_message.status != MESSAGE_STATUS_OK) {
-    free(data);
     // The payloads for the errors that may happen in executing a load query are
     // always non-malloc'ed so it is safe to put them directly here; XXX: if
     // this changes, then either we need to keep track of whether the error is
     // malloc'ed, or we need to make all errors malloc'ed
-    load_context->error = send_message.payload;
-    return SERVER_PROCESS_CODE_ERROR_NONBREAKING;
+    if (send_message.status != MESSAGE_STATUS_OK) {
+      load_context->error = send_message.payload;
+    }
+  } else {
+    load_context->error = format_status(status);
+  }
+  catalog_unlock();
+  free(payload);
+
+  if (load_context->error != NULL) {
+    return _send_load_response(load_context, NULL, 0, client_socket);
   }
-  free(data);
+  load_context->n_rows += n_rows;
   return SERVER_PROCESS_CODE_OK;
 }
 
+/**
+ * Helper function to conclude a load, making the staged rows part of the table.
+ *
+ * This function must be called with the catalog lock held exclusively. The
+ * table is looked up again because the catalog may have changed since the last
+ * batch of rows was staged.
+ */
+static inline void _conclude_staged_rows(LoadCommandContext *load_context) {
+  Table *table = _lookup_load_table(load_context);
+  DbSchemaStatus status = DB_SCHEMA_STATUS_TABLE_NOT_EXIST;
+  if (table != NULL) {
+    status = cmdload_conclude(table, load_context->n_rows);
+  }
+  if (status != DB_SCHEMA_STATUS_OK) {
+    load_context->error = format_status(status);
+  }
+}
+
 /**
  * Process a MESSAGE_STATUS_C_SENDING_CSV_FINISHED message.
  *
  * This is the final step of the load command. The client sends a message to
  * indicate that all rows from the CSV file have been sent to the server. The
- * server then finalizes the load query and sends a message back to the client
- * to indicate the success or failure of the load command.
+ * server then concludes the staged rows, finalizes the load query, and sends a
+ * message back to the client to indicate the success or failure of the load
+ * command, unless a failure has already been reported.
  */
 ServerProcessCode mproc_sending_csv_finished(LoadCommandContext *load_context,
                                              int client_socket) {
   assert(load_context->query != NULL && "Load is not started");
 
-  // Conclude the load query
-  DbSchemaStatus conclude_status = cmdload_conclude(
-      load_context->query->fields.load.table, load_context->n_cumu_rows);
-  if (conclude_status != DB_SCHEMA_STATUS_OK) {
-    load_context->error = format_status(conclude_status);
+  // Publish the staged rows all at once with exclusive access to the catalog
+  if (load_context->error == NULL) {
+    catalog_write_lock();
+    _conclude_staged_rows(load_context);
+    catalog_unlock();
   }
 
   // We will not receive a second message because there is no payload in this
   // case; we can now free the load query and reset it to NULL
-  free(load_context->query);
-  load_context->query = NULL;
+  _reset_load_context(load_context);
+  if (load_context->is_error_reported) {
+    return SERVER_PROCESS_CODE_ERROR_NONBREAKING;
+  }
+  return _send_load_response(load_context, NULL, 0, client_socket);
+}
 
-  // Initialize the send message
+/**
+ * Process a MESSAGE_STATUS_C_SHARING_MEMORY message.
+ *
+ * The client passes the file descriptor of a shared memory channel that it has
+ * created, which the server attaches to and uses from then on for large
+ * payloads in both directions. The file descriptor is closed afterwards since
+ * the mapping stays valid without it. The server responds whether the channel
+ * is set up; on failure the client keeps using the socket only.
+ */
+ServerProcessCode mproc_sharing_memory(Message *recv_message, int *fd,
+                                       SharedChannel **channel,
+                                       int client_socket) {
   Message send_message;
   memset(&send_message, 0, sizeof(Message));
+  send_message.status = MESSAGE_STATUS_OK;
+  send_message.sequence = recv_message->sequence;
 
-  // If the load query was successful, send a message confirming the success and
-  // it does not need to further send its payload
-  if (load_context->error == NULL) {
-    send_message.status = MESSAGE_STATUS_OK;
-    send_message.length = 0;
-    send_message.payload = NULL;
-    send_message.is_malloced = false;
-    if (send_all(client_socket, &send_message, sizeof(Message)) == -1) {
-      return SERVER_PROCESS_CODE_ERROR_SEND_HEADER;
-    }
-    return SERVER_PROCESS_CODE_OK;
+  // A channel cannot be replaced, since the client may not know which
+  // payloads have gone through the old one
+  SharedChannel *attached = NULL;
+  if (*fd >= 0 && *channel == NULL) {
+    attached = shared_channel_attach(*fd);
   }
-
-  // The load query is not successful, report the failure to the client
-  send_message.status = MESSAGE_STATUS_EXECUTION_ERROR;
-  send_message.payload = load_context->error;
-  send_message.length = strlen(send_message.payload);
-  send_message.is_malloced = false;
-  if (send_all(client_socket, &send_message, sizeof(Message)) == -1) {
-    return SERVER_PROCESS_CODE_ERROR_SEND_HEADER;
+  if (*fd >= 0) {
+    close(*fd);
+    *fd = -1;
   }
-  if (send_all(client_socket, send_message.payload, send_message.length) ==
-      -1) {
-    return SERVER_PROCESS_CODE_ERROR_SEND_PAYLOAD;
+  if (attached == NULL) {
+    send_message.status = MESSAGE_STATUS_EXECUTION_ERROR;
+    send_message.payload = "Failed to set up shared memory.";
+    send_message.length = strlen(send_message.payload);
+  } else {
+    *channel = attached;
+  }
+
+  if (send_message_all(client_socket, &send_message) == -1) {
+    return SERVER_PROCESS_CODE_ERROR_SEND;
   }
   return SERVER_PROCESS_CODE_OK;
 }
 
 /**
- * Listen to messages from client continually and execute queries.
+ * Create a new client connection and register it in the server state.
  *
- * This function returns whether a shutdown is requested while handling the
- * current client connection.
+ * This function returns NULL on failure, in which case the caller should close
+ * the client socket.
  */
-bool handle_client(int client_socket) {
+ClientConnection *open_connection(int client_socket) {
+  ClientConnection *conn = calloc(1, sizeof(ClientConnection));
+  if (conn == NULL) {
+    return NULL;
+  }
+  conn->socket = client_socket;
+  conn->client_context = init_client_context();
+  if (conn->client_context == NULL) {
+    free(conn);
+    return NULL;
+  }
+  reset_batch_context(&conn->batch_context);
+  conn->load_context.query = NULL;
+  conn->received_fd = -1;
+
+  // Register the connection in epoll; the connection is polled for one event at
+  // a time and must be rearmed after the event is fully handled, so that its
+  // messages are never processed concurrently
+  struct epoll_event event = {.events = EPOLLIN | EPOLLONESHOT,
+                              .data.ptr = conn};
+  if (epoll_ctl(server_state.epoll_fd, EPOLL_CTL_ADD, client_socket, &event) ==
+      -1) {
+    free_client_context(conn->client_context);
+    free(conn);
+    return NULL;
+  }
+
+  pthread_mutex_lock(&server_state.mutex);
+  DL_APPEND(server_state.connections, conn);
+  server_state.n_connections++;
+  pthread_mutex_unlock(&server_state.mutex);
+
   printf_info("Established connection with client socket %d.\n", client_socket);
+  return conn;
+}
 
-  bool shutdown_requested = false;
-  ClientContext *client_context = init_client_context();
-  LoadCommandContext load_context = {.query = NULL};
-  BatchContext batch_context;
-  reset_batch_context(&batch_context);
+/**
+ * Close a client connection and free all its resources.
+ *
+ * The connection must not be polled or processed at the time of closing.
+ */
+void close_connection(ClientConnection *conn) {
+  pthread_mutex_lock(&server_state.mutex);
+  DL_DELETE(server_state.connections, conn);
+  server_state.n_connections--;
+  pthread_mutex_unlock(&server_state.mutex);
 
-  Message recv_message;
-  while (true) {
-    // Receive a first message that contains the header
-    int length = recv_all(client_socket, &recv_message, sizeof(Message));
+  // Closing the socket also removes it from the epoll instance; the connection
+  // may be closed in the middle of a load, in which case we need to free the
+  // load data and release the table
+  printf_info("Client connection closed at socket %d.\n", conn->socket);
+  close(conn->socket);
+  if (conn->load_context.query != NULL) {
+    _reset_load_context(&conn->load_context);
+  }
+  if (conn->received_fd >= 0) {
+    close(conn->received_fd);
+  }
+  shared_channel_close(conn->channel);
+  free_client_context(conn->client_context);
+  free(conn->payload);
+  free(conn);
+
+  // Wake up the main thread so that it may resume accepting connections
+  eventfd_write(server_state.wakeup_fd, 1);
+}
+
+/**
+ * Request a server shutdown and wake up the main thread to handle it.
+ */
+void request_shutdown() {
+  pthread_mutex_lock(&server_state.mutex);
+  server_state.shutdown_requested = true;
+  pthread_mutex_unlock(&server_state.mutex);
+  eventfd_write(server_state.wakeup_fd, 1);
+}
+
+/**
+ * Receiving status codes of a client connection.
+ */
+typedef enum ReceiveCode {
+  // A complete message has been received.
+  RECEIVE_CODE_COMPLETE,
+  // The message is incomplete and more data needs to be waited for.
+  RECEIVE_CODE_INCOMPLETE,
+  // The client has closed the connection or there is a failure.
+  RECEIVE_CODE_CLOSED,
+} ReceiveCode;
+
+/**
+ * Receive the current message on a client connection without blocking.
+ *
+ * This function receives as much of the current message as is available, and
+ * returns whether the message is complete. A message with a shared payload is
+ * complete once its header is received, as the payload is only picked up when
+ * the message is handled. Failures are reported here but the connection is left
+ * for the caller to close.
+ */
+ReceiveCode receive_message_data(ClientConnection *conn) {
+  bool closed = false;
+  ssize_t length;
+
+  // Receive the header of the message
+  if (conn->n_header_received < sizeof(Message)) {
+    length = recv_available_fd(
+        conn->socket, (char *)&conn->recv_message + conn->n_header_received,
+        sizeof(Message) - conn->n_header_received, &closed,
+        &conn->received_fd);
     if (length < 0) {
       printf_error("Failed to receive header from client at socket %d.\n",
-                   client_socket);
-      shutdown_requested = true; // FATAL
-      break;
-    } else if (length == 0) {
-      break; // No more message to receive from client, elegantly exit loop
+                   conn->socket);
+      return RECEIVE_CODE_CLOSED;
     }
-
-    // Process based on the status of the received message
-    ServerProcessCode sp_code;
-    switch (recv_message.status) {
-    case MESSAGE_STATUS_C_REQUEST_PROCESS_COMMAND:
-      sp_code = mproc_request_process_command(&recv_message, client_context,
-                                              &batch_context, client_socket);
-      break;
-    case MESSAGE_STATUS_C_SENDING_CSV_N_COLS:
-      sp_code = mproc_sending_csv_n_cols(&recv_message, &load_context,
-                                         client_context, client_socket);
-      break;
-    case MESSAGE_STATUS_C_SENDING_CSV_HEADER:
-      sp_code =
-          mproc_sending_csv_header(&recv_message, &load_context, client_socket);
-      break;
-    case MESSAGE_STATUS_C_SENDING_CSV_ROWS:
-      sp_code =
-          mproc_sending_csv_rows(&recv_message, &load_context, client_socket);
-      break;
-    case MESSAGE_STATUS_C_SENDING_CSV_FINISHED:
-      sp_code = mproc_sending_csv_finished(&load_context, client_socket);
-      break;
-    default:
-      assert(0 && "Unreachable code.");
+    conn->n_header_received += length;
+    if (closed) {
+      if (conn->n_header_received > 0) {
+        printf_error("Failed to receive header from client at socket %d.\n",
+                     conn->socket);
+      }
+      return RECEIVE_CODE_CLOSED; // No more message from client
     }
-
-    // Handle the server process code
-    switch (sp_code) {
-    case SERVER_PROCESS_CODE_OK:
-    case SERVER_PROCESS_CODE_ERROR_NONBREAKING:
-      // Both cases we do not terminate the server processing loop; moreover,
-      // non-breaking errors should be handled in their respective processing
-      // routines and not here
-      break;
-    case SERVER_PROCESS_CODE_OK_TERMINATE_SHUTDOWN:
-      shutdown_requested = true;
-      break;
-    case SERVER_PROCESS_CODE_ERROR_SEND_HEADER:
-      printf_error("Failed to send header to client at socket %d.\n",
-                   client_socket);
-      shutdown_requested = true; // FATAL
-      break;
-    case SERVER_PROCESS_CODE_ERROR_SEND_PAYLOAD:
-      printf_error("Failed to send payload to client at socket %d.\n",
-                   client_socket);
-      shutdown_requested = true; // FATAL
-      break;
-    case SERVER_PROCESS_CODE_ERROR_RECV_PAYLOAD:
-      printf_error("Failed to receive payload from client at socket %d.\n",
-                   client_socket);
-      shutdown_requested = true; // FATAL
-      break;
+    if (conn->n_header_received < sizeof(Message)) {
+      return RECEIVE_CODE_INCOMPLETE;
     }
+  }
 
-    if (shutdown_requested) {
-      break;
+  // Receive the payload of the message once the header is complete; the payload
+  // buffer has an extra byte in case it needs to be null-terminated
+  if (conn->recv_message.length < 0) {
+    printf_error("Invalid header from client at socket %d.\n", conn->socket);
+    return RECEIVE_CODE_CLOSED;
+  }
+  size_t payload_length = conn->recv_message.length;
+  if (conn->payload == NULL) {
+    conn->payload = malloc(payload_length + 1);
+    if (conn->payload == NULL) {
+      printf_error("Failed to allocate payload for client at socket %d.\n",
+                   conn->socket);
+      return RECEIVE_CODE_CLOSED;
     }
   }
 
-  printf_info("Client connection closed at socket %d.\n", client_socket);
-  free_client_context(client_context);
-  close(client_socket);
-  return shutdown_requested;
+  // A shared payload is not received here but picked up from the shared memory
+  // channel when the message is handled, since that blocks until the client
+  // has written all of it, which must not stall the event loop
+  if (conn->recv_message.is_shared) {
+    return RECEIVE_CODE_COMPLETE;
+  }
+  length =
+      recv_available(conn->socket, conn->payload + conn->n_payload_received,
+                     payload_length - conn->n_payload_received, &closed);
+  if (length < 0 || (closed && conn->n_payload_received + length <
+                                   payload_length)) {
+    printf_error("Failed to receive payload from client at socket %d.\n",
+                 conn->socket);
+    return RECEIVE_CODE_CLOSED;
+  }
+  conn->n_payload_received += length;
+  return conn->n_payload_received == payload_length ? RECEIVE_CODE_COMPLETE
+                                                    : RECEIVE_CODE_INCOMPLETE;
 }
 
 /**
- * The worker function for the thread pool.
+ * Handle a complete message received from a client connection.
  *
- * This function continuously consumes tasks from the task queue and executes
- * them. The worker thread will terminate when it receives a termination task.
+ * This function processes the message and returns whether the connection should
+ * be closed afterwards. A shared payload is picked up first, which blocks until
+ * the client has written all of it, so this runs on a worker thread unless
+ * there is no thread pool.
  */
-void *thread_worker(void *arg) {
-  (void)arg; // XXX: Unused but needed for the function signature
+bool handle_connection_message(ClientConnection *conn) {
+  Message *recv_message = &conn->recv_message;
+  LoadCommandContext *load_context = &conn->load_context;
+  char *payload = conn->payload;
 
-  DbSchemaStatus status;
-  while (true) {
-    // Dequeue a task from the queue; this is blocking until there is a task to
-    // dequeue or we are done (i.e., THREAD_TASK_TYPE_TERMINATE)
-    ThreadTask task = thread_pool_dequeue_task(__thread_pool__);
-    if (task.type == THREAD_TASK_TYPE_TERMINATE) {
+  // Reset the receiving state of the connection; the payload buffer is now
+  // owned by this function (or passed on to the load context)
+  conn->payload = NULL;
+  conn->n_header_received = 0;
+  conn->n_payload_received = 0;
+
+  // Pick up a shared payload from the shared memory channel, where the client
+  // is writing it right after the header
+  if (recv_message->is_shared &&
+      (conn->channel == NULL ||
+       recv_shared_payload(conn->socket, conn->channel, payload,
+                           recv_message->length) < 0)) {
+    printf_error("Failed to receive shared payload from client at socket %d.\n",
+                 conn->socket);
+    free(payload);
+    return true;
+  }
+
+  // Process based on the status of the received message
+  ServerProcessCode sp_code;
+  switch (recv_message->status) {
+  case MESSAGE_STATUS_C_REQUEST_PROCESS_COMMAND:
+    sp_code = mproc_request_process_command(
+        recv_message, payload, conn->client_context, &conn->batch_context,
+        conn->channel, conn->socket);
+    free(payload);
+    break;
+  case MESSAGE_STATUS_C_SENDING_CSV_PARAMETERS:
+    sp_code = mproc_sending_csv_parameters(recv_message, payload, load_context,
+                                           conn->client_context, conn->socket);
+    free(payload);
+    break;
+  case MESSAGE_STATUS_C_SENDING_CSV_HEADER:
+    sp_code = mproc_sending_csv_header(recv_message, payload, load_context,
+                                       conn->socket);
+    break;
+  case MESSAGE_STATUS_C_SENDING_CSV_ROWS:
+    sp_code = mproc_sending_csv_rows(recv_message, payload, load_context,
+                                     conn->socket);
+    break;
+  case MESSAGE_STATUS_C_SENDING_CSV_FINISHED:
+    sp_code = mproc_sending_csv_finished(load_context, conn->socket);
+    free(payload);
+    break;
+  case MESSAGE_STATUS_C_SHARING_MEMORY:
+    sp_code = mproc_sharing_memory(recv_message, &conn->received_fd,
+                                   &conn->channel, conn->socket);
+    free(payload);
+    break;
+  default:
+    assert(0 && "Unreachable code.");
+  }
+
+  // Handle the server process code; failures to send only affect the current
+  // connection, which is closed, while the server keeps serving the others
+  switch (sp_code) {
+  case SERVER_PROCESS_CODE_OK:
+  case SERVER_PROCESS_CODE_ERROR_NONBREAKING:
+    // Both cases we do not close the connection; moreover, non-breaking errors
+    // should be handled in their respective processing routines and not here
+    return false;
+  case SERVER_PROCESS_CODE_OK_TERMINATE_SHUTDOWN:
+    request_shutdown();
+    return true;
+  case SERVER_PROCESS_CODE_ERROR_SEND:
+    printf_error("Failed to send message to client at socket %d.\n",
+                 conn->socket);
+    return true;
+  }
+  return true;
+}
+
+/**
+ * Process a complete message received from a client connection.
+ *
+ * This is called by a worker thread (or by the main thread if there is no
+ * thread pool) when the header and the full payload of a message have been
+ * received. A client may pipeline its messages, i.e., send more of them without
+ * waiting for the responses, so after processing we keep processing the ones
+ * that are already fully received, strictly in order, without going through
+ * the event loop again; this is capped so that a busy connection does not hold
+ * the thread forever. After that, the connection is either rearmed for polling
+ * or closed, depending on the outcome.
+ */
+void process_connection_message(ClientConnection *conn) {
+  bool should_close = handle_connection_message(conn);
+  for (int i = 1; !should_close && i < MAX_PIPELINED_MESSAGES_PER_TASK; i++) {
+    pthread_mutex_lock(&server_state.mutex);
+    bool shutdown_requested = server_state.shutdown_requested;
+    pthread_mutex_unlock(&server_state.mutex);
+    if (shutdown_requested) {
       break;
     }
 
-    // Call subroutines to execute the shared scan task based on the task type
-    switch (task.type) {
-    case THREAD_TASK_TYPE_SHARED_SCAN:
-      shared_scan_subroutine(task.data);
-      free(task.data);
-      break;
-    case THREAD_TASK_TYPE_HASH_JOIN:
-      status = hash_join_subroutine(task.data);
-      if (status != DB_SCHEMA_STATUS_OK) {
-        printf_error("Failed to execute hash join task %d: %s\n", task.id,
-                     format_status(status));
-      }
+    ReceiveCode r_code = receive_message_data(conn);
+    if (r_code == RECEIVE_CODE_INCOMPLETE) {
       break;
-    default: // Including THREAD_TASK_TYPE_TERMINATE, which should have been
-             // handled above
-      assert(0 && "Unreachable code.");
     }
-    log_file(stdout, "  [%lu] Finished task %d\n", pthread_self(), task.id);
+    should_close = r_code == RECEIVE_CODE_CLOSED ||
+                   handle_connection_message(conn);
+  }
+
+  // Rearm the connection for polling, or close it
+  struct epoll_event event = {.events = EPOLLIN | EPOLLONESHOT,
+                              .data.ptr = conn};
+  if (should_close || epoll_ctl(server_state.epoll_fd, EPOLL_CTL_MOD,
+                                conn->socket, &event) == -1) {
+    close_connection(conn);
+  }
+
+  // Mark the message as fully processed
+  pthread_mutex_lock(&server_state.mutex);
+  server_state.n_in_flight--;
+  pthread_cond_signal(&server_state.cond_in_flight);
+  pthread_mutex_unlock(&server_state.mutex);
+}
+
+/**
+ * Dispatch a complete message received from a client connection.
+ *
+ * The message is processed by the thread pool if there is one, otherwise it is
+ * processed directly in the calling thread.
+ */
+void dispatch_connection_message(ClientConnection *conn) {
+  pthread_mutex_lock(&server_state.mutex);
+  server_state.n_in_flight++;
+  pthread_mutex_unlock(&server_state.mutex);
+
+  if (__thread_pool__ == NULL) {
+    process_connection_message(conn);
+    return;
+  }
+  ThreadTask task = {.id = next_task_id(),
+                     .type = THREAD_TASK_TYPE_CLIENT_REQUEST,
+                     .data = conn};
+  thread_pool_enqueue_task(__thread_pool__, &task);
+  log_file(stdout, "  [LOG] Enqueued client request task %d\n", task.id);
+}
+
+/**
+ * Receive data on a client connection without blocking.
+ *
+ * This function receives as much of the current message as is available. If
+ * the message is complete, it is dispatched for processing; otherwise the
+ * connection is rearmed for polling to wait for the rest. The connection is
+ * closed if the client has closed it or if there is a failure.
+ */
+void receive_connection_data(ClientConnection *conn) {
+  switch (receive_message_data(conn)) {
+  case RECEIVE_CODE_COMPLETE:
+    dispatch_connection_message(conn);
+    return;
+  case RECEIVE_CODE_CLOSED:
+    close_connection(conn);
+    return;
+  case RECEIVE_CODE_INCOMPLETE:
+    break;
+  }
+
+  // The message is incomplete, wait for more data
+  struct epoll_event event = {.events = EPOLLIN | EPOLLONESHOT,
+                              .data.ptr = conn};
+  if (epoll_ctl(server_state.epoll_fd, EPOLL_CTL_MOD, conn->socket, &event) ==
+      -1) {
+    close_connection(conn);
+  }
+}
 
-    // Mark the task as completed
-    thread_pool_mark_task_completion(__thread_pool__);
+/**
+ * Start or stop polling the server socket for new connections.
+ *
+ * New connections are not accepted when the maximum number of connections is
+ * reached; they are left in the backlog of the server socket until some slot
+ * is freed.
+ */
+void set_accepting(bool accepting) {
+  if (server_state.is_accepting == accepting) {
+    return;
   }
+  struct epoll_event event = {.events = EPOLLIN, .data.ptr = &server_state};
+  epoll_ctl(server_state.epoll_fd, accepting ? EPOLL_CTL_ADD : EPOLL_CTL_DEL,
+            server_state.server_socket, &event);
+  server_state.is_accepting = accepting;
+}
 
-  log_file(stdout, "  [%lu] Thread exiting\n", pthread_self());
-  return NULL;
+/**
+ * Handle a thread task dispatched to the thread pool.
+ *
+ * This is the task handler of the thread pool, called by the worker threads on
+ * each dequeued task (and by threads waiting for a task group to complete).
+ */
+void handle_thread_task(ThreadTask *task) {
+  DbSchemaStatus status;
+
+  // Call subroutines to execute the task based on the task type
+  switch (task->type) {
+  case THREAD_TASK_TYPE_SHARED_SCAN:
+    shared_scan_subroutine(task->data);
+    break;
+  case THREAD_TASK_TYPE_HASH_JOIN:
+    status = hash_join_subroutine(task->data);
+    if (status != DB_SCHEMA_STATUS_OK) {
+      printf_error("Failed to execute hash join task %d: %s\n", task->id,
+                   format_status(status));
+    }
+    break;
+  case THREAD_TASK_TYPE_LOAD_CHUNK:
+    cmdload_chunk_subroutine(task->data);
+    break;
+  case THREAD_TASK_TYPE_ADDSUB_CHUNK:
+    cmdaddsub_chunk_subroutine(task->data);
+    break;
+  case THREAD_TASK_TYPE_FETCH_CHUNK:
+    cmdfetch_chunk_subroutine(task->data);
+    break;
+  case THREAD_TASK_TYPE_CLIENT_REQUEST:
+    process_connection_message(task->data);
+    break;
+  default: // Including THREAD_TASK_TYPE_TERMINATE, which should have been
+           // handled by the thread pool
+    assert(0 && "Unreachable code.");
+  }
+  log_file(stdout, "  [%lu] Finished task %d\n", pthread_self(), task->id);
 }
 
 /**
@@ -509,7 +1354,7 @@ int setup_server() {
   }
 
   // Listen for incoming connections
-  if (listen(server_socket, 5) == -1) {
+  if (listen(server_socket, SOMAXCONN) == -1) {
     printf_error("Failed to listen on socket.\n");
     return -1;
   }
@@ -517,14 +1362,73 @@ int setup_server() {
   return server_socket;
 }
 
+/**
+ * Run the event loop of the server.
+ *
+ * This function polls the server socket and all client connections, accepting
+ * new connections and receiving messages, until a shutdown is requested. It
+ * returns 0 on success and -1 on failure.
+ */
+int run_event_loop() {
+  struct epoll_event events[MAX_EPOLL_EVENTS];
+  while (true) {
+    // Check for shutdown request, and whether we can accept more connections
+    pthread_mutex_lock(&server_state.mutex);
+    bool shutdown_requested = server_state.shutdown_requested;
+    bool accepting = server_state.n_connections < server_state.max_connections;
+    pthread_mutex_unlock(&server_state.mutex);
+    if (shutdown_requested) {
+      return 0;
+    }
+    set_accepting(accepting);
+
+    int n_events =
+        epoll_wait(server_state.epoll_fd, events, MAX_EPOLL_EVENTS, -1);
+    if (n_events == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      printf_error("Failed to wait for events.\n");
+      return -1;
+    }
+
+    for (int i = 0; i < n_events; i++) {
+      if (events[i].data.ptr == &server_state) {
+        // New connection on the server socket
+        int client_socket = accept(server_state.server_socket, NULL, NULL);
+        if (client_socket == -1) {
+          printf_error("Failed to accept a new connection.\n");
+          continue;
+        }
+        if (open_connection(client_socket) == NULL) {
+          printf_error("Failed to set up connection at socket %d.\n",
+                       client_socket);
+          close(client_socket);
+        }
+      } else if (events[i].data.ptr == &server_state.wakeup_fd) {
+        // Woken up by a worker; the state is checked at the start of the loop
+        eventfd_t value;
+        eventfd_read(server_state.wakeup_fd, &value);
+      } else {
+        // Data (or hangup) on a client connection
+        receive_connection_data(events[i].data.ptr);
+      }
+    }
+  }
+}
+
 int main(int argc, char *argv[]) {
   init_sysinfo();
   printf("System information:\n");
-  printf("  __n_processors__  %d\n", __n_processors__);
-  printf("  __page_size__     %d\n", __page_size__);
-  printf("  __avg_load_1__    %.2f\n", __avg_load_1__);
-  printf("  __avg_load_5__    %.2f\n", __avg_load_5__);
-  printf("  __avg_load_15__   %.2f\n", __avg_load_15__);
+  printf("  __n_processors__    %d\n", __n_processors__);
+  printf("  __page_size__       %d\n", __page_size__);
+  printf("  __l1d_cache_size__  %ld\n", __l1d_cache_size__);
+  printf("  __l2_cache_size__   %ld\n", __l2_cache_size__);
+  printf("  __l3_cache_size__   %ld\n", __l3_cache_size__);
+  printf("  __avg_load_1__      %.2f\n", __avg_load_1__);
+  printf("  __avg_load_5__      %.2f\n", __avg_load_5__);
+  printf("  __avg_load_15__     %.2f\n", __avg_load_15__);
+  printf("  __has_avx2__        %d\n", __has_avx2__);
 
   // By default, the number of workers is the number of processors, minus a
   // weighted average of system loads over the past few minutes
@@ -538,7 +1442,7 @@ int main(int argc, char *argv[]) {
 
   // Parse the command line arguments
   int opt;
-  while ((opt = getopt(argc, argv, "j:")) != -1) {
+  while ((opt = getopt(argc, argv, "j:c:")) != -1) {
     switch (opt) {
     case 'j':
       n_jobs = atoi(optarg);
@@ -548,8 +1452,17 @@ int main(int argc, char *argv[]) {
         return 1;
       }
       break;
+    case 'c':
+      server_state.max_connections = atoi(optarg);
+      if (server_state.max_connections < 1 ||
+          server_state.max_connections > MAX_CLIENT_CONNECTIONS) {
+        printf_error("Invalid number of clients: %d; must be between [1, %d]\n",
+                     server_state.max_connections, MAX_CLIENT_CONNECTIONS);
+        return 1;
+      }
+      break;
     default:
-      printf_error("Usage: %s [-j jobs]\n", argv[0]);
+      printf_error("Usage: %s [-j jobs] [-c clients]\n", argv[0]);
       return 1;
     }
   }
@@ -568,7 +1481,7 @@ int main(int argc, char *argv[]) {
       printf_error("Failed to set up the thread pool.\n");
       return 1;
     }
-    thread_pool_init(__thread_pool__, n_jobs, thread_worker);
+    thread_pool_init(__thread_pool__, n_jobs, handle_thread_task);
     printf_info("Thread pool successfully set up with %d workers.\n", n_jobs);
   }
 
@@ -577,30 +1490,41 @@ int main(int argc, char *argv[]) {
   if (server_socket < 0) {
     return 1;
   }
-  printf_info("Waiting for client connection at socket %d...\n", server_socket);
+  server_state.server_socket = server_socket;
 
-  // Prepare the remote socket
-  struct sockaddr_un remote;
-  socklen_t t = sizeof(remote);
-  int client_socket = 0;
+  // Set up the epoll instance with the wakeup event file descriptor; the server
+  // socket is added when we start accepting connections
+  server_state.epoll_fd = epoll_create1(0);
+  server_state.wakeup_fd = eventfd(0, EFD_NONBLOCK);
+  struct epoll_event wakeup_event = {.events = EPOLLIN,
+                                     .data.ptr = &server_state.wakeup_fd};
+  if (server_state.epoll_fd == -1 || server_state.wakeup_fd == -1 ||
+      epoll_ctl(server_state.epoll_fd, EPOLL_CTL_ADD, server_state.wakeup_fd,
+                &wakeup_event) == -1) {
+    printf_error("Failed to set up the event loop.\n");
+    return 1;
+  }
+  printf_info("Waiting for client connection at socket %d...\n", server_socket);
 
-  // Wait for incoming client connections and handle them
-  while (true) {
-    if ((client_socket =
-             accept(server_socket, (struct sockaddr *)&remote, &t)) == -1) {
-      printf_error("Failed to accept a new connection.\n");
-      return 1;
-    }
+  // Serve client connections until a shutdown is requested
+  int loop_status = run_event_loop();
 
-    // TODO: Handle multiple concurrent clients
-    // - Maximum number of concurrent client connections to allow?
-    // - What aspects of siloes or isolation are maintained in the design?
-    if (handle_client(client_socket)) {
-      break; // Shutdown requested
-    }
+  // Wait for all dispatched messages to be fully processed, then close all
+  // remaining connections; none of them is being polled or processed now
+  pthread_mutex_lock(&server_state.mutex);
+  while (server_state.n_in_flight > 0) {
+    pthread_cond_wait(&server_state.cond_in_flight, &server_state.mutex);
   }
-
+  pthread_mutex_unlock(&server_state.mutex);
+  while (server_state.connections != NULL) {
+    close_connection(server_state.connections);
+  }
+  close(server_state.wakeup_fd);
+  close(server_state.epoll_fd);
   close(server_socket);
+  if (loop_status < 0) {
+    return 1;
+  }
 
   // Clean up the thread pool
   if (n_jobs > 0) {
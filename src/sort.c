@@ -30,6 +30,19 @@
  */
 #define _QUICKSORT_INSERTION_CUTOFF 15
 
+/**
+ * The number of bits of each digit of radix sort.
+ *
+ * The counts of a digit (2^11 entries of 8 bytes) fit in the level 1 data cache
+ * together with the cache lines that the scatter writes to.
+ */
+#define _RADIXSORT_DIGIT_BITS 11
+
+/**
+ * The number of buckets of each digit of radix sort.
+ */
+#define _RADIXSORT_N_BUCKETS (1 << _RADIXSORT_DIGIT_BITS)
+
 /**
  * Swap two variables of a given type.
  */
@@ -556,3 +569,73 @@ int akmerge(int *arr, size_t *tosort, size_t k, size_t *sizes,
   // Arg merge the two halves
   return amerge(arr, tosort, ltotal, rtotal);
 }
+
+/**
+ * @implements radixsort
+ */
+int radixsort(size_t *arr, size_t size) {
+  if (size < 2) {
+    return 0; // Nothing to sort
+  }
+
+  // The number of digits is determined by the largest element
+  size_t max_value = 0;
+  for (size_t i = 0; i < size; i++) {
+    if (arr[i] > max_value) {
+      max_value = arr[i];
+    }
+  }
+  int n_digits = _get_msb(max_value) / _RADIXSORT_DIGIT_BITS + 1;
+
+  size_t *buffer = malloc(size * sizeof(size_t));
+  size_t(*counts)[_RADIXSORT_N_BUCKETS] =
+      calloc(n_digits, sizeof(size_t[_RADIXSORT_N_BUCKETS]));
+  if (buffer == NULL || counts == NULL) {
+    free(buffer);
+    free(counts);
+    return -1;
+  }
+
+  // Count the occurrences of all digits in a single pass
+  for (size_t i = 0; i < size; i++) {
+    for (int d = 0; d < n_digits; d++) {
+      counts[d][(arr[i] >> (d * _RADIXSORT_DIGIT_BITS)) &
+                (_RADIXSORT_N_BUCKETS - 1)]++;
+    }
+  }
+
+  // Scatter by each digit from the least significant one, alternating between
+  // the array and the buffer; a digit that is the same for all elements would
+  // not move anything, so it is skipped
+  size_t *src = arr;
+  size_t *dst = buffer;
+  for (int d = 0; d < n_digits; d++) {
+    size_t offset = 0;
+    bool trivial = false;
+    for (size_t b = 0; b < _RADIXSORT_N_BUCKETS; b++) {
+      size_t count = counts[d][b];
+      if (count == size) {
+        trivial = true;
+        break;
+      }
+      counts[d][b] = offset;
+      offset += count;
+    }
+    if (trivial) {
+      continue;
+    }
+
+    int shift = d * _RADIXSORT_DIGIT_BITS;
+    for (size_t i = 0; i < size; i++) {
+      dst[counts[d][(src[i] >> shift) & (_RADIXSORT_N_BUCKETS - 1)]++] = src[i];
+    }
+    _SWAP(src, dst, size_t *);
+  }
+
+  if (src != arr) {
+    memcpy(arr, src, size * sizeof(size_t));
+  }
+  free(buffer);
+  free(counts);
+  return 0;
+}
@@ -3,20 +3,96 @@
  * @implements sysinfo.h
  */
 
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/sysinfo.h>
 #include <unistd.h>
 
+#include "consts.h"
 #include "sysinfo.h"
 
 int __n_processors__;
 
 int __page_size__;
 
+long __l1d_cache_size__;
+long __l2_cache_size__;
+long __l3_cache_size__;
+
 double __avg_load_1__;
 double __avg_load_5__;
 double __avg_load_15__;
 
+bool __has_avx2__;
+
+/**
+ * Helper function to read a single line attribute of a cache of the first
+ * processor from sysfs, e.g., "level" of "index0". This function returns
+ * whether the attribute is read.
+ */
+static inline bool _read_cache_attr(int index, const char *attr, char *buf,
+                                    size_t size) {
+  char path[DEFAULT_BUFFER_SIZE];
+  snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu0/cache/index%d/%s",
+           index, attr);
+  FILE *file = fopen(path, "r");
+  if (file == NULL) {
+    return false;
+  }
+  bool is_read = fgets(buf, size, file) != NULL;
+  fclose(file);
+  buf[strcspn(buf, "\n")] = '\0';
+  return is_read;
+}
+
+/**
+ * Helper function to read the cache sizes of the first processor from sysfs.
+ *
+ * Each cache is described by a directory `index<i>` with its level, its type
+ * (Data, Instruction, or Unified) and its size (e.g., "48K"). Caches that are
+ * not found keep their current sizes.
+ */
+static inline void _read_cache_sizes() {
+  char level[DEFAULT_BUFFER_SIZE], type[DEFAULT_BUFFER_SIZE];
+  char size[DEFAULT_BUFFER_SIZE];
+  for (int index = 0;; index++) {
+    if (!_read_cache_attr(index, "level", level, sizeof(level)) ||
+        !_read_cache_attr(index, "type", type, sizeof(type)) ||
+        !_read_cache_attr(index, "size", size, sizeof(size))) {
+      return;
+    }
+    if (strcmp(type, "Instruction") == 0) {
+      continue;
+    }
+
+    char *unit;
+    long n_bytes = strtol(size, &unit, 10);
+    if (*unit == 'K') {
+      n_bytes <<= 10;
+    } else if (*unit == 'M') {
+      n_bytes <<= 20;
+    } else if (*unit == 'G') {
+      n_bytes <<= 30;
+    }
+    if (n_bytes <= 0) {
+      continue;
+    }
+
+    switch (atoi(level)) {
+    case 1:
+      __l1d_cache_size__ = n_bytes;
+      break;
+    case 2:
+      __l2_cache_size__ = n_bytes;
+      break;
+    case 3:
+      __l3_cache_size__ = n_bytes;
+      break;
+    }
+  }
+}
+
 /**
  * @implements init_sysinfo
  */
@@ -24,9 +100,18 @@ void init_sysinfo() {
   __n_processors__ = get_nprocs();
   __page_size__ = getpagesize();
 
+  __l1d_cache_size__ = DEFAULT_L1D_CACHE_SIZE;
+  __l2_cache_size__ = DEFAULT_L2_CACHE_SIZE;
+  __l3_cache_size__ = DEFAULT_L3_CACHE_SIZE;
+  _read_cache_sizes();
+
   double loadavg[3];
   getloadavg(loadavg, 3);
   __avg_load_1__ = loadavg[0];
   __avg_load_5__ = loadavg[1];
   __avg_load_15__ = loadavg[2];
+
+  // This queries CPUID and is safe to call regardless of the target flags
+  __builtin_cpu_init();
+  __has_avx2__ = __builtin_cpu_supports("avx2");
 }
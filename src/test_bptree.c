@@ -2,12 +2,19 @@
 #include <limits.h>
 #include <math.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "binsearch.h"
 #include "bptree.h"
 #include "sort.h"
+#include "sysinfo.h"
 #include "testing.h"
 
+/**
+ * The order of the B+ trees in the tests.
+ */
+static int order;
+
 /**
  * Helper function to find the first leaf node in the B+ tree.
  */
@@ -25,7 +32,7 @@ BPlusNode *_find_first_leaf(BPlusTree *tree) {
 void test_bplus_tree_create() {
   srand(0);
 
-  size_t size = BPLUS_TREE_ORDER * BPLUS_TREE_ORDER; // Ensure >= 2 levels
+  size_t size = order * order; // Ensure >= 2 levels
   if (size < 10000) {
     size = 10000;
   }
@@ -42,14 +49,14 @@ void test_bplus_tree_create() {
   aquicksort(data, sorter, size);
 
   // Bulk load the B+ tree
-  BPlusTree *tree = bplus_tree_create(data, sorter, size);
+  BPlusTree *tree = bplus_tree_create(data, sorter, size, order);
   assert(tree->size == size);
 
   // Check data in the leaf nodes while also checking the forward connections in
   // the leaf level
   BPlusNode *node = _find_first_leaf(tree);
-  for (size_t i = 0; i < size; i += BPLUS_TREE_ORDER - 1) {
-    for (int j = 0; i + j < size && j < BPLUS_TREE_ORDER - 1; j++) {
+  for (size_t i = 0; i < size; i += order - 1) {
+    for (int j = 0; i + j < size && j < order - 1; j++) {
       assert(node->keys[j] == data[sorter[i + j]]);
       assert(node->spec.leaf.values[j] == sorter[i + j]);
     }
@@ -68,7 +75,7 @@ void test_bplus_tree_create() {
 void test_bplus_tree_insert() {
   srand(0);
 
-  size_t size = BPLUS_TREE_ORDER * BPLUS_TREE_ORDER; // Ensure >= 2 levels
+  size_t size = order * order; // Ensure >= 2 levels
   if (size < 10000) {
     size = 10000;
   }
@@ -85,7 +92,7 @@ void test_bplus_tree_insert() {
   aquicksort(data, sorter, size);
 
   // Insert into the B+ tree
-  BPlusTree *tree = bplus_tree_create(NULL, NULL, 0);
+  BPlusTree *tree = bplus_tree_create(NULL, NULL, 0, order);
   for (size_t i = 0; i < size; i++) {
     bplus_tree_insert(tree, data[sorter[i]], sorter[i]);
   }
@@ -115,7 +122,7 @@ void test_bplus_tree_insert() {
 void test_bplus_tree_search_cont() {
   srand(0);
 
-  size_t size = BPLUS_TREE_ORDER * BPLUS_TREE_ORDER; // Ensure >= 2 levels
+  size_t size = order * order; // Ensure >= 2 levels
   if (size < 10000) {
     size = 10000;
   }
@@ -126,7 +133,7 @@ void test_bplus_tree_search_cont() {
     data[i] = rand() % size; // Many duplicates
   }
   quicksort(data, size);
-  BPlusTree *tree = bplus_tree_create(data, NULL, size);
+  BPlusTree *tree = bplus_tree_create(data, NULL, size, order);
 
   // Test 10 random keys, then two corner cases
   for (int x = 0; x < 12; x++) {
@@ -162,7 +169,7 @@ void test_bplus_tree_search_cont() {
  * ranges on borders, etc.
  */
 void test_bplus_tree_search_range_cont_toy() {
-  BPlusTree *tree = bplus_tree_create(NULL, NULL, 0);
+  BPlusTree *tree = bplus_tree_create(NULL, NULL, 0, order);
   size_t *values, count;
 
   // Tree data: []
@@ -276,7 +283,7 @@ void test_bplus_tree_search_range_cont_toy() {
 void test_bplus_tree_search_range_cont() {
   srand(0);
 
-  size_t size = BPLUS_TREE_ORDER * BPLUS_TREE_ORDER; // Ensure >= 2 levels
+  size_t size = order * order; // Ensure >= 2 levels
   if (size < 10000) {
     size = 10000;
   }
@@ -287,7 +294,7 @@ void test_bplus_tree_search_range_cont() {
     data[i] = rand();
   }
   quicksort(data, size);
-  BPlusTree *tree = bplus_tree_create(data, NULL, size);
+  BPlusTree *tree = bplus_tree_create(data, NULL, size, order);
 
   // Test 10 random ranges, then three infinite ranges
   size_t *expected_values = malloc(sizeof(size_t) * size);
@@ -349,7 +356,7 @@ void test_bplus_tree_search_range_cont() {
  * ranges on borders, etc.
  */
 void test_bplus_tree_search_range_toy() {
-  BPlusTree *tree = bplus_tree_create(NULL, NULL, 0);
+  BPlusTree *tree = bplus_tree_create(NULL, NULL, 0, order);
   size_t values[10];
   size_t count;
 
@@ -446,7 +453,7 @@ void test_bplus_tree_search_range_toy() {
 void test_bplus_tree_search_range() {
   srand(0);
 
-  size_t size = BPLUS_TREE_ORDER * BPLUS_TREE_ORDER; // Ensure >= 2 levels
+  size_t size = order * order; // Ensure >= 2 levels
   if (size < 10000) {
     size = 10000;
   }
@@ -461,7 +468,7 @@ void test_bplus_tree_search_range() {
     sorter[i] = i;
   }
   aquicksort(data, sorter, size);
-  BPlusTree *tree = bplus_tree_create(data, sorter, size);
+  BPlusTree *tree = bplus_tree_create(data, sorter, size, order);
 
   // Test 10 random ranges, then three infinite ranges
   size_t *expected_values = malloc(sizeof(size_t) * size);
@@ -517,13 +524,402 @@ void test_bplus_tree_search_range() {
   free(result_values);
 }
 
+/**
+ * Helper function to check the structure of a B+ tree node recursively.
+ *
+ * All keys in the subtree must be within the bounds given by the separators of
+ * the ancestors, all leaf nodes must be at the same level, and nodes other than
+ * the root must not be empty. This function returns the number of key-value
+ * pairs in the subtree.
+ */
+size_t _check_node(BPlusNode *node, int level, int n_levels, long lower,
+                   long upper) {
+  for (int i = 0; i < node->n_keys; i++) {
+    assert(node->keys[i] >= lower && node->keys[i] <= upper);
+    assert(i == 0 || node->keys[i - 1] <= node->keys[i]);
+  }
+  if (node->type == BPLUS_NODE_TYPE_LEAF) {
+    assert(level == n_levels);
+    assert(node->n_keys > 0);
+    return node->n_keys;
+  }
+
+  assert(level < n_levels);
+  assert(level == 0 || node->n_keys > 0);
+  size_t size = 0;
+  for (int i = 0; i <= node->n_keys; i++) {
+    size += _check_node(node->spec.internal.children[i], level + 1, n_levels,
+                        i == 0 ? lower : node->keys[i - 1],
+                        i == node->n_keys ? upper : node->keys[i]);
+  }
+  return size;
+}
+
+/**
+ * Helper function to check the structure of a B+ tree.
+ */
+void _check_tree(BPlusTree *tree) {
+  if (tree->size == 0) {
+    assert(tree->n_levels == 1);
+    assert(tree->root->n_keys == 0);
+    assert(tree->root->spec.internal.children[0]->n_keys == 0);
+    return;
+  }
+  assert(_check_node(tree->root, 0, tree->n_levels, LONG_MIN, LONG_MAX) ==
+         tree->size);
+}
+
+/**
+ * Helper function to shuffle an array of positions.
+ */
+void _shuffle(size_t *arr, size_t size) {
+  for (size_t i = size; i > 1; i--) {
+    size_t j = rand() % i;
+    size_t tmp = arr[i - 1];
+    arr[i - 1] = arr[j];
+    arr[j] = tmp;
+  }
+}
+
+/**
+ * Test the bplus_tree_insert_batch function.
+ */
+void test_bplus_tree_insert_batch() {
+  srand(0);
+
+  size_t size = order * order; // Ensure >= 2 levels
+  if (size < 10000) {
+    size = 10000;
+  }
+
+  // Few distinct keys so that batches hit duplicates across leaf nodes, and
+  // a last part of larger keys that is appended to the end of the tree
+  int *data = malloc(sizeof(int) * size);
+  for (size_t i = 0; i < size; i++) {
+    data[i] = i < size / 10 * 9 ? rand() % (int)(size / 20)
+                                  : rand() % (int)size + (int)size;
+  }
+  size_t *sorter = malloc(sizeof(size_t) * size);
+  for (size_t i = 0; i < size; i++) {
+    sorter[i] = i;
+  }
+
+  // Insert consecutive parts of the data as sorted batches of growing sizes,
+  // starting with an empty tree; the batches are sorted by argsorting the parts
+  BPlusTree *tree = bplus_tree_create(NULL, NULL, 0, order);
+  size_t n_batch = 1;
+  for (size_t start = 0; start < size; start += n_batch, n_batch *= 3) {
+    if (start + n_batch > size) {
+      n_batch = size - start;
+    }
+    aquicksort(data, sorter + start, n_batch);
+    assert(bplus_tree_insert_batch(tree, data, sorter + start, n_batch) == 0);
+    assert(tree->size == start + n_batch);
+    _check_tree(tree);
+  }
+
+  // Every position is in the tree exactly once, with its key
+  bool *seen = calloc(size, sizeof(bool));
+  for (BPlusNode *node = _find_first_leaf(tree); node != NULL;
+       node = node->spec.leaf.next) {
+    for (int j = 0; j < node->n_keys; j++) {
+      size_t pos = node->spec.leaf.values[j];
+      assert(!seen[pos]);
+      assert(node->keys[j] == data[pos]);
+      seen[pos] = true;
+    }
+  }
+  bplus_tree_free(tree);
+
+  // Without a sorter, the batch is the sorted data itself with the indices as
+  // values, which is then the same as bulk loading it
+  quicksort(data, size);
+  tree = bplus_tree_create(NULL, NULL, 0, order);
+  assert(bplus_tree_insert_batch(tree, data, NULL, size) == 0);
+  _check_tree(tree);
+  for (int key = -1; key <= (int)(size / 20); key++) {
+    assert(bplus_tree_search_cont(tree, key, true) ==
+           binsearch(data, key, size, true));
+    assert(bplus_tree_search_cont(tree, key, false) ==
+           binsearch(data, key, size, false));
+  }
+
+  bplus_tree_free(tree);
+  free(data);
+  free(sorter);
+  free(seen);
+}
+
+/**
+ * Test the bplus_tree_delete function.
+ */
+void test_bplus_tree_delete() {
+  srand(0);
+
+  size_t size = order * order; // Ensure >= 2 levels
+  if (size < 10000) {
+    size = 10000;
+  }
+
+  // Use few distinct keys so that duplicates span multiple leaf nodes
+  int *data = malloc(sizeof(int) * size);
+  for (size_t i = 0; i < size; i++) {
+    data[i] = rand() % (size / 50);
+  }
+
+  size_t *sorter = malloc(sizeof(size_t) * size);
+  for (size_t i = 0; i < size; i++) {
+    sorter[i] = i;
+  }
+  aquicksort(data, sorter, size);
+  BPlusTree *tree = bplus_tree_create(data, sorter, size, order);
+
+  // Delete most pairs in a random order; pairs that are not in the tree (any
+  // longer) cannot be deleted
+  size_t *positions = malloc(sizeof(size_t) * size);
+  bool *deleted = calloc(size, sizeof(bool));
+  for (size_t i = 0; i < size; i++) {
+    positions[i] = i;
+  }
+  _shuffle(positions, size);
+  size_t n_deleted = size - size / 8;
+  for (size_t i = 0; i < n_deleted; i++) {
+    size_t pos = positions[i];
+    assert(bplus_tree_delete(tree, data[pos] + 1, pos) == -1);
+    assert(bplus_tree_delete(tree, data[pos], pos) == 0);
+    assert(bplus_tree_delete(tree, data[pos], pos) == -1);
+    deleted[pos] = true;
+    if (i % 997 == 0) {
+      _check_tree(tree);
+    }
+  }
+  assert(tree->size == size - n_deleted);
+  _check_tree(tree);
+
+  // The remaining pairs keep their order in the leaf level
+  BPlusNode *node = _find_first_leaf(tree);
+  int j = 0;
+  for (size_t i = 0; i < size; i++) {
+    if (deleted[sorter[i]]) {
+      continue;
+    }
+    if (j == node->n_keys) {
+      node = node->spec.leaf.next;
+      j = 0;
+    }
+    assert(node->keys[j] == data[sorter[i]]);
+    assert(node->spec.leaf.values[j++] == sorter[i]);
+  }
+  assert(j == node->n_keys && node->spec.leaf.next == NULL);
+
+  // Delete the rest, which collapses the tree into an empty one that can still
+  // be inserted into
+  for (size_t i = n_deleted; i < size; i++) {
+    assert(bplus_tree_delete(tree, data[positions[i]], positions[i]) == 0);
+  }
+  _check_tree(tree);
+  size_t value;
+  assert(bplus_tree_search_range(tree, INT_MIN, INT_MAX, &value) == 0);
+  assert(bplus_tree_insert(tree, 42, 7) == 0);
+  assert(bplus_tree_search_range(tree, INT_MIN, INT_MAX, &value) == 1);
+  assert(value == 7);
+
+  bplus_tree_free(tree);
+  free(data);
+  free(sorter);
+  free(positions);
+  free(deleted);
+}
+
+/**
+ * Test the bplus_tree_update function.
+ */
+void test_bplus_tree_update() {
+  srand(0);
+
+  size_t size = order * order; // Ensure >= 2 levels
+  if (size < 10000) {
+    size = 10000;
+  }
+
+  int *data = malloc(sizeof(int) * size);
+  for (size_t i = 0; i < size; i++) {
+    data[i] = rand() % (size / 10);
+  }
+
+  size_t *sorter = malloc(sizeof(size_t) * size);
+  for (size_t i = 0; i < size; i++) {
+    sorter[i] = i;
+  }
+  aquicksort(data, sorter, size);
+  BPlusTree *tree = bplus_tree_create(data, sorter, size, order);
+
+  // Change keys of random pairs, both by small amounts (which mostly stay in
+  // place) and to arbitrary keys
+  for (size_t i = 0; i < size; i++) {
+    size_t pos = rand() % size;
+    int new_key = i % 2 == 0 ? data[pos] + rand() % 3 - 1
+                             : rand() % (int)(size / 10);
+    assert(bplus_tree_update(tree, data[pos] + 1, new_key, pos) == -1);
+    assert(bplus_tree_update(tree, data[pos], new_key, pos) == 0);
+    data[pos] = new_key;
+    if (i % 997 == 0) {
+      _check_tree(tree);
+    }
+  }
+  assert(tree->size == size);
+  _check_tree(tree);
+
+  // Every position is in the tree exactly once, with its current key
+  bool *seen = calloc(size, sizeof(bool));
+  for (BPlusNode *node = _find_first_leaf(tree); node != NULL;
+       node = node->spec.leaf.next) {
+    for (int j = 0; j < node->n_keys; j++) {
+      size_t pos = node->spec.leaf.values[j];
+      assert(!seen[pos]);
+      assert(node->keys[j] == data[pos]);
+      seen[pos] = true;
+    }
+  }
+
+  bplus_tree_free(tree);
+  free(data);
+  free(sorter);
+  free(seen);
+}
+
+/**
+ * Test the bplus_tree_compact_values function, as for deleting rows with a
+ * clustered index.
+ */
+void test_bplus_tree_compact_values() {
+  srand(0);
+
+  size_t size = order * order; // Ensure >= 2 levels
+  if (size < 10000) {
+    size = 10000;
+  }
+
+  int *data = malloc(sizeof(int) * size);
+  for (size_t i = 0; i < size; i++) {
+    data[i] = rand() % (size / 4);
+  }
+  quicksort(data, size);
+  BPlusTree *tree = bplus_tree_create(data, NULL, size, order);
+
+  // Remove a random tenth of the rows, including whole words of the mask
+  BitVector *removed = bitvector_create(size);
+  for (size_t i = 0; i < size; i++) {
+    if (rand() % 10 == 0 || (i >= 128 && i < 256)) {
+      bitvector_set(removed, i);
+      assert(bplus_tree_delete(tree, data[i], i) == 0);
+    }
+  }
+  assert(bplus_tree_compact_values(tree, removed) == 0);
+  size_t n_rows = 0;
+  for (size_t i = 0; i < size; i++) {
+    if (!bitvector_test(removed, i)) {
+      data[n_rows++] = data[i];
+    }
+  }
+  assert(tree->size == n_rows);
+  _check_tree(tree);
+
+  // The values are contiguous again, so that searches give the positions in
+  // the compacted data
+  BPlusNode *node = _find_first_leaf(tree);
+  for (size_t i = 0; i < n_rows;) {
+    for (int j = 0; j < node->n_keys; j++, i++) {
+      assert(node->keys[j] == data[i]);
+      assert(node->spec.leaf.values[j] == i);
+    }
+    node = node->spec.leaf.next;
+  }
+  assert(node == NULL);
+  for (int key = -1; key <= (int)(size / 4); key++) {
+    assert(bplus_tree_search_cont(tree, key, true) ==
+           binsearch(data, key, n_rows, true));
+    assert(bplus_tree_search_cont(tree, key, false) ==
+           binsearch(data, key, n_rows, false));
+  }
+
+  bitvector_free(removed);
+  bplus_tree_free(tree);
+  free(data);
+}
+
+/**
+ * Test the bplus_tree_shift_values function, as for inserting rows with a
+ * clustered index.
+ */
+void test_bplus_tree_shift_values() {
+  srand(0);
+
+  size_t size = order * order; // Ensure >= 2 levels
+  if (size < 10000) {
+    size = 10000;
+  }
+
+  int *data = malloc(sizeof(int) * (size + 1000));
+  for (size_t i = 0; i < size; i++) {
+    data[i] = rand() % (size / 4);
+  }
+  quicksort(data, size);
+  BPlusTree *tree = bplus_tree_create(data, NULL, size, order);
+
+  // Insert rows at their sorted positions, shifting the rows after them; each
+  // shift passes over the whole leaf level, so only a few rows are inserted
+  size_t n_rows = size;
+  for (size_t i = 0; i < 1000; i++) {
+    int key = rand() % (size / 4);
+    size_t ind = bplus_tree_search_cont(tree, key, false);
+    assert(ind == binsearch(data, key, n_rows, false));
+    memmove(data + ind + 1, data + ind, sizeof(int) * (n_rows++ - ind));
+    data[ind] = key;
+    bplus_tree_shift_values(tree, ind);
+    assert(bplus_tree_insert(tree, key, ind) == 0);
+  }
+  _check_tree(tree);
+
+  BPlusNode *node = _find_first_leaf(tree);
+  for (size_t i = 0; i < n_rows;) {
+    for (int j = 0; j < node->n_keys; j++, i++) {
+      assert(node->keys[j] == data[i]);
+      assert(node->spec.leaf.values[j] == i);
+    }
+    node = node->spec.leaf.next;
+  }
+  assert(node == NULL);
+
+  bplus_tree_free(tree);
+  free(data);
+}
+
 int main() {
-  TEST(bplus_tree_create);
-  TEST(bplus_tree_insert);
-  TEST(bplus_tree_search_cont);
-  TEST(bplus_tree_search_range_cont_toy);
-  TEST(bplus_tree_search_range_cont);
-  TEST(bplus_tree_search_range_toy);
-  TEST(bplus_tree_search_range);
+  init_sysinfo();
+
+  // Test the default order, whose nodes are binary searched before counting
+  // the remaining keys, and small orders, whose trees are deep and whose nodes
+  // are only counted; each with and without AVX2
+  int orders[] = {BPLUS_TREE_ORDER, BPLUS_TREE_MIN_ORDER, 17, 64};
+  bool has_avx2 = __has_avx2__;
+  for (size_t i = 0; i < sizeof(orders) / sizeof(int); i++) {
+    for (int use_avx2 = 0; use_avx2 <= has_avx2; use_avx2++) {
+      order = orders[i];
+      __has_avx2__ = use_avx2;
+      TEST(bplus_tree_create);
+      TEST(bplus_tree_insert);
+      TEST(bplus_tree_insert_batch);
+      TEST(bplus_tree_search_cont);
+      TEST(bplus_tree_search_range_cont_toy);
+      TEST(bplus_tree_search_range_cont);
+      TEST(bplus_tree_search_range_toy);
+      TEST(bplus_tree_search_range);
+      TEST(bplus_tree_delete);
+      TEST(bplus_tree_update);
+      TEST(bplus_tree_compact_values);
+      TEST(bplus_tree_shift_values);
+    }
+  }
   return 0;
 }
@@ -0,0 +1,283 @@
+#include <assert.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "comm.h"
+#include "consts.h"
+#include "testing.h"
+
+/**
+ * Helper function to set up a pair of connected sockets and a shared memory
+ * channel between them, with the first socket acting as the client.
+ */
+static void setup_channel(int sockets[2], SharedChannel **client,
+                          SharedChannel **server) {
+  assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) == 0);
+
+  int fd;
+  *client = shared_channel_create(&fd);
+  assert(*client != NULL);
+  Message message;
+  memset(&message, 0, sizeof(Message));
+  message.status = MESSAGE_STATUS_C_SHARING_MEMORY;
+  assert(send_message_fd(sockets[0], &message, fd) == sizeof(Message));
+  close(fd);
+
+  bool closed;
+  int received_fd = -1;
+  assert(recv_available_fd(sockets[1], &message, sizeof(Message), &closed,
+                           &received_fd) == sizeof(Message));
+  assert(!closed && received_fd >= 0);
+  assert(message.status == MESSAGE_STATUS_C_SHARING_MEMORY);
+  *server = shared_channel_attach(received_fd);
+  assert(*server != NULL);
+  close(received_fd);
+}
+
+/**
+ * The arguments of a sender thread.
+ */
+typedef struct SenderArgs {
+  int socket;
+  SharedChannel *channel;
+  Message *message;
+  ssize_t sent;
+} SenderArgs;
+
+/**
+ * The routine of a sender thread, which may block until the payload is taken.
+ */
+static void *sender(void *arg) {
+  SenderArgs *args = arg;
+  args->sent = send_message_shared(args->socket, args->channel, args->message);
+  return NULL;
+}
+
+/**
+ * Helper function to send a message in a separate thread and receive it.
+ *
+ * The received payload is malloc'ed and returned, and the header is stored in
+ * the given message.
+ */
+static char *transfer(int send_socket, SharedChannel *send_channel,
+                      int recv_socket, SharedChannel *recv_channel,
+                      Message *message, Message *received) {
+  SenderArgs args = {.socket = send_socket,
+                     .channel = send_channel,
+                     .message = message,
+                     .sent = 0};
+  int length = message->length;
+  pthread_t thread;
+  assert(pthread_create(&thread, NULL, sender, &args) == 0);
+
+  assert(recv_all(recv_socket, received, sizeof(Message)) == sizeof(Message));
+  char *payload = malloc(received->length);
+  assert(payload != NULL);
+  if (received->is_shared) {
+    assert(recv_shared_payload(recv_socket, recv_channel, payload,
+                               received->length) == received->length);
+  } else {
+    assert(recv_all(recv_socket, payload, received->length) ==
+           received->length);
+  }
+
+  pthread_join(thread, NULL);
+  assert(args.sent == (ssize_t)sizeof(Message) + length);
+  return payload;
+}
+
+/**
+ * Test moving payloads through a shared memory channel in both directions.
+ *
+ * The payloads span many more slots than the rings have, so that both sides
+ * have to wait on each other, and include segments that straddle slots.
+ */
+void test_shared_channel_transfer() {
+  int sockets[2];
+  SharedChannel *client, *server;
+  setup_channel(sockets, &client, &server);
+
+  size_t length = SHARED_CHANNEL_N_SLOTS * SHARED_CHANNEL_SLOT_SIZE * 3 + 12345;
+  char *data = malloc(length);
+  assert(data != NULL);
+  for (size_t i = 0; i < length; i++) {
+    data[i] = rand();
+  }
+
+  // A single payload buffer from the client to the server
+  Message message, received;
+  memset(&message, 0, sizeof(Message));
+  message.status = MESSAGE_STATUS_C_SENDING_CSV_ROWS;
+  message.length = length;
+  message.payload = data;
+  char *payload =
+      transfer(sockets[0], client, sockets[1], server, &message, &received);
+  assert(received.is_shared && received.length == (int)length);
+  assert(received.status == MESSAGE_STATUS_C_SENDING_CSV_ROWS);
+  assert(memcmp(payload, data, length) == 0);
+  free(payload);
+
+  // Uneven payload segments from the server to the client, twice so that the
+  // second message starts in the middle of the ring
+  for (int round = 0; round < 2; round++) {
+    size_t split[] = {0, 7, SHARED_CHANNEL_SLOT_SIZE + 3, length / 2, length};
+    int n_segments = sizeof(split) / sizeof(split[0]) - 1;
+    memset(&message, 0, sizeof(Message));
+    message.status = MESSAGE_STATUS_OK;
+    message.sequence = round;
+    message.length = length;
+    message.segments = malloc(n_segments * sizeof(struct iovec));
+    message.n_segments = n_segments;
+    for (int i = 0; i < n_segments; i++) {
+      message.segments[i].iov_base = data + split[i];
+      message.segments[i].iov_len = split[i + 1] - split[i];
+    }
+    payload =
+        transfer(sockets[1], server, sockets[0], client, &message, &received);
+    assert(received.is_shared && received.sequence == (unsigned int)round);
+    assert(memcmp(payload, data, length) == 0);
+    free(payload);
+  }
+
+  // A small payload stays on the socket
+  memset(&message, 0, sizeof(Message));
+  message.status = MESSAGE_STATUS_OK;
+  message.length = 100;
+  message.payload = data;
+  payload =
+      transfer(sockets[1], server, sockets[0], client, &message, &received);
+  assert(!received.is_shared && memcmp(payload, data, 100) == 0);
+  free(payload);
+
+  shared_channel_close(client);
+  shared_channel_close(server);
+  close(sockets[0]);
+  close(sockets[1]);
+  free(data);
+}
+
+/**
+ * Test that waiting on a shared memory channel fails once the peer is gone.
+ */
+void test_shared_channel_peer_closed() {
+  int sockets[2];
+  SharedChannel *client, *server;
+  setup_channel(sockets, &client, &server);
+
+  // Nothing is ever sent, so the receiver would wait forever if it did not
+  // notice that the other end of the socket has been closed
+  char buffer[16];
+  close(sockets[0]);
+  assert(recv_shared_payload(sockets[1], server, buffer, sizeof(buffer)) == -1);
+
+  // Attaching to something that is not a channel fails
+  int fds[2];
+  assert(pipe(fds) == 0);
+  assert(shared_channel_attach(fds[0]) == NULL);
+  close(fds[0]);
+  close(fds[1]);
+
+  shared_channel_close(client);
+  shared_channel_close(server);
+  close(sockets[1]);
+}
+
+/**
+ * Test that a channel keeps working when its peer rewrites the geometry in the
+ * header of the region after the channel has been attached.
+ */
+void test_shared_channel_geometry() {
+  int sockets[2];
+  SharedChannel *client, *server;
+  setup_channel(sockets, &client, &server);
+
+  // The number and the size of the slots lead the header of the region
+  size_t *geometry = (size_t *)client->region;
+  geometry[0] = SIZE_MAX / 2;
+  geometry[1] = SIZE_MAX / 2;
+
+  size_t length = SHARED_CHANNEL_N_SLOTS * SHARED_CHANNEL_SLOT_SIZE * 4 + 7;
+  char *data = malloc(length);
+  assert(data != NULL);
+  for (size_t i = 0; i < length; i++) {
+    data[i] = rand();
+  }
+  Message message, received;
+  memset(&message, 0, sizeof(Message));
+  message.status = MESSAGE_STATUS_C_SENDING_CSV_ROWS;
+  message.length = length;
+  message.payload = data;
+  char *payload =
+      transfer(sockets[0], client, sockets[1], server, &message, &received);
+  assert(received.is_shared && memcmp(payload, data, length) == 0);
+  free(payload);
+
+  shared_channel_close(client);
+  shared_channel_close(server);
+  close(sockets[0]);
+  close(sockets[1]);
+  free(data);
+}
+
+/**
+ * Test sending segments without blocking when the peer does not receive.
+ *
+ * The segments are far larger than the socket buffer, so the send stops
+ * midway, and the segments left over must describe exactly the rest.
+ */
+void test_sendv_available() {
+  int sockets[2];
+  assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) == 0);
+
+  size_t length = 8 << 20;
+  char *data = malloc(length);
+  char *received = malloc(length);
+  assert(data != NULL && received != NULL);
+  for (size_t i = 0; i < length; i++) {
+    data[i] = rand();
+  }
+  struct iovec segments[3] = {{.iov_base = data, .iov_len = 5},
+                              {.iov_base = data + 5, .iov_len = length / 2},
+                              {.iov_base = data + 5 + length / 2,
+                               .iov_len = length - 5 - length / 2}};
+  ssize_t sent = sendv_available(sockets[0], segments, 3);
+  assert(sent > 0 && (size_t)sent < length);
+
+  // The rest follows right after what is sent
+  size_t rest = 0;
+  for (int i = 0; i < 3; i++) {
+    if (segments[i].iov_len > 0) {
+      assert(segments[i].iov_base == data + sent + rest);
+    }
+    rest += segments[i].iov_len;
+  }
+  assert(sent + rest == length);
+
+  // Alternate between receiving what is sent and sending what is left
+  size_t total_received = 0;
+  while (sent > 0) {
+    assert(recv_all(sockets[1], received + total_received, sent) == sent);
+    total_received += sent;
+    sent = sendv_available(sockets[0], segments, 3);
+    assert(sent >= 0);
+  }
+  assert(total_received == length);
+  assert(memcmp(received, data, length) == 0);
+
+  close(sockets[0]);
+  close(sockets[1]);
+  free(data);
+  free(received);
+}
+
+int main() {
+  TEST(sendv_available);
+  TEST(shared_channel_transfer);
+  TEST(shared_channel_peer_closed);
+  TEST(shared_channel_geometry);
+  return 0;
+}
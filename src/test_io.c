@@ -0,0 +1,160 @@
+#include <assert.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "io.h"
+#include "sysinfo.h"
+#include "testing.h"
+
+/**
+ * Helper function to wrap CSV data (without the header) in a CSV struct.
+ *
+ * The data is copied into a buffer of the exact size so that reading past the
+ * end can be caught by memory checkers.
+ */
+static CSV make_csv(const char *data, size_t n_cols) {
+  size_t size = strlen(data);
+  CSV csv = {.size = size,
+             .data = malloc(size > 0 ? size : 1),
+             .header = NULL,
+             .n_cols = n_cols,
+             .offset = 0};
+  assert(csv.data != NULL);
+  memcpy(csv.data, data, size);
+  return csv;
+}
+
+/**
+ * Helper function to parse the only row of the CSV data.
+ */
+static CSVParseStatus parse_single_row(const char *data, size_t n_cols,
+                                       int *buffer) {
+  CSV csv = make_csv(data, n_cols);
+  CSVParseStatus status = parse_next_row(&csv, buffer);
+  free(csv.data);
+  return status;
+}
+
+/**
+ * Test parsing valid rows with the parse_next_row function.
+ */
+void test_parse_next_row_valid() {
+  int buffer[4];
+
+  // Multiple rows with empty lines in between and no trailing newline
+  CSV csv = make_csv("1,-2,3\n\n\n40,+50,-60\n7,8,9", 3);
+  assert(parse_next_row(&csv, buffer) == CSV_PARSE_STATUS_CONTINUE);
+  assert(buffer[0] == 1 && buffer[1] == -2 && buffer[2] == 3);
+  assert(parse_next_row(&csv, buffer) == CSV_PARSE_STATUS_CONTINUE);
+  assert(buffer[0] == 40 && buffer[1] == 50 && buffer[2] == -60);
+  assert(parse_next_row(&csv, buffer) == CSV_PARSE_STATUS_CONTINUE);
+  assert(buffer[0] == 7 && buffer[1] == 8 && buffer[2] == 9);
+  assert(parse_next_row(&csv, buffer) == CSV_PARSE_STATUS_EOF);
+  assert(parse_next_row(&csv, buffer) == CSV_PARSE_STATUS_EOF);
+  free(csv.data);
+
+  // Boundary values, leading zeros, and leading whitespaces are accepted
+  assert(parse_single_row("2147483647,-2147483648,0,-0\n", 4, buffer) ==
+         CSV_PARSE_STATUS_CONTINUE);
+  assert(buffer[0] == INT_MAX && buffer[1] == INT_MIN && buffer[2] == 0 &&
+         buffer[3] == 0);
+  assert(parse_single_row("0000000000002147483647, 12,\t-007\n", 3, buffer) ==
+         CSV_PARSE_STATUS_CONTINUE);
+  assert(buffer[0] == INT_MAX && buffer[1] == 12 && buffer[2] == -7);
+
+  // Only empty lines
+  assert(parse_single_row("\n\n\n", 1, buffer) == CSV_PARSE_STATUS_EOF);
+  assert(parse_single_row("", 1, buffer) == CSV_PARSE_STATUS_EOF);
+}
+
+/**
+ * Test parsing invalid rows with the parse_next_row function.
+ */
+void test_parse_next_row_invalid() {
+  int buffer[4];
+
+  // Values that do not fit in an int
+  assert(parse_single_row("2147483648\n", 1, buffer) ==
+         CSV_PARSE_STATUS_ERROR);
+  assert(parse_single_row("-2147483649\n", 1, buffer) ==
+         CSV_PARSE_STATUS_ERROR);
+  assert(parse_single_row("9999999999\n", 1, buffer) ==
+         CSV_PARSE_STATUS_ERROR);
+  assert(parse_single_row("1,123456789012345678901234567890\n", 2, buffer) ==
+         CSV_PARSE_STATUS_ERROR);
+
+  // Malformed values
+  assert(parse_single_row("1,,3\n", 3, buffer) == CSV_PARSE_STATUS_ERROR);
+  assert(parse_single_row("1,-,3\n", 3, buffer) == CSV_PARSE_STATUS_ERROR);
+  assert(parse_single_row("1,2a,3\n", 3, buffer) == CSV_PARSE_STATUS_ERROR);
+  assert(parse_single_row("1,2 ,3\n", 3, buffer) == CSV_PARSE_STATUS_ERROR);
+  assert(parse_single_row("1,2,3\r\n", 3, buffer) == CSV_PARSE_STATUS_ERROR);
+  assert(parse_single_row("1,2,0x3\n", 3, buffer) == CSV_PARSE_STATUS_ERROR);
+
+  // Wrong number of values
+  assert(parse_single_row("1,2\n", 3, buffer) == CSV_PARSE_STATUS_ERROR);
+  assert(parse_single_row("1,2", 3, buffer) == CSV_PARSE_STATUS_ERROR);
+  assert(parse_single_row("1,2,3,4\n", 3, buffer) == CSV_PARSE_STATUS_ERROR);
+  assert(parse_single_row("1,2,3,\n", 3, buffer) == CSV_PARSE_STATUS_ERROR);
+}
+
+/**
+ * Test parsing many random rows with the parse_next_row function.
+ *
+ * The rows are long enough to span multiple blocks of the vectorized delimiter
+ * search, and the values have all possible numbers of digits.
+ */
+void test_parse_next_row_random() {
+  srand(0);
+  const size_t n_rows = 10000;
+  const size_t n_cols = 4;
+
+  // Generate random values and format them into CSV data
+  int *values = malloc(n_rows * n_cols * sizeof(int));
+  char *data = malloc(n_rows * n_cols * 12 + 1);
+  assert(values != NULL && data != NULL);
+  size_t length = 0;
+  for (size_t i = 0; i < n_rows * n_cols; i++) {
+    int n_digits = rand() % 10 + 1;
+    long value = rand() % 10;
+    for (int j = 1; j < n_digits; j++) {
+      value = value * 10 + rand() % 10;
+    }
+    value = value > INT_MAX ? INT_MAX : value;
+    values[i] = rand() % 2 == 0 ? (int)value : -(int)value;
+    char delimiter = i % n_cols == n_cols - 1 ? '\n' : ',';
+    length += sprintf(data + length, "%d%c", values[i], delimiter);
+  }
+
+  // Parse the CSV data and check the values
+  CSV csv = make_csv(data, n_cols);
+  int buffer[n_cols];
+  for (size_t i = 0; i < n_rows; i++) {
+    assert(parse_next_row(&csv, buffer) == CSV_PARSE_STATUS_CONTINUE);
+    for (size_t j = 0; j < n_cols; j++) {
+      assert(buffer[j] == values[i * n_cols + j]);
+    }
+  }
+  assert(parse_next_row(&csv, buffer) == CSV_PARSE_STATUS_EOF);
+
+  free(csv.data);
+  free(data);
+  free(values);
+}
+
+int main() {
+  init_sysinfo();
+
+  // Run the tests on both the baseline and the AVX2 parser if supported
+  bool has_avx2 = __has_avx2__;
+  for (int use_avx2 = 0; use_avx2 <= has_avx2; use_avx2++) {
+    __has_avx2__ = use_avx2;
+    TEST(parse_next_row_valid);
+    TEST(parse_next_row_invalid);
+    TEST(parse_next_row_random);
+  }
+  __has_avx2__ = has_avx2;
+  return 0;
+}
@@ -0,0 +1,461 @@
+#include <assert.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "scan.h"
+#include "sysinfo.h"
+#include "testing.h"
+#include "thread_pool.h"
+#include "zonemap.h"
+
+/**
+ * Task handler of the thread pool used for the parallel shared scan tests.
+ */
+static void handle_thread_task(ThreadTask *task) {
+  assert(task->type == THREAD_TASK_TYPE_SHARED_SCAN);
+  shared_scan_subroutine(task->data);
+}
+
+/**
+ * Helper function to generate random data with values in [-range, range).
+ */
+static int *random_data(size_t length, int range) {
+  int *data = malloc(length * sizeof(int));
+  assert(data != NULL);
+  for (size_t i = 0; i < length; i++) {
+    data[i] = rand() % (2 * range) - range;
+  }
+  return data;
+}
+
+/**
+ * Helper function to check a shared scan against a brute-force evaluation.
+ *
+ * The scan is run with the given flags on the data (as a partial column, and
+ * optionally restricted by a position vector whose i-th position is
+ * `indices[i]`), once with the scalar kernels and once with the AVX2 kernels,
+ * both of which should give exactly the same results as the brute-force
+ * evaluation. If `as_mask` is true, the position vector is given as a boolean
+ * mask instead of an index array, in which case the indices must be increasing.
+ * If `to_masks` is true, the select queries output boolean masks.
+ */
+static void check_shared_scan(int *data, size_t *indices, size_t length,
+                              long *lower_bound_arr, long *upper_bound_arr,
+                              size_t n_select_queries, int flags, bool as_mask,
+                              bool to_masks) {
+  PartialColumn partial_column = {.values = data};
+  GeneralizedValvec valvec = {
+      .valvec_type = GENERALIZED_VALVEC_TYPE_PARTIAL_COLUMN,
+      .valvec_pointer.partial_column = &partial_column,
+      .valvec_length = length};
+  IndexArray index_array = {.n_indices = length, .indices = indices};
+  GeneralizedPosvec posvec = {
+      .posvec_type = GENERALIZED_POSVEC_TYPE_INDEX_ARRAY,
+      .posvec_pointer.index_array = &index_array};
+
+  // The number of positions that can be selected, plus some slack
+  size_t n_positions = indices == NULL ? length : 3 * length + 5;
+  BooleanMask boolean_mask = {.n_set = length,
+                              .mask = bitvector_create(n_positions)};
+  assert(boolean_mask.mask != NULL);
+  if (as_mask) {
+    for (size_t i = 0; i < length; i++) {
+      bitvector_set(boolean_mask.mask, indices[i]);
+    }
+    posvec.posvec_type = GENERALIZED_POSVEC_TYPE_BOOLEAN_MASK;
+    posvec.posvec_pointer.boolean_mask = &boolean_mask;
+  }
+
+  bool has_avx2 = __has_avx2__;
+  for (int use_avx2 = 0; use_avx2 <= has_avx2; use_avx2++) {
+    __has_avx2__ = use_avx2;
+
+    ScanContext ctx = init_empty_scan_context();
+    ctx.n_select_queries = n_select_queries;
+    ctx.lower_bound_arr = lower_bound_arr;
+    ctx.upper_bound_arr = upper_bound_arr;
+    BitVector *selected_masks_arr[n_select_queries];
+    if (to_masks) {
+      for (size_t c = 0; c < n_select_queries; c++) {
+        selected_masks_arr[c] = bitvector_create(n_positions);
+        assert(selected_masks_arr[c] != NULL);
+      }
+      ctx.selected_masks_arr = selected_masks_arr;
+    }
+    assert(shared_scan(&valvec, indices == NULL ? NULL : &posvec, &ctx,
+                       flags) == DB_SCHEMA_STATUS_OK);
+
+    if (flags & SCAN_CALLBACK_SELECT_FLAG) {
+      for (size_t c = 0; c < n_select_queries; c++) {
+        size_t n_expected = 0;
+        size_t next_position = 0;
+        for (size_t i = 0; i < length; i++) {
+          if (data[i] >= lower_bound_arr[c] && data[i] < upper_bound_arr[c]) {
+            size_t position = indices == NULL ? i : indices[i];
+            if (to_masks) {
+              // No position should be set between two selected positions
+              assert(bitvector_next_set(selected_masks_arr[c],
+                                        next_position) == position);
+              next_position = position + 1;
+            } else {
+              assert(n_expected < ctx.n_selected_indices_arr[c]);
+              assert(ctx.selected_indices_arr[c][n_expected] == position);
+            }
+            n_expected++;
+          }
+        }
+        assert(ctx.n_selected_indices_arr[c] == n_expected);
+        if (to_masks) {
+          assert(ctx.selected_indices_arr[c] == NULL);
+          assert(bitvector_next_set(selected_masks_arr[c], next_position) ==
+                 n_positions);
+          assert(bitvector_count(selected_masks_arr[c]) == n_expected);
+          bitvector_free(selected_masks_arr[c]);
+        }
+        free(ctx.selected_indices_arr[c]);
+      }
+      free(ctx.selected_indices_arr);
+      free(ctx.n_selected_indices_arr);
+    } else if (to_masks) {
+      for (size_t c = 0; c < n_select_queries; c++) {
+        bitvector_free(selected_masks_arr[c]);
+      }
+    }
+
+    // Aggregations are only supported without a position vector
+    if (indices == NULL) {
+      int min_result = INT_MAX;
+      int max_result = INT_MIN;
+      long long sum_result = 0;
+      for (size_t i = 0; i < length; i++) {
+        min_result = data[i] < min_result ? data[i] : min_result;
+        max_result = data[i] > max_result ? data[i] : max_result;
+        sum_result += data[i];
+      }
+      assert(!(flags & SCAN_CALLBACK_MIN_FLAG) || ctx.min_result == min_result);
+      assert(!(flags & SCAN_CALLBACK_MAX_FLAG) || ctx.max_result == max_result);
+      assert(!(flags & SCAN_CALLBACK_SUM_FLAG) || ctx.sum_result == sum_result);
+    }
+  }
+  __has_avx2__ = has_avx2;
+  bitvector_free(boolean_mask.mask);
+}
+
+/**
+ * Test shared scans with all combinations of flags on random data.
+ */
+void test_shared_scan_random() {
+  // Lengths around multiples of the vector width, and long enough to be split
+  // into multiple tasks in parallel execution
+  size_t lengths[] = {0, 1, 7, 8, 9, 63, 1000, 100003};
+  long lower_bound_arr[] = {-50, 0, 10, 25, 30, -1000};
+  long upper_bound_arr[] = {50, 1, 10, 75, 20, 1000};
+
+  for (size_t l = 0; l < sizeof(lengths) / sizeof(size_t); l++) {
+    int *data = random_data(lengths[l], 100);
+    for (int flags = 0x01; flags <= 0x0f; flags++) {
+      check_shared_scan(data, NULL, lengths[l], lower_bound_arr,
+                        upper_bound_arr, 6, flags, false, false);
+      check_shared_scan(data, NULL, lengths[l], lower_bound_arr,
+                        upper_bound_arr, 6, flags, false, true);
+    }
+    free(data);
+  }
+}
+
+/**
+ * Test shared scans with select queries whose bounds exceed the int range.
+ */
+void test_shared_scan_extreme_bounds() {
+  size_t length = 1003;
+  int *data = random_data(length, 100);
+  data[0] = INT_MIN;
+  data[1] = INT_MAX;
+  data[length - 1] = INT_MIN;
+
+  long lower_bound_arr[] = {LONG_MIN, (long)INT_MIN - 1, INT_MIN,
+                            (long)INT_MAX + 1, 0, INT_MAX};
+  long upper_bound_arr[] = {LONG_MAX, (long)INT_MAX + 1, (long)INT_MIN + 1,
+                            LONG_MAX, (long)INT_MAX + 1, INT_MAX};
+  for (int flags = 0x01; flags <= 0x0f; flags++) {
+    check_shared_scan(data, NULL, length, lower_bound_arr, upper_bound_arr, 6,
+                      flags, false, false);
+    check_shared_scan(data, NULL, length, lower_bound_arr, upper_bound_arr, 6,
+                      flags, false, true);
+  }
+  free(data);
+}
+
+/**
+ * Test shared scans with a batch of select queries large enough to be matched
+ * via the elementary intervals of the queries.
+ */
+void test_shared_scan_many_queries() {
+  size_t length = 20003;
+  int *data = random_data(length, 100);
+  data[0] = INT_MIN;
+  data[1] = INT_MAX;
+
+  // Random (possibly overlapping, empty, or duplicated) bounds, plus extreme
+  // ones that exceed the int range
+  size_t n_select_queries = 200;
+  long lower_bound_arr[n_select_queries];
+  long upper_bound_arr[n_select_queries];
+  for (size_t c = 0; c < n_select_queries; c++) {
+    lower_bound_arr[c] = rand() % 240 - 120;
+    upper_bound_arr[c] = lower_bound_arr[c] + rand() % 60 - 10;
+  }
+  upper_bound_arr[0] = lower_bound_arr[0];
+  lower_bound_arr[1] = lower_bound_arr[2];
+  upper_bound_arr[1] = upper_bound_arr[2];
+  lower_bound_arr[3] = LONG_MIN;
+  upper_bound_arr[3] = LONG_MAX;
+  lower_bound_arr[4] = INT_MAX;
+  upper_bound_arr[4] = (long)INT_MAX + 1;
+
+  for (int flags = 0x01; flags <= 0x0f; flags += 2) {
+    check_shared_scan(data, NULL, length, lower_bound_arr, upper_bound_arr,
+                      n_select_queries, flags, false, false);
+    check_shared_scan(data, NULL, length, lower_bound_arr, upper_bound_arr,
+                      n_select_queries, flags, false, true);
+  }
+  free(data);
+}
+
+/**
+ * Test shared scans over a whole column that skip zones via its zone map.
+ */
+void test_shared_scan_zone_map() {
+  // Time-correlated data, so that most zones can be skipped by narrow queries
+  size_t n_rows = 10 * ZONE_MAP_BLOCK_SIZE + 123;
+  int data[n_rows];
+  for (size_t i = 0; i < n_rows; i++) {
+    data[i] = (int)(i / 100) + rand() % 10;
+  }
+  Table table = {.n_rows = n_rows, .capacity = n_rows};
+  Column column = {.data = data};
+  assert(init_zone_map(&table, &column, false) == DB_SCHEMA_STATUS_OK);
+
+  // Overwrite some values so that their zones become conservative
+  for (size_t i = 0; i < n_rows; i += 997) {
+    data[i] = rand() % 500;
+    widen_zone_map(&column, i, data[i]);
+  }
+
+  GeneralizedValvec valvec = {.valvec_type = GENERALIZED_VALVEC_TYPE_COLUMN,
+                              .valvec_pointer.column = &column,
+                              .valvec_length = n_rows};
+  long lower_bound_arr[] = {0, 150, 390, 420, 1000};
+  long upper_bound_arr[] = {5, 160, 395, 421, 2000};
+  ScanContext ctx = init_empty_scan_context();
+  ctx.n_select_queries = 5;
+  ctx.lower_bound_arr = lower_bound_arr;
+  ctx.upper_bound_arr = upper_bound_arr;
+  assert(shared_scan(&valvec, NULL, &ctx, SCAN_CALLBACK_SELECT_FLAG) ==
+         DB_SCHEMA_STATUS_OK);
+
+  for (size_t c = 0; c < 5; c++) {
+    size_t n_expected = 0;
+    for (size_t i = 0; i < n_rows; i++) {
+      if (data[i] >= lower_bound_arr[c] && data[i] < upper_bound_arr[c]) {
+        assert(n_expected < ctx.n_selected_indices_arr[c]);
+        assert(ctx.selected_indices_arr[c][n_expected++] == i);
+      }
+    }
+    assert(ctx.n_selected_indices_arr[c] == n_expected);
+    free(ctx.selected_indices_arr[c]);
+  }
+  free(ctx.selected_indices_arr);
+  free(ctx.n_selected_indices_arr);
+  free_zone_map(&column);
+}
+
+/**
+ * Test shared scans restricted by a position vector.
+ */
+void test_shared_scan_posvec() {
+  size_t length = 50003;
+  int *data = random_data(length, 100);
+  size_t *indices = malloc(length * sizeof(size_t));
+  assert(indices != NULL);
+  for (size_t i = 0; i < length; i++) {
+    indices[i] = 3 * i + rand() % 3;
+  }
+
+  long lower_bound_arr[] = {-50, 0, -1000};
+  long upper_bound_arr[] = {50, 1, 1000};
+  for (int as_mask = 0; as_mask <= 1; as_mask++) {
+    for (int to_masks = 0; to_masks <= as_mask; to_masks++) {
+      check_shared_scan(data, indices, length, lower_bound_arr,
+                        upper_bound_arr, 3, SCAN_CALLBACK_SELECT_FLAG, as_mask,
+                        to_masks);
+    }
+  }
+  free(indices);
+  free(data);
+}
+
+/**
+ * Test aggregations over the values at the positions of a position vector,
+ * given both as an index array and as a boolean mask, against a brute-force
+ * evaluation over the gathered values.
+ */
+void test_shared_scan_gather() {
+  size_t length = 150011;
+  int *data = random_data(length, 1000);
+  PartialColumn partial_column = {.values = data};
+  GeneralizedValvec valvec = {
+      .valvec_type = GENERALIZED_VALVEC_TYPE_PARTIAL_COLUMN,
+      .valvec_pointer.partial_column = &partial_column,
+      .valvec_length = length};
+
+  // Select about a third of the positions, in increasing order, and put the
+  // positions in both forms
+  size_t *indices = malloc(length * sizeof(size_t));
+  assert(indices != NULL);
+  BitVector *mask = bitvector_create(length);
+  assert(mask != NULL);
+  size_t n_indices = 0;
+  for (size_t i = 0; i < length; i++) {
+    if (rand() % 3 == 0) {
+      indices[n_indices++] = i;
+      bitvector_set(mask, i);
+    }
+  }
+  IndexArray index_array = {.n_indices = n_indices, .indices = indices};
+  BooleanMask boolean_mask = {.n_set = n_indices, .mask = mask};
+
+  int min_result = INT_MAX;
+  int max_result = INT_MIN;
+  long long sum_result = 0;
+  for (size_t i = 0; i < n_indices; i++) {
+    int value = data[indices[i]];
+    min_result = value < min_result ? value : min_result;
+    max_result = value > max_result ? value : max_result;
+    sum_result += value;
+  }
+
+  for (int as_mask = 0; as_mask <= 1; as_mask++) {
+    GeneralizedPosvec posvec = {
+        .posvec_type = as_mask ? GENERALIZED_POSVEC_TYPE_BOOLEAN_MASK
+                               : GENERALIZED_POSVEC_TYPE_INDEX_ARRAY,
+        .posvec_pointer.index_array = &index_array};
+    if (as_mask) {
+      posvec.posvec_pointer.boolean_mask = &boolean_mask;
+    }
+    for (int flags = 0x02; flags <= 0x0e; flags += 0x02) {
+      ScanContext ctx = init_empty_scan_context();
+      assert(shared_scan_gather(&valvec, &posvec, &ctx, flags) ==
+             DB_SCHEMA_STATUS_OK);
+      assert(ctx.gather_posvec == NULL);
+      assert(!(flags & SCAN_CALLBACK_MIN_FLAG) || ctx.min_result == min_result);
+      assert(!(flags & SCAN_CALLBACK_MAX_FLAG) || ctx.max_result == max_result);
+      assert(!(flags & SCAN_CALLBACK_SUM_FLAG) || ctx.sum_result == sum_result);
+    }
+  }
+
+  bitvector_free(mask);
+  free(indices);
+  free(data);
+}
+
+/**
+ * Test aggregations fused with a select and a fetch, with both the scalar and
+ * the AVX2 kernels, against a brute-force evaluation of the select, the fetch,
+ * and the aggregation one after another.
+ */
+void test_shared_scan_fused() {
+  size_t length = 100003;
+  int *data = random_data(length, 1000);
+  int *fetch_data = random_data(length, 1 << 29);
+  PartialColumn partial_column = {.values = data};
+  GeneralizedValvec valvec = {
+      .valvec_type = GENERALIZED_VALVEC_TYPE_PARTIAL_COLUMN,
+      .valvec_pointer.partial_column = &partial_column,
+      .valvec_length = length};
+  PartialColumn fetch_partial_column = {.values = fetch_data};
+  GeneralizedValvec fetch_valvec = {
+      .valvec_type = GENERALIZED_VALVEC_TYPE_PARTIAL_COLUMN,
+      .valvec_pointer.partial_column = &fetch_partial_column,
+      .valvec_length = length};
+
+  long lower_bound_arr[] = {-500, 0, LONG_MIN, 1000, 10};
+  long upper_bound_arr[] = {500, 1, LONG_MAX, 2000, -10};
+  bool has_avx2 = __has_avx2__;
+  for (size_t c = 0; c < sizeof(lower_bound_arr) / sizeof(long); c++) {
+    int min_result = INT_MAX;
+    int max_result = INT_MIN;
+    long long sum_result = 0;
+    size_t count_result = 0;
+    for (size_t i = 0; i < length; i++) {
+      if (data[i] >= lower_bound_arr[c] && data[i] < upper_bound_arr[c]) {
+        int value = fetch_data[i];
+        min_result = value < min_result ? value : min_result;
+        max_result = value > max_result ? value : max_result;
+        sum_result += value;
+        count_result++;
+      }
+    }
+
+    for (int use_avx2 = 0; use_avx2 <= has_avx2; use_avx2++) {
+      __has_avx2__ = use_avx2;
+      for (int flags = 0x02; flags <= 0x0e; flags += 0x02) {
+        ScanContext ctx = init_empty_scan_context();
+        ctx.n_select_queries = 1;
+        ctx.lower_bound_arr = &lower_bound_arr[c];
+        ctx.upper_bound_arr = &upper_bound_arr[c];
+        assert(shared_scan_fused(&valvec, &fetch_valvec, &ctx, flags) ==
+               DB_SCHEMA_STATUS_OK);
+        assert(ctx.fetch_valvec == NULL);
+        assert(ctx.count_result == count_result);
+        assert(!(flags & SCAN_CALLBACK_MIN_FLAG) ||
+               ctx.min_result == min_result);
+        assert(!(flags & SCAN_CALLBACK_MAX_FLAG) ||
+               ctx.max_result == max_result);
+        assert(!(flags & SCAN_CALLBACK_SUM_FLAG) ||
+               ctx.sum_result == sum_result);
+      }
+    }
+  }
+  __has_avx2__ = has_avx2;
+
+  free(fetch_data);
+  free(data);
+}
+
+int main() {
+  srand(42);
+  init_sysinfo();
+
+  __multi_threaded__ = false;
+  TEST(shared_scan_random);
+  TEST(shared_scan_extreme_bounds);
+  TEST(shared_scan_many_queries);
+  TEST(shared_scan_zone_map);
+  TEST(shared_scan_posvec);
+  TEST(shared_scan_gather);
+  TEST(shared_scan_fused);
+
+  // Pretend to have more processors and much smaller caches than we may have,
+  // so that even the small test inputs are split into many parallel tasks
+  __multi_threaded__ = true;
+  __n_processors__ = 8;
+  __l1d_cache_size__ = 256;
+  __l2_cache_size__ = 4096;
+  __thread_pool__ = malloc(sizeof(ThreadPool));
+  assert(__thread_pool__ != NULL);
+  thread_pool_init(__thread_pool__, 4, handle_thread_task);
+  TEST(shared_scan_random);
+  TEST(shared_scan_extreme_bounds);
+  TEST(shared_scan_many_queries);
+  TEST(shared_scan_zone_map);
+  TEST(shared_scan_posvec);
+  TEST(shared_scan_gather);
+  TEST(shared_scan_fused);
+  thread_pool_shutdown(__thread_pool__);
+  free(__thread_pool__);
+
+  return 0;
+}
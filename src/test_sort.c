@@ -370,6 +370,50 @@ void test_akmerge() {
   }
 }
 
+/**
+ * Test the radixsort function.
+ */
+void test_radixsort() {
+  srand(0);
+  const size_t size = 10000;
+
+  // Generate random positions, the first half within a small range so that
+  // their high digits are the same, and the second half across many digits
+  size_t positions[size];
+  size_t positions_true[size];
+  for (size_t i = 0; i < size; i++) {
+    positions[i] = i < size / 2 ? (size_t)rand() % 1000
+                                : (size_t)rand() * (size_t)rand();
+  }
+
+  // Sort the first half and check against an insertion sort
+  memcpy(positions_true, positions, size / 2 * sizeof(size_t));
+  radixsort(positions, size / 2);
+  for (size_t i = 1; i < size / 2; i++) {
+    size_t current = positions_true[i];
+    size_t j = i;
+    for (; j > 0 && positions_true[j - 1] > current; j--) {
+      positions_true[j] = positions_true[j - 1];
+    }
+    positions_true[j] = current;
+  }
+  for (size_t i = 0; i < size / 2; i++) {
+    assert(positions[i] == positions_true[i]);
+  }
+
+  // Sort all positions; check that they are sorted and that the sum is kept
+  size_t sum = 0;
+  for (size_t i = 0; i < size; i++) {
+    sum += positions[i];
+  }
+  radixsort(positions, size);
+  for (size_t i = 0; i < size - 1; i++) {
+    assert(positions[i] <= positions[i + 1]);
+    sum -= positions[i];
+  }
+  assert(sum == positions[size - 1]);
+}
+
 int main() {
   TEST(quicksort);
   TEST(aquicksort);
@@ -377,5 +421,6 @@ int main() {
   TEST(amerge);
   TEST(kmerge);
   TEST(akmerge);
+  TEST(radixsort);
   return 0;
 }
@@ -0,0 +1,151 @@
+#include <assert.h>
+#include <sched.h>
+#include <stdlib.h>
+
+#include "testing.h"
+#include "thread_pool.h"
+
+/**
+ * Data of a test task that forks `n_subtasks` leaf tasks, each of which spins
+ * for `work` iterations and then increments `counter`.
+ */
+typedef struct TestTaskData {
+  int n_subtasks;
+  int work;
+  int *counter;
+} TestTaskData;
+
+static ThreadPool pool;
+
+/**
+ * Helper function to fork a task group of leaf tasks and join them.
+ */
+static void fork_join_leaves(TestTaskData *data) {
+  TestTaskData *leaves = malloc(data->n_subtasks * sizeof(TestTaskData));
+  assert(data->n_subtasks == 0 || leaves != NULL);
+  for (int i = 0; i < data->n_subtasks; i++) {
+    leaves[i] = *data;
+  }
+  ThreadTaskGroup group;
+  thread_task_group_init(&group);
+  thread_pool_enqueue_group(&pool, &group, THREAD_TASK_TYPE_LOAD_CHUNK, leaves,
+                            sizeof(TestTaskData), data->n_subtasks);
+  thread_pool_wait_group(&pool, &group);
+  free(leaves);
+}
+
+/**
+ * Task handler of the thread pool used for the tests.
+ *
+ * Load chunk tasks are the leaves; hash join tasks and client request tasks
+ * fork leaves (the latter is not part of any task group, like in the server).
+ */
+static void handle_thread_task(ThreadTask *task) {
+  TestTaskData *data = task->data;
+  volatile unsigned sink = 0;
+  switch (task->type) {
+  case THREAD_TASK_TYPE_LOAD_CHUNK:
+    for (int i = 0; i < data->work; i++) {
+      sink += (unsigned)i;
+    }
+    __atomic_fetch_add(data->counter, 1, __ATOMIC_RELAXED);
+    break;
+  case THREAD_TASK_TYPE_HASH_JOIN:
+    fork_join_leaves(data);
+    break;
+  case THREAD_TASK_TYPE_CLIENT_REQUEST:
+    fork_join_leaves(data);
+    __atomic_fetch_add(data->counter, 1000000, __ATOMIC_RELEASE);
+    break;
+  default:
+    assert(0 && "Unreachable code.");
+  }
+}
+
+/**
+ * Test a single task group with more tasks than the shared task queue can hold,
+ * and of uneven sizes, enqueued in several batches.
+ */
+void test_single_group() {
+  int counter = 0;
+  int n_tasks = 3 * THREAD_TASK_QUEUE_SIZE;
+  TestTaskData data[n_tasks];
+  for (int i = 0; i < n_tasks; i++) {
+    data[i] = (TestTaskData){
+        .n_subtasks = 0, .work = rand() % 100000, .counter = &counter};
+  }
+  ThreadTaskGroup group;
+  thread_task_group_init(&group);
+  for (int i = 0; i < n_tasks; i += THREAD_TASK_QUEUE_SIZE / 2) {
+    thread_pool_enqueue_group(&pool, &group, THREAD_TASK_TYPE_LOAD_CHUNK,
+                              &data[i], sizeof(TestTaskData),
+                              THREAD_TASK_QUEUE_SIZE / 2);
+  }
+  thread_pool_wait_group(&pool, &group);
+  assert(__atomic_load_n(&counter, __ATOMIC_ACQUIRE) == n_tasks);
+}
+
+/**
+ * Test tasks that fork subtasks and join them, including more subtasks than a
+ * worker deque can hold.
+ */
+void test_nested_groups() {
+  int counter = 0;
+  int n_tasks = 64;
+  int n_subtasks_total = 0;
+  TestTaskData data[n_tasks];
+  for (int i = 0; i < n_tasks; i++) {
+    int n_subtasks = i == 0 ? 2 * THREAD_TASK_DEQUE_SIZE : rand() % 64;
+    data[i] = (TestTaskData){
+        .n_subtasks = n_subtasks, .work = 1000, .counter = &counter};
+    n_subtasks_total += n_subtasks;
+  }
+  ThreadTaskGroup group;
+  thread_task_group_init(&group);
+  thread_pool_enqueue_group(&pool, &group, THREAD_TASK_TYPE_HASH_JOIN, data,
+                            sizeof(TestTaskData), n_tasks);
+  thread_pool_wait_group(&pool, &group);
+  assert(__atomic_load_n(&counter, __ATOMIC_ACQUIRE) == n_subtasks_total);
+}
+
+/**
+ * Test concurrent tasks outside of any task group that each fork and join their
+ * own task group, like client requests do in the server.
+ */
+void test_concurrent_groups() {
+  int n_tasks = 32;
+  int counters[n_tasks];
+  TestTaskData data[n_tasks];
+  for (int i = 0; i < n_tasks; i++) {
+    counters[i] = 0;
+    data[i] = (TestTaskData){
+        .n_subtasks = 1 + rand() % 128, .work = 10000, .counter = &counters[i]};
+    ThreadTask task = {.id = next_task_id(),
+                       .type = THREAD_TASK_TYPE_CLIENT_REQUEST,
+                       .data = &data[i]};
+    thread_pool_enqueue_task(&pool, &task);
+  }
+
+  // Each counter is marked by its request only after all its leaves are done
+  for (int i = 0; i < n_tasks; i++) {
+    while (__atomic_load_n(&counters[i], __ATOMIC_ACQUIRE) < 1000000) {
+      sched_yield();
+    }
+    assert(counters[i] == 1000000 + data[i].n_subtasks);
+  }
+}
+
+int main() {
+  srand(42);
+
+  int n_workers_arr[] = {1, 4};
+  for (size_t i = 0; i < sizeof(n_workers_arr) / sizeof(int); i++) {
+    thread_pool_init(&pool, n_workers_arr[i], handle_thread_task);
+    TEST(single_group);
+    TEST(nested_groups);
+    TEST(concurrent_groups);
+    thread_pool_shutdown(&pool);
+  }
+
+  return 0;
+}
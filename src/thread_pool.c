@@ -3,42 +3,353 @@
  * @implements thread_pool.h
  */
 
+#include <assert.h>
 #include <limits.h>
+#include <sched.h>
 #include <stdlib.h>
 
+#include "logging.h"
 #include "thread_pool.h"
 
-static int global_task_id = 0;
+static unsigned int global_task_id = 0;
+
+/**
+ * The worker that the current thread is, or NULL if it is not a worker of any
+ * thread pool.
+ */
+static __thread ThreadWorker *current_worker = NULL;
+
+/**
+ * The number of nested waits for task groups on the current thread.
+ */
+static __thread int current_wait_depth = 0;
 
 /**
  * @implements next_task_id
  */
 int next_task_id() {
-  global_task_id = (global_task_id + 1) % INT_MAX;
-  return global_task_id;
+  // Task IDs may be requested by multiple client connections concurrently
+  unsigned int id = __atomic_add_fetch(&global_task_id, 1, __ATOMIC_RELAXED);
+  return (int)(id % INT_MAX);
+}
+
+/**
+ * Helper function to get the worker of a thread pool that the current thread
+ * is, or NULL if it is not a worker of the thread pool.
+ */
+static inline ThreadWorker *_current_worker(ThreadPool *pool) {
+  if (current_worker != NULL && current_worker->pool == pool) {
+    return current_worker;
+  }
+  return NULL;
+}
+
+/**
+ * Helper function to push a task to the bottom of a deque.
+ *
+ * This must only be called by the owner of the deque. This function returns
+ * whether the task is pushed, i.e., false if the deque is full.
+ */
+static inline bool _deque_push(ThreadTaskDeque *deque, ThreadTask *task) {
+  long bottom = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED);
+  long top = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+  if (bottom - top >= THREAD_TASK_DEQUE_SIZE) {
+    return false;
+  }
+  deque->tasks[bottom & (THREAD_TASK_DEQUE_SIZE - 1)] = *task;
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+  return true;
+}
+
+/**
+ * Helper function to pop a task from the bottom of a deque.
+ *
+ * This must only be called by the owner of the deque. The owner and a thief
+ * race for the last task with a compare-and-swap on the top index. This
+ * function returns whether a task is popped.
+ */
+static inline bool _deque_pop(ThreadTaskDeque *deque, ThreadTask *task) {
+  long bottom = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED) - 1;
+  __atomic_store_n(&deque->bottom, bottom, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  long top = __atomic_load_n(&deque->top, __ATOMIC_RELAXED);
+
+  if (top > bottom) {
+    // The deque is empty
+    __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+    return false;
+  }
+  *task = deque->tasks[bottom & (THREAD_TASK_DEQUE_SIZE - 1)];
+  if (top < bottom) {
+    // There are other tasks left so no thief can take this one
+    return true;
+  }
+  bool won = __atomic_compare_exchange_n(&deque->top, &top, top + 1, false,
+                                         __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+  __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+  return won;
+}
+
+/**
+ * Helper function to steal a task from the top of a deque.
+ *
+ * This can be called by any thread. The task is copied before the top index is
+ * advanced, and the copy is discarded if another thread has taken the task in
+ * the meantime. This function returns whether a task is stolen.
+ */
+static inline bool _deque_steal(ThreadTaskDeque *deque, ThreadTask *task) {
+  long top = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  long bottom = __atomic_load_n(&deque->bottom, __ATOMIC_ACQUIRE);
+  if (top >= bottom) {
+    return false;
+  }
+  *task = deque->tasks[top & (THREAD_TASK_DEQUE_SIZE - 1)];
+  return __atomic_compare_exchange_n(&deque->top, &top, top + 1, false,
+                                     __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+}
+
+/**
+ * Helper function to check whether a deque may have tasks to steal.
+ */
+static inline bool _deque_has_task(ThreadTaskDeque *deque) {
+  return __atomic_load_n(&deque->top, __ATOMIC_SEQ_CST) <
+         __atomic_load_n(&deque->bottom, __ATOMIC_SEQ_CST);
+}
+
+/**
+ * Helper function to take a task out of the shared task queue.
+ *
+ * If `group_only` is true, only tasks that are part of a task group are taken,
+ * and tasks in front of the taken task are shifted back by one slot so that the
+ * queue stays contiguous and keeps its order. This function returns whether
+ * such a task is found.
+ */
+static inline bool _queue_take(ThreadTaskQueue *queue, ThreadTask *task,
+                               bool group_only) {
+  // Avoid contending on the mutex when the queue is most likely empty
+  if (__atomic_load_n(&queue->count, __ATOMIC_RELAXED) == 0) {
+    return false;
+  }
+  pthread_mutex_lock(&queue->mutex);
+  for (int i = 0; i < queue->count; i++) {
+    int pos = (queue->front + i) % THREAD_TASK_QUEUE_SIZE;
+    if (group_only && queue->tasks[pos].group == NULL) {
+      continue;
+    }
+    *task = queue->tasks[pos];
+    for (int j = i; j > 0; j--) {
+      queue->tasks[(queue->front + j) % THREAD_TASK_QUEUE_SIZE] =
+          queue->tasks[(queue->front + j - 1) % THREAD_TASK_QUEUE_SIZE];
+    }
+    queue->front = (queue->front + 1) % THREAD_TASK_QUEUE_SIZE;
+    __atomic_store_n(&queue->count, queue->count - 1, __ATOMIC_RELAXED);
+    pthread_cond_signal(&queue->cond_non_full);
+    pthread_mutex_unlock(&queue->mutex);
+    return true;
+  }
+  pthread_mutex_unlock(&queue->mutex);
+  return false;
+}
+
+/**
+ * Helper function to steal a task from any worker of a thread pool other than
+ * the specified one (which can be NULL), visiting the victims in a round-robin
+ * order starting after it. This function returns whether a task is stolen.
+ */
+static inline bool _steal_task(ThreadPool *pool, ThreadWorker *self,
+                               ThreadTask *task) {
+  int start = self == NULL ? 0 : self->index + 1;
+  for (int i = 0; i < pool->n_workers; i++) {
+    ThreadWorker *victim = &pool->workers[(start + i) % pool->n_workers];
+    if (victim != self && _deque_steal(&victim->deque, task)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * Helper function to find a task to run.
+ *
+ * Tasks are looked for in the deque of the worker (if any), then in the shared
+ * task queue, then in the deques of the other workers. If `group_only` is true,
+ * tasks in the shared task queue that are not part of any task group (i.e.,
+ * client requests) are left there; the deques only hold tasks that are part of
+ * some task group. This function returns whether a task is found.
+ */
+static inline bool _find_task(ThreadPool *pool, ThreadWorker *self,
+                              ThreadTask *task, bool group_only) {
+  if (self != NULL && _deque_pop(&self->deque, task)) {
+    return true;
+  }
+  if (_queue_take(&pool->queue, task, group_only)) {
+    return true;
+  }
+  return _steal_task(pool, self, task);
+}
+
+/**
+ * Helper function to check whether there may be a task to run anywhere in a
+ * thread pool.
+ */
+static inline bool _has_task(ThreadPool *pool) {
+  pthread_mutex_lock(&pool->queue.mutex);
+  bool has_task = pool->queue.count > 0;
+  pthread_mutex_unlock(&pool->queue.mutex);
+  for (int i = 0; !has_task && i < pool->n_workers; i++) {
+    has_task = _deque_has_task(&pool->workers[i].deque);
+  }
+  return has_task;
+}
+
+/**
+ * Helper function to wake up parked workers for the specified number of tasks
+ * that have been made available, if any worker is parked.
+ *
+ * The full fence pairs with the one of a parking worker, so that either the
+ * parking worker sees the tasks or we see the parking worker. The queue mutex
+ * must not be held by the caller, since parking workers check the queue while
+ * holding the park mutex.
+ */
+static inline void _unpark_workers(ThreadPool *pool, int n_tasks) {
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&pool->n_parked, __ATOMIC_SEQ_CST) > 0) {
+    pthread_mutex_lock(&pool->park_mutex);
+    if (n_tasks > 1) {
+      pthread_cond_broadcast(&pool->cond_park);
+    } else {
+      pthread_cond_signal(&pool->cond_park);
+    }
+    pthread_mutex_unlock(&pool->park_mutex);
+  }
+}
+
+/**
+ * Helper function to append a task to the shared task queue.
+ *
+ * The queue mutex must be held by the caller, and the queue must not be full.
+ */
+static inline void _queue_push(ThreadTaskQueue *queue, ThreadTask *task) {
+  queue->rear = (queue->rear + 1) % THREAD_TASK_QUEUE_SIZE;
+  queue->tasks[queue->rear] = *task;
+  __atomic_store_n(&queue->count, queue->count + 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * Helper function to wait until the shared task queue is not full.
+ *
+ * The queue mutex must be held by the caller. The workers are waked up before
+ * waiting, since they may have parked before the tasks enqueued so far are
+ * announced; the queue mutex is released in the meantime as required by
+ * `_unpark_workers`.
+ */
+static inline void _queue_wait_non_full(ThreadPool *pool) {
+  while (pool->queue.count >= THREAD_TASK_QUEUE_SIZE) {
+    pthread_mutex_unlock(&pool->queue.mutex);
+    _unpark_workers(pool, THREAD_TASK_QUEUE_SIZE);
+    pthread_mutex_lock(&pool->queue.mutex);
+    if (pool->queue.count >= THREAD_TASK_QUEUE_SIZE) {
+      pthread_cond_wait(&pool->queue.cond_non_full, &pool->queue.mutex);
+    }
+  }
+}
+
+/**
+ * Helper function to run a task and mark its completion in its task group,
+ * waking up the threads waiting for task groups to complete if any.
+ */
+static inline void _run_task(ThreadPool *pool, ThreadTask *task) {
+  pool->task_handler(task);
+  if (task->group == NULL) {
+    return;
+  }
+  __atomic_fetch_add(&task->group->n_completed, 1, __ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&pool->n_waiting, __ATOMIC_SEQ_CST) > 0) {
+    pthread_mutex_lock(&pool->completion_mutex);
+    pthread_cond_broadcast(&pool->cond_completed);
+    pthread_mutex_unlock(&pool->completion_mutex);
+  }
+}
+
+/**
+ * The worker function of a thread pool.
+ *
+ * This function continuously looks for tasks and passes them to the task
+ * handler of the thread pool. If no task is found after a number of attempts,
+ * the worker parks until a task is enqueued. The worker thread will terminate
+ * when the thread pool initializes a shutdown.
+ */
+static void *_thread_pool_worker(void *arg) {
+  ThreadWorker *self = arg;
+  ThreadPool *pool = self->pool;
+  current_worker = self;
+
+  int n_failed_rounds = 0;
+  while (!__atomic_load_n(&pool->shutdown_inited, __ATOMIC_ACQUIRE)) {
+    ThreadTask task;
+    if (_find_task(pool, self, &task, false)) {
+      _run_task(pool, &task);
+      n_failed_rounds = 0;
+      continue;
+    }
+    if (++n_failed_rounds < THREAD_POOL_SPIN_ROUNDS) {
+      sched_yield();
+      continue;
+    }
+
+    // Park until a task is enqueued; the parking is announced before checking
+    // for tasks for the last time so that no wake-up can be missed
+    pthread_mutex_lock(&pool->park_mutex);
+    __atomic_fetch_add(&pool->n_parked, 1, __ATOMIC_SEQ_CST);
+    if (!pool->shutdown_inited && !_has_task(pool)) {
+      pthread_cond_wait(&pool->cond_park, &pool->park_mutex);
+    }
+    __atomic_fetch_sub(&pool->n_parked, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&pool->park_mutex);
+    n_failed_rounds = 0;
+  }
+
+  log_file(stdout, "  [%lu] Thread exiting\n", pthread_self());
+  return NULL;
 }
 
 /**
  * @implements thread_pool_init
  */
 void thread_pool_init(ThreadPool *pool, int n_workers,
-                      void *(*worker_func)(void *)) {
-  // Initialize the task queue
+                      void (*task_handler)(ThreadTask *)) {
+  // Initialize the shared task queue
   pool->queue.front = 0;
   pool->queue.rear = -1;
   pool->queue.count = 0;
-  pool->queue.n_completed = 0;
   pthread_mutex_init(&pool->queue.mutex, NULL);
-  pthread_cond_init(&pool->queue.cond_non_empty, NULL);
   pthread_cond_init(&pool->queue.cond_non_full, NULL);
-  pthread_cond_init(&pool->queue.cond_completed, NULL);
 
   // Initialize the thread pool
   pool->shutdown_inited = false;
+  pthread_mutex_init(&pool->park_mutex, NULL);
+  pthread_cond_init(&pool->cond_park, NULL);
+  pool->n_parked = 0;
+  pthread_mutex_init(&pool->completion_mutex, NULL);
+  pthread_cond_init(&pool->cond_completed, NULL);
+  pool->n_waiting = 0;
+  pool->task_handler = task_handler;
   pool->n_workers = n_workers;
-  pool->workers = malloc(n_workers * sizeof(pthread_t));
+
+  // Initialize all deques before starting any worker since workers may steal
+  // from each other right away
+  pool->workers = malloc(n_workers * sizeof(ThreadWorker));
+  for (int i = 0; i < n_workers; i++) {
+    pool->workers[i].index = i;
+    pool->workers[i].pool = pool;
+    pool->workers[i].deque.top = 0;
+    pool->workers[i].deque.bottom = 0;
+  }
   for (int i = 0; i < n_workers; i++) {
-    pthread_create(&pool->workers[i], NULL, worker_func, NULL);
+    pthread_create(&pool->workers[i].thread, NULL, _thread_pool_worker,
+                   &pool->workers[i]);
   }
 }
 
@@ -46,115 +357,128 @@ void thread_pool_init(ThreadPool *pool, int n_workers,
  * @implements thread_pool_shutdown
  */
 void thread_pool_shutdown(ThreadPool *pool) {
-  // Wake up all workers; otherwise workers may be waiting for being signaled
-  // because of an empty task queue at some point, not noticing that the thread
-  // pool is shutting down
-  pthread_mutex_lock(&pool->queue.mutex);
-  pool->shutdown_inited = true;
-  pthread_cond_broadcast(&pool->queue.cond_non_empty);
-  pthread_mutex_unlock(&pool->queue.mutex);
+  // Wake up all workers; otherwise parked workers would not notice that the
+  // thread pool is shutting down
+  pthread_mutex_lock(&pool->park_mutex);
+  __atomic_store_n(&pool->shutdown_inited, true, __ATOMIC_RELEASE);
+  pthread_cond_broadcast(&pool->cond_park);
+  pthread_mutex_unlock(&pool->park_mutex);
 
   for (int i = 0; i < pool->n_workers; i++) {
-    pthread_join(pool->workers[i], NULL);
+    pthread_join(pool->workers[i].thread, NULL);
   }
   free(pool->workers);
 
-  // Destroy the task queue
+  // Destroy the task queue and the synchronization primitives
   pthread_mutex_destroy(&pool->queue.mutex);
-  pthread_cond_destroy(&pool->queue.cond_non_empty);
   pthread_cond_destroy(&pool->queue.cond_non_full);
-  pthread_cond_destroy(&pool->queue.cond_completed);
+  pthread_mutex_destroy(&pool->park_mutex);
+  pthread_cond_destroy(&pool->cond_park);
+  pthread_mutex_destroy(&pool->completion_mutex);
+  pthread_cond_destroy(&pool->cond_completed);
 }
 
 /**
  * @implements thread_pool_enqueue_task
  */
 void thread_pool_enqueue_task(ThreadPool *pool, ThreadTask *task) {
+  task->group = NULL;
   pthread_mutex_lock(&pool->queue.mutex);
-
-  // The task queue is full, wait for a consumer to dequeue a task
-  while (pool->queue.count >= THREAD_TASK_QUEUE_SIZE) {
-    pthread_cond_wait(&pool->queue.cond_non_full, &pool->queue.mutex);
-  }
-
-  // Enqueue a task
-  pool->queue.rear = (pool->queue.rear + 1) % THREAD_TASK_QUEUE_SIZE;
-  pool->queue.tasks[pool->queue.rear] = *task;
-  pool->queue.count++;
-
-  // Signal that the task queue is not empty because we have just added a task
-  pthread_cond_signal(&pool->queue.cond_non_empty);
+  _queue_wait_non_full(pool);
+  _queue_push(&pool->queue, task);
   pthread_mutex_unlock(&pool->queue.mutex);
+  _unpark_workers(pool, 1);
 }
 
 /**
- * @implements thread_pool_dequeue_task
+ * @implements thread_task_group_init
  */
-ThreadTask thread_pool_dequeue_task(ThreadPool *pool) {
-  pthread_mutex_lock(&pool->queue.mutex);
+void thread_task_group_init(ThreadTaskGroup *group) {
+  group->n_tasks = 0;
+  group->n_completed = 0;
+}
 
-  // If the thread pool has initialized a shutdown, we should no longer consume
-  // any tasks from the queue
-  if (pool->shutdown_inited) {
-    pthread_mutex_unlock(&pool->queue.mutex);
-    return (ThreadTask){
-        .id = next_task_id(), .type = THREAD_TASK_TYPE_TERMINATE, .data = NULL};
-  }
+/**
+ * @implements thread_pool_enqueue_group
+ */
+void thread_pool_enqueue_group(ThreadPool *pool, ThreadTaskGroup *group,
+                               ThreadTaskType type, void *data,
+                               size_t data_size, int n_tasks) {
+  group->n_tasks += n_tasks;
+  char *arena = data;
 
-  // The task queue is empty, wait for a producer to enqueue a task; note that
-  // the thread pool could have initialized a shutdown while we are waiting,
-  // so we need to re-check the shutdown flag every time we are waked up
-  while (pool->queue.count <= 0 && !pool->shutdown_inited) {
-    pthread_cond_wait(&pool->queue.cond_non_empty, &pool->queue.mutex);
+  // Tasks forked by a worker go to its own deque; if the deque is full, running
+  // the task right away is as good as waiting for someone to take it
+  ThreadWorker *self = _current_worker(pool);
+  if (self != NULL) {
+    for (int i = 0; i < n_tasks; i++) {
+      ThreadTask task = {.id = next_task_id(),
+                         .type = type,
+                         .data = arena + i * data_size,
+                         .group = group};
+      if (!_deque_push(&self->deque, &task)) {
+        _run_task(pool, &task);
+      }
+    }
+    _unpark_workers(pool, n_tasks);
+    return;
   }
 
-  // Re-check the shutdown flag after being waked up
-  if (pool->shutdown_inited) {
-    pthread_mutex_unlock(&pool->queue.mutex);
-    return (ThreadTask){
-        .id = next_task_id(), .type = THREAD_TASK_TYPE_TERMINATE, .data = NULL};
+  pthread_mutex_lock(&pool->queue.mutex);
+  for (int i = 0; i < n_tasks; i++) {
+    ThreadTask task = {.id = next_task_id(),
+                       .type = type,
+                       .data = arena + i * data_size,
+                       .group = group};
+    _queue_wait_non_full(pool);
+    _queue_push(&pool->queue, &task);
   }
-
-  // Dequeue a task
-  ThreadTask task = pool->queue.tasks[pool->queue.front];
-  pool->queue.front = (pool->queue.front + 1) % THREAD_TASK_QUEUE_SIZE;
-  pool->queue.count--;
-
-  // Signal that the task queue is not full because we have just removed a task
-  pthread_cond_signal(&pool->queue.cond_non_full);
   pthread_mutex_unlock(&pool->queue.mutex);
-
-  return task;
+  _unpark_workers(pool, n_tasks);
 }
 
 /**
- * @implements thread_pool_reset_queue_completion
+ * @implements thread_pool_wait_group
  */
-void thread_pool_reset_queue_completion(ThreadPool *pool) {
-  pthread_mutex_lock(&pool->queue.mutex);
-  pool->queue.n_completed = 0;
-  pthread_mutex_unlock(&pool->queue.mutex);
-}
+void thread_pool_wait_group(ThreadPool *pool, ThreadTaskGroup *group) {
+  ThreadWorker *self = _current_worker(pool);
+  current_wait_depth++;
 
-/**
- * @implements thread_pool_mark_task_completion
- */
-void thread_pool_mark_task_completion(ThreadPool *pool) {
-  pthread_mutex_lock(&pool->queue.mutex);
-  pool->queue.n_completed++;
-  pthread_cond_signal(&pool->queue.cond_completed);
-  pthread_mutex_unlock(&pool->queue.mutex);
+  while (__atomic_load_n(&group->n_completed, __ATOMIC_ACQUIRE) <
+         group->n_tasks) {
+    // Execute a task of any group ourselves if there is one left, otherwise
+    // wait for the tasks being executed by other threads; the task may wait
+    // for a nested group, so we can only help if there is room for that
+    ThreadTask task;
+    if (current_wait_depth < THREAD_POOL_MAX_WAIT_DEPTH &&
+        _find_task(pool, self, &task, true)) {
+      _run_task(pool, &task);
+      continue;
+    }
+    pthread_mutex_lock(&pool->completion_mutex);
+    __atomic_fetch_add(&pool->n_waiting, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&group->n_completed, __ATOMIC_SEQ_CST) <
+        group->n_tasks) {
+      pthread_cond_wait(&pool->cond_completed, &pool->completion_mutex);
+    }
+    __atomic_fetch_sub(&pool->n_waiting, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&pool->completion_mutex);
+  }
+  current_wait_depth--;
 }
 
 /**
- * @implements thread_pool_wait_queue_completion
+ * @implements thread_pool_n_tasks
  */
-void thread_pool_wait_queue_completion(ThreadPool *pool, int n_tasks) {
-  pthread_mutex_lock(&pool->queue.mutex);
-  while (pool->queue.n_completed < n_tasks) {
-    pthread_cond_wait(&pool->queue.cond_completed, &pool->queue.mutex);
+int thread_pool_n_tasks(size_t n_units, size_t min_units_per_task) {
+  if (!__multi_threaded__ || __thread_pool__ == NULL) {
+    return 1;
   }
-  pthread_mutex_unlock(&pool->queue.mutex);
+  size_t n_tasks = __thread_pool__->n_workers + 1;
+  if (n_tasks > n_units / min_units_per_task) {
+    n_tasks = n_units / min_units_per_task;
+  }
+  return n_tasks == 0 ? 1 : (int)n_tasks;
 }
 
 // Initialize global variables
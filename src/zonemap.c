@@ -0,0 +1,123 @@
+/**
+ * @file zonemap.c
+ * @implements zonemap.h
+ */
+
+#include <limits.h>
+#include <stdlib.h>
+
+#include "zonemap.h"
+
+/**
+ * Helper function to compute the number of zones covering a number of rows.
+ */
+static inline size_t _n_zones(size_t n_rows) {
+  return n_rows / ZONE_MAP_BLOCK_SIZE + (n_rows % ZONE_MAP_BLOCK_SIZE != 0);
+}
+
+/**
+ * Helper function to empty the zones in the [start, end) range.
+ */
+static inline void _empty_zones(ZoneMap *zone_map, size_t start, size_t end) {
+  for (size_t i = start; i < end; i++) {
+    zone_map->mins[i] = INT_MAX;
+    zone_map->maxs[i] = INT_MIN;
+  }
+}
+
+/**
+ * @implements init_zone_map
+ */
+DbSchemaStatus init_zone_map(Table *table, Column *column,
+                             bool skip_computing) {
+  ZoneMap *zone_map = &column->zone_map;
+  zone_map->n_zones = _n_zones(table->capacity);
+  zone_map->mins = malloc(sizeof(int) * zone_map->n_zones);
+  zone_map->maxs = malloc(sizeof(int) * zone_map->n_zones);
+  if (zone_map->mins == NULL || zone_map->maxs == NULL) {
+    free_zone_map(column);
+    return DB_SCHEMA_STATUS_ALLOC_FAILED;
+  }
+  if (skip_computing) {
+    _empty_zones(zone_map, 0, zone_map->n_zones);
+  } else {
+    refresh_zone_map(table, column, 0);
+  }
+  return DB_SCHEMA_STATUS_OK;
+}
+
+/**
+ * @implements resize_zone_map
+ */
+DbSchemaStatus resize_zone_map(Column *column, size_t new_capacity) {
+  ZoneMap *zone_map = &column->zone_map;
+  size_t new_n_zones = _n_zones(new_capacity);
+  int *mins = realloc(zone_map->mins, sizeof(int) * new_n_zones);
+  if (mins == NULL) {
+    return DB_SCHEMA_STATUS_REALLOC_FAILED;
+  }
+  zone_map->mins = mins;
+  int *maxs = realloc(zone_map->maxs, sizeof(int) * new_n_zones);
+  if (maxs == NULL) {
+    return DB_SCHEMA_STATUS_REALLOC_FAILED;
+  }
+  zone_map->maxs = maxs;
+
+  _empty_zones(zone_map, zone_map->n_zones, new_n_zones);
+  zone_map->n_zones = new_n_zones;
+  return DB_SCHEMA_STATUS_OK;
+}
+
+/**
+ * @implements widen_zone_map
+ */
+void widen_zone_map(Column *column, size_t row, int value) {
+  ZoneMap *zone_map = &column->zone_map;
+  size_t zone = row / ZONE_MAP_BLOCK_SIZE;
+  if (value < zone_map->mins[zone]) {
+    zone_map->mins[zone] = value;
+  }
+  if (value > zone_map->maxs[zone]) {
+    zone_map->maxs[zone] = value;
+  }
+}
+
+/**
+ * @implements refresh_zone_map
+ */
+void refresh_zone_map(Table *table, Column *column, size_t from) {
+  ZoneMap *zone_map = &column->zone_map;
+  size_t first_zone = from / ZONE_MAP_BLOCK_SIZE;
+  size_t n_used_zones = _n_zones(table->n_rows);
+
+  for (size_t zone = first_zone; zone < n_used_zones; zone++) {
+    size_t start = zone * ZONE_MAP_BLOCK_SIZE;
+    size_t end = start + ZONE_MAP_BLOCK_SIZE < table->n_rows
+                     ? start + ZONE_MAP_BLOCK_SIZE
+                     : table->n_rows;
+    int min_value = INT_MAX;
+    int max_value = INT_MIN;
+    for (size_t i = start; i < end; i++) {
+      int value = column->data[i];
+      min_value = value < min_value ? value : min_value;
+      max_value = value > max_value ? value : max_value;
+    }
+    zone_map->mins[zone] = min_value;
+    zone_map->maxs[zone] = max_value;
+  }
+
+  _empty_zones(zone_map,
+               first_zone > n_used_zones ? first_zone : n_used_zones,
+               zone_map->n_zones);
+}
+
+/**
+ * @implements free_zone_map
+ */
+void free_zone_map(Column *column) {
+  free(column->zone_map.mins);
+  free(column->zone_map.maxs);
+  column->zone_map.mins = NULL;
+  column->zone_map.maxs = NULL;
+  column->zone_map.n_zones = 0;
+}